@@ -0,0 +1,157 @@
+#include "Ride.h"
+#include <cstring>
+
+static const char* RideStatusNames[RS_COUNT] = {
+    "requested", "assigned", "en-route", "completed", "cancelled"
+};
+
+const char* RideStatusName(int status){
+    if(status < 0 || status >= RS_COUNT){
+        return "unknown";
+    }
+    return RideStatusNames[status];
+}
+
+bool CanTransition(ridestatus from, ridestatus to){
+    switch(from){
+        case RS_REQUESTED:
+            return to == RS_ASSIGNED || to == RS_CANCELLED;
+        case RS_ASSIGNED:
+            return to == RS_ENROUTE || to == RS_REQUESTED || to == RS_CANCELLED;
+        case RS_ENROUTE:
+            return to == RS_COMPLETED || to == RS_CANCELLED;
+        default:
+            return false;
+    }
+}
+
+static void CopyLocation(char* dest, const string& s){
+    size_t n = s.size();
+    if(n > ride::LocationLength - 1){
+        n = ride::LocationLength - 1;
+    }
+    memcpy(dest, s.data(), n);
+    dest[n] = '\0';
+}
+
+ride::ride(){
+    r_id = 0;
+    passengerId = 0;
+    driverId = -1;
+    pickupLocation[0] = '\0';
+    pickupLat = 0.0;
+    pickupLon = 0.0;
+    dropoff[0] = '\0';
+    dropoffLat = 0.0;
+    dropoffLon = 0.0;
+    sizeofparty = 1;
+    hasPets = 0;
+    status = RS_REQUESTED;
+    requestTime = 0;
+}
+
+void ride::setID(int i){
+    r_id = i;
+}
+
+void ride::setPassenger(int i){
+    passengerId = i;
+}
+
+void ride::setDriver(int i){
+    driverId = i;
+}
+
+void ride::setPickUp(const string& s){
+    CopyLocation(pickupLocation, s);
+}
+
+void ride::setDropoff(const string& s){
+    CopyLocation(dropoff, s);
+}
+
+void ride::setPickUpCoords(double lat, double lon){
+    pickupLat = lat;
+    pickupLon = lon;
+}
+
+void ride::setDropoffCoords(double lat, double lon){
+    dropoffLat = lat;
+    dropoffLon = lon;
+}
+
+void ride::setPartySize(int i){
+    sizeofparty = i;
+}
+
+void ride::setPets(bool b){
+    hasPets = b;
+}
+
+void ride::setStatus(ridestatus s){
+    status = s;
+}
+
+void ride::setRequestTime(int64_t t){
+    requestTime = t;
+}
+
+int ride::getID() const{
+    return r_id;
+}
+
+int ride::getPassenger() const{
+    return passengerId;
+}
+
+int ride::getDriver() const{
+    return driverId;
+}
+
+const char* ride::getPickUp() const{
+    return pickupLocation;
+}
+
+const char* ride::getDropoff() const{
+    return dropoff;
+}
+
+double ride::getPickUpLat() const{
+    return pickupLat;
+}
+
+double ride::getPickUpLon() const{
+    return pickupLon;
+}
+
+double ride::getDropoffLat() const{
+    return dropoffLat;
+}
+
+double ride::getDropoffLon() const{
+    return dropoffLon;
+}
+
+int ride::getPartySize() const{
+    return sizeofparty;
+}
+
+bool ride::getPets() const{
+    return hasPets;
+}
+
+ridestatus ride::getStatus() const{
+    return status;
+}
+
+int64_t ride::getRequestTime() const{
+    return requestTime;
+}
+
+bool ride::Valid() const{
+    // read as a byte: any other value in a bool is undefined to use
+    uint8_t pets;
+    memcpy(&pets, &hasPets, 1);
+    return pets <= 1 && status < RS_COUNT
+           && memchr(pickupLocation, 0, LocationLength) != 0 && memchr(dropoff, 0, LocationLength) != 0;
+}
@@ -2,29 +2,77 @@
 #define RIDE_H
 #include <string>
 #include <iostream>
+#include <cstdint>
+using namespace std;
 
+enum ridestatus : uint8_t{
+    RS_REQUESTED = 0,
+    RS_ASSIGNED,
+    RS_ENROUTE,
+    RS_COMPLETED,
+    RS_CANCELLED,
+    RS_COUNT
+};
+
+const char* RideStatusName(int status);
+// lifecycle: requested -> assigned -> en-route -> completed, an assigned ride
+// can fall back to requested if the driver drops it, and anything that is not
+// finished can be cancelled
+bool CanTransition(ridestatus from, ridestatus to);
+
+// Fixed size and trivially copyable so rides can live in the rides slab pool
+// and be written to snapshots as raw records. Location labels are truncated
+// to LocationLength - 1 characters.
 class ride{
+    public:
+        static const int LocationLength = 32;
+
     private:
         int r_id;
-        string pickupLocation;
-        //confused with time
-        string dropoff;
+        int passengerId;
+        int driverId; // -1 until assigned
+        char pickupLocation[LocationLength];
+        double pickupLat;
+        double pickupLon;
+        char dropoff[LocationLength];
+        double dropoffLat;
+        double dropoffLon;
         int sizeofparty;
         bool hasPets;
-        //time again
-        string status;
+        ridestatus status;
+        // milliseconds since the epoch
+        int64_t requestTime;
+
     public:
-        void setID();
-        void setPickUp();
-        //not sure how time set would work
-        void setDropoff();
-        void setPets();
-        //time again
-        void setStatus();
-        int getID();
-        string getPickUp();
-        //time again
-        int getPartySize();
-        string getStatus();
+        ride();
+        void setID(int);
+        void setPassenger(int);
+        void setDriver(int);
+        void setPickUp(const string&);
+        void setDropoff(const string&);
+        void setPickUpCoords(double lat, double lon);
+        void setDropoffCoords(double lat, double lon);
+        void setPartySize(int);
+        void setPets(bool);
+        void setStatus(ridestatus);
+        void setRequestTime(int64_t);
+        int getID() const;
+        int getPassenger() const;
+        int getDriver() const;
+        const char* getPickUp() const;
+        const char* getDropoff() const;
+        double getPickUpLat() const;
+        double getPickUpLon() const;
+        double getDropoffLat() const;
+        double getDropoffLon() const;
+        int getPartySize() const;
+        bool getPets() const;
+        ridestatus getStatus() const;
+        int64_t getRequestTime() const;
+        // false if a raw record (e.g. from a snapshot) holds something the
+        // setters never write: a flag byte other than 0/1, an unknown
+        // status or an unterminated label
+        bool Valid() const;
 
-}
\ No newline at end of file
+};
+#endif
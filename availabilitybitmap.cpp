@@ -0,0 +1,108 @@
+#include "availabilitybitmap.h"
+
+availabilitybitmap::availabilitybitmap(){
+    WordCapacity = 0;
+    Bits = 0;
+}
+
+void availabilitybitmap::Reserve(size_t bits){
+    size_t words = (bits + 63) / 64;
+    if(words <= WordCapacity){
+        return;
+    }
+    size_t newCapacity = WordCapacity == 0 ? 16 : WordCapacity;
+    while(newCapacity < words){
+        newCapacity *= 2;
+    }
+    unique_ptr<atomic<uint64_t>[]> grown(new atomic<uint64_t>[newCapacity]);
+    for(size_t w = 0; w < newCapacity; w++){
+        grown[w].store(w < WordCapacity ? Words[w].load(memory_order_relaxed) : 0, memory_order_relaxed);
+    }
+    Words.swap(grown);
+    WordCapacity = newCapacity;
+}
+
+void availabilitybitmap::PushBack(bool b){
+    Reserve(Bits + 1);
+    Set(Bits, b);
+    Bits++;
+}
+
+void availabilitybitmap::PopBack(){
+    Bits--;
+    // keep bits past the end clear so ClaimAny never returns them
+    Set(Bits, false);
+}
+
+void availabilitybitmap::Clear(){
+    for(size_t w = 0; w < WordCapacity; w++){
+        Words[w].store(0, memory_order_relaxed);
+    }
+    Bits = 0;
+}
+
+size_t availabilitybitmap::Size() const{
+    return Bits;
+}
+
+bool availabilitybitmap::Test(size_t i) const{
+    return (Words[i / 64].load(memory_order_acquire) >> (i % 64)) & 1;
+}
+
+bool availabilitybitmap::Set(size_t i, bool b){
+    uint64_t bit = uint64_t(1) << (i % 64);
+    if(b){
+        return (Words[i / 64].fetch_or(bit, memory_order_acq_rel) & bit) != 0;
+    }
+    return (Words[i / 64].fetch_and(~bit, memory_order_acq_rel) & bit) != 0;
+}
+
+bool availabilitybitmap::TryClaim(size_t i){
+    uint64_t bit = uint64_t(1) << (i % 64);
+    atomic<uint64_t>& word = Words[i / 64];
+    uint64_t cur = word.load(memory_order_relaxed);
+    while(cur & bit){
+        // only fails if another bit in the word changed under us
+        if(word.compare_exchange_weak(cur, cur & ~bit, memory_order_acq_rel, memory_order_relaxed)){
+            return true;
+        }
+    }
+    return false;
+}
+
+bool availabilitybitmap::Release(size_t i){
+    return !Set(i, true);
+}
+
+size_t availabilitybitmap::ClaimAny(size_t hint){
+    size_t words = (Bits + 63) / 64;
+    if(words == 0){
+        return npos;
+    }
+    size_t start = (hint / 64) % words;
+    for(size_t k = 0; k < words; k++){
+        size_t w = (start + k) % words;
+        atomic<uint64_t>& word = Words[w];
+        uint64_t cur = word.load(memory_order_relaxed);
+        while(cur != 0){
+            uint64_t lowest = cur & (~cur + 1);
+            if(word.compare_exchange_weak(cur, cur & ~lowest, memory_order_acq_rel, memory_order_relaxed)){
+                return w * 64 + __builtin_ctzll(lowest);
+            }
+        }
+    }
+    return npos;
+}
+
+uint64_t availabilitybitmap::Word(size_t w) const{
+    return Words[w].load(memory_order_acquire);
+}
+
+size_t availabilitybitmap::Count() const{
+    size_t n = 0;
+    size_t words = (Bits + 63) / 64;
+    for(size_t w = 0; w < words; w++){
+        n += __builtin_popcountll(Words[w].load(memory_order_relaxed));
+    }
+    return n;
+}
@@ -0,0 +1,45 @@
+#ifndef AVAILABILITYBITMAP_H
+#define AVAILABILITYBITMAP_H
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+// One bit per slot, packed 64 to an atomic word. Set/Test/TryClaim/Release
+// and ClaimAny may be called from any number of threads at once; PushBack,
+// PopBack, Clear and Reserve change the size and need the owner's exclusive
+// access like any other structural change.
+class availabilitybitmap{
+    private:
+    unique_ptr<atomic<uint64_t>[]> Words;
+    size_t WordCapacity;
+    size_t Bits;
+
+    availabilitybitmap(const availabilitybitmap&);
+    availabilitybitmap& operator=(const availabilitybitmap&);
+
+    public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    availabilitybitmap();
+    void Reserve(size_t bits);
+    void PushBack(bool b);
+    void PopBack();
+    void Clear();
+    size_t Size() const;
+
+    bool Test(size_t i) const;
+    // returns the previous value of bit i
+    bool Set(size_t i, bool b);
+    // flips bit i from 1 to 0 with a single CAS; false if it was already 0
+    bool TryClaim(size_t i);
+    // false if bit i was already set
+    bool Release(size_t i);
+    // claims some set bit at or after hint (wrapping around); npos if none
+    size_t ClaimAny(size_t hint);
+    // raw word w (bits w*64 .. w*64+63), for scans
+    uint64_t Word(size_t w) const;
+    size_t Count() const;
+};
+#endif
@@ -0,0 +1,683 @@
+#include "batch.h"
+#include "fieldparse.h"
+#include "capability.h"
+#include "payment.h"
+#include "metrics.h"
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+
+static const string_view YesNo[2] = {"no", "yes"};
+
+// the driver as the fields of an add command, coordinates included
+static void WriteDriverFields(reportwriter& out, const driverview& d){
+    out.PutInt(d.id);
+    out.PutChar('|');
+    out.Put(d.name);
+    out.PutChar('|');
+    out.PutInt(d.capacity);
+    out.PutChar('|');
+    out.Put(YesNo[d.handicap]);
+    out.PutChar('|');
+    out.Put(d.type);
+    out.PutChar('|');
+    out.PutFloat(d.rating);
+    out.PutChar('|');
+    out.Put(YesNo[d.available]);
+    out.PutChar('|');
+    out.Put(YesNo[d.pets]);
+    out.PutChar('|');
+    out.Put(d.notes);
+    out.PutChar('|');
+    out.PutDouble(d.lat);
+    out.PutChar('|');
+    out.PutDouble(d.lon);
+    out.PutChar('\n');
+}
+
+// the passenger as the fields of an add command
+static void WritePassengerFields(reportwriter& out, const passengerview& p){
+    out.Put(p.name);
+    out.PutChar('|');
+    out.PutInt(p.id);
+    out.PutChar('|');
+    out.Put(p.p_method);
+    out.PutChar('|');
+    out.Put(YesNo[p.handicap]);
+    out.PutChar('|');
+    out.PutFloat(p.rating);
+    out.PutChar('|');
+    out.Put(YesNo[p.pets]);
+    out.PutChar('\n');
+}
+
+// one ride as a JSON line
+static void WriteRide(reportwriter& out, const ride& r){
+    out.Put("{\"id\":");
+    out.PutInt(r.getID());
+    out.Put(",\"passenger\":");
+    out.PutInt(r.getPassenger());
+    out.Put(",\"driver\":");
+    out.PutInt(r.getDriver());
+    out.Put(",\"status\":");
+    out.PutJson(RideStatusName(r.getStatus()));
+    out.Put(",\"requested\":");
+    out.PutInt(r.getRequestTime());
+    out.Put(",\"pickup\":");
+    out.PutJson(r.getPickUp());
+    out.Put(",\"pickup_lat\":");
+    out.PutDouble(r.getPickUpLat());
+    out.Put(",\"pickup_lon\":");
+    out.PutDouble(r.getPickUpLon());
+    out.Put(",\"dropoff\":");
+    out.PutJson(r.getDropoff());
+    out.Put(",\"dropoff_lat\":");
+    out.PutDouble(r.getDropoffLat());
+    out.Put(",\"dropoff_lon\":");
+    out.PutDouble(r.getDropoffLon());
+    out.Put(",\"party\":");
+    out.PutInt(r.getPartySize());
+    out.Put(",\"pets\":");
+    out.Put(r.getPets() ? "true" : "false");
+    out.Put("}\n");
+}
+
+batchexecutor::batchexecutor(drivers& d, passengers& p)
+    : Drivers(d), Passengers(p){
+    Rides = 0;
+    Dispatch = 0;
+    Feed = 0;
+    Archive = 0;
+    Commands = 0;
+    Failures = 0;
+}
+
+batchexecutor::batchexecutor(drivers& d, passengers& p, rides& r, dispatcher& dispatch)
+    : Drivers(d), Passengers(p){
+    Rides = &r;
+    Dispatch = &dispatch;
+    Feed = 0;
+    Archive = 0;
+    Commands = 0;
+    Failures = 0;
+}
+
+void batchexecutor::AttachFeed(locationfeed* feed){
+    Feed = feed;
+}
+
+void batchexecutor::AttachArchive(ridearchive* archive){
+    Archive = archive;
+}
+
+bool batchexecutor::Fail(reportwriter& out, string_view message, string_view detail){
+    Failures++;
+    out.Put("error ");
+    out.Put(message);
+    if(!detail.empty()){
+        out.PutChar(' ');
+        out.Put(detail);
+    }
+    out.PutChar('\n');
+    return false;
+}
+
+bool batchexecutor::AddDriver(string_view line, int editId, reportwriter& out){
+    string_view f[11];
+    size_t n = SplitFields(line, f, 11);
+    if(n != 9 && n != 11){
+        return Fail(out, "driver needs id|name|capacity|handicap|type|rating|available|pets|notes[|lat|lon]");
+    }
+    int id;
+    int capacity;
+    float rating;
+    double lat = 0;
+    double lon = 0;
+    int handicap = ParseBool(f[3]);
+    int available = ParseBool(f[6]);
+    int pets = ParseBool(f[7]);
+    if(!ParseInt(f[0], id)){
+        return Fail(out, "bad id", f[0]);
+    }
+    if(!ParseInt(f[2], capacity) || capacity < 0){
+        return Fail(out, "bad capacity", f[2]);
+    }
+    if(handicap < 0 || available < 0 || pets < 0){
+        return Fail(out, "handicap, available and pets must be yes or no");
+    }
+    if(ParseVehicleType(f[4]) == VT_ANY){
+        return Fail(out, "vehicle type must be one of compact, 2dr, sedan, 4dr, SUV, van, other; got", f[4]);
+    }
+    if(!ParseFloat(f[5], rating) || rating < 1.0f || rating > 5.0f){
+        return Fail(out, "rating must be between 1 and 5; got", f[5]);
+    }
+    if(n == 11 && !ParseCoordinates(f[9], f[10], lat, lon)){
+        return Fail(out, "bad coordinates");
+    }
+    if(n == 9 && editId >= 0){
+        // an edit without coordinates leaves the driver where it is
+        size_t slot = Drivers.Lookup(editId);
+        if(slot != drivers::npos){
+            driverview old = Drivers.View(slot);
+            lat = old.lat;
+            lon = old.lon;
+        }
+    }
+    driverview d;
+    d.id = id;
+    d.name = f[1];
+    d.capacity = capacity;
+    d.handicap = handicap;
+    d.type = f[4];
+    d.rating = rating;
+    d.available = available;
+    d.pets = pets;
+    d.notes = f[8];
+    d.lat = lat;
+    d.lon = lon;
+    if(editId < 0){
+        if(!Drivers.Add(d)){
+            return Fail(out, "duplicate driver id", f[0]);
+        }
+    }
+    else if(!Drivers.Edit(editId, d)){
+        return Fail(out, "no such driver, or the new id is taken");
+    }
+    out.Put("ok\n");
+    return true;
+}
+
+bool batchexecutor::AddPassenger(string_view line, int editId, reportwriter& out){
+    string_view f[6];
+    if(SplitFields(line, f, 6) != 6){
+        return Fail(out, "passenger needs name|id|payment|handicap|rating|pets");
+    }
+    int id;
+    float rating;
+    int handicap = ParseBool(f[3]);
+    int pets = ParseBool(f[5]);
+    if(!ParseInt(f[1], id)){
+        return Fail(out, "bad id", f[1]);
+    }
+    if(ParsePaymentMethod(f[2]) == PM_UNKNOWN){
+        return Fail(out, "payment method must be one of cash, card, debit; got", f[2]);
+    }
+    if(handicap < 0 || pets < 0){
+        return Fail(out, "handicap and pets must be yes or no");
+    }
+    if(!ParseFloat(f[4], rating) || rating < 1.0f || rating > 5.0f){
+        return Fail(out, "rating must be between 1 and 5; got", f[4]);
+    }
+    passengerview p;
+    p.name = f[0];
+    p.id = id;
+    p.p_method = f[2];
+    p.handicap = handicap;
+    p.rating = rating;
+    p.pets = pets;
+    if(editId < 0){
+        if(!Passengers.Add(p)){
+            return Fail(out, "duplicate passenger id", f[1]);
+        }
+    }
+    else if(!Passengers.Edit(editId, p)){
+        return Fail(out, "no such passenger, or the new id is taken");
+    }
+    out.Put("ok\n");
+    return true;
+}
+
+bool batchexecutor::Execute(string_view line, reportwriter& out){
+    METRIC_TIMER(M_COMMAND);
+    line = Trim(line);
+    if(line.empty() || line[0] == '#'){
+        return true;
+    }
+    Commands++;
+    string_view rest = line;
+    string_view cmd = NextWord(rest);
+    string_view what = NextWord(rest);
+    bool isDriver = what == "driver" || what == "drivers";
+    bool isPassenger = what == "passenger" || what == "passengers";
+    int id;
+
+    if(cmd == "add" || cmd == "edit"){
+        int editId = -1;
+        if(cmd == "edit"){
+            string_view word = NextWord(rest);
+            if(!ParseInt(word, editId)){
+                return Fail(out, "bad id", word);
+            }
+        }
+        if(isDriver){
+            return AddDriver(rest, editId, out);
+        }
+        if(isPassenger){
+            return AddPassenger(rest, editId, out);
+        }
+        return Fail(out, "expected driver or passenger, got", what);
+    }
+    if(cmd == "find" || cmd == "delete"){
+        string_view word = NextWord(rest);
+        if(!ParseInt(word, id)){
+            return Fail(out, "bad id", word);
+        }
+        if(isDriver){
+            size_t slot = Drivers.Lookup(id);
+            if(slot == drivers::npos){
+                return Fail(out, "no driver", word);
+            }
+            if(cmd == "delete"){
+                Drivers.Delete(id);
+                out.Put("ok\n");
+                return true;
+            }
+            out.Put("ok ");
+            if(Trim(rest) == "fields"){
+                WriteDriverFields(out, Drivers.View(slot));
+            }
+            else{
+                WriteDriver(out, Drivers.View(slot), RF_JSONL);
+            }
+            return true;
+        }
+        if(isPassenger){
+            size_t slot = Passengers.Lookup(id);
+            if(slot == passengers::npos){
+                return Fail(out, "no passenger", word);
+            }
+            if(cmd == "delete"){
+                Passengers.Delete(id);
+                out.Put("ok\n");
+                return true;
+            }
+            out.Put("ok ");
+            if(Trim(rest) == "fields"){
+                WritePassengerFields(out, Passengers.View(slot));
+            }
+            else{
+                WritePassenger(out, Passengers.View(slot), RF_JSONL);
+            }
+            return true;
+        }
+        return Fail(out, "expected driver or passenger, got", what);
+    }
+    if(cmd == "available"){
+        int b = ParseBool(Trim(rest));
+        if(!ParseInt(what, id) || b < 0){
+            return Fail(out, "usage: available <driver id> yes|no");
+        }
+        // the dispatcher claimed them for a ride; only completing or
+        // cancelling it hands them back
+        if(b && OnRide(id)){
+            return Fail(out, "driver is on a ride", what);
+        }
+        if(!Drivers.SetAvailable(id, b)){
+            return Fail(out, "no driver", what);
+        }
+        out.Put("ok\n");
+        return true;
+    }
+    if(cmd == "rating"){
+        float rating;
+        if(!ParseInt(what, id) || !ParseFloat(Trim(rest), rating)){
+            return Fail(out, "usage: rating <driver id> <rating>");
+        }
+        // the same range add and edit enforce; written so NaN fails too
+        if(!(rating >= 1.0f && rating <= 5.0f)){
+            return Fail(out, "rating must be between 1 and 5; got", Trim(rest));
+        }
+        if(!Drivers.SetRating(id, rating)){
+            return Fail(out, "no driver", what);
+        }
+        out.Put("ok\n");
+        return true;
+    }
+    if(cmd == "top"){
+        double lat;
+        double lon;
+        int k;
+        string_view lonText = NextWord(rest);
+        if(!ParseInt(NextWord(rest), k) || k < 0){
+            return Fail(out, "usage: top <lat> <lon> <k> [<vehicle type>]");
+        }
+        if(!ParseCoordinates(what, lonText, lat, lon)){
+            return Fail(out, "bad coordinates");
+        }
+        string_view typeName = NextWord(rest);
+        int type = VT_ANY;
+        if(!typeName.empty() && (type = ParseVehicleType(typeName)) == VT_ANY){
+            return Fail(out, "unknown vehicle type", typeName);
+        }
+        vector<size_t> best = Drivers.TopRated(lat, lon, k, type);
+        out.Put("ok");
+        for(size_t i = 0; i < best.size(); i++){
+            out.PutChar(' ');
+            out.PutInt(Drivers.IdAt(best[i]));
+        }
+        out.PutChar('\n');
+        return true;
+    }
+    if(cmd == "location"){
+        double lat;
+        double lon;
+        string_view latText = NextWord(rest);
+        string_view lonText = NextWord(rest);
+        if(!ParseInt(what, id) || lonText.empty()){
+            return Fail(out, "usage: location <driver id> <lat> <lon>");
+        }
+        if(!ParseCoordinates(latText, lonText, lat, lon)){
+            return Fail(out, "bad coordinates");
+        }
+        if(!Drivers.SetLocation(id, lat, lon)){
+            return Fail(out, "no driver", what);
+        }
+        out.Put("ok\n");
+        return true;
+    }
+    if(cmd == "ping" && Feed != 0){
+        double lat;
+        double lon;
+        string_view latText = NextWord(rest);
+        string_view lonText = NextWord(rest);
+        if(!ParseInt(what, id) || lonText.empty()){
+            return Fail(out, "usage: ping <driver id> <lat> <lon>");
+        }
+        if(!ParseCoordinates(latText, lonText, lat, lon)){
+            return Fail(out, "bad coordinates");
+        }
+        if(!Feed->Push(id, lat, lon)){
+            return Fail(out, "location feed full, ping dropped");
+        }
+        out.Put("ok\n");
+        return true;
+    }
+    if(cmd == "print"){
+        string_view name = NextWord(rest);
+        int format = name.empty() ? RF_TEXT : ParseReportFormat(name);
+        if(format == RF_UNKNOWN){
+            return Fail(out, "format must be text, csv or jsonl; got", name);
+        }
+        size_t n;
+        if(isDriver){
+            n = ExportDrivers(Drivers, out, static_cast<reportformat>(format));
+        }
+        else if(isPassenger){
+            n = ExportPassengers(Passengers, out, static_cast<reportformat>(format));
+        }
+        else{
+            return Fail(out, "expected drivers or passengers, got", what);
+        }
+        out.Put("ok ");
+        out.PutInt(n);
+        out.PutChar('\n');
+        return true;
+    }
+    if(cmd == "stats"){
+        if(isDriver){
+            fleetsnapshot s = Drivers.Stats();
+            out.Put("ok count=");
+            out.PutInt(s.count);
+            out.Put(" available=");
+            out.PutInt(s.available);
+            out.Put(" seats=");
+            out.PutInt(s.availableSeats);
+            out.Put(" rating=");
+            out.PutDouble(s.meanRating);
+            out.Put(" handicap=");
+            out.PutInt(s.handicap);
+            out.Put(" pets=");
+            out.PutInt(s.pets);
+            out.PutChar('\n');
+            return true;
+        }
+        if(isPassenger){
+            ridersnapshot s = Passengers.Stats();
+            out.Put("ok count=");
+            out.PutInt(s.count);
+            out.Put(" rating=");
+            out.PutDouble(s.meanRating);
+            out.Put(" handicap=");
+            out.PutInt(s.handicap);
+            out.Put(" pets=");
+            out.PutInt(s.pets);
+            out.PutChar('\n');
+            return true;
+        }
+        if(what == "archive" && Archive != 0){
+            archivestats s = Archive->Stats();
+            out.Put("ok rides=");
+            out.PutInt(s.rides);
+            out.Put(" segments=");
+            out.PutInt(s.segments);
+            out.Put(" locations=");
+            out.PutInt(s.locations);
+            out.Put(" bytes=");
+            out.PutInt(s.bytes);
+            out.Put(" raw_bytes=");
+            out.PutInt(s.rawBytes);
+            out.PutChar('\n');
+            return true;
+        }
+        return Fail(out, "expected drivers or passengers, got", what);
+    }
+    if(cmd == "history" && Archive != 0){
+        string_view word = NextWord(rest);
+        if((!isDriver && !isPassenger) || !ParseInt(word, id)){
+            return Fail(out, "usage: history driver|passenger <id>");
+        }
+        vector<ride> found;
+        if(isDriver){
+            Archive->DriverHistory(id, found);
+        }
+        else{
+            Archive->PassengerHistory(id, found);
+        }
+        for(size_t i = 0; i < found.size(); i++){
+            WriteRide(out, found[i]);
+        }
+        out.Put("ok ");
+        out.PutInt(found.size());
+        out.PutChar('\n');
+        return true;
+    }
+    if(cmd == "metrics"){
+        WriteMetrics(out);
+        out.Put("ok\n");
+        return true;
+    }
+    if(Rides != 0 && (cmd == "request" || cmd == "ride" || cmd == "pickup" || cmd == "complete" || cmd == "cancel"
+                      || cmd == "tick" || cmd == "candidates")){
+        // the second word is already split off; hand the whole tail back
+        return RideCommand(cmd, Trim(line.substr(cmd.size())), out);
+    }
+    return Fail(out, "unknown command", cmd);
+}
+
+bool batchexecutor::OnRide(int driverId) const{
+    if(Rides == 0){
+        return false;
+    }
+    vector<int> active;
+    Rides->ByStatus(RS_ASSIGNED, active);
+    vector<int> enroute;
+    Rides->ByStatus(RS_ENROUTE, enroute);
+    active.insert(active.end(), enroute.begin(), enroute.end());
+    for(size_t i = 0; i < active.size(); i++){
+        if(Rides->Find(active[i])->getDriver() == driverId){
+            return true;
+        }
+    }
+    return false;
+}
+
+bool batchexecutor::RideCommand(string_view cmd, string_view rest, reportwriter& out){
+    int id;
+    if(cmd == "tick"){
+        if(Feed != 0){
+            Feed->Apply();
+        }
+        batchreport b = Dispatch->Tick();
+        out.Put("ok pending=");
+        out.PutInt(b.pending);
+        out.Put(" batched=");
+        out.PutInt(b.batched);
+        out.Put(" matched=");
+        out.PutInt(b.matched);
+        out.Put(" latency_us=");
+        out.PutDouble(b.latencyUs);
+        out.PutChar('\n');
+        return true;
+    }
+    if(cmd == "candidates"){
+        string_view word = NextWord(rest);
+        double lat;
+        double lon;
+        int party;
+        int pets;
+        string_view latText = NextWord(rest);
+        string_view lonText = NextWord(rest);
+        if(!ParseInt(word, id) || !ParseInt(NextWord(rest), party) || party < 1 || (pets = ParseBool(NextWord(rest))) < 0){
+            return Fail(out, "usage: candidates <passenger id> <lat> <lon> <party size> <pets yes|no>");
+        }
+        if(!ParseCoordinates(latText, lonText, lat, lon)){
+            return Fail(out, "bad coordinates");
+        }
+        size_t ps = Passengers.Lookup(id);
+        if(ps == passengers::npos){
+            return Fail(out, "no passenger", word);
+        }
+        // the drivers this shard's next tick would consider for the ride
+        dispatchconfig c = Dispatch->GetConfig();
+        uint32_t required = RequiredMask(party, pets || Passengers.PetsAt(ps), Passengers.HandicapAt(ps));
+        vector<size_t> near = Drivers.Nearest(lat, lon, c.candidatesPerRide, c.maxPickupKm, required, party);
+        out.Put("ok ");
+        out.PutInt(near.size());
+        if(!near.empty()){
+            out.PutChar(' ');
+            out.PutDouble(spatialgrid::DistanceKm(lat, lon, Drivers.LatAt(near[0]), Drivers.LonAt(near[0])));
+        }
+        out.PutChar('\n');
+        return true;
+    }
+    if(cmd == "request"){
+        string_view word = NextWord(rest);
+        double coords[4];
+        int party;
+        if(!ParseInt(word, id)){
+            return Fail(out, "bad passenger id", word);
+        }
+        string_view coordText[4];
+        for(int i = 0; i < 4; i++){
+            coordText[i] = NextWord(rest);
+        }
+        int pets;
+        if(!ParseInt(NextWord(rest), party) || party < 1 || (pets = ParseBool(NextWord(rest))) < 0){
+            return Fail(out, "usage: request <passenger id> <lat> <lon> <lat> <lon> <party size> <pets yes|no>");
+        }
+        // pickup, then dropoff
+        for(int i = 0; i < 4; i += 2){
+            if(!ParseCoordinates(coordText[i], coordText[i + 1], coords[i], coords[i + 1])){
+                return Fail(out, "bad coordinates");
+            }
+        }
+        if(Passengers.Lookup(id) == passengers::npos){
+            return Fail(out, "no passenger", word);
+        }
+        ride r;
+        r.setPassenger(id);
+        r.setPickUpCoords(coords[0], coords[1]);
+        r.setDropoffCoords(coords[2], coords[3]);
+        r.setPartySize(party);
+        r.setPets(pets);
+        out.Put("ok ");
+        out.PutInt(Rides->Create(r));
+        out.PutChar('\n');
+        return true;
+    }
+    string_view word = NextWord(rest);
+    if(!ParseInt(word, id)){
+        return Fail(out, "bad ride id", word);
+    }
+    if(cmd == "ride"){
+        const ride* r = Rides->Find(id);
+        if(r == 0){
+            return Fail(out, "no ride", word);
+        }
+        out.Put("ok status=");
+        out.Put(RideStatusName(r->getStatus()));
+        out.Put(" passenger=");
+        out.PutInt(r->getPassenger());
+        out.Put(" driver=");
+        out.PutInt(r->getDriver());
+        out.PutChar('\n');
+        return true;
+    }
+    bool done;
+    if(cmd == "pickup"){
+        done = Dispatch->PickUp(id);
+    }
+    else if(cmd == "complete"){
+        done = Dispatch->CompleteRide(id);
+    }
+    else{
+        done = Dispatch->CancelRide(id);
+    }
+    if(!done){
+        return Fail(out, "ride cannot move to that status", word);
+    }
+    out.Put("ok\n");
+    return true;
+}
+
+void batchexecutor::Run(FILE* in, FILE* outFile, const function<void()>& afterChunk){
+    reportwriter out(outFile);
+    vector<char> buf(1 << 20);
+    size_t have = 0;
+    for(;;){
+        if(have == buf.size()){
+            // one line longer than the buffer
+            buf.resize(buf.size() * 2);
+        }
+        out.Flush();
+        if(afterChunk){
+            afterChunk();
+        }
+        // read(2) rather than fread: it returns whatever a pipe or terminal
+        // has, where fread would wait to fill the whole buffer
+        ssize_t got = read(fileno(in), buf.data() + have, buf.size() - have);
+        if(got < 0 && errno == EINTR){
+            continue;
+        }
+        if(got <= 0){
+            break;
+        }
+        have += got;
+        size_t start = 0;
+        for(;;){
+            const char* nl = static_cast<const char*>(memchr(buf.data() + start, '\n', have - start));
+            if(nl == 0){
+                break;
+            }
+            size_t end = nl - buf.data();
+            Execute(string_view(buf.data() + start, end - start), out);
+            start = end + 1;
+        }
+        // keep the partial last line for the next read
+        memmove(buf.data(), buf.data() + start, have - start);
+        have -= start;
+    }
+    if(have != 0){
+        Execute(string_view(buf.data(), have), out);
+    }
+    out.Flush();
+}
+
+size_t batchexecutor::CommandCount() const{
+    return Commands;
+}
+
+size_t batchexecutor::FailureCount() const{
+    return Failures;
+}
@@ -0,0 +1,104 @@
+#ifndef BATCH_H
+#define BATCH_H
+#include <string>
+#include <string_view>
+#include <functional>
+#include <cstdio>
+#include <cstddef>
+using namespace std;
+
+#include "drivers.h"
+#include "passengers.h"
+#include "rides.h"
+#include "dispatcher.h"
+#include "locationfeed.h"
+#include "ridearchive.h"
+#include "report.h"
+
+// Prompt-free command mode: one command per line, one response per command.
+// The last line of every response starts with "ok" or "error", so a client
+// can pipeline commands and match up the answers.
+//
+//   add driver id|name|capacity|handicap|type|rating|available|pets|notes[|lat|lon]
+//   add passenger name|id|payment|handicap|rating|pets
+//   edit driver <id> <fields as for add>
+//   edit passenger <id> <fields as for add>
+//   find driver|passenger <id>             -> ok <record as JSON>
+//   find driver <id> fields                -> ok <fields as for add, with
+//                                             lat|lon>
+//   find passenger <id> fields             -> ok <fields as for add>
+//   delete driver|passenger <id>
+//   available <driver id> yes|no          (yes is refused while an assigned
+//                                             or en-route ride names them)
+//   rating <driver id> <rating>
+//   top <lat> <lon> <k> [<vehicle type>]   -> ok <driver id> ... (the k best
+//                                             rated available drivers in
+//                                             the region, best first)
+//   location <driver id> <lat> <lon>
+//   ping <driver id> <lat> <lon>           queued on the attached location
+//                                          feed; applied on its next tick
+//   print drivers|passengers [text|csv|jsonl]  -> the records, then ok <count>
+//   stats drivers|passengers               -> ok key=value ...
+//   metrics                                -> Prometheus text, then ok
+//                                             (all zero unless built with
+//                                             REGISTRY_METRICS)
+//
+// With a rides list and dispatcher attached:
+//
+//   request <passenger id> <lat> <lon> <lat> <lon> <party size> <pets yes|no>
+//                                          -> ok <ride id>
+//   ride <ride id>                         -> ok status=... driver=...
+//   pickup|complete|cancel <ride id>        (complete also takes an
+//                                             assigned ride)
+//   tick                                   -> ok pending=... matched=...
+//   candidates <passenger id> <lat> <lon> <party size> <pets yes|no>
+//                                          -> ok <drivers in reach> [<km to
+//                                             the nearest>]
+//
+// With a ride archive attached:
+//
+//   history driver|passenger <id>          -> one JSON line per archived
+//                                             ride, oldest first, then
+//                                             ok <count>
+//   stats archive                          -> ok rides=... bytes=... ...
+//
+// Fields are separated by '|' and trimmed; booleans take yes/no, true/false
+// or 1/0. Blank lines and lines starting with '#' are skipped silently.
+class batchexecutor{
+    private:
+    drivers& Drivers;
+    passengers& Passengers;
+    rides* Rides;          // 0 when ride commands are off
+    dispatcher* Dispatch;
+    locationfeed* Feed;    // 0 when ping is off
+    ridearchive* Archive;  // 0 when history is off
+    size_t Commands;
+    size_t Failures;
+
+    bool AddDriver(string_view fields, int editId, reportwriter& out);
+    bool AddPassenger(string_view fields, int editId, reportwriter& out);
+    bool RideCommand(string_view cmd, string_view rest, reportwriter& out);
+    // an assigned or en-route ride names this driver
+    bool OnRide(int driverId) const;
+    bool Fail(reportwriter& out, string_view message, string_view detail = string_view());
+
+    public:
+    batchexecutor(drivers& d, passengers& p);
+    batchexecutor(drivers& d, passengers& p, rides& r, dispatcher& dispatch);
+    // ping goes through feed; tick applies it before dispatching
+    void AttachFeed(locationfeed* feed);
+    // history reads from archive; the dispatcher should archive into it
+    void AttachArchive(ridearchive* archive);
+    // runs one command and appends its response to out; false if it failed
+    bool Execute(string_view line, reportwriter& out);
+    // executes every line of in, writing responses to out. Each read takes
+    // whatever input is available and output is flushed before the next
+    // one, so a client that waits for each answer still gets it; afterChunk
+    // (if set) runs at the same points, e.g. to let the registry compact its
+    // log. in is read with read(2) on its descriptor, bypassing its stdio
+    // buffer.
+    void Run(FILE* in, FILE* out, const function<void()>& afterChunk = function<void()>());
+    size_t CommandCount() const;
+    size_t FailureCount() const;
+};
+#endif
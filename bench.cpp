@@ -0,0 +1,431 @@
+// Microbenchmarks for the registry and dispatch hot paths.
+//
+//   bench [sizes...] [--only name] [--save file] [--compare file]
+//
+// sizes are record counts (10k, 1M and so on; default 10k 100k 1M). Each
+// benchmark prints ns/op, heap allocations/op and, where the kernel allows
+// perf_event_open, last level cache misses/op. --save writes the results
+// as CSV; --compare reads such a file and adds the change in ns/op against
+// it, so a change can be checked against a baseline run.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+using namespace std;
+
+#include "drivers.h"
+#include "passengers.h"
+#include "rides.h"
+#include "dispatcher.h"
+#include "importer.h"
+#include "report.h"
+
+// every heap allocation in the process goes through these
+static atomic<uint64_t> Allocations(0);
+
+void* operator new(size_t n){
+    Allocations.fetch_add(1, memory_order_relaxed);
+    void* p = malloc(n == 0 ? 1 : n);
+    if(p == 0){
+        throw bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t n){
+    return operator new(n);
+}
+
+void* operator new(size_t n, align_val_t a){
+    Allocations.fetch_add(1, memory_order_relaxed);
+    size_t align = static_cast<size_t>(a);
+    void* p = aligned_alloc(align, (n + align - 1) / align * align);
+    if(p == 0){
+        throw bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t n, align_val_t a){
+    return operator new(n, a);
+}
+
+void operator delete(void* p) noexcept{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept{
+    free(p);
+}
+
+void operator delete(void* p, align_val_t) noexcept{
+    free(p);
+}
+
+void operator delete[](void* p, align_val_t) noexcept{
+    free(p);
+}
+
+void operator delete(void* p, size_t, align_val_t) noexcept{
+    free(p);
+}
+
+void operator delete[](void* p, size_t, align_val_t) noexcept{
+    free(p);
+}
+
+// Cache misses for this thread; reads -1 when perf events are unavailable
+// (containers and perf_event_paranoid often forbid them).
+class misscounter{
+    private:
+    int Fd;
+
+    public:
+    misscounter(){
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        Fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+    ~misscounter(){
+        if(Fd >= 0){
+            close(Fd);
+        }
+    }
+    bool Available() const{
+        return Fd >= 0;
+    }
+    void Start(){
+        if(Fd >= 0){
+            ioctl(Fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(Fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    int64_t Stop(){
+        if(Fd < 0){
+            return -1;
+        }
+        ioctl(Fd, PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t count = 0;
+        if(read(Fd, &count, sizeof(count)) != sizeof(count)){
+            return -1;
+        }
+        return static_cast<int64_t>(count);
+    }
+};
+
+struct benchresult{
+    string name;
+    size_t records;
+    size_t ops;
+    double nsPerOp;
+    double allocsPerOp;
+    double missesPerOp; // negative if not measured
+};
+
+static misscounter Misses;
+static vector<benchresult> Results;
+static map<string, double> Baseline;
+static string Only;
+
+// deterministic, so runs are comparable
+struct generator{
+    uint64_t state;
+    explicit generator(uint64_t seed){
+        state = seed * 0x9E3779B97F4A7C15ull + 1;
+    }
+    uint64_t Next(){
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+    int Below(int n){
+        return static_cast<int>(Next() % static_cast<uint64_t>(n));
+    }
+    double Uniform(double lo, double hi){
+        return lo + (hi - lo) * static_cast<double>(Next() >> 11) / 9007199254740992.0;
+    }
+};
+
+static const char* const Types[] = {"compact", "2dr", "sedan", "4dr", "SUV", "van", "other"};
+static const char* const Methods[] = {"cash", "card", "debit"};
+
+static void FillDrivers(drivers& list, size_t n, uint64_t seed){
+    generator g(seed);
+    char name[32];
+    list.Reserve(n);
+    for(size_t i = 0; i < n; i++){
+        snprintf(name, sizeof(name), "Driver %zu", i);
+        list.Emplace(static_cast<int>(i), name, 1 + g.Below(8), g.Below(10) == 0, Types[g.Below(7)],
+                     1.0f + g.Below(41) / 10.0f, g.Below(4) != 0, g.Below(3) == 0, "generated",
+                     g.Uniform(40.5, 40.9), g.Uniform(-74.2, -73.7));
+    }
+}
+
+static void FillPassengers(passengers& list, size_t n, uint64_t seed){
+    generator g(seed);
+    char name[32];
+    list.Reserve(n);
+    for(size_t i = 0; i < n; i++){
+        snprintf(name, sizeof(name), "Passenger %zu", i);
+        list.Emplace(name, static_cast<int>(i), Methods[g.Below(3)], g.Below(10) == 0,
+                     1.0f + g.Below(41) / 10.0f, g.Below(3) == 0);
+    }
+}
+
+// runs body once and records it as ops operations
+static void Measure(const string& name, size_t records, size_t ops, const function<void()>& body){
+    if(!Only.empty() && name.find(Only) == string::npos){
+        return;
+    }
+    uint64_t allocs = Allocations.load(memory_order_relaxed);
+    Misses.Start();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    body();
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+    int64_t misses = Misses.Stop();
+    allocs = Allocations.load(memory_order_relaxed) - allocs;
+
+    benchresult r;
+    r.name = name;
+    r.records = records;
+    r.ops = ops == 0 ? 1 : ops;
+    r.nsPerOp = chrono::duration<double, nano>(end - start).count() / r.ops;
+    r.allocsPerOp = static_cast<double>(allocs) / r.ops;
+    r.missesPerOp = misses < 0 ? -1.0 : static_cast<double>(misses) / r.ops;
+    Results.push_back(r);
+
+    char line[160];
+    snprintf(line, sizeof(line), "%-22s %10zu %12.1f %10.3f ", r.name.c_str(), r.records, r.nsPerOp, r.allocsPerOp);
+    cout << line;
+    if(r.missesPerOp < 0){
+        snprintf(line, sizeof(line), "%10s", "-");
+    }
+    else{
+        snprintf(line, sizeof(line), "%10.2f", r.missesPerOp);
+    }
+    cout << line;
+    map<string, double>::const_iterator base = Baseline.find(r.name + "/" + to_string(r.records));
+    if(base != Baseline.end() && base->second > 0){
+        snprintf(line, sizeof(line), " %+8.1f%%", 100.0 * (r.nsPerOp - base->second) / base->second);
+        cout << line;
+    }
+    cout << "\n";
+}
+
+// keeps the optimizer from dropping a result
+static volatile size_t Sink;
+
+static void RunSize(size_t n){
+    generator g(n);
+    size_t lookups = n < 1000000 ? 1000000 : n;
+    vector<int> keys(lookups);
+    for(size_t i = 0; i < lookups; i++){
+        keys[i] = g.Below(static_cast<int>(n));
+    }
+    string csvPath = "bench-drivers.csv";
+    string snapPath = "bench-drivers.snap";
+
+    {
+        drivers fresh("bench");
+        Measure("driver.add", n, n, [&]{ FillDrivers(fresh, n, 1); });
+    }
+    {
+        passengers fresh("bench");
+        Measure("passenger.add", n, n, [&]{ FillPassengers(fresh, n, 2); });
+    }
+
+    drivers fleet("bench");
+    FillDrivers(fleet, n, 1);
+    passengers riders("bench");
+    FillPassengers(riders, n, 2);
+
+    Measure("driver.lookup", n, lookups, [&]{
+        size_t found = 0;
+        for(size_t i = 0; i < lookups; i++){
+            found += fleet.Lookup(keys[i]) != drivers::npos;
+        }
+        Sink = found;
+    });
+    Measure("passenger.lookup", n, lookups, [&]{
+        size_t found = 0;
+        for(size_t i = 0; i < lookups; i++){
+            found += riders.Lookup(keys[i]) != passengers::npos;
+        }
+        Sink = found;
+    });
+
+    // a typical dispatch filter: available, roomy, well rated
+    driverquery q = AnyDriver();
+    q.minRating = 4.0f;
+    q.minCapacity = 4;
+    q.availableOnly = true;
+    q.pets = true;
+    size_t rounds = n >= 1000000 ? 10 : 100;
+    Measure("driver.query", n, rounds, [&]{
+        for(size_t i = 0; i < rounds; i++){
+            Sink = fleet.Query(q).size();
+        }
+    });
+    Measure("driver.scan", n, rounds, [&]{
+        vector<uint64_t> bits;
+        for(size_t i = 0; i < rounds; i++){
+            fleet.Scan(q, bits);
+            Sink = bits.size();
+        }
+    });
+    Measure("driver.nearest", n, 100000, [&]{
+        generator at(7);
+        for(size_t i = 0; i < 100000; i++){
+            Sink = fleet.Nearest(at.Uniform(40.5, 40.9), at.Uniform(-74.2, -73.7), 8, 5.0, 0).size();
+        }
+    });
+
+    {
+        rides trips("bench");
+        dispatcher dispatch(fleet, riders, trips);
+        size_t requests = n < 100000 ? n / 10 : 10000;
+        generator at(11);
+        for(size_t i = 0; i < requests; i++){
+            ride r;
+            r.setPassenger(static_cast<int>(i));
+            r.setPickUpCoords(at.Uniform(40.5, 40.9), at.Uniform(-74.2, -73.7));
+            r.setDropoffCoords(at.Uniform(40.5, 40.9), at.Uniform(-74.2, -73.7));
+            r.setPartySize(1 + at.Below(3));
+            trips.Create(r);
+        }
+        Measure("dispatch.tick", n, requests, [&]{
+            while(trips.CountByStatus(RS_REQUESTED) != 0 && dispatch.Tick().matched != 0){
+            }
+        });
+    }
+
+    Measure("driver.export.csv", n, n, [&]{
+        reportwriter out(csvPath);
+        Sink = ExportDrivers(fleet, out, RF_CSV);
+    });
+    Measure("driver.export.text", n, n, [&]{
+        reportwriter out(string("/dev/null"));
+        Sink = ExportDrivers(fleet, out, RF_TEXT);
+    });
+    {
+        drivers imported("bench");
+        Measure("driver.import.csv", n, n, [&]{ Sink = ImportDrivers(csvPath, imported).imported; });
+    }
+    fleet.SaveSnapshot(snapPath);
+    {
+        drivers loaded("bench");
+        Measure("driver.snapshot.load", n, n, [&]{ Sink = loaded.LoadSnapshot(snapPath); });
+    }
+    Measure("driver.snapshot.save", n, n, [&]{ Sink = fleet.SaveSnapshot(snapPath); });
+    remove(csvPath.c_str());
+    remove(snapPath.c_str());
+}
+
+// "10k", "2M", "500000"
+static size_t ParseCount(const char* s){
+    char* end;
+    double v = strtod(s, &end);
+    if(*end == 'k' || *end == 'K'){
+        v *= 1e3;
+    }
+    else if(*end == 'm' || *end == 'M'){
+        v *= 1e6;
+    }
+    return v < 1 ? 0 : static_cast<size_t>(v);
+}
+
+static void LoadBaseline(const string& path){
+    ifstream in(path);
+    string line;
+    getline(in, line);
+    while(getline(in, line)){
+        stringstream fields(line);
+        string name, records, ops, ns;
+        getline(fields, name, ',');
+        getline(fields, records, ',');
+        getline(fields, ops, ',');
+        getline(fields, ns, ',');
+        Baseline[name + "/" + records] = atof(ns.c_str());
+    }
+}
+
+static void SaveResults(const string& path){
+    ofstream out(path);
+    out << "name,records,ops,ns_per_op,allocs_per_op,misses_per_op\n";
+    for(size_t i = 0; i < Results.size(); i++){
+        const benchresult& r = Results[i];
+        out << r.name << ',' << r.records << ',' << r.ops << ',' << r.nsPerOp << ','
+            << r.allocsPerOp << ',' << r.missesPerOp << '\n';
+    }
+}
+
+int main(int argc, char** argv){
+    vector<size_t> sizes;
+    string save;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--only") == 0 && i + 1 < argc){
+            Only = argv[++i];
+        }
+        else if(strcmp(argv[i], "--save") == 0 && i + 1 < argc){
+            save = argv[++i];
+        }
+        else if(strcmp(argv[i], "--compare") == 0 && i + 1 < argc){
+            LoadBaseline(argv[++i]);
+        }
+        else if(ParseCount(argv[i]) != 0){
+            sizes.push_back(ParseCount(argv[i]));
+        }
+        else{
+            cerr << "usage: bench [sizes...] [--only name] [--save file] [--compare file]\n";
+            return 1;
+        }
+    }
+    if(sizes.empty()){
+        sizes.push_back(10000);
+        sizes.push_back(100000);
+        sizes.push_back(1000000);
+    }
+    if(!Misses.Available()){
+        cout << "cache miss counters unavailable (perf_event_open failed)\n";
+    }
+    char line[160];
+    snprintf(line, sizeof(line), "%-22s %10s %12s %10s %10s%s", "benchmark", "records", "ns/op", "allocs/op",
+             "misses/op", Baseline.empty() ? "" : "  vs base");
+    cout << line << "\n";
+    for(size_t i = 0; i < sizes.size(); i++){
+        RunSize(sizes[i]);
+    }
+    if(!save.empty()){
+        SaveResults(save);
+    }
+    return 0;
+}
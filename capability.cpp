@@ -0,0 +1,77 @@
+#include "capability.h"
+
+static const char* VehicleTypeNames[VT_COUNT] = {
+    "compact", "2dr", "sedan", "4dr", "SUV", "van", "other"
+};
+
+int ParseVehicleType(string_view s){
+    for(int i = 0; i < VT_COUNT; i++){
+        if(s == VehicleTypeNames[i]){
+            return i;
+        }
+    }
+    return VT_ANY;
+}
+
+const char* VehicleTypeName(int type){
+    if(type < 0 || type >= VT_COUNT){
+        return "other";
+    }
+    return VehicleTypeNames[type];
+}
+
+uint32_t CapacityMask(int seats){
+    if(seats <= 0){
+        return 0;
+    }
+    if(seats >= CapacityBits){
+        return (1u << CapacityBits) - 1;
+    }
+    return (1u << seats) - 1;
+}
+
+uint32_t DriverMask(const driver& d){
+    return DriverMask(d.getCapacity(), d.getHandicap(), d.getPets(), d.getAvailable(),
+                      ParseVehicleType(d.getType()));
+}
+
+uint32_t DriverMask(int capacity, bool handicap, bool pets, bool available, int type){
+    uint32_t m = CapacityMask(capacity);
+    if(handicap){
+        m |= CAP_HANDICAP;
+    }
+    if(pets){
+        m |= CAP_PETS;
+    }
+    if(available){
+        m |= CAP_AVAILABLE;
+    }
+    if(type < 0 || type >= VT_COUNT){
+        type = VT_OTHER;
+    }
+    m |= 1u << (CAP_TYPE_SHIFT + type);
+    return m;
+}
+
+uint32_t RequiredMask(int party, bool pets, bool handicap, int vehicleType){
+    uint32_t m = CAP_AVAILABLE;
+    // capacity >= party <=> thermometer bit (party - 1) is set; bigger
+    // parties narrow to the drivers with at least CapacityBits seats
+    if(party > 0){
+        m |= 1u << ((party < CapacityBits ? party : CapacityBits) - 1);
+    }
+    if(pets){
+        m |= CAP_PETS;
+    }
+    if(handicap){
+        m |= CAP_HANDICAP;
+    }
+    if(vehicleType >= 0 && vehicleType < VT_COUNT){
+        m |= 1u << (CAP_TYPE_SHIFT + vehicleType);
+    }
+    return m;
+}
+
+uint32_t RequiredMask(const passenger& p, int party, bool pets, int vehicleType){
+    return RequiredMask(party, pets || p.getPets(), p.getHandicap(), vehicleType);
+}
@@ -0,0 +1,57 @@
+#ifndef CAPABILITY_H
+#define CAPABILITY_H
+#include <string>
+#include <string_view>
+#include <cstdint>
+using namespace std;
+
+#include "driver.h"
+#include "passenger.h"
+
+// vehicle types main.cpp asks for
+enum vehicletype{
+    VT_COMPACT = 0,
+    VT_2DR,
+    VT_SEDAN,
+    VT_4DR,
+    VT_SUV,
+    VT_VAN,
+    VT_OTHER,
+    VT_COUNT,
+    VT_ANY = -1
+};
+
+// Driver capability mask layout:
+//   bits 0-15   capacity as a thermometer code (bit i set <=> capacity > i)
+//   bit  16     handicap capable
+//   bit  17     pets allowed
+//   bit  18     available
+//   bits 24-30  vehicle type, one-hot
+//   bit  31     never set on a driver; marks an unsatisfiable request
+// A request builds the same layout with the bits it needs, so a driver is
+// eligible exactly when (driverMask & required) == required. The exception
+// is a party over CapacityBits: its mask only asks for the top capacity
+// bit, and the seats have to be checked against the capacity column too
+// (drivers::Nearest's minCapacity).
+const int CapacityBits = 16;
+const uint32_t CAP_HANDICAP = 1u << 16;
+const uint32_t CAP_PETS = 1u << 17;
+const uint32_t CAP_AVAILABLE = 1u << 18;
+const int CAP_TYPE_SHIFT = 24;
+const uint32_t CAP_IMPOSSIBLE = 1u << 31;
+
+int ParseVehicleType(string_view s); // VT_ANY if unknown
+const char* VehicleTypeName(int type);
+
+uint32_t CapacityMask(int seats);
+uint32_t DriverMask(const driver& d);
+uint32_t DriverMask(int capacity, bool handicap, bool pets, bool available, int type);
+uint32_t RequiredMask(int party, bool pets, bool handicap, int vehicleType = VT_ANY);
+// what a ride for this passenger needs from a driver
+uint32_t RequiredMask(const passenger& p, int party, bool pets, int vehicleType = VT_ANY);
+
+inline bool MaskEligible(uint32_t driverMask, uint32_t required){
+    return (driverMask & required) == required;
+}
+
+#endif
@@ -0,0 +1,143 @@
+#include "concurrentdrivers.h"
+#include <mutex>
+
+concurrentdrivers::concurrentdrivers(){
+    Shards.reset(new shard[ShardCount]);
+}
+
+concurrentdrivers::shard& concurrentdrivers::ShardFor(int id) const{
+    // Fibonacci hashing so sequential ids spread over all shards
+    uint32_t h = static_cast<uint32_t>(id) * 2654435769u;
+    return Shards[h >> (32 - ShardBits)];
+}
+
+bool concurrentdrivers::Add(const driver& d){
+    shard& s = ShardFor(d.getID());
+    unique_lock<shared_mutex> lock(s.Lock);
+    if(s.IdIndex.count(d.getID()) != 0){
+        return false;
+    }
+    s.IdIndex[d.getID()] = s.Records.size();
+    s.Records.push_back(d);
+    s.Masks.emplace_back(DriverMask(d));
+    s.Ratings.emplace_back(d.getRating());
+    return true;
+}
+
+bool concurrentdrivers::Edit(int id, const driver& d){
+    // an edit that changes the id moves the driver to another shard
+    if(d.getID() != id){
+        driver old;
+        if(!Find(id, old) || !Add(d)){
+            return false;
+        }
+        return Delete(id);
+    }
+    shard& s = ShardFor(id);
+    unique_lock<shared_mutex> lock(s.Lock);
+    unordered_map<int, size_t>::iterator it = s.IdIndex.find(id);
+    if(it == s.IdIndex.end()){
+        return false;
+    }
+    s.Records[it->second] = d;
+    s.Masks[it->second].store(DriverMask(d), memory_order_relaxed);
+    s.Ratings[it->second].store(d.getRating(), memory_order_relaxed);
+    return true;
+}
+
+bool concurrentdrivers::Delete(int id){
+    shard& s = ShardFor(id);
+    unique_lock<shared_mutex> lock(s.Lock);
+    unordered_map<int, size_t>::iterator it = s.IdIndex.find(id);
+    if(it == s.IdIndex.end()){
+        return false;
+    }
+    size_t slot = it->second;
+    size_t last = s.Records.size() - 1;
+    if(slot != last){
+        s.Records[slot] = s.Records[last];
+        s.Masks[slot].store(s.Masks[last].load(memory_order_relaxed), memory_order_relaxed);
+        s.Ratings[slot].store(s.Ratings[last].load(memory_order_relaxed), memory_order_relaxed);
+        s.IdIndex[s.Records[slot].getID()] = slot;
+    }
+    s.Records.pop_back();
+    s.Masks.pop_back();
+    s.Ratings.pop_back();
+    s.IdIndex.erase(id);
+    return true;
+}
+
+bool concurrentdrivers::SetAvailable(int id, bool b){
+    shard& s = ShardFor(id);
+    shared_lock<shared_mutex> lock(s.Lock);
+    unordered_map<int, size_t>::const_iterator it = s.IdIndex.find(id);
+    if(it == s.IdIndex.end()){
+        return false;
+    }
+    if(b){
+        s.Masks[it->second].fetch_or(CAP_AVAILABLE, memory_order_release);
+    }
+    else{
+        s.Masks[it->second].fetch_and(~CAP_AVAILABLE, memory_order_release);
+    }
+    return true;
+}
+
+bool concurrentdrivers::SetRating(int id, float r){
+    shard& s = ShardFor(id);
+    shared_lock<shared_mutex> lock(s.Lock);
+    unordered_map<int, size_t>::const_iterator it = s.IdIndex.find(id);
+    if(it == s.IdIndex.end()){
+        return false;
+    }
+    s.Ratings[it->second].store(r, memory_order_release);
+    return true;
+}
+
+bool concurrentdrivers::Find(int id, driver& out) const{
+    shard& s = ShardFor(id);
+    shared_lock<shared_mutex> lock(s.Lock);
+    unordered_map<int, size_t>::const_iterator it = s.IdIndex.find(id);
+    if(it == s.IdIndex.end()){
+        return false;
+    }
+    out = s.Records[it->second];
+    out.setAvailable((s.Masks[it->second].load(memory_order_acquire) & CAP_AVAILABLE) != 0);
+    out.setRating(s.Ratings[it->second].load(memory_order_acquire));
+    return true;
+}
+
+size_t concurrentdrivers::Size() const{
+    size_t n = 0;
+    for(size_t i = 0; i < ShardCount; i++){
+        shared_lock<shared_mutex> lock(Shards[i].Lock);
+        n += Shards[i].Records.size();
+    }
+    return n;
+}
+
+vector<int> concurrentdrivers::Eligible(uint32_t required) const{
+    vector<int> out;
+    for(size_t i = 0; i < ShardCount; i++){
+        const shard& s = Shards[i];
+        shared_lock<shared_mutex> lock(s.Lock);
+        for(size_t k = 0; k < s.Masks.size(); k++){
+            if(MaskEligible(s.Masks[k].load(memory_order_relaxed), required)){
+                out.push_back(s.Records[k].getID());
+            }
+        }
+    }
+    return out;
+}
+
+size_t concurrentdrivers::CountEligible(uint32_t required) const{
+    size_t n = 0;
+    for(size_t i = 0; i < ShardCount; i++){
+        const shard& s = Shards[i];
+        shared_lock<shared_mutex> lock(s.Lock);
+        for(size_t k = 0; k < s.Masks.size(); k++){
+            n += MaskEligible(s.Masks[k].load(memory_order_relaxed), required);
+        }
+    }
+    return n;
+}
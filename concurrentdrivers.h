@@ -0,0 +1,55 @@
+#ifndef CONCURRENTDRIVERS_H
+#define CONCURRENTDRIVERS_H
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <shared_mutex>
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+#include "driver.h"
+#include "capability.h"
+
+// Thread-safe driver registry, sharded by a hash of d_id.
+//
+// Each shard has a reader/writer lock, but only Add, Edit and Delete take it
+// exclusively. Availability and rating live in per-slot atomics and are
+// written under the shared lock, so the high-volume setAvailable/rating
+// traffic never blocks match queries (which also only take shared locks).
+class concurrentdrivers{
+    private:
+    static const size_t ShardBits = 6;
+    static const size_t ShardCount = 1 << ShardBits;
+
+    // aligned so neighbouring shards' locks don't share a cache line
+    struct alignas(64) shard{
+        mutable shared_mutex Lock;
+        unordered_map<int, size_t> IdIndex;
+        // deques never move existing elements, which atomics need
+        deque<driver> Records;
+        deque<atomic<uint32_t> > Masks;
+        deque<atomic<float> > Ratings;
+    };
+
+    unique_ptr<shard[]> Shards;
+
+    shard& ShardFor(int id) const;
+
+    public:
+    concurrentdrivers();
+    bool Add(const driver& d);
+    bool Edit(int id, const driver& d);
+    bool Delete(int id);
+    bool SetAvailable(int id, bool b);
+    bool SetRating(int id, float r);
+    // copies the driver with this id into out
+    bool Find(int id, driver& out) const;
+    size_t Size() const;
+    // ids of every driver whose mask satisfies required
+    vector<int> Eligible(uint32_t required) const;
+    size_t CountEligible(uint32_t required) const;
+};
+#endif
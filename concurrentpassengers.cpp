@@ -0,0 +1,94 @@
+#include "concurrentpassengers.h"
+#include <mutex>
+
+concurrentpassengers::concurrentpassengers(){
+    Shards.reset(new shard[ShardCount]);
+}
+
+concurrentpassengers::shard& concurrentpassengers::ShardFor(int id) const{
+    uint32_t h = static_cast<uint32_t>(id) * 2654435769u;
+    return Shards[h >> (32 - ShardBits)];
+}
+
+bool concurrentpassengers::Add(const passenger& p){
+    shard& s = ShardFor(p.getID());
+    unique_lock<shared_mutex> lock(s.Lock);
+    if(s.IdIndex.count(p.getID()) != 0){
+        return false;
+    }
+    s.IdIndex[p.getID()] = s.Records.size();
+    s.Records.push_back(p);
+    s.Ratings.emplace_back(p.getRating());
+    return true;
+}
+
+bool concurrentpassengers::Edit(int id, const passenger& p){
+    if(p.getID() != id){
+        passenger old;
+        if(!Find(id, old) || !Add(p)){
+            return false;
+        }
+        return Delete(id);
+    }
+    shard& s = ShardFor(id);
+    unique_lock<shared_mutex> lock(s.Lock);
+    unordered_map<int, size_t>::iterator it = s.IdIndex.find(id);
+    if(it == s.IdIndex.end()){
+        return false;
+    }
+    s.Records[it->second] = p;
+    s.Ratings[it->second].store(p.getRating(), memory_order_relaxed);
+    return true;
+}
+
+bool concurrentpassengers::Delete(int id){
+    shard& s = ShardFor(id);
+    unique_lock<shared_mutex> lock(s.Lock);
+    unordered_map<int, size_t>::iterator it = s.IdIndex.find(id);
+    if(it == s.IdIndex.end()){
+        return false;
+    }
+    size_t slot = it->second;
+    size_t last = s.Records.size() - 1;
+    if(slot != last){
+        s.Records[slot] = s.Records[last];
+        s.Ratings[slot].store(s.Ratings[last].load(memory_order_relaxed), memory_order_relaxed);
+        s.IdIndex[s.Records[slot].getID()] = slot;
+    }
+    s.Records.pop_back();
+    s.Ratings.pop_back();
+    s.IdIndex.erase(id);
+    return true;
+}
+
+bool concurrentpassengers::SetRating(int id, float r){
+    shard& s = ShardFor(id);
+    shared_lock<shared_mutex> lock(s.Lock);
+    unordered_map<int, size_t>::const_iterator it = s.IdIndex.find(id);
+    if(it == s.IdIndex.end()){
+        return false;
+    }
+    s.Ratings[it->second].store(r, memory_order_release);
+    return true;
+}
+
+bool concurrentpassengers::Find(int id, passenger& out) const{
+    shard& s = ShardFor(id);
+    shared_lock<shared_mutex> lock(s.Lock);
+    unordered_map<int, size_t>::const_iterator it = s.IdIndex.find(id);
+    if(it == s.IdIndex.end()){
+        return false;
+    }
+    out = s.Records[it->second];
+    out.setRating(s.Ratings[it->second].load(memory_order_acquire));
+    return true;
+}
+
+size_t concurrentpassengers::Size() const{
+    size_t n = 0;
+    for(size_t i = 0; i < ShardCount; i++){
+        shared_lock<shared_mutex> lock(Shards[i].Lock);
+        n += Shards[i].Records.size();
+    }
+    return n;
+}
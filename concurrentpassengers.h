@@ -0,0 +1,43 @@
+#ifndef CONCURRENTPASSENGERS_H
+#define CONCURRENTPASSENGERS_H
+#include <deque>
+#include <unordered_map>
+#include <shared_mutex>
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+#include "passenger.h"
+
+// Thread-safe passenger registry, sharded by a hash of the id the same way
+// as concurrentdrivers. Rating updates are atomic stores under the shared
+// lock; only Add, Edit and Delete lock a shard exclusively.
+class concurrentpassengers{
+    private:
+    static const size_t ShardBits = 6;
+    static const size_t ShardCount = 1 << ShardBits;
+
+    struct alignas(64) shard{
+        mutable shared_mutex Lock;
+        unordered_map<int, size_t> IdIndex;
+        deque<passenger> Records;
+        deque<atomic<float> > Ratings;
+    };
+
+    unique_ptr<shard[]> Shards;
+
+    shard& ShardFor(int id) const;
+
+    public:
+    concurrentpassengers();
+    bool Add(const passenger& p);
+    bool Edit(int id, const passenger& p);
+    bool Delete(int id);
+    bool SetRating(int id, float r);
+    // copies the passenger with this id into out
+    bool Find(int id, passenger& out) const;
+    size_t Size() const;
+};
+#endif
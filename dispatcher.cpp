@@ -0,0 +1,256 @@
+#include "dispatcher.h"
+#include "capability.h"
+#include "metrics.h"
+#include <chrono>
+#include <limits>
+#include <unordered_map>
+
+// cost of leaving a ride unmatched; larger than any real pickup distance
+static const double NoMatchCost = 1e9;
+
+static dispatchconfig DefaultConfig(){
+    dispatchconfig c;
+    c.windowSize = 64;
+    c.candidatesPerRide = 8;
+    c.maxPickupKm = 10.0;
+    return c;
+}
+
+dispatcher::dispatcher(drivers& d, passengers& p, rides& r)
+    : Drivers(d), Passengers(p), Rides(r){
+    Archive = 0;
+    Config = DefaultConfig();
+    Last = batchreport();
+    TotalBatched = 0;
+    TotalMatched = 0;
+}
+
+dispatcher::dispatcher(drivers& d, passengers& p, rides& r, dispatchconfig c)
+    : Drivers(d), Passengers(p), Rides(r){
+    Archive = 0;
+    Config = c;
+    Last = batchreport();
+    TotalBatched = 0;
+    TotalMatched = 0;
+}
+
+void dispatcher::SetConfig(dispatchconfig c){
+    Config = c;
+}
+
+dispatchconfig dispatcher::GetConfig() const{
+    return Config;
+}
+
+void dispatcher::AttachArchive(ridearchive* archive){
+    Archive = archive;
+}
+
+batchreport dispatcher::Tick(){
+    METRIC_TIMER(M_DISPATCH_TICK);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    batchreport report = batchreport();
+
+    Rides.ByStatus(RS_REQUESTED, Pending);
+    report.pending = Pending.size();
+    if(Pending.size() > Config.windowSize){
+        Pending.resize(Config.windowSize);
+    }
+    report.batched = Pending.size();
+
+    // candidate drivers per ride; the union of them are the columns
+    size_t n = Pending.size();
+    vector<vector<size_t> > candidates(n);
+    vector<char> orphaned(n, 0);
+    unordered_map<size_t, size_t> columnOf;
+    Columns.clear();
+    for(size_t i = 0; i < n; i++){
+        const ride* r = Rides.Find(Pending[i]);
+        size_t ps = Passengers.Lookup(r->getPassenger());
+        if(ps == passengers::npos){
+            orphaned[i] = 1;
+            continue;
+        }
+        uint32_t required = RequiredMask(r->getPartySize(), r->getPets() || Passengers.PetsAt(ps),
+                                         Passengers.HandicapAt(ps));
+        candidates[i] = Drivers.Nearest(r->getPickUpLat(), r->getPickUpLon(),
+                                        Config.candidatesPerRide, Config.maxPickupKm, required,
+                                        r->getPartySize());
+        for(size_t c = 0; c < candidates[i].size(); c++){
+            if(columnOf.insert(make_pair(candidates[i][c], Columns.size())).second){
+                Columns.push_back(candidates[i][c]);
+            }
+        }
+    }
+
+    if(Columns.empty()){
+        for(size_t i = 0; i < n; i++){
+            Rides.Requeue(Pending[i]);
+        }
+    }
+    else{
+        // pad with "unmatched" columns so every ride has somewhere to go
+        size_t m = Columns.size() < n ? n : Columns.size();
+        Costs.assign(n * m, NoMatchCost);
+        for(size_t i = 0; i < n; i++){
+            const ride* r = Rides.Find(Pending[i]);
+            for(size_t c = 0; c < candidates[i].size(); c++){
+                size_t slot = candidates[i][c];
+                Costs[i * m + columnOf[slot]] = spatialgrid::DistanceKm(
+                    r->getPickUpLat(), r->getPickUpLon(), Drivers.LatAt(slot), Drivers.LonAt(slot));
+            }
+        }
+        vector<size_t> assigned = SolveAssignment(Costs, n, m);
+
+        // apply the whole batch once it is solved
+        for(size_t i = 0; i < n; i++){
+            size_t col = assigned[i];
+            if(col >= Columns.size() || Costs[i * m + col] >= NoMatchCost){
+                // let the rides behind it have a turn next tick
+                Rides.Requeue(Pending[i]);
+                continue;
+            }
+            int driverId = Drivers.IdAt(Columns[col]);
+            // another dispatcher may have taken the driver since the solve
+            if(!Drivers.Claim(driverId)){
+                Rides.Requeue(Pending[i]);
+                continue;
+            }
+            if(Rides.AssignDriver(Pending[i], driverId)){
+                report.matched++;
+            }
+            else{
+                Drivers.Release(driverId);
+            }
+        }
+    }
+
+    // the passenger is gone, nobody is waiting for these; cancelled like
+    // any other so they're archived and their slots go back to the pool
+    for(size_t i = 0; i < n; i++){
+        if(orphaned[i]){
+            CancelRide(Pending[i]);
+        }
+    }
+
+    report.matchRate = report.batched == 0 ? 0.0 : static_cast<double>(report.matched) / report.batched;
+    report.latencyUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    TotalBatched += report.batched;
+    TotalMatched += report.matched;
+    METRIC_ADD(M_DISPATCH_MATCHED, report.matched);
+    Last = report;
+    return report;
+}
+
+bool dispatcher::PickUp(int rideId){
+    return Rides.SetStatus(rideId, RS_ENROUTE);
+}
+
+bool dispatcher::CompleteRide(int rideId){
+    const ride* r = Rides.Find(rideId);
+    if(r == 0){
+        return false;
+    }
+    int driverId = r->getDriver();
+    // a driver may finish without reporting the pickup separately
+    if(r->getStatus() == RS_ASSIGNED && !Rides.SetStatus(rideId, RS_ENROUTE)){
+        return false;
+    }
+    if(!Rides.SetStatus(rideId, RS_COMPLETED)){
+        return false;
+    }
+    Drivers.Release(driverId);
+    if(Archive != 0){
+        Archive->Archive(*r);
+        Rides.Retire(rideId);
+    }
+    return true;
+}
+
+bool dispatcher::CancelRide(int rideId){
+    const ride* r = Rides.Find(rideId);
+    if(r == 0){
+        return false;
+    }
+    int driverId = r->getDriver();
+    if(!Rides.SetStatus(rideId, RS_CANCELLED)){
+        return false;
+    }
+    if(driverId >= 0){
+        Drivers.Release(driverId);
+    }
+    if(Archive != 0){
+        Archive->Archive(*r);
+        Rides.Retire(rideId);
+    }
+    return true;
+}
+
+const batchreport& dispatcher::LastReport() const{
+    return Last;
+}
+
+void dispatcher::PrintReport(ostream& out) const{
+    out << "Batch: " << Last.matched << " of " << Last.batched << " rides matched ("
+        << Last.matchRate * 100.0 << "%), " << Last.pending << " were pending, "
+        << Last.latencyUs << " us\n";
+    out << "Overall: " << TotalMatched << " of " << TotalBatched << " rides matched\n";
+}
+
+vector<size_t> SolveAssignment(const vector<double>& cost, size_t rows, size_t cols){
+    // classic O(rows^2 * cols) potentials formulation, 1-based internally
+    const double inf = numeric_limits<double>::infinity();
+    vector<double> u(rows + 1, 0.0), v(cols + 1, 0.0), minv(cols + 1);
+    vector<size_t> p(cols + 1, 0), way(cols + 1, 0);
+    vector<char> used(cols + 1);
+    for(size_t i = 1; i <= rows; i++){
+        p[0] = i;
+        size_t j0 = 0;
+        minv.assign(cols + 1, inf);
+        used.assign(cols + 1, 0);
+        do{
+            used[j0] = 1;
+            size_t i0 = p[j0];
+            size_t j1 = 0;
+            double delta = inf;
+            for(size_t j = 1; j <= cols; j++){
+                if(used[j]){
+                    continue;
+                }
+                double cur = cost[(i0 - 1) * cols + (j - 1)] - u[i0] - v[j];
+                if(cur < minv[j]){
+                    minv[j] = cur;
+                    way[j] = j0;
+                }
+                if(minv[j] < delta){
+                    delta = minv[j];
+                    j1 = j;
+                }
+            }
+            for(size_t j = 0; j <= cols; j++){
+                if(used[j]){
+                    u[p[j]] += delta;
+                    v[j] -= delta;
+                }
+                else{
+                    minv[j] -= delta;
+                }
+            }
+            j0 = j1;
+        }
+        while(p[j0] != 0);
+        do{
+            size_t j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        }
+        while(j0 != 0);
+    }
+    vector<size_t> result(rows, cols);
+    for(size_t j = 1; j <= cols; j++){
+        if(p[j] != 0){
+            result[p[j] - 1] = j - 1;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,77 @@
+#ifndef DISPATCHER_H
+#define DISPATCHER_H
+#include <vector>
+#include <iostream>
+#include <cstddef>
+using namespace std;
+
+#include "drivers.h"
+#include "passengers.h"
+#include "rides.h"
+#include "ridearchive.h"
+
+struct dispatchconfig{
+    // most requested rides solved together per tick
+    size_t windowSize;
+    // nearest eligible drivers considered per ride
+    size_t candidatesPerRide;
+    double maxPickupKm;
+};
+
+struct batchreport{
+    size_t pending;   // requested rides when the tick started
+    size_t batched;   // rides taken into this batch
+    size_t matched;
+    double latencyUs;
+    double matchRate; // matched / batched
+};
+
+// Takes the oldest requested rides (up to windowSize), gathers the nearest
+// eligible available drivers for each from the spatial grid and capability
+// masks, and solves the whole batch as one min-total-pickup-distance
+// assignment. Assignments are only applied after the solve, so a batch
+// never leaves a half-updated registry. Drivers are taken with
+// drivers::Claim, so two dispatchers sharing a registry can't double-book
+// one; a ride that loses that race simply waits for the next tick. Rides
+// that found no driver go to the back of the requested list so they cannot
+// starve newer requests.
+class dispatcher{
+    private:
+    drivers& Drivers;
+    passengers& Passengers;
+    rides& Rides;
+    ridearchive* Archive; // 0 when finished rides stay in Rides
+    dispatchconfig Config;
+    batchreport Last;
+    size_t TotalBatched;
+    size_t TotalMatched;
+    // scratch reused between ticks
+    vector<int> Pending;
+    vector<size_t> Columns;
+    vector<double> Costs;
+
+    public:
+    dispatcher(drivers&, passengers&, rides&);
+    dispatcher(drivers&, passengers&, rides&, dispatchconfig);
+    void SetConfig(dispatchconfig c);
+    dispatchconfig GetConfig() const;
+    batchreport Tick();
+    // finished rides are handed to archive and their slots retired, so
+    // their ids stop resolving in Rides
+    void AttachArchive(ridearchive* archive);
+    // the driver has the passenger on board (assigned -> en-route)
+    bool PickUp(int rideId);
+    // finish or cancel a ride and hand its driver back to the pool; an
+    // assigned ride can be completed without a PickUp first
+    bool CompleteRide(int rideId);
+    bool CancelRide(int rideId);
+    const batchreport& LastReport() const;
+    void PrintReport(ostream& out) const;
+};
+
+// Minimum-cost assignment of rows to distinct columns (Hungarian method).
+// cost is rows x cols, row-major, rows <= cols. Returns the column for each
+// row.
+vector<size_t> SolveAssignment(const vector<double>& cost, size_t rows, size_t cols);
+
+#endif
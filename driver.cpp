@@ -11,20 +11,36 @@ driver::driver(){
     v_available = 0;
     pets = 0;
     notes = "Blank";
+    lat = 0.0;
+    lon = 0.0;
 
 
 }
 
 driver::driver(int d_id, string d_name, int v_capacity, bool handicap, string v_type, float d_rating, bool v_available, bool pets, string notes){
 this -> d_id = d_id;
-this -> d_name = d_name;
+this -> d_name = move(d_name);
 this -> v_capacity = v_capacity;
 this -> handicap = handicap;
-this -> v_type = v_type;
+this -> v_type = move(v_type);
 this -> d_rating = d_rating;
 this -> v_available = v_available;
 this -> pets = pets;
-this -> notes = notes;
+this -> notes = move(notes);
+this -> lat = 0.0;
+this -> lon = 0.0;
+}
+
+driver::driver(const driverview& v)
+    : d_name(v.name), v_type(v.type), notes(v.notes){
+    d_id = v.id;
+    v_capacity = v.capacity;
+    handicap = v.handicap;
+    d_rating = v.rating;
+    v_available = v.available;
+    pets = v.pets;
+    lat = v.lat;
+    lon = v.lon;
 }
 
 void driver::setID(int i){
@@ -32,7 +48,7 @@ void driver::setID(int i){
 }
 
 void driver::setName(string n){
-    d_name = n;
+    d_name = move(n);
 }
 
 void driver::setCapacity(int i){
@@ -44,7 +60,7 @@ void driver::setHandicap(bool b){
 }
 
 void driver::setType(string t){
-    v_type = t;
+    v_type = move(t);
 }
 
 void driver::setRating(float r){
@@ -59,14 +75,19 @@ void driver::setPets(bool b){
     pets = b;
 }
 void driver::setNotes(string n){
-    notes = n;
+    notes = move(n);
+}
+
+void driver::setLocation(double la, double lo){
+    lat = la;
+    lon = lo;
 }
 
 int driver::getID() const{
     return d_id;
 }
 
-string driver::getName() const{
+const string& driver::getName() const{
     return d_name;
 }
 
@@ -78,7 +99,7 @@ bool driver::getHandicap() const{
     return handicap;
 }
 
-string driver::getType() const{
+const string& driver::getType() const{
     return v_type;
 }
 
@@ -94,6 +115,30 @@ bool driver::getPets() const{
     return pets;
 }
 
-string driver::getNotes() const{
+const string& driver::getNotes() const{
     return notes;
-}
\ No newline at end of file
+}
+
+double driver::getLat() const{
+    return lat;
+}
+
+double driver::getLon() const{
+    return lon;
+}
+
+driverview driver::View() const{
+    driverview v;
+    v.id = d_id;
+    v.name = d_name;
+    v.capacity = v_capacity;
+    v.handicap = handicap;
+    v.type = v_type;
+    v.rating = d_rating;
+    v.available = v_available;
+    v.pets = pets;
+    v.notes = notes;
+    v.lat = lat;
+    v.lon = lon;
+    return v;
+}
@@ -2,9 +2,26 @@
 #define DRIVER_H
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <iomanip>
 using namespace std;
 
+// Non-owning view of a driver's fields. drivers::View() hands these out for
+// stored records so listings can read them without building a driver.
+struct driverview{
+    int id;
+    string_view name;
+    int capacity;
+    bool handicap;
+    string_view type;
+    float rating;
+    bool available;
+    bool pets;
+    string_view notes;
+    double lat;
+    double lon;
+};
+
 class driver{
 private:
     int d_id;
@@ -16,10 +33,15 @@ private:
     bool v_available;
     bool pets;
     string notes;
+    double lat;
+    double lon;
 
 public:
     driver();
+    // strings are taken by value and moved in, so callers can pass temporaries
+    // or std::move() without a copy
     driver(int, string, int, bool, string, float, bool, bool, string);
+    explicit driver(const driverview&);
     void setID(int);
     void setName(string);
     void setCapacity(int);
@@ -29,16 +51,20 @@ public:
     void setAvailable(bool);
     void setPets(bool);
     void setNotes(string);
+    void setLocation(double, double);
 
     int getID() const;
-    string getName() const;
+    const string& getName() const;
     int getCapacity() const;
     bool getHandicap() const;
-    string getType() const;
+    const string& getType() const;
     float getRating() const;
     bool getAvailable() const;
     bool getPets() const; 
-    string getNotes() const;
+    const string& getNotes() const;
+    double getLat() const;
+    double getLon() const;
+    driverview View() const;
 
 
     
@@ -95,6 +95,7 @@ int main() {
     getline(cin, name);
 
     drivers List(name);
+    List.LoadSnapshot("drivers.snap");
     c = ' ';
 
     PrintMenu();
@@ -106,6 +107,7 @@ int main() {
             PrintMenu();
         }
     }
+    List.SaveSnapshot("drivers.snap");
     return 0;
 
 }
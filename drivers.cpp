@@ -1,26 +1,1142 @@
 #include "drivers.h"
+#include "snapshot.h"
+#include "report.h"
+#include "scankernels.h"
+#include "metrics.h"
+#include "geohash.h"
 #include <iterator>
-drivers::drivers(){
+static void EncodeDriver(logencoder& e, const driverview& d){
+    e.PutInt(d.id);
+    e.PutString(d.name);
+    e.PutInt(d.capacity);
+    e.PutU8(d.handicap);
+    e.PutString(d.type);
+    e.PutFloat(d.rating);
+    e.PutU8(d.available);
+    e.PutU8(d.pets);
+    e.PutString(d.notes);
+    e.PutDouble(d.lat);
+    e.PutDouble(d.lon);
+}
+
+static driver DecodeDriver(logdecoder& in){
+    int id = in.GetInt();
+    string name = in.GetString();
+    int capacity = in.GetInt();
+    bool handicap = in.GetU8();
+    string type = in.GetString();
+    float rating = in.GetFloat();
+    bool available = in.GetU8();
+    bool pets = in.GetU8();
+    string notes = in.GetString();
+    driver d(id, name, capacity, handicap, type, rating, available, pets, notes);
+    double lat = in.GetDouble();
+    double lon = in.GetDouble();
+    d.setLocation(lat, lon);
+    return d;
+}
 
+// interns the known vehicle types in enum order so their ids match
+static void SeedTypeNames(internpool& pool){
+    for(int i = 0; i < VT_COUNT; i++){
+        pool.Intern(VehicleTypeName(i));
+    }
+}
+
+drivers::drivers(){
+    Log = 0;
+    Versioning = false;
+    SeedTypeNames(TypeNames);
 }
 
 drivers::drivers(string name){
     ListName = name;
+    Log = 0;
+    Versioning = false;
+    SeedTypeNames(TypeNames);
 } 
 
-void drivers::Add(driver driver1){
-    TotalDrivers.push_back(driver1);
+bool drivers::Add(const driver& driver1){
+    return Add(driver1.View());
 }
 
-void drivers::PrintSize(){
-    if(TotalDrivers.size() != 0){
-    cout <<"The is currently " <<TotalDrivers.size() << " Drivers";
+bool drivers::Emplace(int id, string_view name, int capacity, bool handicap, string_view type, float rating,
+                      bool available, bool pets, string_view notes, double lat, double lon){
+    driverview d;
+    d.id = id;
+    d.name = name;
+    d.capacity = capacity;
+    d.handicap = handicap;
+    d.type = type;
+    d.rating = rating;
+    d.available = available;
+    d.pets = pets;
+    d.notes = notes;
+    d.lat = lat;
+    d.lon = lon;
+    return Add(d);
+}
+
+bool drivers::Add(const driverview& driver1){
+    METRIC_TIMER(M_DRIVER_ADD);
+    if(IdIndex.count(driver1.id) != 0){
+        return false;
     }
-    else
-    cout << "vector is empty man!\n";
+    IdIndex[driver1.id] = Ids.size();
+    PushSlot(driver1);
+    Handles.Push();
+    IndexSlot(Ids.size() - 1);
+    CountSlot(Ids.size() - 1, 1);
+    if(Log != 0){
+        logencoder e;
+        EncodeDriver(e, driver1);
+        Log->Append(LR_DRIVER_ADD, e);
+    }
+    return true;
+}
+
+bool drivers::Edit(int id, const driver& driver1){
+    return Edit(id, driver1.View());
+}
+
+bool drivers::Edit(recordhandle h, const driver& driver1){
+    return Edit(h, driver1.View());
+}
+
+bool drivers::Edit(int id, const driverview& driver1){
+    return EditSlot(Lookup(id), driver1);
+}
+
+bool drivers::Edit(recordhandle h, const driverview& driver1){
+    return EditSlot(Handles.Resolve(h), driver1);
+}
+
+bool drivers::EditSlot(size_t slot, const driverview& driver1){
+    METRIC_TIMER(M_DRIVER_EDIT);
+    if(slot == npos){
+        return false;
+    }
+    int id = Ids[slot];
+    // changing the id has to keep the index unique
+    if(driver1.id != id){
+        if(IdIndex.count(driver1.id) != 0){
+            return false;
+        }
+        IdIndex.erase(id);
+        IdIndex[driver1.id] = slot;
+    }
+    // rewritten in place; only the indexes whose key changed are touched
+    uint16_t oldType = Types[slot];
+    size_t oldCapacity = CapacityKey(Capacities[slot]);
+    float oldRating = Ratings[slot];
+    double oldLat = Lats[slot];
+    double oldLon = Lons[slot];
+    {
+        lock_guard<mutex> guard(TopLock);
+        TopIndex.Remove(slot, Ratings.data());
+    }
+    ForgetStrings(slot);
+    CountSlot(slot, -1);
+    WriteSlot(slot, driver1);
+    if(Types[slot] != oldType){
+        TypeIndex.Remove(oldType, slot);
+        TypeIndex.Insert(Types[slot], slot);
+    }
+    if(CapacityKey(Capacities[slot]) != oldCapacity){
+        CapacityIndex.Remove(oldCapacity, slot);
+        CapacityIndex.Insert(CapacityKey(Capacities[slot]), slot);
+    }
+    if(ratingindex::Key(Ratings[slot]) != ratingindex::Key(oldRating)){
+        RatingIndex.Remove(oldRating, slot);
+        RatingIndex.Insert(Ratings[slot], slot);
+    }
+    if(Lats[slot] != oldLat || Lons[slot] != oldLon){
+        Grid.Move(slot, oldLat, oldLon, Lats[slot], Lons[slot]);
+    }
+    CapMasks[slot] = DriverMask(Capacities[slot], Handicap[slot], Pets[slot], false, Types[slot]);
+    if(Available.Test(slot)){
+        lock_guard<mutex> guard(TopLock);
+        TopIndex.Insert(TopKey(slot), slot, Ratings.data());
+    }
+    MarkDirty(slot);
+    CountSlot(slot, 1);
+    CompactStrings();
+    if(Log != 0){
+        logencoder e;
+        e.PutInt(id);
+        EncodeDriver(e, driver1);
+        Log->Append(LR_DRIVER_EDIT, e);
+    }
+    return true;
+}
+
+bool drivers::Delete(int id){
+    return DeleteSlot(Lookup(id));
+}
+
+bool drivers::Delete(recordhandle h){
+    return DeleteSlot(Handles.Resolve(h));
+}
+
+bool drivers::DeleteSlot(size_t slot){
+    METRIC_TIMER(M_DRIVER_DELETE);
+    if(slot == npos){
+        return false;
+    }
+    int id = Ids[slot];
+    // swap with the last entry so the erase doesn't shift the columns; the
+    // moved record keeps its index entries, renumbered in place
+    size_t last = Ids.size() - 1;
+    UnindexSlot(slot);
+    ForgetStrings(slot);
+    CountSlot(slot, -1);
+    if(slot != last){
+        MoveSlot(last, slot);
+        RenumberSlot(last, slot);
+        IdIndex[Ids[slot]] = slot;
+        MarkDirty(slot);
+    }
+    PopSlot();
+    Handles.Erase(slot);
+    IdIndex.erase(id);
+    CompactStrings();
+    if(Log != 0){
+        logencoder e;
+        e.PutInt(id);
+        Log->Append(LR_DRIVER_DELETE, e);
+    }
+    return true;
+}
+
+bool drivers::SetAvailable(int id, bool b){
+    size_t slot = Lookup(id);
+    if(slot == npos){
+        return false;
+    }
+    if(Available.Set(slot, b) != b){
+        MarkDirty(slot);
+        {
+            lock_guard<mutex> guard(TopLock);
+            if(b){
+                TopIndex.Insert(TopKey(slot), slot, Ratings.data());
+            }
+            else{
+                TopIndex.Remove(slot, Ratings.data());
+            }
+        }
+        if(b){
+            FleetStats.MadeAvailable(Capacities[slot], Handicap[slot], Pets[slot]);
+        }
+        else{
+            FleetStats.MadeUnavailable(Capacities[slot], Handicap[slot], Pets[slot]);
+        }
+    }
+    LogAvailable(id, b);
+    return true;
+}
+
+bool drivers::SetRating(int id, float rating){
+    size_t slot = Lookup(id);
+    if(slot == npos){
+        return false;
+    }
+    CountSlot(slot, -1);
+    RatingIndex.Remove(Ratings[slot], slot);
+    {
+        lock_guard<mutex> guard(TopLock);
+        Ratings[slot] = rating;
+        TopIndex.Update(slot, Ratings.data());
+    }
+    RatingIndex.Insert(rating, slot);
+    CountSlot(slot, 1);
+    MarkDirty(slot);
+    if(Log != 0){
+        logencoder e;
+        e.PutInt(id);
+        e.PutFloat(rating);
+        Log->Append(LR_DRIVER_RATING, e);
+    }
+    return true;
+}
+
+bool drivers::SetLocation(int id, double lat, double lon){
+    size_t slot = Lookup(id);
+    if(slot == npos){
+        return false;
+    }
+    // only the grid depends on the position
+    Grid.Move(slot, Lats[slot], Lons[slot], lat, lon);
+    Lats[slot] = lat;
+    Lons[slot] = lon;
+    {
+        lock_guard<mutex> guard(TopLock);
+        TopIndex.Regroup(slot, TopKey(slot), Ratings.data());
+    }
+    MarkDirty(slot);
+    if(Log != 0){
+        logencoder e;
+        e.PutInt(id);
+        e.PutDouble(lat);
+        e.PutDouble(lon);
+        Log->Append(LR_DRIVER_LOCATION, e);
+    }
+    return true;
+}
+
+size_t drivers::SetLocations(const locationupdate* updates, size_t n){
+    size_t applied = 0;
+    logencoder e;
+    lock_guard<mutex> guard(TopLock);
+    for(size_t i = 0; i < n; i++){
+        const locationupdate& u = updates[i];
+        size_t slot = Lookup(u.id);
+        if(slot == npos){
+            continue;
+        }
+        Grid.Move(slot, Lats[slot], Lons[slot], u.lat, u.lon);
+        Lats[slot] = u.lat;
+        Lons[slot] = u.lon;
+        TopIndex.Regroup(slot, TopKey(slot), Ratings.data());
+        MarkDirty(slot);
+        applied++;
+        if(Log != 0){
+            e.PutInt(u.id);
+            e.PutDouble(u.lat);
+            e.PutDouble(u.lon);
+        }
+    }
+    if(Log != 0 && applied != 0){
+        Log->Append(LR_DRIVER_LOCATIONS, e);
+    }
+    return applied;
 }
 
+void drivers::PushSlot(const driverview& d){
+    Ids.push_back(0);
+    Capacities.push_back(0);
+    Ratings.push_back(0);
+    Available.PushBack(false);
+    Handicap.push_back(0);
+    Pets.push_back(0);
+    Types.push_back(0);
+    Lats.push_back(0);
+    Lons.push_back(0);
+    CapMasks.push_back(0);
+    Cold.push_back(coldfields());
+    WriteSlot(Ids.size() - 1, d);
+}
 
+void drivers::WriteSlot(size_t slot, const driverview& d){
+    Ids[slot] = d.id;
+    Capacities[slot] = d.capacity;
+    Ratings[slot] = d.rating;
+    Available.Set(slot, d.available);
+    Handicap[slot] = d.handicap;
+    Pets[slot] = d.pets;
+    Types[slot] = TypeNames.Intern(d.type);
+    Lats[slot] = d.lat;
+    Lons[slot] = d.lon;
+    Cold[slot].name = Strings.Store(d.name);
+    Cold[slot].notes = Strings.Store(d.notes);
+}
 
+// sign is 1 when the slot starts counting, -1 when it stops
+void drivers::CountSlot(size_t slot, int sign){
+    if(sign > 0){
+        FleetStats.Add(Capacities[slot], Ratings[slot], Handicap[slot], Pets[slot], Available.Test(slot));
+    }
+    else{
+        FleetStats.Remove(Capacities[slot], Ratings[slot], Handicap[slot], Pets[slot], Available.Test(slot));
+    }
+}
 
+void drivers::ForgetStrings(size_t slot){
+    Strings.Forget(Cold[slot].name);
+    Strings.Forget(Cold[slot].notes);
+}
+
+// the arena never frees single strings; once most of it is dead, copy the
+// live ones into a fresh arena and drop the old blocks
+void drivers::CompactStrings(){
+    if(Strings.DeadBytes() < 64 * 1024 || Strings.DeadBytes() < Strings.LiveBytes()){
+        return;
+    }
+    stringarena fresh;
+    for(size_t i = 0; i < Cold.size(); i++){
+        Cold[i].name = fresh.Store(Cold[i].name);
+        Cold[i].notes = fresh.Store(Cold[i].notes);
+    }
+    Strings.Swap(fresh);
+}
+
+void drivers::MoveSlot(size_t from, size_t to){
+    Ids[to] = Ids[from];
+    Capacities[to] = Capacities[from];
+    Ratings[to] = Ratings[from];
+    Available.Set(to, Available.Test(from));
+    Handicap[to] = Handicap[from];
+    Pets[to] = Pets[from];
+    Types[to] = Types[from];
+    Lats[to] = Lats[from];
+    Lons[to] = Lons[from];
+    CapMasks[to] = CapMasks[from];
+    Cold[to] = Cold[from];
+}
+
+void drivers::PopSlot(){
+    Ids.pop_back();
+    Capacities.pop_back();
+    Ratings.pop_back();
+    Available.PopBack();
+    Handicap.pop_back();
+    Pets.pop_back();
+    Types.pop_back();
+    Lats.pop_back();
+    Lons.pop_back();
+    CapMasks.pop_back();
+    Cold.pop_back();
+}
+
+void drivers::IndexSlot(size_t slot){
+    MarkDirty(slot);
+    // DriverMask maps interned types outside the enum to VT_OTHER
+    CapMasks[slot] = DriverMask(Capacities[slot], Handicap[slot], Pets[slot], false, Types[slot]);
+    Grid.Insert(slot, Lats[slot], Lons[slot]);
+    TypeIndex.Insert(Types[slot], slot);
+    CapacityIndex.Insert(CapacityKey(Capacities[slot]), slot);
+    RatingIndex.Insert(Ratings[slot], slot);
+    if(Available.Test(slot)){
+        lock_guard<mutex> guard(TopLock);
+        TopIndex.Insert(TopKey(slot), slot, Ratings.data());
+    }
+}
+
+void drivers::UnindexSlot(size_t slot){
+    Grid.Remove(slot, Lats[slot], Lons[slot]);
+    TypeIndex.Remove(Types[slot], slot);
+    CapacityIndex.Remove(CapacityKey(Capacities[slot]), slot);
+    RatingIndex.Remove(Ratings[slot], slot);
+    lock_guard<mutex> guard(TopLock);
+    TopIndex.Remove(slot, Ratings.data());
+}
+
+// slot from now holds what was in from, whose columns were copied over
+void drivers::RenumberSlot(size_t from, size_t to){
+    Grid.Renumber(from, to, Lats[to], Lons[to]);
+    TypeIndex.Renumber(Types[to], from, to);
+    CapacityIndex.Renumber(CapacityKey(Capacities[to]), from, to);
+    RatingIndex.Renumber(Ratings[to], from, to);
+    lock_guard<mutex> guard(TopLock);
+    TopIndex.Renumber(from, to);
+}
+
+uint64_t drivers::TopKey(size_t slot) const{
+    return topratedindex::Key(GeohashBits(Lats[slot], Lons[slot], RegionBits), Types[slot]);
+}
+
+// capacities past CapacityBits share the last bucket
+size_t drivers::CapacityKey(int capacity){
+    if(capacity <= 0){
+        return 0;
+    }
+    return capacity > CapacityBits ? CapacityBits : capacity;
+}
 
+recordhandle drivers::Handle(int id) const{
+    size_t slot = Lookup(id);
+    return slot == npos ? NoHandle : Handles.At(slot);
+}
+
+recordhandle drivers::HandleAt(size_t slot) const{
+    return Handles.At(slot);
+}
+
+size_t drivers::Resolve(recordhandle h) const{
+    return Handles.Resolve(h);
+}
+
+size_t drivers::Lookup(int id) const{
+    METRIC_COUNT(M_DRIVER_LOOKUP);
+    unordered_map<int, size_t>::const_iterator it = IdIndex.find(id);
+    if(it == IdIndex.end()){
+        return npos;
+    }
+    return it->second;
+}
+
+driver drivers::At(size_t slot) const{
+    return driver(View(slot));
+}
+
+driverview drivers::View(size_t slot) const{
+    driverview d;
+    d.id = Ids[slot];
+    d.name = Cold[slot].name;
+    d.capacity = Capacities[slot];
+    d.handicap = Handicap[slot];
+    d.type = TypeNames.Name(Types[slot]);
+    d.rating = Ratings[slot];
+    d.available = Available.Test(slot);
+    d.pets = Pets[slot];
+    d.notes = Cold[slot].notes;
+    d.lat = Lats[slot];
+    d.lon = Lons[slot];
+    return d;
+}
+
+size_t drivers::Size() const{
+    return Ids.size();
+}
+
+void drivers::Reserve(size_t n){
+    Ids.reserve(n);
+    Capacities.reserve(n);
+    Ratings.reserve(n);
+    Available.Reserve(n);
+    Handicap.reserve(n);
+    Pets.reserve(n);
+    Types.reserve(n);
+    Lats.reserve(n);
+    Lons.reserve(n);
+    CapMasks.reserve(n);
+    Cold.reserve(n);
+    IdIndex.reserve(n);
+    TypeIndex.Reserve(n);
+    CapacityIndex.Reserve(n);
+    RatingIndex.Reserve(n);
+    TopIndex.Reserve(n);
+    Handles.Reserve(n);
+}
+
+void drivers::Clear(){
+    Ids.clear();
+    Capacities.clear();
+    Ratings.clear();
+    Available.Clear();
+    Handicap.clear();
+    Pets.clear();
+    Types.clear();
+    Lats.clear();
+    Lons.clear();
+    CapMasks.clear();
+    Cold.clear();
+    Strings.Clear();
+    IdIndex.clear();
+    Handles.Clear();
+    Grid.Clear();
+    FleetStats.Clear();
+    TypeIndex.Clear();
+    CapacityIndex.Clear();
+    RatingIndex.Clear();
+    lock_guard<mutex> guard(TopLock);
+    TopIndex.Clear();
+}
+
+static const char DriversMagic[8] = {'D', 'R', 'V', 'S', 'N', 'A', 'P', '1'};
+
+bool drivers::SaveSnapshot(const string& path) const{
+    vector<char> bytes;
+    SnapshotBytes(bytes, 0);
+    return WriteSnapshotFile(path, bytes);
+}
+
+void drivers::SnapshotBytes(vector<char>& out, uint64_t lsn) const{
+    size_t n = Ids.size();
+    vector<string_view> strings;
+    strings.reserve(n * 3);
+    uint64_t stringBytes = 0;
+    // the file keeps the type as text plus a vehicletype column, so it
+    // doesn't depend on the order types were interned in
+    vector<uint8_t> types(n);
+    for(size_t i = 0; i < n; i++){
+        string_view type = TypeNames.Name(Types[i]);
+        strings.push_back(Cold[i].name);
+        strings.push_back(type);
+        strings.push_back(Cold[i].notes);
+        stringBytes += Cold[i].name.size() + type.size() + Cold[i].notes.size();
+        types[i] = static_cast<uint8_t>(Types[i] < VT_COUNT ? Types[i] : static_cast<uint16_t>(VT_OTHER));
+    }
+    snapshotwriter w;
+    w.Begin(DriversMagic, n, 3, stringBytes, lsn);
+    w.WriteColumn(Ids.data(), n * sizeof(int));
+    w.WriteColumn(Capacities.data(), n * sizeof(int));
+    w.WriteColumn(Ratings.data(), n * sizeof(float));
+    vector<uint8_t> available(n);
+    for(size_t i = 0; i < n; i++){
+        available[i] = Available.Test(i);
+    }
+    w.WriteColumn(available.data(), n);
+    w.WriteColumn(Handicap.data(), n);
+    w.WriteColumn(Pets.data(), n);
+    w.WriteColumn(types.data(), n);
+    w.WriteColumn(Lats.data(), n * sizeof(double));
+    w.WriteColumn(Lons.data(), n * sizeof(double));
+    w.WriteStrings(strings);
+    w.Take(out);
+}
+
+bool drivers::LoadSnapshot(const string& path, uint64_t* lsn){
+    snapshotreader r;
+    if(!r.Open(path, DriversMagic) || r.GetHeader().fields != 3){
+        return false;
+    }
+    size_t n = r.GetHeader().count;
+    const int* ids = static_cast<const int*>(r.NextColumn(n * sizeof(int)));
+    const int* capacities = static_cast<const int*>(r.NextColumn(n * sizeof(int)));
+    const float* ratings = static_cast<const float*>(r.NextColumn(n * sizeof(float)));
+    const uint8_t* available = static_cast<const uint8_t*>(r.NextColumn(n));
+    const uint8_t* handicap = static_cast<const uint8_t*>(r.NextColumn(n));
+    const uint8_t* pets = static_cast<const uint8_t*>(r.NextColumn(n));
+    // only the type strings are used; the vehicletype column is for readers
+    // that don't intern
+    r.NextColumn(n);
+    const double* lats = static_cast<const double*>(r.NextColumn(n * sizeof(double)));
+    const double* lons = static_cast<const double*>(r.NextColumn(n * sizeof(double)));
+    if(lons == 0 || !r.OpenStrings()){
+        return false;
+    }
+    // a duplicate id or a flag other than 0/1 can't have come from
+    // SaveSnapshot; refuse the file before touching the collection
+    unordered_map<int, size_t> index;
+    index.reserve(n);
+    for(size_t i = 0; i < n; i++){
+        if(!index.insert(make_pair(ids[i], i)).second || available[i] > 1 || handicap[i] > 1 || pets[i] > 1){
+            return false;
+        }
+    }
+
+    Clear();
+    if(lsn != 0){
+        *lsn = r.GetHeader().lsn;
+    }
+    Ids.assign(ids, ids + n);
+    Capacities.assign(capacities, capacities + n);
+    Ratings.assign(ratings, ratings + n);
+    Available.Reserve(n);
+    for(size_t i = 0; i < n; i++){
+        Available.PushBack(available[i] != 0);
+    }
+    Handicap.assign(handicap, handicap + n);
+    Pets.assign(pets, pets + n);
+    Types.resize(n);
+    Lats.assign(lats, lats + n);
+    Lons.assign(lons, lons + n);
+    CapMasks.resize(n);
+    Cold.resize(n);
+    IdIndex.swap(index);
+    for(size_t i = 0; i < n; i++){
+        size_t len;
+        const char* str = r.StringAt(i * 3, len);
+        Cold[i].name = Strings.Store(string_view(str, len));
+        str = r.StringAt(i * 3 + 1, len);
+        Types[i] = TypeNames.Intern(string_view(str, len));
+        str = r.StringAt(i * 3 + 2, len);
+        Cold[i].notes = Strings.Store(string_view(str, len));
+        Handles.Push();
+        IndexSlot(i);
+        CountSlot(i, 1);
+    }
+    return true;
+}
+
+int drivers::IdAt(size_t slot) const{
+    return Ids[slot];
+}
+
+float drivers::RatingAt(size_t slot) const{
+    return Ratings[slot];
+}
+
+bool drivers::AvailableAt(size_t slot) const{
+    return Available.Test(slot);
+}
+
+double drivers::LatAt(size_t slot) const{
+    return Lats[slot];
+}
+
+double drivers::LonAt(size_t slot) const{
+    return Lons[slot];
+}
+
+uint32_t drivers::MaskAt(size_t slot) const{
+    return CapMasks[slot];
+}
+
+vector<size_t> drivers::Nearest(double lat, double lon, size_t k, double maxKm,
+                                const function<bool(const driver&)>& eligible) const{
+    METRIC_TIMER(M_DRIVER_NEAREST);
+    return Grid.KNearest(lat, lon, k, maxKm, [&](size_t slot){
+        return Available.Test(slot) && (!eligible || eligible(At(slot)));
+    });
+}
+
+vector<size_t> drivers::Nearest(double lat, double lon, size_t k, double maxKm, uint32_t required,
+                                int minCapacity) const{
+    METRIC_TIMER(M_DRIVER_NEAREST);
+    const uint32_t* masks = CapMasks.data();
+    const availabilitybitmap* available = &Available;
+    bool needAvailable = (required & CAP_AVAILABLE) != 0;
+    required &= ~CAP_AVAILABLE;
+    // the capacity thermometer stops at CapacityBits, see capability.h
+    const int* capacities = minCapacity > CapacityBits ? Capacities.data() : 0;
+    return Grid.KNearest(lat, lon, k, maxKm, [=](size_t slot){
+        return MaskEligible(masks[slot], required) && (!needAvailable || available->Test(slot))
+               && (capacities == 0 || capacities[slot] >= minCapacity);
+    });
+}
+
+static scanpredicate MaskPredicate(uint32_t required){
+    scanpredicate p;
+    p.required = required;
+    p.minRating = 0.0f;
+    p.maxRating = 5.0f;
+    p.minCapacity = 0;
+    return p;
+}
+
+// runs the scan kernel, then one AND per word with the availability bitmap;
+// ratings and capacities are passed as 0 when p doesn't need them
+void drivers::ScanBits(const scanpredicate& p, const float* ratings, const int* capacities,
+                       bool needAvailable, vector<uint64_t>& bits) const{
+    size_t n = Ids.size();
+    size_t words = (n + 63) / 64;
+    bits.resize(words);
+    ScanColumns(CapMasks.data(), ratings, capacities, n, p, bits.data());
+    if(needAvailable){
+        for(size_t w = 0; w < words; w++){
+            bits[w] &= Available.Word(w);
+        }
+    }
+}
+
+vector<size_t> drivers::Eligible(uint32_t required) const{
+    bool needAvailable = (required & CAP_AVAILABLE) != 0;
+    vector<uint64_t> bits;
+    ScanBits(MaskPredicate(required & ~CAP_AVAILABLE), 0, 0, needAvailable, bits);
+    vector<size_t> out(CountBits(bits.data(), bits.size()));
+    CompactBits(bits.data(), bits.size(), out.data());
+    return out;
+}
+
+size_t drivers::CountEligible(uint32_t required) const{
+    bool needAvailable = (required & CAP_AVAILABLE) != 0;
+    vector<uint64_t> bits;
+    ScanBits(MaskPredicate(required & ~CAP_AVAILABLE), 0, 0, needAvailable, bits);
+    return CountBits(bits.data(), bits.size());
+}
+
+void drivers::Scan(const driverquery& q, vector<uint64_t>& bits) const{
+    METRIC_TIMER(M_DRIVER_SCAN);
+    scanpredicate p = MaskPredicate(0);
+    p.minRating = q.minRating;
+    p.maxRating = q.maxRating;
+    p.minCapacity = q.minCapacity;
+    // the capacity thermometer in the masks covers small parties, so the
+    // capacities column is only read for bigger ones
+    const int* capacities = 0;
+    if(q.minCapacity <= CapacityBits){
+        p.required |= CapacityMask(q.minCapacity);
+    }
+    else{
+        capacities = Capacities.data();
+    }
+    if(q.handicap){
+        p.required |= CAP_HANDICAP;
+    }
+    if(q.pets){
+        p.required |= CAP_PETS;
+    }
+    // masks only know the enum types, with everything else folded into
+    // VT_OTHER; those two need the exact type checked afterwards
+    bool exactType = false;
+    if(q.type != VT_ANY){
+        if(q.type < 0){
+            p.required |= CAP_IMPOSSIBLE;
+        }
+        else if(q.type < VT_COUNT && q.type != VT_OTHER){
+            p.required |= 1u << (CAP_TYPE_SHIFT + q.type);
+        }
+        else{
+            p.required |= 1u << (CAP_TYPE_SHIFT + VT_OTHER);
+            exactType = true;
+        }
+    }
+    ScanBits(p, Ratings.data(), capacities, q.availableOnly, bits);
+    if(exactType){
+        for(size_t w = 0; w < bits.size(); w++){
+            uint64_t b = bits[w];
+            while(b != 0){
+                size_t slot = w * 64 + __builtin_ctzll(b);
+                if(Types[slot] != q.type){
+                    bits[w] &= ~(1ull << (slot % 64));
+                }
+                b &= b - 1;
+            }
+        }
+    }
+}
+
+vector<size_t> drivers::Scan(const driverquery& q) const{
+    vector<uint64_t> bits;
+    Scan(q, bits);
+    vector<size_t> out(CountBits(bits.data(), bits.size()));
+    CompactBits(bits.data(), bits.size(), out.data());
+    return out;
+}
+
+driverquery AnyDriver(){
+    driverquery q;
+    q.minRating = 0.0f;
+    q.maxRating = 5.0f;
+    q.type = VT_ANY;
+    q.minCapacity = 0;
+    q.availableOnly = false;
+    q.handicap = false;
+    q.pets = false;
+    return q;
+}
+
+bool drivers::Matches(const driverquery& q, size_t slot) const{
+    return Ratings[slot] >= q.minRating && Ratings[slot] <= q.maxRating &&
+           (q.type == VT_ANY || Types[slot] == q.type) &&
+           Capacities[slot] >= q.minCapacity &&
+           (!q.handicap || Handicap[slot]) && (!q.pets || Pets[slot]) &&
+           (!q.availableOnly || Available.Test(slot));
+}
+
+drivercolumns drivers::Columns() const{
+    drivercolumns c;
+    c.size = Ids.size();
+    c.masks = CapMasks.data();
+    c.ratings = Ratings.data();
+    c.capacities = Capacities.data();
+    c.types = Types.data();
+    c.available = &Available;
+    return c;
+}
+
+vector<size_t> drivers::TopRated(double lat, double lon, size_t k, int type, uint32_t required) const{
+    uint64_t region = GeohashBits(lat, lon, RegionBits);
+    vector<uint64_t> keys;
+    if(type == VT_ANY){
+        for(size_t t = 0; t < TypeNames.Size(); t++){
+            keys.push_back(topratedindex::Key(region, static_cast<uint16_t>(t)));
+        }
+    }
+    else{
+        keys.push_back(topratedindex::Key(region, static_cast<uint16_t>(type)));
+    }
+    // everything in the index is available; the masks don't carry that bit
+    required &= ~CAP_AVAILABLE;
+    vector<size_t> out;
+    lock_guard<mutex> guard(TopLock);
+    TopIndex.Top(keys.data(), keys.size(), k, Ratings.data(), [&](size_t slot){
+        return MaskEligible(CapMasks[slot], required);
+    }, out);
+    return out;
+}
+
+// Drives the search from whichever index yields the fewest candidates and
+// checks the remaining conditions against the columns, so the cost follows
+// the most selective condition rather than the collection size.
+vector<size_t> drivers::Query(const driverquery& q) const{
+    METRIC_TIMER(M_DRIVER_QUERY);
+    enum{ BY_SCAN, BY_TYPE, BY_CAPACITY, BY_RATING } by = BY_SCAN;
+    size_t best = Ids.size();
+    if(q.type != VT_ANY){
+        size_t n = q.type < 0 ? 0 : TypeIndex.Bucket(q.type).size();
+        if(n < best){
+            best = n;
+            by = BY_TYPE;
+        }
+    }
+    size_t minKey = CapacityKey(q.minCapacity);
+    if(minKey > 0){
+        size_t n = 0;
+        for(size_t k = minKey; k < CapacityIndex.BucketCount(); k++){
+            n += CapacityIndex.Bucket(k).size();
+        }
+        if(n < best){
+            best = n;
+            by = BY_CAPACITY;
+        }
+    }
+    // a range covering every bucket can't beat the scan
+    if(ratingindex::Key(q.minRating) > 0 || q.maxRating < 5.0f){
+        size_t n = RatingIndex.CountRange(q.minRating, q.maxRating);
+        if(n < best){
+            best = n;
+            by = BY_RATING;
+        }
+    }
+
+    vector<size_t> out;
+    if(by == BY_TYPE){
+        if(q.type >= 0){
+            const vector<uint32_t>& b = TypeIndex.Bucket(q.type);
+            for(size_t i = 0; i < b.size(); i++){
+                if(Matches(q, b[i])){
+                    out.push_back(b[i]);
+                }
+            }
+        }
+    }
+    else if(by == BY_CAPACITY){
+        for(size_t k = minKey; k < CapacityIndex.BucketCount(); k++){
+            const vector<uint32_t>& b = CapacityIndex.Bucket(k);
+            for(size_t i = 0; i < b.size(); i++){
+                if(Matches(q, b[i])){
+                    out.push_back(b[i]);
+                }
+            }
+        }
+    }
+    else if(by == BY_RATING){
+        RatingIndex.ForRange(q.minRating, q.maxRating, Ratings.data(), [&](size_t slot){
+            if(Matches(q, slot)){
+                out.push_back(slot);
+            }
+        });
+    }
+    else{
+        for(size_t i = 0; i < Ids.size(); i++){
+            if(Matches(q, i)){
+                out.push_back(i);
+            }
+        }
+    }
+    return out;
+}
+
+bool drivers::Claim(int id){
+    size_t slot = Lookup(id);
+    if(slot == npos){
+        return false;
+    }
+    if(!Available.TryClaim(slot)){
+        return false;
+    }
+    {
+        lock_guard<mutex> guard(TopLock);
+        TopIndex.Remove(slot, Ratings.data());
+    }
+    MarkDirty(slot);
+    FleetStats.MadeUnavailable(Capacities[slot], Handicap[slot], Pets[slot]);
+    LogAvailable(id, false);
+    return true;
+}
+
+int drivers::ClaimAny(){
+    size_t slot = Available.ClaimAny(0);
+    if(slot == availabilitybitmap::npos){
+        return -1;
+    }
+    {
+        lock_guard<mutex> guard(TopLock);
+        TopIndex.Remove(slot, Ratings.data());
+    }
+    MarkDirty(slot);
+    FleetStats.MadeUnavailable(Capacities[slot], Handicap[slot], Pets[slot]);
+    LogAvailable(Ids[slot], false);
+    return Ids[slot];
+}
+
+bool drivers::Release(int id){
+    size_t slot = Lookup(id);
+    if(slot == npos){
+        return false;
+    }
+    if(Available.Release(slot)){
+        {
+            lock_guard<mutex> guard(TopLock);
+            TopIndex.Insert(TopKey(slot), slot, Ratings.data());
+        }
+        MarkDirty(slot);
+        FleetStats.MadeAvailable(Capacities[slot], Handicap[slot], Pets[slot]);
+    }
+    LogAvailable(id, true);
+    return true;
+}
+
+void drivers::MarkDirty(size_t slot){
+    if(!Versioning){
+        return;
+    }
+    lock_guard<mutex> guard(DirtyLock);
+    if(slot >= DirtyFlags.size()){
+        DirtyFlags.resize(slot + 1 > 2 * DirtyFlags.size() ? slot + 1 : 2 * DirtyFlags.size());
+    }
+    if(!DirtyFlags[slot]){
+        DirtyFlags[slot] = 1;
+        Dirty.push_back(slot);
+    }
+}
+
+void drivers::EnableVersions(){
+    if(Versioning){
+        return;
+    }
+    Versioning = true;
+    // everything that exists so far goes into the first publish
+    for(size_t i = 0; i < Ids.size(); i++){
+        MarkDirty(i);
+    }
+}
+
+void drivers::Publish(){
+    if(!Versioning){
+        return;
+    }
+    vector<size_t> changed;
+    {
+        lock_guard<mutex> guard(DirtyLock);
+        changed.swap(Dirty);
+        for(size_t i = 0; i < changed.size(); i++){
+            DirtyFlags[changed[i]] = 0;
+        }
+    }
+    Versions.Resize(Ids.size());
+    for(size_t i = 0; i < changed.size(); i++){
+        // slots past the end were deleted since they were marked
+        if(changed[i] < Ids.size()){
+            Versions.Set(changed[i], driver(View(changed[i])));
+        }
+    }
+    Versions.Publish();
+}
+
+driverversion drivers::Version() const{
+    return Versions.Read();
+}
+
+void drivers::LogAvailable(int id, bool b){
+    if(Log != 0){
+        logencoder e;
+        e.PutInt(id);
+        e.PutU8(b);
+        Log->Append(LR_DRIVER_AVAILABLE, e);
+    }
+}
+
+void drivers::AttachLog(writeaheadlog* log){
+    Log = log;
+}
+
+bool drivers::ApplyLogRecord(uint8_t type, const char* data, size_t size){
+    logdecoder in(data, size);
+    int id;
+    driver d;
+    switch(type){
+        case LR_DRIVER_ADD:
+            d = DecodeDriver(in);
+            return in.Good() && Add(d);
+        case LR_DRIVER_EDIT:
+            id = in.GetInt();
+            d = DecodeDriver(in);
+            return in.Good() && Edit(id, d);
+        case LR_DRIVER_DELETE:
+            id = in.GetInt();
+            return in.Good() && Delete(id);
+        case LR_DRIVER_AVAILABLE:{
+            id = in.GetInt();
+            bool b = in.GetU8();
+            return in.Good() && SetAvailable(id, b);
+        }
+        case LR_DRIVER_LOCATION:{
+            id = in.GetInt();
+            double lat = in.GetDouble();
+            double lon = in.GetDouble();
+            return in.Good() && SetLocation(id, lat, lon);
+        }
+        case LR_DRIVER_RATING:{
+            id = in.GetInt();
+            float rating = in.GetFloat();
+            return in.Good() && SetRating(id, rating);
+        }
+        case LR_DRIVER_LOCATIONS:{
+            // id, lat, lon repeated to the end of the record
+            vector<locationupdate> updates;
+            while(in.Remaining() >= sizeof(int32_t) + 2 * sizeof(double)){
+                locationupdate u;
+                u.id = in.GetInt();
+                u.lat = in.GetDouble();
+                u.lon = in.GetDouble();
+                updates.push_back(u);
+            }
+            return in.Good() && updates.size() != 0 && SetLocations(updates.data(), updates.size()) != 0;
+        }
+    }
+    return false;
+}
+
+driversummary drivers::Summarize() const{
+    driversummary init;
+    init.count = 0;
+    init.available = 0;
+    init.availableSeats = 0;
+    // a plain sum here; divided once at the end
+    init.averageRating = 0;
+    init.perType.assign(TypeNames.Size(), 0);
+    driversummary s = ::ParallelReduce(threadpool::Shared(), Ids.size(), init,
+        [&](size_t begin, size_t end){
+            driversummary c = init;
+            for(size_t i = begin; i < end; i++){
+                bool available = Available.Test(i);
+                c.count++;
+                c.available += available;
+                c.availableSeats += available ? Capacities[i] : 0;
+                c.averageRating += Ratings[i];
+                c.perType[Types[i]]++;
+            }
+            return c;
+        },
+        [](driversummary a, const driversummary& b){
+            a.count += b.count;
+            a.available += b.available;
+            a.availableSeats += b.availableSeats;
+            a.averageRating += b.averageRating;
+            for(size_t t = 0; t < a.perType.size(); t++){
+                a.perType[t] += b.perType[t];
+            }
+            return a;
+        });
+    if(s.count != 0){
+        s.averageRating /= s.count;
+    }
+    return s;
+}
+
+fleetsnapshot drivers::Stats() const{
+    return FleetStats.Snapshot();
+}
+
+void drivers::PrintSize(){
+    if(Ids.size() != 0){
+    fleetsnapshot s = FleetStats.Snapshot();
+    cout <<"The is currently " <<Ids.size() << " Drivers, " << s.available << " available with "
+         << s.availableSeats << " seats\n";
+    cout << "Mean rating: " << s.meanRating << "\n";
+    cout << "Handicap capable: " << s.handicap << " (" << s.availableHandicap << " available)\n";
+    cout << "Pets allowed: " << s.pets << " (" << s.availablePets << " available)\n";
+    cout << "Available by capacity:";
+    for(int c = 1; c <= CapacityBits; c++){
+        if(s.availableByCapacity[c] != 0){
+            cout << " " << c << (c == CapacityBits ? "+" : "") << ":" << s.availableByCapacity[c];
+        }
+    }
+    cout << "\n";
+    }
+    else
+    cout << "vector is empty man!\n";
+}
+
+void drivers::PrintAll() const{
+    reportwriter out(stdout);
+    if(Versioning){
+        // the last published version, so a concurrent claim can't tear it
+        ExportDrivers(Version(), out, RF_TEXT);
+        return;
+    }
+    ExportDrivers(*this, out, RF_TEXT);
+}
@@ -2,21 +2,294 @@
 #define DRIVERS_H
 #include <vector>
 #include <string>
+#include <string_view>
 #include <iterator>
+#include <unordered_map>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
 using namespace std;
 
 #include "driver.h"
+#include "spatialgrid.h"
+#include "capability.h"
+#include "availabilitybitmap.h"
+#include "wal.h"
+#include "stringarena.h"
+#include "internpool.h"
+#include "secondaryindex.h"
+#include "toprated.h"
+#include "handletable.h"
+#include "scankernels.h"
+#include "parallel.h"
+#include "fleetstats.h"
+#include "versioned.h"
 
+// compound filter for drivers::Query; start from AnyDriver() and narrow it
+struct driverquery{
+    float minRating;
+    float maxRating;
+    int type;          // vehicletype, or VT_ANY
+    int minCapacity;
+    bool availableOnly;
+    bool handicap;     // only handicap capable drivers
+    bool pets;         // only drivers who take pets
+};
+
+driverquery AnyDriver();
+
+// raw column pointers for the match policies in matchpolicy.h; valid until
+// the next change to the collection
+struct drivercolumns{
+    size_t size;
+    const uint32_t* masks;  // capability masks without CAP_AVAILABLE
+    const float* ratings;
+    const int* capacities;
+    const uint16_t* types;  // TypeNames ids, equal to the vehicletype for known types
+    const availabilitybitmap* available;
+};
+
+// a consistent, immutable copy of the fleet, see drivers::Version()
+typedef versionedtable<driver>::view driverversion;
+
+// one position change for drivers::SetLocations
+struct locationupdate{
+    int id;
+    double lat;
+    double lon;
+};
+
+// fleet-wide aggregates, recomputed by drivers::Summarize()
+struct driversummary{
+    size_t count;
+    size_t available;
+    // seats across the available drivers
+    size_t availableSeats;
+    double averageRating;
+    // drivers per vehicle type, indexed by type id (vehicletype for the
+    // known ones)
+    vector<size_t> perType;
+};
+
+// Drivers are stored column by column: the fields match queries touch are
+// kept in contiguous arrays indexed by slot, and the strings live in a side
+// table so scans never pull them into cache. driver objects are built on
+// demand by At(). Names and notes are kept in one arena per collection and
+// vehicle types are interned, so adding a driver doesn't allocate per string.
+//
+// Availability is a packed atomic bitmap rather than a column: Claim,
+// ClaimAny and Release may run from several dispatcher threads at once and
+// a driver can only ever be claimed by one of them. Everything else
+// (including SetAvailable) still expects a single writer.
 class drivers{
     private:
-    vector<driver> TotalDrivers;
+    // views into Strings
+    struct coldfields{
+        string_view name;
+        string_view notes;
+    };
+
+    // hot columns, all indexed by slot
+    vector<int> Ids;
+    vector<int> Capacities;
+    vector<float> Ratings;
+    vector<uint8_t> Handicap;
+    vector<uint8_t> Pets;
+    vector<uint16_t> Types; // TypeNames id, equal to the vehicletype for known types
+    vector<double> Lats;
+    vector<double> Lons;
+    // capability mask per slot (see capability.h), without CAP_AVAILABLE
+    vector<uint32_t> CapMasks;
+    availabilitybitmap Available;
+    // cold columns
+    vector<coldfields> Cold;
+    stringarena Strings;
+    internpool TypeNames;
+
     string ListName;
+    // d_id -> slot
+    unordered_map<int, size_t> IdIndex;
+    // stable names for slots, see Handle()
+    handletable Handles;
+    // positions of every driver; availability is checked against the
+    // bitmap at query time since claims can't touch the grid
+    spatialgrid Grid;
+    // secondary indexes for Query(), kept in step by IndexSlot/UnindexSlot
+    bucketindex TypeIndex;     // by TypeNames id
+    bucketindex CapacityIndex; // by CapacityKey
+    ratingindex RatingIndex;
+    // available drivers by (region, type) in rating order for TopRated().
+    // Claim and Release change it from other threads, so it has a lock of
+    // its own; Ratings of indexed slots are only written under it too.
+    topratedindex TopIndex;
+    mutable mutex TopLock;
+    // running aggregates behind Stats()
+    fleetstats FleetStats;
+    // mutations are appended here when attached
+    writeaheadlog* Log;
+    // published copies for Version(); slots changed since the last
+    // Publish() are queued in Dirty. DirtyLock is only taken when
+    // versioning is on, since Claim and Release mark from other threads.
+    versionedtable<driver> Versions;
+    bool Versioning;
+    mutex DirtyLock;
+    vector<size_t> Dirty;
+    vector<uint8_t> DirtyFlags;
+
+    void PushSlot(const driverview& d);
+    void WriteSlot(size_t slot, const driverview& d);
+    void MoveSlot(size_t from, size_t to);
+    void PopSlot();
+    void IndexSlot(size_t slot);
+    void UnindexSlot(size_t slot);
+    void RenumberSlot(size_t from, size_t to);
+    bool EditSlot(size_t slot, const driverview& d);
+    bool DeleteSlot(size_t slot);
+    void LogAvailable(int id, bool b);
+    void ForgetStrings(size_t slot);
+    void CompactStrings();
+    void CountSlot(size_t slot, int sign);
+    void MarkDirty(size_t slot);
+    static size_t CapacityKey(int capacity);
+    // TopIndex group of a slot at its current position and type
+    uint64_t TopKey(size_t slot) const;
+    bool Matches(const driverquery& q, size_t slot) const;
+    void ScanBits(const scanpredicate& p, const float* ratings, const int* capacities,
+                  bool needAvailable, vector<uint64_t>& bits) const;
     
     public:
+    static const size_t npos = static_cast<size_t>(-1);
+    // TopRated() regions are geohash cells of this many bits (20: about
+    // 39 x 20 km)
+    static const size_t RegionBits = 20;
+
     drivers();
     drivers(string);
-    void Add(driver driver1);
+    bool Add(const driver& driver1);
+    bool Add(const driverview& d);
+    // adds straight from the field values, without building a driver first
+    bool Emplace(int id, string_view name, int capacity, bool handicap, string_view type, float rating,
+                 bool available, bool pets, string_view notes, double lat = 0, double lon = 0);
+    bool Edit(int id, const driver& driver1);
+    bool Edit(int id, const driverview& d);
+    bool Delete(int id);
+    // Edit and Delete by handle skip the id lookup. Edits are made in place
+    // and only touch the indexes whose keys changed; a delete moves the
+    // last record into the hole (O(1)) and its handle follows it.
+    bool Edit(recordhandle h, const driver& driver1);
+    bool Edit(recordhandle h, const driverview& d);
+    bool Delete(recordhandle h);
+    bool SetAvailable(int id, bool b);
+    bool SetRating(int id, float rating);
+    bool SetLocation(int id, double lat, double lon);
+    // applies a batch of position changes in order and logs them as one
+    // record; returns how many ids were found
+    size_t SetLocations(const locationupdate* updates, size_t n);
+    // atomically takes an available driver; false if someone else has it
+    bool Claim(int id);
+    // claims any available driver, returns its id or -1
+    int ClaimAny();
+    // makes a claimed driver available again
+    bool Release(int id);
+    // returns the slot of the driver with this id, or npos
+    size_t Lookup(int id) const;
+    // Slots change when a delete moves the last record; handles name the
+    // record itself until it's deleted, and never resolve after that.
+    // They aren't saved: a reload or Clear() hands out new ones.
+    recordhandle Handle(int id) const; // NoHandle if there's no such driver
+    recordhandle HandleAt(size_t slot) const;
+    // the driver's current slot, or npos once it's gone
+    size_t Resolve(recordhandle h) const;
+    // materializes the driver stored in slot
+    driver At(size_t slot) const;
+    // the same fields without copying them out; the views stay valid until
+    // the next mutation
+    driverview View(size_t slot) const;
+    size_t Size() const;
+    void Reserve(size_t n);
+    void Clear();
+    // binary snapshot, see snapshot.h
+    bool SaveSnapshot(const string& path) const;
+    // serialized snapshot tagged with the log position it reflects
+    void SnapshotBytes(vector<char>& out, uint64_t lsn) const;
+    // lsn, if given, receives the log position stored in the snapshot
+    bool LoadSnapshot(const string& path, uint64_t* lsn = 0);
+    // every later mutation is appended to log (0 detaches)
+    void AttachLog(writeaheadlog* log);
+    // replays one LR_DRIVER_* record
+    bool ApplyLogRecord(uint8_t type, const char* data, size_t size);
+
+    int IdAt(size_t slot) const;
+    float RatingAt(size_t slot) const;
+    bool AvailableAt(size_t slot) const;
+    double LatAt(size_t slot) const;
+    double LonAt(size_t slot) const;
+    uint32_t MaskAt(size_t slot) const;
+
+    // slots of the k available drivers closest to (lat, lon) that pass
+    // eligible, closest first
+    vector<size_t> Nearest(double lat, double lon, size_t k, double maxKm,
+                           const function<bool(const driver&)>& eligible) const;
+    // same, filtered on the capability masks (CAP_AVAILABLE is checked
+    // against the availability bitmap) and, past what the masks can tell,
+    // on minCapacity; pass the party size with a RequiredMask
+    vector<size_t> Nearest(double lat, double lon, size_t k, double maxKm, uint32_t required,
+                           int minCapacity = 0) const;
+    // slots of every driver whose mask satisfies required
+    vector<size_t> Eligible(uint32_t required) const;
+    size_t CountEligible(uint32_t required) const;
+    // slots of every driver matching q, in no particular order
+    vector<size_t> Query(const driverquery& q) const;
+    drivercolumns Columns() const;
+    // slots of the k best rated available drivers in the region of
+    // (lat, lon), best first, of one type (a TypeNames id, i.e. the
+    // vehicletype for known types) or VT_ANY, whose masks satisfy
+    // required. Costs O(k log k) off the per-region heaps, no sort.
+    vector<size_t> TopRated(double lat, double lon, size_t k, int type = VT_ANY, uint32_t required = 0) const;
+    // the same filter as a brute-force column scan (see scankernels.h):
+    // one bit per slot, or the ascending list of matching slots. Doesn't
+    // touch the secondary indexes, so it doubles as a check on them.
+    void Scan(const driverquery& q, vector<uint64_t>& bits) const;
+    vector<size_t> Scan(const driverquery& q) const;
+    // Parallel passes over every slot on threadpool::Shared(), chunked as
+    // described in parallel.h. f(slot, view) / map(slot, view) may run on
+    // several threads at once and must not modify the collection. For
+    // ParallelReduce, init has to be the identity of combine: each chunk
+    // folds its slots in order starting from init, then the chunks are
+    // combined in order, so the result is the same on every run.
+    template<typename F>
+    void ParallelForEach(F f) const{
+        ParallelFor(threadpool::Shared(), Ids.size(), [&](size_t begin, size_t end){
+            for(size_t i = begin; i < end; i++){
+                f(i, View(i));
+            }
+        });
+    }
+    template<typename T, typename Map, typename Combine>
+    T ParallelReduce(T init, Map map, Combine combine) const{
+        return ::ParallelReduce(threadpool::Shared(), Ids.size(), init, [&](size_t begin, size_t end){
+            T acc = init;
+            for(size_t i = begin; i < end; i++){
+                acc = combine(acc, map(i, View(i)));
+            }
+            return acc;
+        }, combine);
+    }
+    driversummary Summarize() const;
+    // the running aggregates, O(1) and lock-free; safe to call from any
+    // thread while the collection is being changed
+    fleetsnapshot Stats() const;
+    // Versioned reads: after EnableVersions(), the writer calls Publish()
+    // whenever its changes should become visible (e.g. once per tick) and
+    // any thread may take a Version(), an O(1) immutable view of the last
+    // publish that later writes never disturb. Publish copies only the
+    // slots changed since the previous one.
+    void EnableVersions();
+    void Publish();
+    // empty until the first Publish()
+    driverversion Version() const;
     void PrintSize();
+    void PrintAll() const;
     
     
 };
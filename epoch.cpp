@@ -0,0 +1,105 @@
+#include "epoch.h"
+#include <thread>
+
+epochdomain::epochdomain(){
+    for(size_t i = 0; i < Slots; i++){
+        Pins[i].epoch.store(0, memory_order_relaxed);
+    }
+    // 0 marks a free slot, so epochs start at 1
+    Global.store(1, memory_order_relaxed);
+}
+
+epochdomain::~epochdomain(){
+    for(size_t i = 0; i < Retired.size(); i++){
+        Retired[i].free();
+    }
+}
+
+size_t epochdomain::Enter(){
+    for(;;){
+        for(size_t i = 0; i < Slots; i++){
+            uint64_t expected = 0;
+            // seq_cst so the pin is visible before the reader loads any
+            // pointer it protects
+            if(Pins[i].epoch.load(memory_order_relaxed) == 0
+               && Pins[i].epoch.compare_exchange_strong(expected, Global.load())){
+                return i;
+            }
+        }
+        this_thread::yield();
+    }
+}
+
+void epochdomain::Exit(size_t slot){
+    Pins[slot].epoch.store(0, memory_order_release);
+}
+
+void epochdomain::Retire(function<void()> free){
+    // a reader pinned at this epoch or earlier may still be looking at the
+    // object; one that pins later can't have reached it
+    uint64_t e = Global.fetch_add(1);
+    {
+        lock_guard<mutex> guard(RetireLock);
+        retired r;
+        r.epoch = e;
+        r.free = move(free);
+        Retired.push_back(move(r));
+    }
+    Collect();
+}
+
+size_t epochdomain::Collect(){
+    uint64_t oldest = UINT64_MAX;
+    for(size_t i = 0; i < Slots; i++){
+        uint64_t e = Pins[i].epoch.load();
+        if(e != 0 && e < oldest){
+            oldest = e;
+        }
+    }
+    vector<function<void()> > ready;
+    {
+        lock_guard<mutex> guard(RetireLock);
+        size_t kept = 0;
+        for(size_t i = 0; i < Retired.size(); i++){
+            if(Retired[i].epoch < oldest){
+                ready.push_back(move(Retired[i].free));
+            }
+            else{
+                Retired[kept++] = move(Retired[i]);
+            }
+        }
+        Retired.resize(kept);
+    }
+    // outside the lock, a deleter may retire more
+    for(size_t i = 0; i < ready.size(); i++){
+        ready[i]();
+    }
+    return ready.size();
+}
+
+size_t epochdomain::PendingCount(){
+    lock_guard<mutex> guard(RetireLock);
+    return Retired.size();
+}
+
+epochdomain& epochdomain::Shared(){
+    static epochdomain domain;
+    return domain;
+}
+
+epochguard::epochguard(epochdomain& d){
+    Domain = &d;
+    Slot = d.Enter();
+}
+
+epochguard::epochguard(epochguard&& other){
+    Domain = other.Domain;
+    Slot = other.Slot;
+    other.Domain = 0;
+}
+
+epochguard::~epochguard(){
+    if(Domain != 0){
+        Domain->Exit(Slot);
+    }
+}
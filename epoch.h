@@ -0,0 +1,68 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+// Epoch based reclamation. A reader pins the current epoch for as long as
+// it holds pointers into shared data; a writer that unlinks something
+// retires it with a deleter, and the deleter only runs once every reader
+// pinned at or before the retirement has unpinned. Pinning is one store
+// into a per-reader slot; nothing a reader does ever blocks a writer.
+class epochdomain{
+    private:
+    static const size_t Slots = 128;
+
+    struct alignas(64) slot{
+        atomic<uint64_t> epoch; // 0 when free
+    };
+    struct retired{
+        uint64_t epoch;
+        function<void()> free;
+    };
+
+    slot Pins[Slots];
+    alignas(64) atomic<uint64_t> Global;
+    mutex RetireLock;
+    vector<retired> Retired;
+
+    epochdomain(const epochdomain&);
+    epochdomain& operator=(const epochdomain&);
+
+    public:
+    epochdomain();
+    // runs every deleter still pending
+    ~epochdomain();
+    // pins the current epoch and returns the slot to pass to Exit. Waits if
+    // all slots are taken.
+    size_t Enter();
+    void Exit(size_t slot);
+    // free runs once no reader can still see the object
+    void Retire(function<void()> free);
+    // runs the deleters that have become safe; returns how many ran
+    size_t Collect();
+    size_t PendingCount();
+
+    // the domain the registries use unless told otherwise
+    static epochdomain& Shared();
+};
+
+// holds a pin for its lifetime
+class epochguard{
+    private:
+    epochdomain* Domain;
+    size_t Slot;
+
+    epochguard(const epochguard&);
+    epochguard& operator=(const epochguard&);
+
+    public:
+    explicit epochguard(epochdomain& d);
+    epochguard(epochguard&& other);
+    ~epochguard();
+};
+#endif
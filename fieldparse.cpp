@@ -0,0 +1,73 @@
+#include "fieldparse.h"
+#include "spatialgrid.h"
+#include <charconv>
+
+string_view Trim(string_view s){
+    size_t b = 0;
+    size_t e = s.size();
+    while(b < e && (s[b] == ' ' || s[b] == '\t' || s[b] == '\r')){
+        b++;
+    }
+    while(e > b && (s[e - 1] == ' ' || s[e - 1] == '\t' || s[e - 1] == '\r')){
+        e--;
+    }
+    return s.substr(b, e - b);
+}
+
+bool ParseInt(string_view s, int& out){
+    from_chars_result r = from_chars(s.data(), s.data() + s.size(), out);
+    return r.ec == errc() && r.ptr == s.data() + s.size();
+}
+
+bool ParseFloat(string_view s, float& out){
+    from_chars_result r = from_chars(s.data(), s.data() + s.size(), out);
+    return r.ec == errc() && r.ptr == s.data() + s.size();
+}
+
+bool ParseDouble(string_view s, double& out){
+    from_chars_result r = from_chars(s.data(), s.data() + s.size(), out);
+    return r.ec == errc() && r.ptr == s.data() + s.size();
+}
+
+bool ParseCoordinates(string_view latText, string_view lonText, double& lat, double& lon){
+    return ParseDouble(latText, lat) && ParseDouble(lonText, lon) && spatialgrid::ValidPosition(lat, lon);
+}
+
+int ParseBool(string_view s){
+    if(s == "yes" || s == "true" || s == "1"){
+        return 1;
+    }
+    if(s == "no" || s == "false" || s == "0"){
+        return 0;
+    }
+    return -1;
+}
+
+string_view NextWord(string_view& s){
+    size_t b = 0;
+    while(b < s.size() && (s[b] == ' ' || s[b] == '\t')){
+        b++;
+    }
+    size_t e = b;
+    while(e < s.size() && s[e] != ' ' && s[e] != '\t'){
+        e++;
+    }
+    string_view w = s.substr(b, e - b);
+    s = s.substr(e);
+    return w;
+}
+
+size_t SplitFields(string_view s, string_view* fields, size_t max){
+    size_t n = 0;
+    for(;;){
+        size_t bar = s.find('|');
+        if(n == max){
+            return max + 1;
+        }
+        fields[n++] = Trim(s.substr(0, bar));
+        if(bar == string_view::npos){
+            return n;
+        }
+        s = s.substr(bar + 1);
+    }
+}
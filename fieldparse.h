@@ -0,0 +1,23 @@
+#ifndef FIELDPARSE_H
+#define FIELDPARSE_H
+#include <string_view>
+#include <cstddef>
+using namespace std;
+
+// Text field parsing shared by the importer and the batch command reader.
+// Numbers must take up the whole field; no partial parses.
+string_view Trim(string_view s);
+bool ParseInt(string_view s, int& out);
+bool ParseFloat(string_view s, float& out);
+bool ParseDouble(string_view s, double& out);
+// a lat/lon pair that is finite and on the globe (spatialgrid::ValidPosition);
+// every command and import path that takes a position goes through this
+bool ParseCoordinates(string_view latText, string_view lonText, double& lat, double& lon);
+// yes/no, true/false or 1/0; -1 if not a boolean
+int ParseBool(string_view s);
+// splits the next space separated word off s
+string_view NextWord(string_view& s);
+// '|' separated and trimmed into fields; returns the number of fields, or
+// max + 1 if there were more than max
+size_t SplitFields(string_view s, string_view* fields, size_t max);
+#endif
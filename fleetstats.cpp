@@ -0,0 +1,118 @@
+#include "fleetstats.h"
+#include <cmath>
+
+static int64_t RatingMilli(float rating){
+    return llround(static_cast<double>(rating) * 1000.0);
+}
+
+static size_t CapacitySlot(int capacity){
+    if(capacity <= 0){
+        return 0;
+    }
+    return capacity > CapacityBits ? CapacityBits : capacity;
+}
+
+fleetstats::fleetstats(){
+    Clear();
+}
+
+void fleetstats::AdjustAvailable(int capacity, bool handicap, bool pets, int64_t sign){
+    Available.count.fetch_add(sign, memory_order_relaxed);
+    Available.seats.fetch_add(sign * capacity, memory_order_relaxed);
+    Available.handicap.fetch_add(sign * handicap, memory_order_relaxed);
+    Available.pets.fetch_add(sign * pets, memory_order_relaxed);
+    Available.byCapacity[CapacitySlot(capacity)].fetch_add(sign, memory_order_relaxed);
+}
+
+void fleetstats::Adjust(int capacity, float rating, bool handicap, bool pets, bool available, int64_t sign){
+    Totals.count.fetch_add(sign, memory_order_relaxed);
+    Totals.handicap.fetch_add(sign * handicap, memory_order_relaxed);
+    Totals.pets.fetch_add(sign * pets, memory_order_relaxed);
+    Totals.ratingMilli.fetch_add(sign * RatingMilli(rating), memory_order_relaxed);
+    if(available){
+        AdjustAvailable(capacity, handicap, pets, sign);
+    }
+}
+
+void fleetstats::Add(int capacity, float rating, bool handicap, bool pets, bool available){
+    Adjust(capacity, rating, handicap, pets, available, 1);
+}
+
+void fleetstats::Remove(int capacity, float rating, bool handicap, bool pets, bool available){
+    Adjust(capacity, rating, handicap, pets, available, -1);
+}
+
+void fleetstats::MadeAvailable(int capacity, bool handicap, bool pets){
+    AdjustAvailable(capacity, handicap, pets, 1);
+}
+
+void fleetstats::MadeUnavailable(int capacity, bool handicap, bool pets){
+    AdjustAvailable(capacity, handicap, pets, -1);
+}
+
+void fleetstats::Clear(){
+    Totals.count = 0;
+    Totals.handicap = 0;
+    Totals.pets = 0;
+    Totals.ratingMilli = 0;
+    Available.count = 0;
+    Available.seats = 0;
+    Available.handicap = 0;
+    Available.pets = 0;
+    for(int i = 0; i <= CapacityBits; i++){
+        Available.byCapacity[i] = 0;
+    }
+}
+
+fleetsnapshot fleetstats::Snapshot() const{
+    fleetsnapshot s;
+    s.count = Totals.count.load(memory_order_relaxed);
+    s.handicap = Totals.handicap.load(memory_order_relaxed);
+    s.pets = Totals.pets.load(memory_order_relaxed);
+    int64_t milli = Totals.ratingMilli.load(memory_order_relaxed);
+    s.meanRating = s.count > 0 ? milli / 1000.0 / s.count : 0.0;
+    s.available = Available.count.load(memory_order_relaxed);
+    s.availableSeats = Available.seats.load(memory_order_relaxed);
+    s.availableHandicap = Available.handicap.load(memory_order_relaxed);
+    s.availablePets = Available.pets.load(memory_order_relaxed);
+    for(int i = 0; i <= CapacityBits; i++){
+        s.availableByCapacity[i] = Available.byCapacity[i].load(memory_order_relaxed);
+    }
+    return s;
+}
+
+riderstats::riderstats(){
+    Clear();
+}
+
+void riderstats::Adjust(float rating, bool handicap, bool pets, int64_t sign){
+    Count.fetch_add(sign, memory_order_relaxed);
+    Handicap.fetch_add(sign * handicap, memory_order_relaxed);
+    Pets.fetch_add(sign * pets, memory_order_relaxed);
+    RatingMilli.fetch_add(sign * ::RatingMilli(rating), memory_order_relaxed);
+}
+
+void riderstats::Add(float rating, bool handicap, bool pets){
+    Adjust(rating, handicap, pets, 1);
+}
+
+void riderstats::Remove(float rating, bool handicap, bool pets){
+    Adjust(rating, handicap, pets, -1);
+}
+
+void riderstats::Clear(){
+    Count = 0;
+    Handicap = 0;
+    Pets = 0;
+    RatingMilli = 0;
+}
+
+ridersnapshot riderstats::Snapshot() const{
+    ridersnapshot s;
+    s.count = Count.load(memory_order_relaxed);
+    s.handicap = Handicap.load(memory_order_relaxed);
+    s.pets = Pets.load(memory_order_relaxed);
+    int64_t milli = RatingMilli.load(memory_order_relaxed);
+    s.meanRating = s.count > 0 ? milli / 1000.0 / s.count : 0.0;
+    return s;
+}
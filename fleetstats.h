@@ -0,0 +1,96 @@
+#ifndef FLEETSTATS_H
+#define FLEETSTATS_H
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+#include "capability.h"
+
+// Point-in-time copy of the fleet counters. Each field is exact on its own;
+// fields read around a concurrent update may straddle it (e.g. a claim
+// counted in available but not yet in availableSeats).
+struct fleetsnapshot{
+    int64_t count;
+    int64_t handicap;       // handicap capable drivers
+    int64_t pets;           // drivers who take pets
+    double meanRating;
+    int64_t available;
+    int64_t availableSeats;
+    int64_t availableHandicap;
+    int64_t availablePets;
+    // available drivers by capacity; the last entry is CapacityBits or more
+    int64_t availableByCapacity[CapacityBits + 1];
+};
+
+// Running fleet aggregates, adjusted by drivers on every add, edit, delete
+// and availability change instead of being recomputed by a scan. All
+// counters are atomics: availability changes may come from several
+// dispatcher threads at once, and Snapshot() is a handful of relaxed loads
+// that never blocks writers.
+class fleetstats{
+    private:
+    // writers from Claim/Release hit these all the time, so they get their
+    // own cache line away from the rest
+    struct alignas(64) availablecounters{
+        atomic<int64_t> count;
+        atomic<int64_t> seats;
+        atomic<int64_t> handicap;
+        atomic<int64_t> pets;
+        atomic<int64_t> byCapacity[CapacityBits + 1];
+    };
+    struct alignas(64) totalcounters{
+        atomic<int64_t> count;
+        atomic<int64_t> handicap;
+        atomic<int64_t> pets;
+        // sum of ratings in thousandths; integer so add and remove cancel
+        // exactly however long the process runs
+        atomic<int64_t> ratingMilli;
+    };
+
+    totalcounters Totals;
+    availablecounters Available;
+
+    fleetstats(const fleetstats&);
+    fleetstats& operator=(const fleetstats&);
+    void Adjust(int capacity, float rating, bool handicap, bool pets, bool available, int64_t sign);
+    void AdjustAvailable(int capacity, bool handicap, bool pets, int64_t sign);
+
+    public:
+    fleetstats();
+    void Add(int capacity, float rating, bool handicap, bool pets, bool available);
+    void Remove(int capacity, float rating, bool handicap, bool pets, bool available);
+    // a driver went from unavailable to available (or back)
+    void MadeAvailable(int capacity, bool handicap, bool pets);
+    void MadeUnavailable(int capacity, bool handicap, bool pets);
+    void Clear();
+    fleetsnapshot Snapshot() const;
+};
+
+struct ridersnapshot{
+    int64_t count;
+    int64_t handicap;
+    int64_t pets;
+    double meanRating;
+};
+
+// the same for passengers, which have a single writer
+class riderstats{
+    private:
+    atomic<int64_t> Count;
+    atomic<int64_t> Handicap;
+    atomic<int64_t> Pets;
+    atomic<int64_t> RatingMilli;
+
+    riderstats(const riderstats&);
+    riderstats& operator=(const riderstats&);
+    void Adjust(float rating, bool handicap, bool pets, int64_t sign);
+
+    public:
+    riderstats();
+    void Add(float rating, bool handicap, bool pets);
+    void Remove(float rating, bool handicap, bool pets);
+    void Clear();
+    ridersnapshot Snapshot() const;
+};
+#endif
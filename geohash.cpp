@@ -0,0 +1,86 @@
+#include "geohash.h"
+#include "spatialgrid.h"
+
+static const char Base32[] = "0123456789bcdefghjkmnpqrstuvwxyz";
+
+// base32 value of c, or -1
+static int Base32Value(char c){
+    for(int i = 0; i < 32; i++){
+        if(Base32[i] == c){
+            return i;
+        }
+    }
+    return -1;
+}
+
+string GeohashEncode(double lat, double lon, size_t precision){
+    if(precision > MaxGeohashLength){
+        precision = MaxGeohashLength;
+    }
+    uint64_t bits = GeohashBits(lat, lon, precision * 5);
+    string hash(precision, ' ');
+    for(size_t i = precision; i-- > 0; ){
+        hash[i] = Base32[bits & 31];
+        bits >>= 5;
+    }
+    return hash;
+}
+
+uint64_t GeohashBits(double lat, double lon, size_t bits){
+    if(bits > MaxGeohashLength * 5){
+        bits = MaxGeohashLength * 5;
+    }
+    double latLo = -90, latHi = 90;
+    double lonLo = -180, lonHi = 180;
+    uint64_t value = 0;
+    bool even = true;
+    for(size_t i = 0; i < bits; i++){
+        double& lo = even ? lonLo : latLo;
+        double& hi = even ? lonHi : latHi;
+        double v = even ? lon : lat;
+        double mid = (lo + hi) / 2;
+        value <<= 1;
+        if(v >= mid){
+            value |= 1;
+            lo = mid;
+        }
+        else{
+            hi = mid;
+        }
+        even = !even;
+    }
+    return value;
+}
+
+bool GeohashDecode(string_view hash, geobox& box){
+    box.minLat = -90;
+    box.maxLat = 90;
+    box.minLon = -180;
+    box.maxLon = 180;
+    bool even = true;
+    for(size_t i = 0; i < hash.size(); i++){
+        int value = Base32Value(hash[i]);
+        if(value < 0){
+            return false;
+        }
+        for(int b = 4; b >= 0; b--){
+            double& lo = even ? box.minLon : box.minLat;
+            double& hi = even ? box.maxLon : box.maxLat;
+            double mid = (lo + hi) / 2;
+            if((value >> b) & 1){
+                lo = mid;
+            }
+            else{
+                hi = mid;
+            }
+            even = !even;
+        }
+    }
+    return true;
+}
+
+double GeoboxDistanceKm(const geobox& box, double lat, double lon){
+    double nearLat = lat < box.minLat ? box.minLat : (lat > box.maxLat ? box.maxLat : lat);
+    double nearLon = lon < box.minLon ? box.minLon : (lon > box.maxLon ? box.maxLon : lon);
+    return spatialgrid::DistanceKm(lat, lon, nearLat, nearLon);
+}
@@ -0,0 +1,29 @@
+#ifndef GEOHASH_H
+#define GEOHASH_H
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+// Standard base32 geohashes. Each character halves the cell five more
+// times, alternating longitude and latitude, so every prefix of a hash is
+// the cell that contains it; a region is just a prefix.
+struct geobox{
+    double minLat, maxLat;
+    double minLon, maxLon;
+};
+
+static const size_t MaxGeohashLength = 12;
+
+// precision characters, at most MaxGeohashLength
+string GeohashEncode(double lat, double lon, size_t precision);
+// the first bits bits of the hash as a number (at most 5 *
+// MaxGeohashLength); cheaper than GeohashEncode when only cell identity
+// matters
+uint64_t GeohashBits(double lat, double lon, size_t bits);
+// false if hash holds a character that isn't geohash base32
+bool GeohashDecode(string_view hash, geobox& box);
+// from (lat, lon) to the nearest point of box; 0 inside it
+double GeoboxDistanceKm(const geobox& box, double lat, double lon);
+#endif
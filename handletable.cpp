@@ -0,0 +1,85 @@
+#include "handletable.h"
+
+const uint32_t handletable::NoEntry;
+
+handletable::handletable(){
+    FreeHead = NoEntry;
+}
+
+recordhandle handletable::Push(){
+    uint32_t e;
+    if(FreeHead != NoEntry){
+        e = FreeHead;
+        FreeHead = Entries[e].slot;
+    }
+    else{
+        e = static_cast<uint32_t>(Entries.size());
+        entry fresh;
+        // generation 0 is NoHandle's
+        fresh.generation = 1;
+        Entries.push_back(fresh);
+    }
+    Entries[e].slot = static_cast<uint32_t>(EntryOf.size());
+    EntryOf.push_back(e);
+    recordhandle h;
+    h.index = e;
+    h.generation = Entries[e].generation;
+    return h;
+}
+
+void handletable::Erase(size_t slot){
+    uint32_t e = EntryOf[slot];
+    Entries[e].generation = Entries[e].generation == 0xFFFFFFFFu ? 1 : Entries[e].generation + 1;
+    Entries[e].slot = FreeHead;
+    FreeHead = e;
+    size_t last = EntryOf.size() - 1;
+    if(slot != last){
+        EntryOf[slot] = EntryOf[last];
+        Entries[EntryOf[slot]].slot = static_cast<uint32_t>(slot);
+    }
+    EntryOf.pop_back();
+}
+
+size_t handletable::Resolve(recordhandle h) const{
+    if(h.index >= Entries.size() || Entries[h.index].generation != h.generation){
+        return npos;
+    }
+    uint32_t slot = Entries[h.index].slot;
+    // a freed entry holds a free list link, which may look like any slot;
+    // only a live one points back at itself
+    if(slot >= EntryOf.size() || EntryOf[slot] != h.index){
+        return npos;
+    }
+    return slot;
+}
+
+recordhandle handletable::At(size_t slot) const{
+    if(slot >= EntryOf.size()){
+        return NoHandle;
+    }
+    recordhandle h;
+    h.index = EntryOf[slot];
+    h.generation = Entries[h.index].generation;
+    return h;
+}
+
+size_t handletable::Size() const{
+    return EntryOf.size();
+}
+
+void handletable::Reserve(size_t slots){
+    Entries.reserve(slots);
+    EntryOf.reserve(slots);
+}
+
+void handletable::Clear(){
+    // keep the entries so their generations move on; a plain clear would
+    // let old handles resolve to the next records pushed
+    FreeHead = NoEntry;
+    for(size_t i = Entries.size(); i-- > 0; ){
+        Entries[i].generation = Entries[i].generation == 0xFFFFFFFFu ? 1 : Entries[i].generation + 1;
+        Entries[i].slot = FreeHead;
+        FreeHead = static_cast<uint32_t>(i);
+    }
+    EntryOf.clear();
+}
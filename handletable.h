@@ -0,0 +1,62 @@
+#ifndef HANDLETABLE_H
+#define HANDLETABLE_H
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+// Names one record of a collection for as long as it exists. Slots move
+// when a delete swaps the last record into the hole; handles don't, and a
+// handle to a deleted record stops resolving (its generation is gone) even
+// once the entry is reused.
+struct recordhandle{
+    uint32_t index;
+    uint32_t generation;
+};
+
+// never resolves
+const recordhandle NoHandle = {0, 0};
+
+inline bool operator==(recordhandle a, recordhandle b){
+    return a.index == b.index && a.generation == b.generation;
+}
+
+inline bool operator!=(recordhandle a, recordhandle b){
+    return !(a == b);
+}
+
+// Handle entries for a swap-and-pop column store. The owner mirrors every
+// change to its columns: Push() for a new last slot, Erase(slot) for a
+// delete that moves the last slot into slot. Both are O(1), and so is
+// Resolve: one array read and a generation compare, no hashing.
+class handletable{
+    private:
+    static const uint32_t NoEntry = 0xFFFFFFFFu;
+
+    struct entry{
+        uint32_t slot;       // or the next free entry while unused
+        uint32_t generation; // bumped whenever the entry is freed
+    };
+
+    vector<entry> Entries;
+    // slot -> entry
+    vector<uint32_t> EntryOf;
+    uint32_t FreeHead;
+
+    public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    handletable();
+    // a handle for the slot after the current last one
+    recordhandle Push();
+    // retires slot's handle, then moves the last slot's handle to slot
+    void Erase(size_t slot);
+    // the slot h names, or npos if its record is gone
+    size_t Resolve(recordhandle h) const;
+    recordhandle At(size_t slot) const;
+    size_t Size() const;
+    void Reserve(size_t slots);
+    // every outstanding handle stops resolving
+    void Clear();
+};
+#endif
@@ -0,0 +1,666 @@
+#include "importer.h"
+#include "mappedfile.h"
+#include "payment.h"
+#include "capability.h"
+#include "fieldparse.h"
+#include "spatialgrid.h"
+#include <string_view>
+#include <charconv>
+#include <deque>
+#include <cstring>
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+
+// one field of the current row; text points into the mapped file unless the
+// value had escapes, in which case it points into the reader's scratch space
+struct fieldvalue{
+    string_view text;
+    bool present;
+};
+
+enum driverfield{
+    DF_ID, DF_NAME, DF_CAPACITY, DF_HANDICAP, DF_TYPE, DF_RATING,
+    DF_AVAILABLE, DF_PETS, DF_NOTES, DF_LAT, DF_LON, DF_COUNT
+};
+const char* DriverFieldNames[DF_COUNT] = {
+    "id", "name", "capacity", "handicap", "type", "rating",
+    "available", "pets", "notes", "lat", "lon"
+};
+
+enum passengerfield{
+    PF_NAME, PF_ID, PF_PAYMENT, PF_HANDICAP, PF_RATING, PF_PETS, PF_COUNT
+};
+const char* PassengerFieldNames[PF_COUNT] = {
+    "name", "id", "payment", "handicap", "rating", "pets"
+};
+
+int FieldIndex(const char* const* names, int count, string_view name){
+    for(int i = 0; i < count; i++){
+        if(name == names[i]){
+            return i;
+        }
+    }
+    return -1;
+}
+
+void AppendUtf8(string& out, unsigned cp){
+    if(cp < 0x80){
+        out += static_cast<char>(cp);
+    }
+    else if(cp < 0x800){
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    else{
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// Splits the mapped buffer into rows and fills one fieldvalue per schema
+// field. Nothing is copied unless a value contains escapes.
+class rowreader{
+    private:
+    const char* Data;
+    size_t Length;
+    size_t Offset;
+    size_t Line;
+    bool Json;
+    const char* const* Names;
+    int Count;
+    vector<int> CsvColumns; // csv column -> schema field, -1 if ignored
+    // unescaped copies of values that had escapes; a deque so views handed
+    // out earlier stay valid for the whole import
+    deque<string> Scratch;
+
+    string& NextScratch(){
+        Scratch.push_back(string());
+        return Scratch.back();
+    }
+
+    bool ParseCsv(string_view line, vector<fieldvalue>& row, string& error){
+        size_t col = 0;
+        size_t i = 0;
+        while(true){
+            string_view value;
+            if(i < line.size() && line[i] == '"'){
+                size_t start = ++i;
+                bool escaped = false;
+                while(true){
+                    if(i >= line.size()){
+                        error = "unterminated quoted field";
+                        return false;
+                    }
+                    if(line[i] == '"'){
+                        if(i + 1 < line.size() && line[i + 1] == '"'){
+                            escaped = true;
+                            i += 2;
+                            continue;
+                        }
+                        break;
+                    }
+                    i++;
+                }
+                value = line.substr(start, i - start);
+                i++;
+                if(escaped){
+                    string& s = NextScratch();
+                    for(size_t j = 0; j < value.size(); j++){
+                        s += value[j];
+                        if(value[j] == '"'){
+                            j++;
+                        }
+                    }
+                    value = s;
+                }
+                while(i < line.size() && line[i] != ','){
+                    i++;
+                }
+            }
+            else{
+                size_t start = i;
+                while(i < line.size() && line[i] != ','){
+                    i++;
+                }
+                value = Trim(line.substr(start, i - start));
+            }
+            if(col < CsvColumns.size() && CsvColumns[col] >= 0){
+                row[CsvColumns[col]].text = value;
+                row[CsvColumns[col]].present = true;
+            }
+            col++;
+            if(i >= line.size()){
+                break;
+            }
+            i++; // comma
+        }
+        return true;
+    }
+
+    bool ParseJsonString(string_view line, size_t& i, string_view& out){
+        // i is on the opening quote
+        size_t start = ++i;
+        bool escaped = false;
+        while(i < line.size() && line[i] != '"'){
+            if(line[i] == '\\'){
+                escaped = true;
+                i++;
+            }
+            i++;
+        }
+        if(i >= line.size()){
+            return false;
+        }
+        out = line.substr(start, i - start);
+        i++;
+        if(!escaped){
+            return true;
+        }
+        string& s = NextScratch();
+        for(size_t j = 0; j < out.size(); j++){
+            if(out[j] != '\\' || j + 1 >= out.size()){
+                s += out[j];
+                continue;
+            }
+            char c = out[++j];
+            switch(c){
+                case 'n': s += '\n'; break;
+                case 't': s += '\t'; break;
+                case 'r': s += '\r'; break;
+                case 'b': s += '\b'; break;
+                case 'f': s += '\f'; break;
+                case 'u':{
+                    unsigned cp = 0;
+                    if(j + 4 < out.size() &&
+                       from_chars(out.data() + j + 1, out.data() + j + 5, cp, 16).ptr == out.data() + j + 5){
+                        AppendUtf8(s, cp);
+                        j += 4;
+                    }
+                    break;
+                }
+                default: s += c; break;
+            }
+        }
+        out = s;
+        return true;
+    }
+
+    bool ParseJson(string_view line, vector<fieldvalue>& row, string& error){
+        size_t i = 0;
+        error = "malformed JSON object";
+        if(line.empty() || line[0] != '{'){
+            return false;
+        }
+        i = 1;
+        while(true){
+            while(i < line.size() && (line[i] == ' ' || line[i] == '\t')){
+                i++;
+            }
+            if(i < line.size() && line[i] == '}'){
+                return true;
+            }
+            string_view key;
+            if(i >= line.size() || line[i] != '"' || !ParseJsonString(line, i, key)){
+                return false;
+            }
+            while(i < line.size() && line[i] == ' '){
+                i++;
+            }
+            if(i >= line.size() || line[i] != ':'){
+                return false;
+            }
+            i++;
+            while(i < line.size() && line[i] == ' '){
+                i++;
+            }
+            string_view value;
+            bool isNull = false;
+            if(i < line.size() && line[i] == '"'){
+                if(!ParseJsonString(line, i, value)){
+                    return false;
+                }
+            }
+            else{
+                size_t start = i;
+                while(i < line.size() && line[i] != ',' && line[i] != '}'){
+                    i++;
+                }
+                value = Trim(line.substr(start, i - start));
+                isNull = value == "null";
+                if(value.empty()){
+                    return false;
+                }
+            }
+            int f = FieldIndex(Names, Count, key);
+            if(f >= 0 && !isNull){
+                row[f].text = value;
+                row[f].present = true;
+            }
+            while(i < line.size() && line[i] == ' '){
+                i++;
+            }
+            if(i >= line.size()){
+                return false;
+            }
+            if(line[i] == ','){
+                i++;
+            }
+            else if(line[i] != '}'){
+                return false;
+            }
+        }
+    }
+
+    public:
+    rowreader(const char* data, size_t length, bool json, const char* const* names, int count){
+        Data = data;
+        Length = length;
+        Offset = 0;
+        Line = 0;
+        Json = json;
+        Names = names;
+        Count = count;
+    }
+
+    // reads the CSV header; false if the file has none
+    bool ReadHeader(string& error){
+        if(Json){
+            return true;
+        }
+        string_view line;
+        if(!NextLine(line)){
+            error = "missing header row";
+            return false;
+        }
+        size_t i = 0;
+        while(true){
+            size_t start = i;
+            while(i < line.size() && line[i] != ','){
+                i++;
+            }
+            string_view name = Trim(line.substr(start, i - start));
+            if(name.size() >= 2 && name.front() == '"' && name.back() == '"'){
+                name = name.substr(1, name.size() - 2);
+            }
+            CsvColumns.push_back(FieldIndex(Names, Count, name));
+            if(i >= line.size()){
+                break;
+            }
+            i++;
+        }
+        return true;
+    }
+
+    // next non-blank line, without the terminator
+    bool NextLine(string_view& line){
+        while(Offset < Length){
+            const char* start = Data + Offset;
+            const char* nl = static_cast<const char*>(memchr(start, '\n', Length - Offset));
+            size_t len = nl ? static_cast<size_t>(nl - start) : Length - Offset;
+            Offset += len + (nl ? 1 : 0);
+            Line++;
+            line = Trim(string_view(start, len));
+            if(!line.empty()){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t GetLine() const{
+        return Line;
+    }
+
+    // false at end of input; ok is false if the row could not be split
+    bool Next(vector<fieldvalue>& row, bool& ok, string& error){
+        string_view line;
+        if(!NextLine(line)){
+            return false;
+        }
+        for(int i = 0; i < Count; i++){
+            row[i].present = false;
+            row[i].text = string_view();
+        }
+        ok = Json ? ParseJson(line, row, error) : ParseCsv(line, row, error);
+        return true;
+    }
+
+    size_t LineEstimate() const{
+        size_t n = 0;
+        const char* p = Data;
+        const char* end = Data + Length;
+        while(p < end && (p = static_cast<const char*>(memchr(p, '\n', end - p))) != 0){
+            n++;
+            p++;
+        }
+        return n + 1;
+    }
+};
+
+bool IsJsonFile(const string& path, const mappedfile& file, importformat format){
+    if(format != IF_AUTO){
+        return format == IF_JSONL;
+    }
+    size_t dot = path.rfind('.');
+    if(dot != string::npos){
+        string ext = path.substr(dot);
+        if(ext == ".jsonl" || ext == ".json" || ext == ".ndjson"){
+            return true;
+        }
+        if(ext == ".csv"){
+            return false;
+        }
+    }
+    for(size_t i = 0; i < file.GetLength(); i++){
+        char c = file.GetData()[i];
+        if(c != ' ' && c != '\t' && c != '\r' && c != '\n'){
+            return c == '{';
+        }
+    }
+    return false;
+}
+
+void AddError(importresult& r, size_t line, const string& message){
+    importerror e;
+    e.line = line;
+    e.message = message;
+    r.errors.push_back(e);
+}
+
+bool ErrorBefore(const importerror& a, const importerror& b){
+    return a.line < b.line;
+}
+
+// stage 1 and 3 report separately, put them back in file order
+void SortErrors(importresult& r){
+    stable_sort(r.errors.begin(), r.errors.end(), ErrorBefore);
+}
+
+bool RequireField(const fieldvalue& f, const char* name, size_t line, importresult& r){
+    if(!f.present){
+        AddError(r, line, string("missing field '") + name + "'");
+        return false;
+    }
+    return true;
+}
+
+}
+
+importresult ImportDrivers(const string& path, drivers& list, importformat format){
+    importresult result;
+    result.opened = false;
+    result.rows = 0;
+    result.imported = 0;
+    mappedfile file;
+    if(!file.Open(path)){
+        return result;
+    }
+    result.opened = true;
+    rowreader reader(file.GetData(), file.GetLength(), IsJsonFile(path, file, format), DriverFieldNames, DF_COUNT);
+    string error;
+    if(!reader.ReadHeader(error)){
+        AddError(result, 1, error);
+        return result;
+    }
+
+    // stage 1: tokenize into columns; strings stay as views into the file
+    size_t estimate = reader.LineEstimate();
+    vector<size_t> lines;
+    vector<int> ids;
+    vector<int> capacities;
+    vector<float> ratings;
+    vector<int> types;
+    vector<uint8_t> flags; // handicap | available << 1 | pets << 2
+    vector<double> lats;
+    vector<double> lons;
+    vector<string_view> names;
+    vector<string_view> typeNames;
+    vector<string_view> notes;
+    vector<uint8_t> parsed;
+    lines.reserve(estimate);
+    ids.reserve(estimate);
+    capacities.reserve(estimate);
+    ratings.reserve(estimate);
+    types.reserve(estimate);
+    flags.reserve(estimate);
+    lats.reserve(estimate);
+    lons.reserve(estimate);
+    names.reserve(estimate);
+    typeNames.reserve(estimate);
+    notes.reserve(estimate);
+    parsed.reserve(estimate);
+
+    vector<fieldvalue> row(DF_COUNT);
+    bool ok;
+    while(reader.Next(row, ok, error)){
+        size_t line = reader.GetLine();
+        result.rows++;
+        if(!ok){
+            AddError(result, line, error);
+            continue;
+        }
+        bool good = true;
+        for(int f = DF_ID; f <= DF_PETS; f++){
+            good = RequireField(row[f], DriverFieldNames[f], line, result) && good;
+        }
+        if(!good){
+            continue;
+        }
+        int id = 0, capacity = 0;
+        float rating = 0;
+        double lat = 0, lon = 0;
+        int handicap = ParseBool(row[DF_HANDICAP].text);
+        int available = ParseBool(row[DF_AVAILABLE].text);
+        int pets = ParseBool(row[DF_PETS].text);
+        if(!ParseInt(row[DF_ID].text, id)){
+            AddError(result, line, "id is not an integer");
+            continue;
+        }
+        if(!ParseInt(row[DF_CAPACITY].text, capacity) || capacity < 0){
+            AddError(result, line, "capacity is not a non-negative integer");
+            continue;
+        }
+        if(!ParseFloat(row[DF_RATING].text, rating)){
+            AddError(result, line, "rating is not a number");
+            continue;
+        }
+        if(handicap < 0 || available < 0 || pets < 0){
+            AddError(result, line, "handicap, available and pets must be yes or no");
+            continue;
+        }
+        if((row[DF_LAT].present && !ParseDouble(row[DF_LAT].text, lat)) ||
+           (row[DF_LON].present && !ParseDouble(row[DF_LON].text, lon))){
+            AddError(result, line, "lat/lon is not a number");
+            continue;
+        }
+        lines.push_back(line);
+        ids.push_back(id);
+        capacities.push_back(capacity);
+        ratings.push_back(rating);
+        types.push_back(ParseVehicleType(row[DF_TYPE].text));
+        flags.push_back(static_cast<uint8_t>(handicap | (available << 1) | (pets << 2)));
+        lats.push_back(lat);
+        lons.push_back(lon);
+        names.push_back(row[DF_NAME].text);
+        typeNames.push_back(row[DF_TYPE].text);
+        notes.push_back(row[DF_NOTES].text);
+    }
+
+    // stage 2: range/vocabulary checks as straight loops over the columns
+    size_t n = ids.size();
+    parsed.assign(n, 1);
+    const float* r = ratings.data();
+    const int* t = types.data();
+    uint8_t* p = parsed.data();
+    for(size_t i = 0; i < n; i++){
+        p[i] = (r[i] >= 1.0f) & (r[i] <= 5.0f);
+    }
+    for(size_t i = 0; i < n; i++){
+        p[i] |= static_cast<uint8_t>((t[i] < 0) << 1);
+    }
+    const double* la = lats.data();
+    const double* lo = lons.data();
+    for(size_t i = 0; i < n; i++){
+        p[i] |= static_cast<uint8_t>(!spatialgrid::ValidPosition(la[i], lo[i]) << 2);
+    }
+
+    // stage 3: bulk insert the rows that passed
+    list.Reserve(list.Size() + n);
+    for(size_t i = 0; i < n; i++){
+        if(p[i] != 1){
+            if((p[i] & 1) == 0){
+                AddError(result, lines[i], "rating must be between 1 and 5");
+            }
+            if(p[i] & 2){
+                AddError(result, lines[i], "vehicle type '" + string(typeNames[i]) +
+                         "' is not one of compact, 2dr, sedan, 4dr, SUV, van, other");
+            }
+            if(p[i] & 4){
+                AddError(result, lines[i], "lat/lon must be finite, lat in [-90, 90] and lon in [-180, 180]");
+            }
+            continue;
+        }
+        if(!list.Emplace(ids[i], names[i], capacities[i], flags[i] & 1, typeNames[i], ratings[i],
+                         (flags[i] >> 1) & 1, (flags[i] >> 2) & 1, notes[i], lats[i], lons[i])){
+            AddError(result, lines[i], "duplicate driver id " + to_string(ids[i]));
+            continue;
+        }
+        result.imported++;
+    }
+    SortErrors(result);
+    return result;
+}
+
+importresult ImportPassengers(const string& path, passengers& list, importformat format){
+    importresult result;
+    result.opened = false;
+    result.rows = 0;
+    result.imported = 0;
+    mappedfile file;
+    if(!file.Open(path)){
+        return result;
+    }
+    result.opened = true;
+    rowreader reader(file.GetData(), file.GetLength(), IsJsonFile(path, file, format), PassengerFieldNames, PF_COUNT);
+    string error;
+    if(!reader.ReadHeader(error)){
+        AddError(result, 1, error);
+        return result;
+    }
+
+    // stage 1: tokenize into columns
+    size_t estimate = reader.LineEstimate();
+    vector<size_t> lines;
+    vector<int> ids;
+    vector<float> ratings;
+    vector<int> methods;
+    vector<uint8_t> flags; // handicap | pets << 1
+    vector<string_view> names;
+    vector<string_view> methodNames;
+    vector<uint8_t> parsed;
+    lines.reserve(estimate);
+    ids.reserve(estimate);
+    ratings.reserve(estimate);
+    methods.reserve(estimate);
+    flags.reserve(estimate);
+    names.reserve(estimate);
+    methodNames.reserve(estimate);
+
+    vector<fieldvalue> row(PF_COUNT);
+    bool ok;
+    while(reader.Next(row, ok, error)){
+        size_t line = reader.GetLine();
+        result.rows++;
+        if(!ok){
+            AddError(result, line, error);
+            continue;
+        }
+        bool good = true;
+        for(int f = 0; f < PF_COUNT; f++){
+            good = RequireField(row[f], PassengerFieldNames[f], line, result) && good;
+        }
+        if(!good){
+            continue;
+        }
+        int id = 0;
+        float rating = 0;
+        int handicap = ParseBool(row[PF_HANDICAP].text);
+        int pets = ParseBool(row[PF_PETS].text);
+        if(!ParseInt(row[PF_ID].text, id)){
+            AddError(result, line, "id is not an integer");
+            continue;
+        }
+        if(!ParseFloat(row[PF_RATING].text, rating)){
+            AddError(result, line, "rating is not a number");
+            continue;
+        }
+        if(handicap < 0 || pets < 0){
+            AddError(result, line, "handicap and pets must be yes or no");
+            continue;
+        }
+        lines.push_back(line);
+        ids.push_back(id);
+        ratings.push_back(rating);
+        methods.push_back(ParsePaymentMethod(row[PF_PAYMENT].text));
+        flags.push_back(static_cast<uint8_t>(handicap | (pets << 1)));
+        names.push_back(row[PF_NAME].text);
+        methodNames.push_back(row[PF_PAYMENT].text);
+    }
+
+    // stage 2: range/vocabulary checks as straight loops over the columns
+    size_t n = ids.size();
+    parsed.assign(n, 1);
+    const float* r = ratings.data();
+    const int* m = methods.data();
+    uint8_t* p = parsed.data();
+    for(size_t i = 0; i < n; i++){
+        p[i] = (r[i] >= 1.0f) & (r[i] <= 5.0f);
+    }
+    for(size_t i = 0; i < n; i++){
+        p[i] |= static_cast<uint8_t>((m[i] < 0) << 1);
+    }
+
+    // stage 3: bulk insert the rows that passed
+    list.Reserve(list.Size() + n);
+    for(size_t i = 0; i < n; i++){
+        if(p[i] != 1){
+            if((p[i] & 1) == 0){
+                AddError(result, lines[i], "rating must be between 1 and 5");
+            }
+            if(p[i] & 2){
+                AddError(result, lines[i], "payment method '" + string(methodNames[i]) +
+                         "' is not one of cash, card, debit");
+            }
+            continue;
+        }
+        if(!list.Emplace(names[i], ids[i], methodNames[i], flags[i] & 1, ratings[i], (flags[i] >> 1) & 1)){
+            AddError(result, lines[i], "duplicate passenger id " + to_string(ids[i]));
+            continue;
+        }
+        result.imported++;
+    }
+    SortErrors(result);
+    return result;
+}
+
+void PrintImportResult(const importresult& r, ostream& out){
+    if(!r.opened){
+        out << "Could not open file\n";
+        return;
+    }
+    out << "Imported " << r.imported << " of " << r.rows << " rows";
+    if(!r.errors.empty()){
+        out << ", " << r.errors.size() << " errors";
+    }
+    out << "\n";
+    size_t shown = r.errors.size() < 20 ? r.errors.size() : 20;
+    for(size_t i = 0; i < shown; i++){
+        out << "  line " << r.errors[i].line << ": " << r.errors[i].message << "\n";
+    }
+    if(shown < r.errors.size()){
+        out << "  ...\n";
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef IMPORTER_H
+#define IMPORTER_H
+#include <string>
+#include <vector>
+#include <cstddef>
+using namespace std;
+
+#include "drivers.h"
+#include "passengers.h"
+
+// Batch import of CSV (with a header row) or JSONL (one flat object per line).
+//
+// drivers:    id,name,capacity,handicap,type,rating,available,pets,notes[,lat,lon]
+// passengers: name,id,payment,handicap,rating,pets
+//
+// Booleans may be yes/no, true/false or 1/0. Bad rows are reported with
+// their line number and skipped; the rest of the file is still imported.
+enum importformat{
+    IF_AUTO,  // by extension, then by the first character of the file
+    IF_CSV,
+    IF_JSONL
+};
+
+struct importerror{
+    size_t line;
+    string message;
+};
+
+struct importresult{
+    bool opened;
+    size_t rows;
+    size_t imported;
+    vector<importerror> errors;
+};
+
+importresult ImportDrivers(const string& path, drivers& list, importformat format = IF_AUTO);
+importresult ImportPassengers(const string& path, passengers& list, importformat format = IF_AUTO);
+// prints the summary and the first few errors
+void PrintImportResult(const importresult& r, ostream& out);
+
+#endif
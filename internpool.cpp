@@ -0,0 +1,34 @@
+#include "internpool.h"
+
+uint16_t internpool::Intern(string_view s){
+    int id = Find(s);
+    if(id >= 0){
+        return static_cast<uint16_t>(id);
+    }
+    if(Names.size() > 0xFFFF){
+        // out of ids; share the last one rather than failing the insert
+        return 0xFFFF;
+    }
+    Names.push_back(string(s));
+    return static_cast<uint16_t>(Names.size() - 1);
+}
+
+int internpool::Find(string_view s) const{
+    for(size_t i = 0; i < Names.size(); i++){
+        if(Names[i] == s){
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+string_view internpool::Name(uint16_t id) const{
+    if(id >= Names.size()){
+        return string_view();
+    }
+    return Names[id];
+}
+
+size_t internpool::Size() const{
+    return Names.size();
+}
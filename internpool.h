@@ -0,0 +1,27 @@
+#ifndef INTERNPOOL_H
+#define INTERNPOOL_H
+#include <deque>
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+// Maps the handful of distinct values a field takes (vehicle types, payment
+// methods) to small ids. Owners intern the known vocabulary first, in enum
+// order, so those ids match the vehicletype/paymentmethod enums; anything
+// else typed in still gets an id of its own instead of being lost. Lookup
+// is a linear scan, which is the fastest option at these sizes.
+class internpool{
+    private:
+    // deque so the views handed out by Name() stay valid as it grows
+    deque<string> Names;
+
+    public:
+    uint16_t Intern(string_view s);
+    // -1 if s has never been interned
+    int Find(string_view s) const;
+    string_view Name(uint16_t id) const;
+    size_t Size() const;
+};
+#endif
@@ -0,0 +1,97 @@
+#include "locationfeed.h"
+#include "metrics.h"
+
+locationfeed::locationfeed(drivers& d, size_t capacity)
+    : Drivers(d){
+    size_t n = 2;
+    while(n < capacity){
+        n <<= 1;
+    }
+    Cells.reset(new cell[n]);
+    for(size_t i = 0; i < n; i++){
+        Cells[i].sequence.store(i, memory_order_relaxed);
+    }
+    Mask = n - 1;
+    Tail.store(0, memory_order_relaxed);
+    Head = 0;
+    Dropped.store(0, memory_order_relaxed);
+    Stats = feedstats();
+}
+
+bool locationfeed::Push(int id, double lat, double lon){
+    size_t pos = Tail.load(memory_order_relaxed);
+    cell* c;
+    for(;;){
+        c = &Cells[pos & Mask];
+        size_t seq = c->sequence.load(memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if(diff == 0){
+            // the cell is free for this lap; claim it
+            if(Tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)){
+                break;
+            }
+        }
+        else if(diff < 0){
+            // the consumer hasn't freed this cell from the last lap yet
+            Dropped.fetch_add(1, memory_order_relaxed);
+            return false;
+        }
+        else{
+            pos = Tail.load(memory_order_relaxed);
+        }
+    }
+    c->update.id = id;
+    c->update.lat = lat;
+    c->update.lon = lon;
+    c->sequence.store(pos + 1, memory_order_release);
+    return true;
+}
+
+bool locationfeed::Pop(locationupdate& u){
+    cell& c = Cells[Head & Mask];
+    if(c.sequence.load(memory_order_acquire) != Head + 1){
+        // empty, or the producer that claimed this cell is still writing
+        return false;
+    }
+    u = c.update;
+    c.sequence.store(Head + Mask + 1, memory_order_release);
+    Head++;
+    return true;
+}
+
+size_t locationfeed::Apply(){
+    METRIC_TIMER(M_FEED_APPLY);
+    // only what was queued when the tick started, so busy producers can't
+    // keep one tick going forever
+    size_t limit = Tail.load(memory_order_acquire) - Head;
+    Batch.clear();
+    Latest.clear();
+    locationupdate u;
+    for(size_t i = 0; i < limit && Pop(u); i++){
+        Stats.received++;
+        pair<unordered_map<int, size_t>::iterator, bool> at = Latest.insert(make_pair(u.id, Batch.size()));
+        if(at.second){
+            Batch.push_back(u);
+        }
+        else{
+            // pings from one producer arrive in order; keep the newest
+            Batch[at.first->second] = u;
+            Stats.coalesced++;
+        }
+    }
+    size_t applied = Batch.empty() ? 0 : Drivers.SetLocations(Batch.data(), Batch.size());
+    Stats.applied += applied;
+    Stats.unknown += Batch.size() - applied;
+    Stats.ticks++;
+    return applied;
+}
+
+size_t locationfeed::Pending() const{
+    return Tail.load(memory_order_relaxed) - Head;
+}
+
+feedstats locationfeed::GetStats() const{
+    feedstats s = Stats;
+    s.dropped = Dropped.load(memory_order_relaxed);
+    return s;
+}
@@ -0,0 +1,68 @@
+#ifndef LOCATIONFEED_H
+#define LOCATIONFEED_H
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+#include "drivers.h"
+
+struct feedstats{
+    uint64_t received;   // pings drained from the queue
+    uint64_t dropped;    // pings refused because the queue was full
+    uint64_t coalesced;  // pings replaced by a later one for the same driver
+    uint64_t applied;    // positions written to the registry
+    uint64_t unknown;    // pings for ids the registry doesn't have
+    uint64_t ticks;
+};
+
+// Ingestion stage for GPS pings. Any number of threads Push into a bounded
+// lock-free queue; one thread calls Apply() once per tick, which drains
+// the queue, keeps only the latest ping per driver and hands the survivors
+// to drivers::SetLocations in one batch (one grid update and one log record
+// per driver per tick, however often it pinged).
+//
+// The queue is the bounded ring of Vyukov's MPMC design with a single
+// consumer: a producer claims a cell with one CAS on Tail and publishes it
+// through the cell's sequence number, so producers never wait on each other
+// or on the consumer. When the ring is full Push drops the ping rather than
+// block; the driver's next ping supersedes it anyway.
+class locationfeed{
+    private:
+    struct cell{
+        atomic<size_t> sequence;
+        locationupdate update;
+    };
+
+    drivers& Drivers;
+    unique_ptr<cell[]> Cells;
+    size_t Mask;
+    alignas(64) atomic<size_t> Tail;   // next cell a producer claims
+    alignas(64) size_t Head;           // consumer only
+    atomic<uint64_t> Dropped;
+    // consumer side, reused between ticks
+    vector<locationupdate> Batch;
+    unordered_map<int, size_t> Latest;  // id -> index in Batch
+    feedstats Stats;
+
+    locationfeed(const locationfeed&);
+    locationfeed& operator=(const locationfeed&);
+    bool Pop(locationupdate& u);
+
+    public:
+    // capacity is rounded up to a power of two
+    explicit locationfeed(drivers& d, size_t capacity = 1 << 16);
+    // safe from any thread; false if the queue was full and the ping dropped
+    bool Push(int id, double lat, double lon);
+    // single consumer: applies everything queued so far; returns the
+    // number of positions written
+    size_t Apply();
+    // pings waiting for the next Apply (approximate while producers run)
+    size_t Pending() const;
+    // consumer side counters; dropped is read from the producers' counter
+    feedstats GetStats() const;
+};
+#endif
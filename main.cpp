@@ -2,7 +2,22 @@
 #include <iomanip>
 #include "passengers.h"
 #include "drivers.h"
-// #include "riders.h"
+#include "rides.h"
+#include "importer.h"
+#include "dispatcher.h"
+#include "ridearchive.h"
+#include "registrystore.h"
+#include "report.h"
+#include "batch.h"
+#include "server.h"
+#include "shardrouter.h"
+#include "metrics.h"
+#include "capability.h"
+#include "payment.h"
+#include <cstring>
+#include <limits>
+#include <cstdlib>
+#include <csignal>
 
 using namespace std;
 
@@ -14,18 +29,31 @@ void PrintMenu(){
     cout << "F - Find\n";
     cout << "S - Print Single Entity\n";
     cout << "P - Print All Entries in Collection\n";
+    cout << "I - Import CSV/JSONL File\n";
+    cout << "M - Match Requested Rides to Drivers\n";
+    cout << "X - Export Collection to File\n";
 
 
 }
 
-void ExecuteMenu(char option, drivers& ListOfDrivers, passengers& ListOfPassengers){
+// stdin is gone for good (closed or broken); the prompt loops give up on
+// this instead of asking forever
+static bool InputClosed(){
+    return cin.eof() || cin.bad();
+}
+
+void ExecuteMenu(char option, drivers& ListOfDrivers, passengers& ListOfPassengers, rides& ListOfRides, dispatcher& Dispatch){
+    METRIC_TIMER(M_COMMAND);
 char c = ' ';
 int tempNum = 0;
 string tempStr = " ";
 bool tempBool = 0;
 float tempFloat = 0.0;
+double tempLat = 0.0;
+double tempLon = 0.0;
 driver d;
 passenger p;
+ride r;
 
 
     switch (toupper(option))
@@ -59,7 +87,9 @@ passenger p;
             do{
             cout <<"Handicap Capable, Please Enter yes or no: ";
                 
-                    cin >> tempStr;
+                    if(!(cin >> tempStr)){
+                        return;
+                    }
                     if(tempStr == "yes"){
                         tempBool = true;
                         d.setHandicap(tempBool);
@@ -72,22 +102,32 @@ passenger p;
                         cout << "Please input yes or no";
                     }
             }
-            while(tempStr != "yes" || tempStr != "no");
+            while(tempStr != "yes" && tempStr != "no");
             cin.ignore();
 
             do{
             cout <<"Please enter the veichle type of: compact, 2dr, sedan, 4dr, SUV, van, other";
-                cin >> tempStr;
+                if(!(cin >> tempStr)){
+                    return;
+                }
                 d.setType(tempStr);
                                     
              
             }
-            while(tempStr != "compact" || tempStr != "2dr" || tempStr != "sedan" ||tempStr != "4dr" || tempStr != "SUV" || tempStr != "van" || tempStr != "other");
+            while(ParseVehicleType(tempStr) == VT_ANY);
             cin.ignore();
 
             do{
             cout << "Driver Rating Between 1 and 5: ";
-            cin >> tempFloat;
+            if(!(cin >> tempFloat)){
+                if(InputClosed()){
+                    return;
+                }
+                // not a number: clear the error so the loop can ask again
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                tempFloat = 0;
+            }
             d.setRating(tempFloat);
 
             }
@@ -97,7 +137,9 @@ passenger p;
             do{
             cout <<"Available, Please Enter yes or no: ";
                 
-                    cin >> tempStr;
+                    if(!(cin >> tempStr)){
+                        return;
+                    }
                     if(tempStr == "yes"){
                         tempBool = true;
                         d.setAvailable(tempBool);
@@ -110,13 +152,15 @@ passenger p;
                         cout << "Please input yes or no";
                     }
             }
-            while(tempStr != "yes" || tempStr != "no");
+            while(tempStr != "yes" && tempStr != "no");
             cin.ignore();
 
             do{
             cout <<"Pets Allowed, Please Enter yes or no: ";
                 
-                    cin >> tempStr;
+                    if(!(cin >> tempStr)){
+                        return;
+                    }
                     if(tempStr == "yes"){
                         tempBool = true;
                         d.setPets(tempBool);
@@ -129,7 +173,7 @@ passenger p;
                         cout << "Please input yes or no";
                     }
             }
-            while(tempStr != "yes" || tempStr != "no");
+            while(tempStr != "yes" && tempStr != "no");
             cin.ignore();
 
             cout <<"Important Notes: ";
@@ -158,17 +202,21 @@ passenger p;
 
             do{
             cout << "Enter Payment Method(cash, card, debit): ";
-            cin >> tempStr;
+            if(!(cin >> tempStr)){
+                return;
+            }
             p.setPaymentMethod(tempStr);
             
             }
-            while(tempStr != "cash" || tempStr != "card"|| tempStr != "debit");
+            while(ParsePaymentMethod(tempStr) == PM_UNKNOWN);
             cin.ignore();
 
             do{
             cout <<"Handicapped, Please Enter yes or no: ";
                 
-                    cin >> tempStr;
+                    if(!(cin >> tempStr)){
+                        return;
+                    }
                     if(tempStr == "yes"){
                         tempBool = true;
                         p.setHandicap(tempBool);
@@ -181,12 +229,20 @@ passenger p;
                         cout << "Please input yes or no";
                     }
             }
-            while(tempStr != "yes" || tempStr != "no");
+            while(tempStr != "yes" && tempStr != "no");
             cin.ignore();
 
             do{
             cout << "Passenger Rating Between 1 and 5: ";
-            cin >> tempFloat;
+            if(!(cin >> tempFloat)){
+                if(InputClosed()){
+                    return;
+                }
+                // not a number: clear the error so the loop can ask again
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                tempFloat = 0;
+            }
             p.setRating(tempFloat);
 
             }
@@ -196,7 +252,9 @@ passenger p;
             do{
             cout <<"Pets with you, Please Enter yes or no: ";
                 
-                    cin >> tempStr;
+                    if(!(cin >> tempStr)){
+                        return;
+                    }
                     if(tempStr == "yes"){
                         tempBool = true;
                         p.setPets(tempBool);
@@ -209,22 +267,290 @@ passenger p;
                         cout << "Please input yes or no";
                     }
             }
-            while(tempStr != "yes" || tempStr != "no");
+            while(tempStr != "yes" && tempStr != "no");
             cin.ignore();
 
             ListOfPassengers.Add(p);
             cout <<"\n";
             break;
 
-            // case 'C'     
+            case 'C':
+            cin.ignore();
+
+            cout <<"Enter Passenger ID: ";
+            cin >> tempNum;
+            if(ListOfPassengers.Lookup(tempNum) == passengers::npos){
+                cout << "No passenger with ID " << tempNum << "\n";
+                break;
+            }
+            r.setPassenger(tempNum);
+            cin.ignore();
+
+            cout <<"Pickup Location: ";
+            getline(cin, tempStr);
+            r.setPickUp(tempStr);
+
+            cout <<"Pickup Latitude and Longitude: ";
+            cin >> tempLat >> tempLon;
+            r.setPickUpCoords(tempLat, tempLon);
+            cin.ignore();
+
+            cout <<"Dropoff Location: ";
+            getline(cin, tempStr);
+            r.setDropoff(tempStr);
+
+            cout <<"Dropoff Latitude and Longitude: ";
+            cin >> tempLat >> tempLon;
+            r.setDropoffCoords(tempLat, tempLon);
+
+            cout <<"Size of Party: ";
+            cin >> tempNum;
+            r.setPartySize(tempNum);
+
+            cout <<"Pets, Please Enter yes or no: ";
+            cin >> tempStr;
+            r.setPets(tempStr == "yes");
+
+            tempNum = ListOfRides.Create(r);
+            cout <<"Ride " << tempNum << " requested\n";
+            break;
            
 
         
         }
         
         break;
-    
-    //case 'E':
+
+    case 'I':
+        cin.ignore();
+        cout << "Choose what list to import into.\n";
+        cout << "A. Drivers\n" << "B. Passengers\n";
+        cin >> c;
+        cin.ignore();
+        cout << "File path: ";
+        getline(cin, tempStr);
+        if(toupper(c) == 'A'){
+            PrintImportResult(ImportDrivers(tempStr, ListOfDrivers), cout);
+        }
+        else if(toupper(c) == 'B'){
+            PrintImportResult(ImportPassengers(tempStr, ListOfPassengers), cout);
+        }
+        break;
+
+    case 'M':
+        Dispatch.Tick();
+        Dispatch.PrintReport(cout);
+        break;
+
+    case 'P':
+        cin.ignore();
+        cout << "Choose what list to print.\n";
+        cout << "A. Drivers\n" << "B. Passengers\n" << "C. Rides\n";
+        cin >> c;
+        if(toupper(c) == 'A'){
+            ListOfDrivers.PrintAll();
+        }
+        else if(toupper(c) == 'B'){
+            ListOfPassengers.PrintAll();
+        }
+        else if(toupper(c) == 'C'){
+            ListOfRides.PrintAll();
+        }
+        break;
+
+    case 'X':{
+        cin.ignore();
+        cout << "Choose what list to export.\n";
+        cout << "A. Drivers\n" << "B. Passengers\n";
+        cin >> c;
+        cout << "Format (text, csv, jsonl): ";
+        cin >> tempStr;
+        int format = ParseReportFormat(tempStr);
+        if(format == RF_UNKNOWN){
+            cout << "Unknown format " << tempStr << "\n";
+            break;
+        }
+        cin.ignore();
+        cout << "File path: ";
+        getline(cin, tempStr);
+        reportwriter out(tempStr);
+        if(!out.IsOpen()){
+            cout << "Could not open " << tempStr << "\n";
+            break;
+        }
+        if(toupper(c) == 'A'){
+            tempNum = ExportDrivers(ListOfDrivers, out, static_cast<reportformat>(format));
+        }
+        else if(toupper(c) == 'B'){
+            tempNum = ExportPassengers(ListOfPassengers, out, static_cast<reportformat>(format));
+        }
+        else{
+            break;
+        }
+        if(out.Flush()){
+            cout << tempNum << " records written\n";
+        }
+        else{
+            cout << "Write to " << tempStr << " failed\n";
+        }
+        break;
+    }
+
+    case 'E':{
+        cin.ignore();
+        cout << "Choose what list to edit.\n";
+        cout << "A. Drivers\n" << "B. Passengers\n";
+        cin >> c;
+        cout << "Enter ID: ";
+        cin >> tempNum;
+        cin.ignore();
+        // the handle keeps naming the record however the slots move
+        if(toupper(c) == 'A'){
+            recordhandle h = ListOfDrivers.Handle(tempNum);
+            if(h == NoHandle){
+                cout << "No driver with ID " << tempNum << "\n";
+                break;
+            }
+            d = ListOfDrivers.At(ListOfDrivers.Resolve(h));
+            cout << "Field to change (name, capacity, type, rating, notes, location): ";
+            cin >> tempStr;
+            cin.ignore();
+            if(tempStr == "name"){
+                cout << "Enter Name: ";
+                getline(cin, tempStr);
+                d.setName(tempStr);
+            }
+            else if(tempStr == "capacity"){
+                do{
+                cout << "Enter Vehicle Capacity: ";
+                if(!(cin >> tempNum)){
+                    if(InputClosed()){
+                        return;
+                    }
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    tempNum = 0;
+                }
+                }
+                while(tempNum < 1);
+                d.setCapacity(tempNum);
+            }
+            else if(tempStr == "type"){
+                do{
+                cout << "Please enter the veichle type of: compact, 2dr, sedan, 4dr, SUV, van, other";
+                    if(!(cin >> tempStr)){
+                        return;
+                    }
+                }
+                while(ParseVehicleType(tempStr) == VT_ANY);
+                d.setType(tempStr);
+            }
+            else if(tempStr == "rating"){
+                do{
+                cout << "Driver Rating Between 1 and 5: ";
+                if(!(cin >> tempFloat)){
+                    if(InputClosed()){
+                        return;
+                    }
+                    // not a number: clear the error so the loop can ask again
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    tempFloat = 0;
+                }
+                }
+                while(tempFloat < 1 || tempFloat > 5);
+                d.setRating(tempFloat);
+            }
+            else if(tempStr == "notes"){
+                cout << "Important Notes: ";
+                getline(cin, tempStr);
+                d.setNotes(tempStr);
+            }
+            else if(tempStr == "location"){
+                do{
+                cout << "Latitude and Longitude: ";
+                if(!(cin >> tempLat >> tempLon)){
+                    if(InputClosed()){
+                        return;
+                    }
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    tempLat = 100;
+                }
+                }
+                while(tempLat < -90 || tempLat > 90 || tempLon < -180 || tempLon > 180);
+                d.setLocation(tempLat, tempLon);
+            }
+            else{
+                cout << "Unknown field " << tempStr << "\n";
+                break;
+            }
+            cout << (ListOfDrivers.Edit(h, d) ? "Driver updated\n" : "Edit failed\n");
+        }
+        else if(toupper(c) == 'B'){
+            recordhandle h = ListOfPassengers.Handle(tempNum);
+            if(h == NoHandle){
+                cout << "No passenger with ID " << tempNum << "\n";
+                break;
+            }
+            p = ListOfPassengers.At(ListOfPassengers.Resolve(h));
+            cout << "Field to change (name, payment, rating): ";
+            cin >> tempStr;
+            cin.ignore();
+            if(tempStr == "name"){
+                cout << "Enter Name: ";
+                getline(cin, tempStr);
+                p.setName(tempStr);
+            }
+            else if(tempStr == "payment"){
+                do{
+                cout << "Enter Payment Method(cash, card, debit): ";
+                if(!(cin >> tempStr)){
+                    return;
+                }
+                }
+                while(ParsePaymentMethod(tempStr) == PM_UNKNOWN);
+                p.setPaymentMethod(tempStr);
+            }
+            else if(tempStr == "rating"){
+                do{
+                cout << "Passenger Rating Between 1 and 5: ";
+                if(!(cin >> tempFloat)){
+                    if(InputClosed()){
+                        return;
+                    }
+                    // not a number: clear the error so the loop can ask again
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    tempFloat = 0;
+                }
+                }
+                while(tempFloat < 1 || tempFloat > 5);
+                p.setRating(tempFloat);
+            }
+            else{
+                cout << "Unknown field " << tempStr << "\n";
+                break;
+            }
+            cout << (ListOfPassengers.Edit(h, p) ? "Passenger updated\n" : "Edit failed\n");
+        }
+        break;
+    }
+
+    case 'D':
+        cin.ignore();
+        cout << "Choose what list to delete from.\n";
+        cout << "A. Drivers\n" << "B. Passengers\n";
+        cin >> c;
+        cout << "Enter ID: ";
+        cin >> tempNum;
+        if(toupper(c) == 'A'){
+            cout << (ListOfDrivers.Delete(tempNum) ? "Driver deleted\n" : "No such driver\n");
+        }
+        else if(toupper(c) == 'B'){
+            cout << (ListOfPassengers.Delete(tempNum) ? "Passenger deleted\n" : "No such passenger\n");
+        }
+        break;
 
     }
     
@@ -234,29 +560,142 @@ passenger p;
 
 
 
-int main() {
+static requestserver* ActiveServer = 0;
+
+static void StopServer(int){
+    if(ActiveServer != 0){
+        ActiveServer->Stop();
+    }
+}
+
+// --serve [port]: the batch protocol over TCP until SIGINT/SIGTERM
+static int Serve(drivers& d_list, passengers& p_list, int port){
+    rides r_list("Rides List");
+    dispatcher dispatch(d_list, p_list, r_list);
+    registrystore store("registry", d_list, p_list);
+    if(!store.Open()){
+        fprintf(stderr, "could not open the registry log, changes will not be saved\n");
+    }
+    r_list.LoadSnapshot("rides.snap");
+    // finished rides leave the dispatch path for the columnar archive
+    ridearchive archive;
+    archive.Load("rides.archive");
+    dispatch.AttachArchive(&archive);
+    locationfeed feed(d_list);
+    batchexecutor exec(d_list, p_list, r_list, dispatch);
+    exec.AttachFeed(&feed);
+    exec.AttachArchive(&archive);
+    requestserver server(exec);
+    if(!server.Listen("", port)){
+        fprintf(stderr, "could not listen on port %d\n", port);
+        return 1;
+    }
+    fprintf(stderr, "listening on port %d\n", server.Port());
+    ActiveServer = &server;
+    signal(SIGINT, StopServer);
+    signal(SIGTERM, StopServer);
+    // pings queued during a round of events land together
+    server.Run([&]{
+        feed.Apply();
+        store.MaybeCompact();
+    });
+    ActiveServer = 0;
+    feed.Apply();
+    fprintf(stderr, "served %zu requests\n", server.RequestCount());
+    store.Compact();
+    store.Close();
+    r_list.SaveSnapshot("rides.snap");
+    if(!archive.Save("rides.archive")){
+        fprintf(stderr, "could not save the ride archive\n");
+    }
+    return 0;
+}
+
+// --route <deployment file> [port]: front end for --serve shards, see
+// shardrouter.h
+static int Route(const char* path, int port){
+    sharddeployment deployment;
+    if(!LoadDeployment(path, deployment)){
+        fprintf(stderr, "could not read the deployment in %s\n", path);
+        return 1;
+    }
+    shardrouter router(deployment);
+    if(!router.Connect()){
+        fprintf(stderr, "could not reach every shard\n");
+        return 1;
+    }
+    requestserver server([&router](string_view line, reportwriter& out){ return router.Execute(line, out); });
+    if(!server.Listen("", port)){
+        fprintf(stderr, "could not listen on port %d\n", port);
+        return 1;
+    }
+    fprintf(stderr, "routing to %zu shards on port %d\n", router.ShardCount(), server.Port());
+    ActiveServer = &server;
+    signal(SIGINT, StopServer);
+    signal(SIGTERM, StopServer);
+    server.Run();
+    ActiveServer = 0;
+    fprintf(stderr, "routed %zu requests\n", server.RequestCount());
+    return 0;
+}
+
+int main(int argc, char** argv) {
     string name, name2;
 
     char c;
     name = "Passengers List";
     name2 = "Drivers List";
-    
+    bool batch = argc > 1 && (strcmp(argv[1], "--batch") == 0 || strcmp(argv[1], "-b") == 0);
 
-    cout << name <<"\n";
     passengers p_list(name);
     drivers d_list(name2);
+    if(argc > 1 && strcmp(argv[1], "--serve") == 0){
+        return Serve(d_list, p_list, argc > 2 ? atoi(argv[2]) : 7878);
+    }
+    if(argc > 2 && strcmp(argv[1], "--route") == 0){
+        return Route(argv[2], argc > 3 ? atoi(argv[3]) : 7878);
+    }
+    if(batch){
+        // commands on stdin, one response per command on stdout
+        registrystore store("registry", d_list, p_list);
+        if(!store.Open()){
+            fprintf(stderr, "could not open the registry log, changes will not be saved\n");
+        }
+        batchexecutor exec(d_list, p_list);
+        exec.Run(stdin, stdout, [&]{ store.MaybeCompact(); });
+        store.Compact();
+        store.Close();
+        return exec.FailureCount() == 0 ? 0 : 1;
+    }
+
+    cout << name <<"\n";
+    rides r_list("Rides List");
+    dispatcher dispatch(d_list, p_list, r_list);
+    // pick up where the last run left off: snapshot plus log tail
+    registrystore store("registry", d_list, p_list);
+    if(!store.Open()){
+        cout << "Could not open the registry log, changes will not be saved\n";
+    }
+    r_list.LoadSnapshot("rides.snap");
     c = ' ';
 
     PrintMenu();
     while(c != 'q'){
         cout << "Option Choice\n";
-        cin >> c;
-        if (c == 'A' || c == 'd'|| c == 'f'|| c == 'p'){
-            ExecuteMenu(c, d_list, p_list);
+        if(!(cin >> c)){
+            // end of input quits like q, so the state is still saved
+            break;
+        }
+        if (c == 'A' || c == 'd'|| c == 'D'|| c == 'E'|| c == 'e'|| c == 'f'|| c == 'p'|| c == 'P'|| c == 'I'|| c == 'M'|| c == 'X'){
+            ExecuteMenu(c, d_list, p_list, r_list, dispatch);
+            store.MaybeCompact();
             PrintMenu();
         }
 
     }
+    store.Compact();
+    store.Close();
+    r_list.SaveSnapshot("rides.snap");
     return 0;
 }
 
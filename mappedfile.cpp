@@ -0,0 +1,62 @@
+#include "mappedfile.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+mappedfile::mappedfile(){
+    Data = 0;
+    Length = 0;
+    Fd = -1;
+}
+
+mappedfile::~mappedfile(){
+    Close();
+}
+
+bool mappedfile::Open(const string& path){
+    Close();
+    Fd = open(path.c_str(), O_RDONLY);
+    if(Fd < 0){
+        return false;
+    }
+    struct stat st;
+    if(fstat(Fd, &st) != 0){
+        Close();
+        return false;
+    }
+    Length = static_cast<size_t>(st.st_size);
+    if(Length == 0){
+        // mmap refuses empty files; an empty mapping is still a valid open
+        return true;
+    }
+    void* p = mmap(0, Length, PROT_READ, MAP_PRIVATE, Fd, 0);
+    if(p == MAP_FAILED){
+        Length = 0;
+        Close();
+        return false;
+    }
+    madvise(p, Length, MADV_SEQUENTIAL);
+    Data = static_cast<const char*>(p);
+    return true;
+}
+
+void mappedfile::Close(){
+    if(Data != 0){
+        munmap(const_cast<char*>(Data), Length);
+    }
+    if(Fd >= 0){
+        close(Fd);
+    }
+    Data = 0;
+    Length = 0;
+    Fd = -1;
+}
+
+const char* mappedfile::GetData() const{
+    return Data;
+}
+
+size_t mappedfile::GetLength() const{
+    return Length;
+}
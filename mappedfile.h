@@ -0,0 +1,25 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+#include <string>
+#include <cstddef>
+using namespace std;
+
+// Read-only mmap of a whole file. Unmapped when the object goes away.
+class mappedfile{
+    private:
+    const char* Data;
+    size_t Length;
+    int Fd;
+
+    mappedfile(const mappedfile&);
+    mappedfile& operator=(const mappedfile&);
+
+    public:
+    mappedfile();
+    ~mappedfile();
+    bool Open(const string& path);
+    void Close();
+    const char* GetData() const;
+    size_t GetLength() const;
+};
+#endif
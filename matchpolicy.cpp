@@ -0,0 +1,77 @@
+#include "matchpolicy.h"
+#include <utility>
+
+matchrequest AnyRequest(){
+    matchrequest r;
+    r.partySize = 1;
+    r.minRating = 0.0f;
+    r.type = VT_ANY;
+    r.pets = false;
+    r.handicap = false;
+    r.availableOnly = false;
+    return r;
+}
+
+namespace{
+
+enum{
+    MF_PETS = 1,
+    MF_HANDICAP = 2,
+    MF_RATING = 4,
+    MF_TYPE = 8,
+    MF_AVAILABLE = 16,
+    MF_COUNT = 32
+};
+
+// the policy for one combination of MF_ flags; capacity is always checked
+template<unsigned Flags>
+struct flagpolicy{
+    typedef Match<When<(Flags & MF_PETS) != 0, RequiresPets>,
+                  When<(Flags & MF_HANDICAP) != 0, RequiresHandicap>,
+                  When<(Flags & MF_RATING) != 0, RequestRating>,
+                  When<(Flags & MF_TYPE) != 0, RequestType>,
+                  When<(Flags & MF_AVAILABLE) != 0, Available>,
+                  Capacity> type;
+};
+
+typedef size_t (*matchfn)(const drivers&, const matchrequest&, size_t*);
+
+template<size_t... Flags>
+const matchfn* BuildTable(index_sequence<Flags...>){
+    static const matchfn table[] = { &MatchInto<typename flagpolicy<Flags>::type>... };
+    return table;
+}
+
+const matchfn* const Policies = BuildTable(make_index_sequence<MF_COUNT>());
+
+unsigned RequestFlags(const matchrequest& r){
+    unsigned flags = 0;
+    if(r.pets){
+        flags |= MF_PETS;
+    }
+    if(r.handicap){
+        flags |= MF_HANDICAP;
+    }
+    if(r.minRating > 0.0f){
+        flags |= MF_RATING;
+    }
+    if(r.type != VT_ANY){
+        flags |= MF_TYPE;
+    }
+    if(r.availableOnly){
+        flags |= MF_AVAILABLE;
+    }
+    return flags;
+}
+
+}
+
+vector<size_t> MatchDrivers(const drivers& list, const matchrequest& r){
+    vector<size_t> out(list.Size());
+    out.resize(Policies[RequestFlags(r)](list, r, out.data()));
+    return out;
+}
+
+size_t MatchPolicyCount(){
+    return MF_COUNT;
+}
@@ -0,0 +1,167 @@
+#ifndef MATCHPOLICY_H
+#define MATCHPOLICY_H
+#include <vector>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+#include "drivers.h"
+#include "capability.h"
+
+// Compile-time composed driver filters. A policy is a list of constraints,
+//
+//   typedef Match<RequiresPets, MinRating<4>, Capacity> petfriendly;
+//   vector<size_t> slots = MatchAll<petfriendly>(fleet, request);
+//
+// and MatchAll instantiates one loop per policy: the capability bits every
+// constraint needs are merged into a single mask compare, the remaining
+// checks are and-ed without short-circuiting, and the result is appended
+// branch-free, so the loop body has no data-dependent branches at all.
+//
+// MatchDrivers() is the runtime entry point: it picks one of the
+// pre-instantiated policies from the fields of a matchrequest.
+
+// the runtime half of a match; fields a policy doesn't use are ignored
+struct matchrequest{
+    int partySize;
+    float minRating;
+    int type;          // vehicletype or interned type id, or VT_ANY
+    bool pets;
+    bool handicap;
+    bool availableOnly;
+};
+
+matchrequest AnyRequest();
+
+// what a constraint sees for one slot; availableWord holds the bitmap word
+// covering slot i, loaded once per 64 slots
+struct matchcontext{
+    const uint32_t* masks;
+    const float* ratings;
+    const int* capacities;
+    const uint16_t* types;
+    uint64_t availableWord;
+};
+
+// no constraint; the base of all the others
+struct matchpolicy{
+    static uint32_t Mask(const matchrequest&){
+        return 0;
+    }
+    static bool Check(const matchcontext&, size_t, const matchrequest&){
+        return true;
+    }
+};
+
+struct RequiresPets : matchpolicy{
+    static uint32_t Mask(const matchrequest&){
+        return CAP_PETS;
+    }
+};
+
+struct RequiresHandicap : matchpolicy{
+    static uint32_t Mask(const matchrequest&){
+        return CAP_HANDICAP;
+    }
+};
+
+// rating of at least Tenths / 10 stars
+template<int Tenths>
+struct MinRatingTenths : matchpolicy{
+    static bool Check(const matchcontext& x, size_t i, const matchrequest&){
+        return x.ratings[i] >= Tenths / 10.0f;
+    }
+};
+
+template<int Stars>
+struct MinRating : MinRatingTenths<Stars * 10>{
+};
+
+// rating of at least request.minRating
+struct RequestRating : matchpolicy{
+    static bool Check(const matchcontext& x, size_t i, const matchrequest& r){
+        return x.ratings[i] >= r.minRating;
+    }
+};
+
+// exactly this type, like driverquery::type: custom types interned past
+// the enum don't count as VT_OTHER here
+template<int Type>
+struct VehicleType : matchpolicy{
+    static bool Check(const matchcontext& x, size_t i, const matchrequest&){
+        return x.types[i] == Type;
+    }
+};
+
+// vehicle type from request.type
+struct RequestType : matchpolicy{
+    static bool Check(const matchcontext& x, size_t i, const matchrequest& r){
+        return x.types[i] == r.type;
+    }
+};
+
+// seats for request.partySize
+struct Capacity : matchpolicy{
+    static bool Check(const matchcontext& x, size_t i, const matchrequest& r){
+        return x.capacities[i] >= r.partySize;
+    }
+};
+
+struct Available : matchpolicy{
+    static bool Check(const matchcontext& x, size_t i, const matchrequest&){
+        return (x.availableWord >> (i & 63)) & 1;
+    }
+};
+
+template<bool On, typename P>
+using When = typename conditional<On, P, matchpolicy>::type;
+
+template<typename... Ps>
+struct Match{
+    static uint32_t Mask(const matchrequest& r){
+        return (Ps::Mask(r) | ... | 0u);
+    }
+    // & rather than && so every check is evaluated; they are all cheap loads
+    // and compares, which beats a branch per constraint
+    static bool Check(const matchcontext& x, size_t i, const matchrequest& r){
+        return (true & ... & Ps::Check(x, i, r));
+    }
+};
+
+// writes every matching slot to out (room for list.Size() entries) in slot
+// order and returns how many there were
+template<typename Policy>
+size_t MatchInto(const drivers& list, const matchrequest& r, size_t* out){
+    drivercolumns c = list.Columns();
+    matchcontext x;
+    x.masks = c.masks;
+    x.ratings = c.ratings;
+    x.capacities = c.capacities;
+    x.types = c.types;
+    const uint32_t mask = Policy::Mask(r);
+    size_t n = 0;
+    for(size_t base = 0; base < c.size; base += 64){
+        x.availableWord = c.available->Word(base / 64);
+        size_t end = c.size - base < 64 ? c.size : base + 64;
+        for(size_t i = base; i < end; i++){
+            bool pass = ((x.masks[i] & mask) == mask) & Policy::Check(x, i, r);
+            out[n] = i;
+            n += pass;
+        }
+    }
+    return n;
+}
+
+template<typename Policy>
+vector<size_t> MatchAll(const drivers& list, const matchrequest& r){
+    vector<size_t> out(list.Size());
+    out.resize(MatchInto<Policy>(list, r, out.data()));
+    return out;
+}
+
+// picks the pre-instantiated policy that checks exactly what r asks for
+vector<size_t> MatchDrivers(const drivers& list, const matchrequest& r);
+// how many pre-instantiated policies MatchDrivers chooses from
+size_t MatchPolicyCount();
+#endif
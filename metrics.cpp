@@ -0,0 +1,200 @@
+#include "metrics.h"
+#include "report.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdio>
+#include <cstring>
+
+namespace{
+
+struct metricinfo{
+    const char* name;
+    const char* help;
+    metrickind kind;
+};
+
+const metricinfo Info[M_COUNT] = {
+    {"driver_add_seconds", "drivers::Add and Emplace", MK_HISTOGRAM},
+    {"driver_edit_seconds", "drivers::Edit", MK_HISTOGRAM},
+    {"driver_delete_seconds", "drivers::Delete", MK_HISTOGRAM},
+    {"driver_lookups_total", "drivers::Lookup calls", MK_COUNTER},
+    {"driver_query_seconds", "drivers::Query", MK_HISTOGRAM},
+    {"driver_scan_seconds", "drivers::Scan", MK_HISTOGRAM},
+    {"driver_nearest_seconds", "drivers::Nearest", MK_HISTOGRAM},
+    {"passenger_add_seconds", "passengers::Add and Emplace", MK_HISTOGRAM},
+    {"passenger_edit_seconds", "passengers::Edit", MK_HISTOGRAM},
+    {"passenger_delete_seconds", "passengers::Delete", MK_HISTOGRAM},
+    {"passenger_lookups_total", "passengers::Lookup calls", MK_COUNTER},
+    {"passenger_query_seconds", "passengers::Query", MK_HISTOGRAM},
+    {"dispatch_tick_seconds", "dispatcher::Tick", MK_HISTOGRAM},
+    {"dispatch_matched_total", "rides assigned a driver", MK_COUNTER},
+    {"log_append_seconds", "write-ahead log appends", MK_HISTOGRAM},
+    {"log_flush_seconds", "write-ahead log group commits, write and fdatasync", MK_HISTOGRAM},
+    {"store_compact_seconds", "registry snapshot and log truncation", MK_HISTOGRAM},
+    {"feed_apply_seconds", "locationfeed ticks, drain to registry", MK_HISTOGRAM},
+    {"command_seconds", "menu and batch commands", MK_HISTOGRAM}
+};
+
+mutex BlocksLock;
+vector<unique_ptr<metricsblock> > Blocks;
+thread_local metricsblock* Local = 0;
+
+// blocks outlive their threads so nothing recorded is lost
+metricsblock* NewBlock(){
+    unique_ptr<metricsblock> b(new metricsblock());
+    metricsblock* p = b.get();
+    lock_guard<mutex> guard(BlocksLock);
+    Blocks.push_back(move(b));
+    return p;
+}
+
+}
+
+const char* MetricName(int id){
+    return id >= 0 && id < M_COUNT ? Info[id].name : "unknown";
+}
+
+int MetricKind(int id){
+    return id >= 0 && id < M_COUNT ? Info[id].kind : MK_COUNTER;
+}
+
+metricsblock& LocalMetrics(){
+    if(Local == 0){
+        Local = NewBlock();
+    }
+    return *Local;
+}
+
+int MetricBucket(uint64_t ns){
+    const uint64_t sub = 1u << metricsblock::SubBits;
+    if(ns < sub){
+        return static_cast<int>(ns);
+    }
+    int e = 63 - __builtin_clzll(ns);
+    int b = ((e - metricsblock::SubBits + 1) << metricsblock::SubBits)
+          + static_cast<int>((ns >> (e - metricsblock::SubBits)) & (sub - 1));
+    return b < metricsblock::Buckets ? b : metricsblock::Buckets - 1;
+}
+
+uint64_t MetricBucketStart(int bucket){
+    const int sub = 1 << metricsblock::SubBits;
+    if(bucket < sub){
+        return bucket;
+    }
+    int e = (bucket >> metricsblock::SubBits) + metricsblock::SubBits - 1;
+    return static_cast<uint64_t>(sub + (bucket & (sub - 1))) << (e - metricsblock::SubBits);
+}
+
+void SnapshotMetrics(metricsnapshot& out){
+    memset(&out, 0, sizeof(out));
+    lock_guard<mutex> guard(BlocksLock);
+    for(size_t i = 0; i < Blocks.size(); i++){
+        const metricsblock& b = *Blocks[i];
+        for(int m = 0; m < M_COUNT; m++){
+            out.counts[m] += b.counts[m].load(memory_order_relaxed);
+            out.sums[m] += b.sums[m].load(memory_order_relaxed);
+            if(Info[m].kind != MK_HISTOGRAM){
+                continue;
+            }
+            for(int k = 0; k < metricsblock::Buckets; k++){
+                out.buckets[m][k] += b.buckets[m][k].load(memory_order_relaxed);
+            }
+        }
+    }
+}
+
+uint64_t MetricQuantile(const metricsnapshot& s, int id, double q){
+    uint64_t total = 0;
+    for(int k = 0; k < metricsblock::Buckets; k++){
+        total += s.buckets[id][k];
+    }
+    if(total == 0){
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(q * (total - 1));
+    uint64_t seen = 0;
+    for(int k = 0; k < metricsblock::Buckets; k++){
+        seen += s.buckets[id][k];
+        if(seen > rank){
+            return MetricBucketStart(k);
+        }
+    }
+    return MetricBucketStart(metricsblock::Buckets - 1);
+}
+
+static void PutSeconds(reportwriter& out, uint64_t ns){
+    char text[32];
+    snprintf(text, sizeof(text), "%.9g", ns / 1e9);
+    out.Put(text);
+}
+
+void WriteMetrics(reportwriter& out){
+    unique_ptr<metricsnapshot> s(new metricsnapshot());
+    SnapshotMetrics(*s);
+    for(int m = 0; m < M_COUNT; m++){
+        out.Put("# HELP registry_");
+        out.Put(Info[m].name);
+        out.PutChar(' ');
+        out.Put(Info[m].help);
+        out.Put("\n# TYPE registry_");
+        out.Put(Info[m].name);
+        out.Put(Info[m].kind == MK_HISTOGRAM ? " histogram\n" : " counter\n");
+        if(Info[m].kind == MK_COUNTER){
+            out.Put("registry_");
+            out.Put(Info[m].name);
+            out.PutChar(' ');
+            out.PutInt(s->counts[m]);
+            out.PutChar('\n');
+            continue;
+        }
+        // Prometheus only needs cumulative counts, so the fine buckets are
+        // folded into one per power of two from 128ns up
+        uint64_t cumulative = 0;
+        int k = 0;
+        for(int e = 7; e < metricsblock::Exponents + metricsblock::SubBits - 1; e++){
+            int end = (e - metricsblock::SubBits + 1) << metricsblock::SubBits;
+            for(; k < end; k++){
+                cumulative += s->buckets[m][k];
+            }
+            out.Put("registry_");
+            out.Put(Info[m].name);
+            out.Put("_bucket{le=\"");
+            PutSeconds(out, uint64_t(1) << e);
+            out.Put("\"} ");
+            out.PutInt(cumulative);
+            out.PutChar('\n');
+        }
+        for(; k < metricsblock::Buckets; k++){
+            cumulative += s->buckets[m][k];
+        }
+        // the count comes from the buckets too so the two always agree
+        out.Put("registry_");
+        out.Put(Info[m].name);
+        out.Put("_bucket{le=\"+Inf\"} ");
+        out.PutInt(cumulative);
+        out.Put("\nregistry_");
+        out.Put(Info[m].name);
+        out.Put("_sum ");
+        PutSeconds(out, s->sums[m]);
+        out.Put("\nregistry_");
+        out.Put(Info[m].name);
+        out.Put("_count ");
+        out.PutInt(cumulative);
+        out.PutChar('\n');
+    }
+}
+
+void ResetMetrics(){
+    lock_guard<mutex> guard(BlocksLock);
+    for(size_t i = 0; i < Blocks.size(); i++){
+        metricsblock& b = *Blocks[i];
+        for(int m = 0; m < M_COUNT; m++){
+            b.counts[m].store(0, memory_order_relaxed);
+            b.sums[m].store(0, memory_order_relaxed);
+            for(int k = 0; k < metricsblock::Buckets; k++){
+                b.buckets[m][k].store(0, memory_order_relaxed);
+            }
+        }
+    }
+}
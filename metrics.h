@@ -0,0 +1,125 @@
+#ifndef METRICS_H
+#define METRICS_H
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+class reportwriter;
+
+// Hot path counters and latency histograms.
+//
+// Every thread records into its own block, so recording is a relaxed
+// load/add/store on memory no other thread writes: no locked instruction,
+// no shared cache line. WriteMetrics sums the blocks. Latencies go into
+// log-linear buckets (16 per power of two, so within ~6%) like an HDR
+// histogram at four significant bits.
+//
+// The METRIC_* macros compile to nothing unless REGISTRY_METRICS is
+// defined, so a default build carries no instrumentation at all.
+// ID lookups are only counted: timing a 5ns operation would cost more than
+// the operation itself.
+enum metricid{
+    M_DRIVER_ADD = 0,
+    M_DRIVER_EDIT,
+    M_DRIVER_DELETE,
+    M_DRIVER_LOOKUP,
+    M_DRIVER_QUERY,
+    M_DRIVER_SCAN,
+    M_DRIVER_NEAREST,
+    M_PASSENGER_ADD,
+    M_PASSENGER_EDIT,
+    M_PASSENGER_DELETE,
+    M_PASSENGER_LOOKUP,
+    M_PASSENGER_QUERY,
+    M_DISPATCH_TICK,
+    M_DISPATCH_MATCHED,
+    M_LOG_APPEND,
+    M_LOG_FLUSH,
+    M_STORE_COMPACT,
+    M_FEED_APPLY,
+    M_COMMAND,
+    M_COUNT
+};
+
+enum metrickind{
+    MK_COUNTER,
+    MK_HISTOGRAM
+};
+
+const char* MetricName(int id);
+int MetricKind(int id);
+
+// per-thread storage; one of these per thread that ever recorded anything
+struct metricsblock{
+    static const int SubBits = 4;
+    static const int Exponents = 40;  // up to 2^40 ns, about 18 minutes
+    static const int Buckets = Exponents << SubBits;
+
+    atomic<uint64_t> counts[M_COUNT];
+    atomic<uint64_t> sums[M_COUNT];   // ns for histograms
+    atomic<uint64_t> buckets[M_COUNT][Buckets];
+};
+
+metricsblock& LocalMetrics();
+int MetricBucket(uint64_t ns);
+// lower bound of a bucket in ns
+uint64_t MetricBucketStart(int bucket);
+
+inline void MetricCount(int id, uint64_t n = 1){
+    metricsblock& b = LocalMetrics();
+    b.counts[id].store(b.counts[id].load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+inline void MetricRecord(int id, uint64_t ns){
+    metricsblock& b = LocalMetrics();
+    int k = MetricBucket(ns);
+    b.counts[id].store(b.counts[id].load(memory_order_relaxed) + 1, memory_order_relaxed);
+    b.sums[id].store(b.sums[id].load(memory_order_relaxed) + ns, memory_order_relaxed);
+    b.buckets[id][k].store(b.buckets[id][k].load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+// records the time until it goes out of scope
+class metrictimer{
+    private:
+    int Id;
+    chrono::steady_clock::time_point Start;
+
+    public:
+    explicit metrictimer(int id) : Id(id), Start(chrono::steady_clock::now()){
+    }
+    ~metrictimer(){
+        MetricRecord(Id, chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - Start).count());
+    }
+};
+
+// totals over every thread
+struct metricsnapshot{
+    uint64_t counts[M_COUNT];
+    uint64_t sums[M_COUNT];
+    uint64_t buckets[M_COUNT][metricsblock::Buckets];
+};
+
+void SnapshotMetrics(metricsnapshot& out);
+// q in [0, 1]; 0 if nothing was recorded
+uint64_t MetricQuantile(const metricsnapshot& s, int id, double q);
+// Prometheus text exposition format, histograms in seconds with one bucket
+// per power of two
+void WriteMetrics(reportwriter& out);
+void ResetMetrics();
+
+#ifdef REGISTRY_METRICS
+#define METRIC_JOIN2(a, b) a##b
+#define METRIC_JOIN(a, b) METRIC_JOIN2(a, b)
+#define METRIC_TIMER(id) metrictimer METRIC_JOIN(metricTimer, __LINE__)(id)
+#define METRIC_COUNT(id) MetricCount(id)
+#define METRIC_ADD(id, n) MetricCount(id, n)
+#else
+#define METRIC_TIMER(id) do{}while(0)
+#define METRIC_COUNT(id) do{}while(0)
+#define METRIC_ADD(id, n) do{}while(0)
+#endif
+
+#endif
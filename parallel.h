@@ -0,0 +1,49 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+#include <vector>
+#include <cstddef>
+using namespace std;
+
+#include "threadpool.h"
+
+// Slots per chunk. A multiple of 64 so no two chunks share a word of the
+// availability bitmap, and of 16 so chunk boundaries fall on cache line
+// boundaries in every 4-byte column.
+const size_t ParallelChunk = 4096;
+
+inline size_t ChunkCount(size_t n){
+    return (n + ParallelChunk - 1) / ParallelChunk;
+}
+
+// f(begin, end) for consecutive slot ranges covering [0, n), spread over
+// the pool
+template<typename F>
+void ParallelFor(threadpool& pool, size_t n, F f){
+    size_t chunks = ChunkCount(n);
+    pool.Run(chunks, [&](size_t c){
+        size_t begin = c * ParallelChunk;
+        size_t end = begin + ParallelChunk < n ? begin + ParallelChunk : n;
+        f(begin, end);
+    });
+}
+
+// map(begin, end) -> T per chunk; the partial results are combined in chunk
+// order on the calling thread, so the result (floating point sums
+// included) depends only on n, never on the thread count or on which
+// thread ran what
+template<typename T, typename Map, typename Combine>
+T ParallelReduce(threadpool& pool, size_t n, T init, Map map, Combine combine){
+    size_t chunks = ChunkCount(n);
+    vector<T> partial(chunks, init);
+    pool.Run(chunks, [&](size_t c){
+        size_t begin = c * ParallelChunk;
+        size_t end = begin + ParallelChunk < n ? begin + ParallelChunk : n;
+        partial[c] = map(begin, end);
+    });
+    T out = init;
+    for(size_t c = 0; c < chunks; c++){
+        out = combine(out, partial[c]);
+    }
+    return out;
+}
+#endif
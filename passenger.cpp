@@ -1,20 +1,31 @@
 #include "passenger.h"
 
 passenger::passenger(){
-
+    id = 0;
+    handicap = 0;
+    rating = 0;
+    pets = 0;
 }
 
 passenger::passenger(string name, int id, string p_method, bool handicap, float rating, bool pets) {
-    this -> name = name;
+    this -> name = move(name);
     this -> id = id;
-    this -> p_method = p_method;
+    this -> p_method = move(p_method);
     this -> handicap = handicap;
     this -> rating = rating;
     this -> pets = pets;
 }
 
+passenger::passenger(const passengerview& v)
+    : name(v.name), p_method(v.p_method){
+    id = v.id;
+    handicap = v.handicap;
+    rating = v.rating;
+    pets = v.pets;
+}
+
 void passenger::setName(string n){
-    name = n;
+    name = move(n);
 }
 
 void passenger::setID(int i){
@@ -22,7 +33,7 @@ void passenger::setID(int i){
 }
 
 void passenger::setPaymentMethod(string p){
-    p_method = p;
+    p_method = move(p);
 }
 
 void passenger::setHandicap(bool b){
@@ -58,7 +69,7 @@ void passenger::setPets(bool b){
 */
 
 
-string passenger::getName() const{
+const string& passenger::getName() const{
     return name;
 }
 
@@ -66,7 +77,7 @@ int passenger::getID() const{
     return id;
 }
 
-string passenger::getPayment() const{
+const string& passenger::getPayment() const{
     return p_method;
 }
 
@@ -82,6 +93,13 @@ bool passenger::getPets() const{
     return pets;
 }
 
-
-
-
+passengerview passenger::View() const{
+    passengerview v;
+    v.name = name;
+    v.id = id;
+    v.p_method = p_method;
+    v.handicap = handicap;
+    v.rating = rating;
+    v.pets = pets;
+    return v;
+}
@@ -1,8 +1,19 @@
 #ifndef PASSENGER_H
 #define PASSENGER_H
 #include <string>
+#include <string_view>
 #include <iostream>
 using namespace std;
+// Non-owning view of a passenger's fields, see driverview
+struct passengerview{
+    string_view name;
+    int id;
+    string_view p_method;
+    bool handicap;
+    float rating;
+    bool pets;
+};
+
 class passenger{
     private:
         string name;
@@ -14,7 +25,9 @@ class passenger{
     
     public:
         passenger();
+        // strings are moved in, see driver
         passenger(string name, int id, string p_method, bool handicap, float rating, bool pets);
+        explicit passenger(const passengerview&);
         void setName(string);
         void setID(int);
         void setPaymentMethod(string);
@@ -23,12 +36,13 @@ class passenger{
         void setPets(bool);
         
         
-        string getName() const;
+        const string& getName() const;
         int getID() const;
-        string getPayment() const;
+        const string& getPayment() const;
         bool getHandicap() const;
         float getRating() const;
         bool getPets() const;
+        passengerview View() const;
 
     
 };
@@ -1,55 +1,596 @@
 #include "passengers.h"
+#include "snapshot.h"
+#include "payment.h"
+#include "report.h"
+#include "metrics.h"
 #include <iterator>
 #include <algorithm>
-passengers::passengers(){
+static void EncodePassenger(logencoder& e, const passengerview& p){
+    e.PutString(p.name);
+    e.PutInt(p.id);
+    e.PutString(p.p_method);
+    e.PutU8(p.handicap);
+    e.PutFloat(p.rating);
+    e.PutU8(p.pets);
+}
 
+static passenger DecodePassenger(logdecoder& in){
+    string name = in.GetString();
+    int id = in.GetInt();
+    string method = in.GetString();
+    bool handicap = in.GetU8();
+    float rating = in.GetFloat();
+    bool pets = in.GetU8();
+    return passenger(name, id, method, handicap, rating, pets);
+}
+
+// interns the known payment methods in enum order so their ids match
+static void SeedMethodNames(internpool& pool){
+    for(int i = 0; i < PM_COUNT; i++){
+        pool.Intern(PaymentMethodName(i));
+    }
+}
+
+passengers::passengers(){
+    Log = 0;
+    Versioning = false;
+    SeedMethodNames(MethodNames);
 }
 
 passengers::passengers(string name){
     ListName = name;
+    Log = 0;
+    Versioning = false;
+    SeedMethodNames(MethodNames);
+}
+
+bool passengers::Add(const passenger& p){
+    return Add(p.View());
+}
+
+bool passengers::Emplace(string_view name, int id, string_view p_method, bool handicap, float rating, bool pets){
+    passengerview p;
+    p.name = name;
+    p.id = id;
+    p.p_method = p_method;
+    p.handicap = handicap;
+    p.rating = rating;
+    p.pets = pets;
+    return Add(p);
+}
+
+bool passengers::Add(const passengerview& p){
+    METRIC_TIMER(M_PASSENGER_ADD);
+    if(IdIndex.count(p.id) != 0){
+        return false;
+    }
+    IdIndex[p.id] = Ids.size();
+    PushSlot(p);
+    Handles.Push();
+    IndexSlot(Ids.size() - 1);
+    if(Log != 0){
+        logencoder e;
+        EncodePassenger(e, p);
+        Log->Append(LR_PASSENGER_ADD, e);
+    }
+    return true;
+}
+
+bool passengers::Edit(int id, const passenger& p){
+    return Edit(id, p.View());
+}
+
+bool passengers::Edit(recordhandle h, const passenger& p){
+    return Edit(h, p.View());
+}
+
+bool passengers::Edit(int id, const passengerview& p){
+    return EditSlot(Lookup(id), p);
+}
+
+bool passengers::Edit(recordhandle h, const passengerview& p){
+    return EditSlot(Handles.Resolve(h), p);
+}
+
+bool passengers::EditSlot(size_t slot, const passengerview& p){
+    METRIC_TIMER(M_PASSENGER_EDIT);
+    if(slot == npos){
+        return false;
+    }
+    int id = Ids[slot];
+    // changing the id has to keep the index unique
+    if(p.id != id){
+        if(IdIndex.count(p.id) != 0){
+            return false;
+        }
+        IdIndex.erase(id);
+        IdIndex[p.id] = slot;
+    }
+    // rewritten in place; only the indexes whose key changed are touched
+    uint16_t oldMethod = Methods[slot];
+    float oldRating = Ratings[slot];
+    Strings.Forget(Cold[slot].name);
+    RiderStats.Remove(Ratings[slot], Handicap[slot], Pets[slot]);
+    WriteSlot(slot, p);
+    RiderStats.Add(Ratings[slot], Handicap[slot], Pets[slot]);
+    if(Methods[slot] != oldMethod){
+        MethodIndex.Remove(oldMethod, slot);
+        MethodIndex.Insert(Methods[slot], slot);
+    }
+    if(ratingindex::Key(Ratings[slot]) != ratingindex::Key(oldRating)){
+        RatingIndex.Remove(oldRating, slot);
+        RatingIndex.Insert(Ratings[slot], slot);
+    }
+    MarkDirty(slot);
+    CompactStrings();
+    if(Log != 0){
+        logencoder e;
+        e.PutInt(id);
+        EncodePassenger(e, p);
+        Log->Append(LR_PASSENGER_EDIT, e);
+    }
+    return true;
+}
+
+bool passengers::Delete(int id){
+    return DeleteSlot(Lookup(id));
+}
+
+bool passengers::Delete(recordhandle h){
+    return DeleteSlot(Handles.Resolve(h));
+}
+
+bool passengers::DeleteSlot(size_t slot){
+    METRIC_TIMER(M_PASSENGER_DELETE);
+    if(slot == npos){
+        return false;
+    }
+    int id = Ids[slot];
+    // swap with the last entry so the erase doesn't shift the columns; the
+    // moved record keeps its index entries, renumbered in place
+    size_t last = Ids.size() - 1;
+    Strings.Forget(Cold[slot].name);
+    UnindexSlot(slot);
+    if(slot != last){
+        MoveSlot(last, slot);
+        MethodIndex.Renumber(Methods[slot], last, slot);
+        RatingIndex.Renumber(Ratings[slot], last, slot);
+        IdIndex[Ids[slot]] = slot;
+        MarkDirty(slot);
+    }
+    PopSlot();
+    Handles.Erase(slot);
+    IdIndex.erase(id);
+    CompactStrings();
+    if(Log != 0){
+        logencoder e;
+        e.PutInt(id);
+        Log->Append(LR_PASSENGER_DELETE, e);
+    }
+    return true;
+}
+
+void passengers::PushSlot(const passengerview& p){
+    Ids.push_back(0);
+    Ratings.push_back(0);
+    Handicap.push_back(0);
+    Pets.push_back(0);
+    Methods.push_back(0);
+    Cold.push_back(coldfields());
+    WriteSlot(Ids.size() - 1, p);
+}
+
+void passengers::WriteSlot(size_t slot, const passengerview& p){
+    Ids[slot] = p.id;
+    Ratings[slot] = p.rating;
+    Handicap[slot] = p.handicap;
+    Pets[slot] = p.pets;
+    Methods[slot] = MethodNames.Intern(p.p_method);
+    Cold[slot].name = Strings.Store(p.name);
+}
+
+// same policy as drivers: rebuild the arena once most of it is dead
+void passengers::CompactStrings(){
+    if(Strings.DeadBytes() < 64 * 1024 || Strings.DeadBytes() < Strings.LiveBytes()){
+        return;
+    }
+    stringarena fresh;
+    for(size_t i = 0; i < Cold.size(); i++){
+        Cold[i].name = fresh.Store(Cold[i].name);
+    }
+    Strings.Swap(fresh);
+}
+
+// also keeps RiderStats in step: every slot that is indexed is counted
+void passengers::IndexSlot(size_t slot){
+    MarkDirty(slot);
+    MethodIndex.Insert(Methods[slot], slot);
+    RatingIndex.Insert(Ratings[slot], slot);
+    RiderStats.Add(Ratings[slot], Handicap[slot], Pets[slot]);
+}
+
+void passengers::UnindexSlot(size_t slot){
+    MethodIndex.Remove(Methods[slot], slot);
+    RatingIndex.Remove(Ratings[slot], slot);
+    RiderStats.Remove(Ratings[slot], Handicap[slot], Pets[slot]);
+}
+
+void passengers::MoveSlot(size_t from, size_t to){
+    Ids[to] = Ids[from];
+    Ratings[to] = Ratings[from];
+    Handicap[to] = Handicap[from];
+    Pets[to] = Pets[from];
+    Methods[to] = Methods[from];
+    Cold[to] = Cold[from];
+}
+
+void passengers::PopSlot(){
+    Ids.pop_back();
+    Ratings.pop_back();
+    Handicap.pop_back();
+    Pets.pop_back();
+    Methods.pop_back();
+    Cold.pop_back();
+}
+
+recordhandle passengers::Handle(int id) const{
+    size_t slot = Lookup(id);
+    return slot == npos ? NoHandle : Handles.At(slot);
+}
+
+recordhandle passengers::HandleAt(size_t slot) const{
+    return Handles.At(slot);
+}
+
+size_t passengers::Resolve(recordhandle h) const{
+    return Handles.Resolve(h);
+}
+
+size_t passengers::Lookup(int id) const{
+    METRIC_COUNT(M_PASSENGER_LOOKUP);
+    unordered_map<int, size_t>::const_iterator it = IdIndex.find(id);
+    if(it == IdIndex.end()){
+        return npos;
+    }
+    return it->second;
+}
 
+passenger passengers::At(size_t slot) const{
+    return passenger(View(slot));
 }
 
-void passengers::Add(passenger p){
-    TotalPassengers.push_back(p);
+passengerview passengers::View(size_t slot) const{
+    passengerview p;
+    p.name = Cold[slot].name;
+    p.id = Ids[slot];
+    p.p_method = MethodNames.Name(Methods[slot]);
+    p.handicap = Handicap[slot];
+    p.rating = Ratings[slot];
+    p.pets = Pets[slot];
+    return p;
+}
+
+size_t passengers::Size() const{
+    return Ids.size();
+}
+
+void passengers::Reserve(size_t n){
+    Ids.reserve(n);
+    Ratings.reserve(n);
+    Handicap.reserve(n);
+    Pets.reserve(n);
+    Methods.reserve(n);
+    Cold.reserve(n);
+    IdIndex.reserve(n);
+    MethodIndex.Reserve(n);
+    RatingIndex.Reserve(n);
+    Handles.Reserve(n);
+}
+
+void passengers::Clear(){
+    Ids.clear();
+    Ratings.clear();
+    Handicap.clear();
+    Pets.clear();
+    Methods.clear();
+    Cold.clear();
+    Strings.Clear();
+    IdIndex.clear();
+    Handles.Clear();
+    MethodIndex.Clear();
+    RatingIndex.Clear();
+    RiderStats.Clear();
+}
+
+static const char PassengersMagic[8] = {'P', 'S', 'G', 'S', 'N', 'A', 'P', '1'};
+
+bool passengers::SaveSnapshot(const string& path) const{
+    vector<char> bytes;
+    SnapshotBytes(bytes, 0);
+    return WriteSnapshotFile(path, bytes);
+}
+
+void passengers::SnapshotBytes(vector<char>& out, uint64_t lsn) const{
+    size_t n = Ids.size();
+    vector<string_view> strings;
+    strings.reserve(n * 2);
+    uint64_t stringBytes = 0;
+    for(size_t i = 0; i < n; i++){
+        string_view method = MethodNames.Name(Methods[i]);
+        strings.push_back(Cold[i].name);
+        strings.push_back(method);
+        stringBytes += Cold[i].name.size() + method.size();
+    }
+    snapshotwriter w;
+    w.Begin(PassengersMagic, n, 2, stringBytes, lsn);
+    w.WriteColumn(Ids.data(), n * sizeof(int));
+    w.WriteColumn(Ratings.data(), n * sizeof(float));
+    w.WriteColumn(Handicap.data(), n);
+    w.WriteColumn(Pets.data(), n);
+    w.WriteStrings(strings);
+    w.Take(out);
+}
+
+bool passengers::LoadSnapshot(const string& path, uint64_t* lsn){
+    snapshotreader r;
+    if(!r.Open(path, PassengersMagic) || r.GetHeader().fields != 2){
+        return false;
+    }
+    size_t n = r.GetHeader().count;
+    const int* ids = static_cast<const int*>(r.NextColumn(n * sizeof(int)));
+    const float* ratings = static_cast<const float*>(r.NextColumn(n * sizeof(float)));
+    const uint8_t* handicap = static_cast<const uint8_t*>(r.NextColumn(n));
+    const uint8_t* pets = static_cast<const uint8_t*>(r.NextColumn(n));
+    if(pets == 0 || !r.OpenStrings()){
+        return false;
+    }
+    // a duplicate id or a flag other than 0/1 can't have come from
+    // SaveSnapshot; refuse the file before touching the collection
+    unordered_map<int, size_t> index;
+    index.reserve(n);
+    for(size_t i = 0; i < n; i++){
+        if(!index.insert(make_pair(ids[i], i)).second || handicap[i] > 1 || pets[i] > 1){
+            return false;
+        }
+    }
+
+    Clear();
+    if(lsn != 0){
+        *lsn = r.GetHeader().lsn;
+    }
+    Ids.assign(ids, ids + n);
+    Ratings.assign(ratings, ratings + n);
+    Handicap.assign(handicap, handicap + n);
+    Pets.assign(pets, pets + n);
+    Methods.resize(n);
+    Cold.resize(n);
+    IdIndex.swap(index);
+    for(size_t i = 0; i < n; i++){
+        size_t len;
+        const char* str = r.StringAt(i * 2, len);
+        Cold[i].name = Strings.Store(string_view(str, len));
+        str = r.StringAt(i * 2 + 1, len);
+        Methods[i] = MethodNames.Intern(string_view(str, len));
+        Handles.Push();
+        IndexSlot(i);
+    }
+    return true;
+}
+
+void passengers::AttachLog(writeaheadlog* log){
+    Log = log;
+}
+
+bool passengers::ApplyLogRecord(uint8_t type, const char* data, size_t size){
+    logdecoder in(data, size);
+    int id;
+    passenger p;
+    switch(type){
+        case LR_PASSENGER_ADD:
+            p = DecodePassenger(in);
+            return in.Good() && Add(p);
+        case LR_PASSENGER_EDIT:
+            id = in.GetInt();
+            p = DecodePassenger(in);
+            return in.Good() && Edit(id, p);
+        case LR_PASSENGER_DELETE:
+            id = in.GetInt();
+            return in.Good() && Delete(id);
+    }
+    return false;
+}
+
+int passengers::IdAt(size_t slot) const{
+    return Ids[slot];
+}
+
+float passengers::RatingAt(size_t slot) const{
+    return Ratings[slot];
+}
+
+bool passengers::HandicapAt(size_t slot) const{
+    return Handicap[slot];
+}
+
+bool passengers::PetsAt(size_t slot) const{
+    return Pets[slot];
+}
+
+passengerquery AnyPassenger(){
+    passengerquery q;
+    q.minRating = 0.0f;
+    q.maxRating = 5.0f;
+    q.method = PM_UNKNOWN;
+    q.handicap = false;
+    q.pets = false;
+    return q;
+}
+
+bool passengers::Matches(const passengerquery& q, size_t slot) const{
+    return Ratings[slot] >= q.minRating && Ratings[slot] <= q.maxRating &&
+           (q.method == PM_UNKNOWN || Methods[slot] == q.method) &&
+           (!q.handicap || Handicap[slot]) && (!q.pets || Pets[slot]);
+}
+
+// same plan as drivers::Query: the most selective index drives the search
+vector<size_t> passengers::Query(const passengerquery& q) const{
+    METRIC_TIMER(M_PASSENGER_QUERY);
+    enum{ BY_SCAN, BY_METHOD, BY_RATING } by = BY_SCAN;
+    size_t best = Ids.size();
+    if(q.method != PM_UNKNOWN){
+        size_t n = q.method < 0 ? 0 : MethodIndex.Bucket(q.method).size();
+        if(n < best){
+            best = n;
+            by = BY_METHOD;
+        }
+    }
+    if(ratingindex::Key(q.minRating) > 0 || q.maxRating < 5.0f){
+        size_t n = RatingIndex.CountRange(q.minRating, q.maxRating);
+        if(n < best){
+            best = n;
+            by = BY_RATING;
+        }
+    }
+
+    vector<size_t> out;
+    if(by == BY_METHOD){
+        if(q.method >= 0){
+            const vector<uint32_t>& b = MethodIndex.Bucket(q.method);
+            for(size_t i = 0; i < b.size(); i++){
+                if(Matches(q, b[i])){
+                    out.push_back(b[i]);
+                }
+            }
+        }
+    }
+    else if(by == BY_RATING){
+        RatingIndex.ForRange(q.minRating, q.maxRating, Ratings.data(), [&](size_t slot){
+            if(Matches(q, slot)){
+                out.push_back(slot);
+            }
+        });
+    }
+    else{
+        for(size_t i = 0; i < Ids.size(); i++){
+            if(Matches(q, i)){
+                out.push_back(i);
+            }
+        }
+    }
+    return out;
+}
+
+void passengers::MarkDirty(size_t slot){
+    if(!Versioning){
+        return;
+    }
+    if(slot >= DirtyFlags.size()){
+        DirtyFlags.resize(slot + 1 > 2 * DirtyFlags.size() ? slot + 1 : 2 * DirtyFlags.size());
+    }
+    if(!DirtyFlags[slot]){
+        DirtyFlags[slot] = 1;
+        Dirty.push_back(slot);
+    }
+}
+
+void passengers::EnableVersions(){
+    if(Versioning){
+        return;
+    }
+    Versioning = true;
+    for(size_t i = 0; i < Ids.size(); i++){
+        MarkDirty(i);
+    }
+}
+
+void passengers::Publish(){
+    if(!Versioning){
+        return;
+    }
+    Versions.Resize(Ids.size());
+    for(size_t i = 0; i < Dirty.size(); i++){
+        DirtyFlags[Dirty[i]] = 0;
+        if(Dirty[i] < Ids.size()){
+            Versions.Set(Dirty[i], passenger(View(Dirty[i])));
+        }
+    }
+    Dirty.clear();
+    Versions.Publish();
+}
+
+passengerversion passengers::Version() const{
+    return Versions.Read();
+}
+
+passengersummary passengers::Summarize() const{
+    passengersummary init;
+    init.count = 0;
+    init.handicap = 0;
+    init.pets = 0;
+    init.averageRating = 0;
+    init.perMethod.assign(MethodNames.Size(), 0);
+    passengersummary s = ::ParallelReduce(threadpool::Shared(), Ids.size(), init,
+        [&](size_t begin, size_t end){
+            passengersummary c = init;
+            for(size_t i = begin; i < end; i++){
+                c.count++;
+                c.handicap += Handicap[i];
+                c.pets += Pets[i];
+                c.averageRating += Ratings[i];
+                c.perMethod[Methods[i]]++;
+            }
+            return c;
+        },
+        [](passengersummary a, const passengersummary& b){
+            a.count += b.count;
+            a.handicap += b.handicap;
+            a.pets += b.pets;
+            a.averageRating += b.averageRating;
+            for(size_t m = 0; m < a.perMethod.size(); m++){
+                a.perMethod[m] += b.perMethod[m];
+            }
+            return a;
+        });
+    if(s.count != 0){
+        s.averageRating /= s.count;
+    }
+    return s;
+}
+
+ridersnapshot passengers::Stats() const{
+    return RiderStats.Snapshot();
 }
 
 void passengers::PrintSize(){
-    if(TotalPassengers.size() != 0){
-        cout << "The size is: " << TotalPassengers.size() << endl;
+    if(Ids.size() != 0){
+        ridersnapshot s = RiderStats.Snapshot();
+        cout << "The size is: " << Ids.size() << "\n";
+        cout << "Mean rating: " << s.meanRating << "\n";
+        cout << "Need handicap access: " << s.handicap << "\n";
+        cout << "Travel with pets: " << s.pets << endl;
     }
     else
     cout << "Vector is empty.\n";
 }
 void passengers::PrintAll(){
-    vector<passenger>::iterator it;
-    passenger* ptr; 
-    unsigned i = 0; // counter
-    for(it = TotalPassengers.begin(); it != TotalPassengers.end(); it++, i++) {
-       cout << "Name: " << (*it).getName() << endl;
-       cout << "ID: " << (*it).getID() << endl;
-       cout << "Payment: "<< (*it).getPayment() << endl;
-       cout << "Handicap: ";
-       if((*it).getHandicap() == 0){
-        cout << "Not Handicap Capable \n";
-       }
-       else{
-       cout <<"Handicap Capable \n";
-       }
-       cout << "Ratings: " <<(*it).getRating() << endl;
-       if((*it).getPets() == 0){
-        cout << "Not Pet Capable \n";
-       }
-       else{
-       cout <<"Pet Capable \n";
-       cout << endl;
-       }
-    
+    // cout shares stdout's buffer, so this interleaves with it correctly
+    reportwriter out(stdout);
+    if(Versioning){
+        ExportPassengers(Version(), out, RF_TEXT);
+        return;
     }
+    ExportPassengers(*this, out, RF_TEXT);
 }
 
 void passengers::FindEntry(int n){
-    vector<passenger>::iterator it;
-    it = find(TotalPassengers.begin(),TotalPassengers.end(), n);
-    cout << *it <<endl;
+    size_t slot = Lookup(n);
+    if(slot == npos){
+        cout << "No passenger with ID " << n << endl;
+        return;
+    }
+    passengerview p = View(slot);
+    cout << "Name: " << p.name << endl;
+    cout << "ID: " << p.id << endl;
+    cout << "Payment: " << p.p_method << endl;
+    cout << "Ratings: " << p.rating << endl;
 }
@@ -2,23 +2,176 @@
 #define PASSENGERS_H
 #include <vector>
 #include <string>
+#include <string_view>
 #include <iterator>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
 using namespace std;
 
 #include "passenger.h"
+#include "wal.h"
+#include "payment.h"
+#include "stringarena.h"
+#include "internpool.h"
+#include "secondaryindex.h"
+#include "handletable.h"
+#include "parallel.h"
+#include "fleetstats.h"
+#include "versioned.h"
 
+// compound filter for passengers::Query; start from AnyPassenger()
+struct passengerquery{
+    float minRating;
+    float maxRating;
+    int method;    // paymentmethod, or PM_UNKNOWN for any
+    bool handicap; // only passengers who need a handicap capable car
+    bool pets;     // only passengers travelling with pets
+};
+
+passengerquery AnyPassenger();
+
+// aggregates recomputed by passengers::Summarize()
+struct passengersummary{
+    size_t count;
+    size_t handicap;
+    size_t pets;
+    double averageRating;
+    // passengers per payment method id (paymentmethod for the known ones)
+    vector<size_t> perMethod;
+};
+
+// immutable copy of the passenger list, see passengers::Version()
+typedef versionedtable<passenger>::view passengerversion;
+
+// Column storage like drivers: hot fields in contiguous arrays by slot,
+// names in an arena, payment methods interned, passenger objects built on
+// demand by At().
 class passengers{
     private:
-    vector<passenger> TotalPassengers;
+    // views into Strings
+    struct coldfields{
+        string_view name;
+    };
+
+    // hot columns, all indexed by slot
+    vector<int> Ids;
+    vector<float> Ratings;
+    vector<uint8_t> Handicap;
+    vector<uint8_t> Pets;
+    vector<uint16_t> Methods; // MethodNames id, equal to the paymentmethod for known methods
+    // cold columns
+    vector<coldfields> Cold;
+    stringarena Strings;
+    internpool MethodNames;
+    // secondary indexes for Query()
+    bucketindex MethodIndex; // by MethodNames id
+    ratingindex RatingIndex;
+    // running aggregates behind Stats()
+    riderstats RiderStats;
+
     string ListName;
+    // id -> slot
+    unordered_map<int, size_t> IdIndex;
+    // stable names for slots, see drivers::Handle()
+    handletable Handles;
+    // mutations are appended here when attached
+    writeaheadlog* Log;
+    // published copies for Version(); single writer, so no lock
+    versionedtable<passenger> Versions;
+    bool Versioning;
+    vector<size_t> Dirty;
+    vector<uint8_t> DirtyFlags;
+
+    void PushSlot(const passengerview& p);
+    void WriteSlot(size_t slot, const passengerview& p);
+    void MoveSlot(size_t from, size_t to);
+    void PopSlot();
+    void IndexSlot(size_t slot);
+    void UnindexSlot(size_t slot);
+    bool EditSlot(size_t slot, const passengerview& p);
+    bool DeleteSlot(size_t slot);
+    bool Matches(const passengerquery& q, size_t slot) const;
+    void CompactStrings();
+    void MarkDirty(size_t slot);
 
     public:
+    static const size_t npos = static_cast<size_t>(-1);
+
     passengers();
     passengers(string);
-    void Add(passenger p);
+    bool Add(const passenger& p);
+    bool Add(const passengerview& p);
+    // adds straight from the field values, without building a passenger first
+    bool Emplace(string_view name, int id, string_view p_method, bool handicap, float rating, bool pets);
+    bool Edit(int id, const passenger& p);
+    bool Edit(int id, const passengerview& p);
+    bool Delete(int id);
+    // in place / swap-and-pop like the drivers versions
+    bool Edit(recordhandle h, const passenger& p);
+    bool Edit(recordhandle h, const passengerview& p);
+    bool Delete(recordhandle h);
+    // returns the slot of the passenger with this id, or npos
+    size_t Lookup(int id) const;
+    // see drivers::Handle()
+    recordhandle Handle(int id) const;
+    recordhandle HandleAt(size_t slot) const;
+    size_t Resolve(recordhandle h) const;
+    // materializes the passenger stored in slot
+    passenger At(size_t slot) const;
+    // the same fields without copying them out; the views stay valid until
+    // the next mutation
+    passengerview View(size_t slot) const;
+    size_t Size() const;
+    void Reserve(size_t n);
+    void Clear();
+    // binary snapshot, see snapshot.h
+    bool SaveSnapshot(const string& path) const;
+    // serialized snapshot tagged with the log position it reflects
+    void SnapshotBytes(vector<char>& out, uint64_t lsn) const;
+    // lsn, if given, receives the log position stored in the snapshot
+    bool LoadSnapshot(const string& path, uint64_t* lsn = 0);
+    // every later mutation is appended to log (0 detaches)
+    void AttachLog(writeaheadlog* log);
+    // replays one LR_PASSENGER_* record
+    bool ApplyLogRecord(uint8_t type, const char* data, size_t size);
+
+    int IdAt(size_t slot) const;
+    float RatingAt(size_t slot) const;
+    bool HandicapAt(size_t slot) const;
+    bool PetsAt(size_t slot) const;
+    // slots of every passenger matching q, in no particular order
+    vector<size_t> Query(const passengerquery& q) const;
+
+    // see drivers::ParallelForEach / ParallelReduce
+    template<typename F>
+    void ParallelForEach(F f) const{
+        ParallelFor(threadpool::Shared(), Ids.size(), [&](size_t begin, size_t end){
+            for(size_t i = begin; i < end; i++){
+                f(i, View(i));
+            }
+        });
+    }
+    template<typename T, typename Map, typename Combine>
+    T ParallelReduce(T init, Map map, Combine combine) const{
+        return ::ParallelReduce(threadpool::Shared(), Ids.size(), init, [&](size_t begin, size_t end){
+            T acc = init;
+            for(size_t i = begin; i < end; i++){
+                acc = combine(acc, map(i, View(i)));
+            }
+            return acc;
+        }, combine);
+    }
+    passengersummary Summarize() const;
+    // running aggregates, O(1) and lock-free like drivers::Stats()
+    ridersnapshot Stats() const;
+    // versioned reads, as for drivers
+    void EnableVersions();
+    void Publish();
+    passengerversion Version() const;
     void PrintSize();
     void PrintAll();
     void FindEntry(int n) ;
 
 };
-#endif
\ No newline at end of file
+#endif
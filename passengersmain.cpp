@@ -80,6 +80,7 @@ int main() {
 
     cout << name <<"\n";
     passengers List(name);
+    List.LoadSnapshot("passengers.snap");
     c = ' ';
 
     PrintMenu();
@@ -92,5 +93,6 @@ int main() {
         }
 
     }
+    List.SaveSnapshot("passengers.snap");
     return 0;
 }
\ No newline at end of file
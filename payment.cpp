@@ -0,0 +1,21 @@
+#include "payment.h"
+
+static const char* PaymentMethodNames[PM_COUNT] = {
+    "cash", "card", "debit"
+};
+
+int ParsePaymentMethod(string_view s){
+    for(int i = 0; i < PM_COUNT; i++){
+        if(s == PaymentMethodNames[i]){
+            return i;
+        }
+    }
+    return PM_UNKNOWN;
+}
+
+const char* PaymentMethodName(int method){
+    if(method < 0 || method >= PM_COUNT){
+        return "unknown";
+    }
+    return PaymentMethodNames[method];
+}
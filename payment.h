@@ -0,0 +1,18 @@
+#ifndef PAYMENT_H
+#define PAYMENT_H
+#include <string_view>
+using namespace std;
+
+// payment methods main.cpp asks for
+enum paymentmethod{
+    PM_CASH = 0,
+    PM_CARD,
+    PM_DEBIT,
+    PM_COUNT,
+    PM_UNKNOWN = -1
+};
+
+int ParsePaymentMethod(string_view s); // PM_UNKNOWN if unknown
+const char* PaymentMethodName(int method);
+
+#endif
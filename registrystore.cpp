@@ -0,0 +1,104 @@
+#include "registrystore.h"
+#include "snapshot.h"
+#include "metrics.h"
+
+registrystore::registrystore(const string& dir, drivers& d, passengers& p)
+    : Dir(dir), Drivers(d), Passengers(p), Compacting(false){
+    CompactBytes = 64 << 20;
+}
+
+registrystore::~registrystore(){
+    Close();
+}
+
+bool registrystore::Open(){
+    uint64_t driversLsn = 0;
+    uint64_t passengersLsn = 0;
+    Drivers.LoadSnapshot(Dir + "/drivers.snap", &driversLsn);
+    Passengers.LoadSnapshot(Dir + "/passengers.snap", &passengersLsn);
+    // the log has to pick up right after the older snapshot, or changes
+    // between the two are lost
+    uint64_t first = (driversLsn < passengersLsn ? driversLsn : passengersLsn) + 1;
+    uint64_t last = writeaheadlog::Replay(Dir, [&](uint64_t lsn, uint8_t type, const char* data, size_t size){
+        if(type < LR_PASSENGER_FIRST){
+            if(lsn > driversLsn){
+                Drivers.ApplyLogRecord(type, data, size);
+            }
+        }
+        else if(lsn > passengersLsn){
+            Passengers.ApplyLogRecord(type, data, size);
+        }
+    }, true, first);
+    if(driversLsn > last){
+        last = driversLsn;
+    }
+    if(passengersLsn > last){
+        last = passengersLsn;
+    }
+    if(!Log.Open(Dir, last + 1)){
+        return false;
+    }
+    Drivers.AttachLog(&Log);
+    Passengers.AttachLog(&Log);
+    return true;
+}
+
+void registrystore::Compact(){
+    METRIC_TIMER(M_STORE_COMPACT);
+    if(!Log.IsOpen()){
+        return;
+    }
+    if(Compactor.joinable()){
+        Compactor.join();
+    }
+    // the snapshots cover everything up to cut; the new segment starts after.
+    // If the log has failed, the old segments are all there is to recover
+    // from, so they stay.
+    uint64_t cut;
+    if(!Log.Rotate(cut)){
+        return;
+    }
+    vector<char> driverBytes;
+    vector<char> passengerBytes;
+    Drivers.SnapshotBytes(driverBytes, cut);
+    Passengers.SnapshotBytes(passengerBytes, cut);
+    string dir = Dir;
+    Compacting = true;
+    Compactor = thread([this, dir, cut, driverBytes = move(driverBytes), passengerBytes = move(passengerBytes)](){
+        if(WriteSnapshotFile(dir + "/drivers.snap", driverBytes) &&
+           WriteSnapshotFile(dir + "/passengers.snap", passengerBytes)){
+            writeaheadlog::RemoveSegmentsBefore(dir, cut + 1);
+        }
+        Compacting = false;
+    });
+}
+
+void registrystore::MaybeCompact(){
+    if(!Compacting && Log.IsOpen() && Log.CurrentSize() >= CompactBytes){
+        Compact();
+    }
+}
+
+void registrystore::SetCompactBytes(size_t bytes){
+    CompactBytes = bytes;
+}
+
+bool registrystore::Sync(){
+    return Log.IsOpen() && Log.Sync();
+}
+
+void registrystore::Close(){
+    if(Compactor.joinable()){
+        Compactor.join();
+    }
+    if(Log.IsOpen()){
+        Log.Sync();
+        Drivers.AttachLog(0);
+        Passengers.AttachLog(0);
+        Log.Close();
+    }
+}
+
+writeaheadlog& registrystore::GetLog(){
+    return Log;
+}
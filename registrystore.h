@@ -0,0 +1,49 @@
+#ifndef REGISTRYSTORE_H
+#define REGISTRYSTORE_H
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+#include "drivers.h"
+#include "passengers.h"
+#include "wal.h"
+
+// Durable storage for the drivers and passengers registries in one
+// directory: drivers.snap, passengers.snap and the write-ahead log segments.
+//
+// Open() loads the newest snapshots and replays the log records they don't
+// already include, up to the first damaged one (see writeaheadlog::Replay),
+// then attaches the log so later mutations are recorded.
+// Compact() rotates the log, serializes both collections on the calling
+// thread and leaves writing the snapshots and deleting the old segments to a
+// background thread.
+class registrystore{
+    private:
+    string Dir;
+    drivers& Drivers;
+    passengers& Passengers;
+    writeaheadlog Log;
+    thread Compactor;
+    atomic<bool> Compacting;
+    // MaybeCompact() triggers once the current segment passes this
+    size_t CompactBytes;
+
+    public:
+    registrystore(const string& dir, drivers& d, passengers& p);
+    ~registrystore();
+    bool Open();
+    void Compact();
+    void MaybeCompact();
+    void SetCompactBytes(size_t bytes);
+    // waits until all logged mutations are on disk; false if they can't
+    // be (no log, or it failed)
+    bool Sync();
+    // waits for a running compaction, syncs and detaches the log
+    void Close();
+    writeaheadlog& GetLog();
+};
+#endif
@@ -0,0 +1,422 @@
+#include "report.h"
+#include <charconv>
+#include <cstring>
+
+static const char* ReportFormatNames[RF_COUNT] = {
+    "text", "csv", "jsonl"
+};
+
+int ParseReportFormat(string_view s){
+    for(int i = 0; i < RF_COUNT; i++){
+        if(s == ReportFormatNames[i]){
+            return i;
+        }
+    }
+    return RF_UNKNOWN;
+}
+
+const char* ReportFormatName(int format){
+    if(format < 0 || format >= RF_COUNT){
+        return "unknown";
+    }
+    return ReportFormatNames[format];
+}
+
+reportwriter::reportwriter(FILE* out){
+    Out = out;
+    Sink = 0;
+    Owned = false;
+    Failed = out == 0;
+    Buffer.resize(BufferSize);
+    Used = 0;
+}
+
+reportwriter::reportwriter(const string& path){
+    Out = fopen(path.c_str(), "wb");
+    Sink = 0;
+    Owned = true;
+    Failed = Out == 0;
+    Buffer.resize(BufferSize);
+    Used = 0;
+}
+
+reportwriter::~reportwriter(){
+    Flush();
+    if(Owned && Out != 0){
+        fclose(Out);
+    }
+}
+
+reportwriter::reportwriter(string* sink){
+    Out = 0;
+    Sink = sink;
+    Owned = false;
+    Failed = false;
+    // a sink is usually fed a line at a time; no need for a big buffer
+    Buffer.resize(64 * 1024);
+    Used = 0;
+}
+
+void reportwriter::Redirect(string* sink){
+    Flush();
+    Sink = sink;
+}
+
+bool reportwriter::IsOpen() const{
+    return Out != 0 || Sink != 0;
+}
+
+// makes room for n more bytes; n is always well under the buffer size
+void reportwriter::Reserve(size_t n){
+    if(Used + n > Buffer.size()){
+        Flush();
+    }
+}
+
+void reportwriter::Put(string_view s){
+    if(s.size() >= Buffer.size() / 2){
+        // too big to be worth copying
+        Flush();
+        if(Sink != 0){
+            Sink->append(s.data(), s.size());
+        }
+        else if(Out == 0 || fwrite(s.data(), 1, s.size(), Out) != s.size()){
+            Failed = true;
+        }
+        return;
+    }
+    Reserve(s.size());
+    memcpy(Buffer.data() + Used, s.data(), s.size());
+    Used += s.size();
+}
+
+void reportwriter::PutChar(char c){
+    Reserve(1);
+    Buffer[Used++] = c;
+}
+
+void reportwriter::PutInt(int64_t v){
+    Reserve(24);
+    char* at = Buffer.data() + Used;
+    Used = to_chars(at, at + 24, v).ptr - Buffer.data();
+}
+
+// shortest text that reads back as the same value, which is also what
+// cout prints for the usual one-decimal ratings
+void reportwriter::PutFloat(float v){
+    Reserve(32);
+    char* at = Buffer.data() + Used;
+    Used = to_chars(at, at + 32, v).ptr - Buffer.data();
+}
+
+void reportwriter::PutDouble(double v){
+    Reserve(32);
+    char* at = Buffer.data() + Used;
+    Used = to_chars(at, at + 32, v).ptr - Buffer.data();
+}
+
+void reportwriter::PutCsv(string_view s){
+    if(s.find_first_of(",\"\r\n") == string_view::npos){
+        Put(s);
+        return;
+    }
+    PutChar('"');
+    size_t start = 0;
+    for(size_t i = 0; i < s.size(); i++){
+        if(s[i] == '"'){
+            Put(s.substr(start, i + 1 - start));
+            PutChar('"');
+            start = i + 1;
+        }
+    }
+    Put(s.substr(start));
+    PutChar('"');
+}
+
+void reportwriter::PutJson(string_view s){
+    static const char Hex[] = "0123456789abcdef";
+    PutChar('"');
+    size_t start = 0;
+    for(size_t i = 0; i < s.size(); i++){
+        unsigned char c = static_cast<unsigned char>(s[i]);
+        if(c >= 0x20 && c != '"' && c != '\\'){
+            continue;
+        }
+        Put(s.substr(start, i - start));
+        start = i + 1;
+        Reserve(6);
+        char* at = Buffer.data() + Used;
+        at[0] = '\\';
+        if(c == '"' || c == '\\'){
+            at[1] = static_cast<char>(c);
+            Used += 2;
+        }
+        else if(c == '\n'){
+            at[1] = 'n';
+            Used += 2;
+        }
+        else if(c == '\t'){
+            at[1] = 't';
+            Used += 2;
+        }
+        else{
+            memcpy(at + 1, "u00", 3);
+            at[4] = Hex[c >> 4];
+            at[5] = Hex[c & 15];
+            Used += 6;
+        }
+    }
+    Put(s.substr(start));
+    PutChar('"');
+}
+
+bool reportwriter::Flush(){
+    if(Used != 0){
+        if(Sink != 0){
+            Sink->append(Buffer.data(), Used);
+        }
+        else if(Out == 0 || fwrite(Buffer.data(), 1, Used, Out) != Used){
+            Failed = true;
+        }
+        Used = 0;
+    }
+    if(Out != 0 && fflush(Out) != 0){
+        Failed = true;
+    }
+    return !Failed;
+}
+
+// flag text by value, so formatting a record has no branches on the flags
+static const string_view YesNo[2] = {"no", "yes"};
+static const string_view TrueFalse[2] = {"false", "true"};
+static const string_view HandicapText[2] = {"Not Handicap Capable\n", "Handicap Capable\n"};
+static const string_view PetsText[2] = {"Not Pet Capable\n", "Pet Capable\n"};
+static const string_view AvailableText[2] = {"Not Available\n", "Available\n"};
+
+// one entry per reportformat; header may be 0
+struct driverformat{
+    void (*header)(reportwriter& out);
+    void (*record)(reportwriter& out, const driverview& d);
+};
+
+struct passengerformat{
+    void (*header)(reportwriter& out);
+    void (*record)(reportwriter& out, const passengerview& p);
+};
+
+static void DriverText(reportwriter& out, const driverview& d){
+    out.Put("ID: ");
+    out.PutInt(d.id);
+    out.Put("\nName: ");
+    out.Put(d.name);
+    out.Put("\nCapacity: ");
+    out.PutInt(d.capacity);
+    out.Put("\nHandicap: ");
+    out.Put(HandicapText[d.handicap]);
+    out.Put("Type: ");
+    out.Put(d.type);
+    out.Put("\nRating: ");
+    out.PutFloat(d.rating);
+    out.PutChar('\n');
+    out.Put(AvailableText[d.available]);
+    out.Put(PetsText[d.pets]);
+    out.Put("Notes: ");
+    out.Put(d.notes);
+    out.Put("\nLocation: ");
+    out.PutDouble(d.lat);
+    out.Put(", ");
+    out.PutDouble(d.lon);
+    out.Put("\n\n");
+}
+
+static void DriverCsvHeader(reportwriter& out){
+    out.Put("id,name,capacity,handicap,type,rating,available,pets,notes,lat,lon\n");
+}
+
+static void DriverCsv(reportwriter& out, const driverview& d){
+    out.PutInt(d.id);
+    out.PutChar(',');
+    out.PutCsv(d.name);
+    out.PutChar(',');
+    out.PutInt(d.capacity);
+    out.PutChar(',');
+    out.Put(YesNo[d.handicap]);
+    out.PutChar(',');
+    out.PutCsv(d.type);
+    out.PutChar(',');
+    out.PutFloat(d.rating);
+    out.PutChar(',');
+    out.Put(YesNo[d.available]);
+    out.PutChar(',');
+    out.Put(YesNo[d.pets]);
+    out.PutChar(',');
+    out.PutCsv(d.notes);
+    out.PutChar(',');
+    out.PutDouble(d.lat);
+    out.PutChar(',');
+    out.PutDouble(d.lon);
+    out.PutChar('\n');
+}
+
+static void DriverJson(reportwriter& out, const driverview& d){
+    out.Put("{\"id\":");
+    out.PutInt(d.id);
+    out.Put(",\"name\":");
+    out.PutJson(d.name);
+    out.Put(",\"capacity\":");
+    out.PutInt(d.capacity);
+    out.Put(",\"handicap\":");
+    out.Put(TrueFalse[d.handicap]);
+    out.Put(",\"type\":");
+    out.PutJson(d.type);
+    out.Put(",\"rating\":");
+    out.PutFloat(d.rating);
+    out.Put(",\"available\":");
+    out.Put(TrueFalse[d.available]);
+    out.Put(",\"pets\":");
+    out.Put(TrueFalse[d.pets]);
+    out.Put(",\"notes\":");
+    out.PutJson(d.notes);
+    out.Put(",\"lat\":");
+    out.PutDouble(d.lat);
+    out.Put(",\"lon\":");
+    out.PutDouble(d.lon);
+    out.Put("}\n");
+}
+
+static const driverformat DriverFormats[RF_COUNT] = {
+    {0, DriverText},
+    {DriverCsvHeader, DriverCsv},
+    {0, DriverJson}
+};
+
+static void PassengerText(reportwriter& out, const passengerview& p){
+    out.Put("Name: ");
+    out.Put(p.name);
+    out.Put("\nID: ");
+    out.PutInt(p.id);
+    out.Put("\nPayment: ");
+    out.Put(p.p_method);
+    out.Put("\nHandicap: ");
+    out.Put(HandicapText[p.handicap]);
+    out.Put("Ratings: ");
+    out.PutFloat(p.rating);
+    out.PutChar('\n');
+    out.Put(PetsText[p.pets]);
+    out.PutChar('\n');
+}
+
+static void PassengerCsvHeader(reportwriter& out){
+    out.Put("name,id,payment,handicap,rating,pets\n");
+}
+
+static void PassengerCsv(reportwriter& out, const passengerview& p){
+    out.PutCsv(p.name);
+    out.PutChar(',');
+    out.PutInt(p.id);
+    out.PutChar(',');
+    out.PutCsv(p.p_method);
+    out.PutChar(',');
+    out.Put(YesNo[p.handicap]);
+    out.PutChar(',');
+    out.PutFloat(p.rating);
+    out.PutChar(',');
+    out.Put(YesNo[p.pets]);
+    out.PutChar('\n');
+}
+
+static void PassengerJson(reportwriter& out, const passengerview& p){
+    out.Put("{\"name\":");
+    out.PutJson(p.name);
+    out.Put(",\"id\":");
+    out.PutInt(p.id);
+    out.Put(",\"payment\":");
+    out.PutJson(p.p_method);
+    out.Put(",\"handicap\":");
+    out.Put(TrueFalse[p.handicap]);
+    out.Put(",\"rating\":");
+    out.PutFloat(p.rating);
+    out.Put(",\"pets\":");
+    out.Put(TrueFalse[p.pets]);
+    out.Put("}\n");
+}
+
+static const passengerformat PassengerFormats[RF_COUNT] = {
+    {0, PassengerText},
+    {PassengerCsvHeader, PassengerCsv},
+    {0, PassengerJson}
+};
+
+void WriteDriver(reportwriter& out, const driverview& d, reportformat format){
+    if(format >= 0 && format < RF_COUNT){
+        DriverFormats[format].record(out, d);
+    }
+}
+
+void WritePassenger(reportwriter& out, const passengerview& p, reportformat format){
+    if(format >= 0 && format < RF_COUNT){
+        PassengerFormats[format].record(out, p);
+    }
+}
+
+size_t ExportDrivers(const drivers& list, reportwriter& out, reportformat format){
+    if(format < 0 || format >= RF_COUNT){
+        return 0;
+    }
+    const driverformat& f = DriverFormats[format];
+    if(f.header != 0){
+        f.header(out);
+    }
+    size_t n = list.Size();
+    for(size_t i = 0; i < n; i++){
+        f.record(out, list.View(i));
+    }
+    out.Flush();
+    return n;
+}
+
+size_t ExportPassengers(const passengers& list, reportwriter& out, reportformat format){
+    if(format < 0 || format >= RF_COUNT){
+        return 0;
+    }
+    const passengerformat& f = PassengerFormats[format];
+    if(f.header != 0){
+        f.header(out);
+    }
+    size_t n = list.Size();
+    for(size_t i = 0; i < n; i++){
+        f.record(out, list.View(i));
+    }
+    out.Flush();
+    return n;
+}
+
+size_t ExportDrivers(const driverversion& list, reportwriter& out, reportformat format){
+    if(format < 0 || format >= RF_COUNT){
+        return 0;
+    }
+    const driverformat& f = DriverFormats[format];
+    if(f.header != 0){
+        f.header(out);
+    }
+    list.ForEach([&](size_t, const driver& d){
+        f.record(out, d.View());
+    });
+    out.Flush();
+    return list.Size();
+}
+
+size_t ExportPassengers(const passengerversion& list, reportwriter& out, reportformat format){
+    if(format < 0 || format >= RF_COUNT){
+        return 0;
+    }
+    const passengerformat& f = PassengerFormats[format];
+    if(f.header != 0){
+        f.header(out);
+    }
+    list.ForEach([&](size_t, const passenger& p){
+        f.record(out, p.View());
+    });
+    out.Flush();
+    return list.Size();
+}
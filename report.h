@@ -0,0 +1,83 @@
+#ifndef REPORT_H
+#define REPORT_H
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+#include "drivers.h"
+#include "passengers.h"
+
+// Listing/export of whole collections. Records are formatted straight from
+// the column views into one large buffer that is written out with fwrite
+// when it fills, so dumping a collection costs one syscall per megabyte
+// instead of a flush per line.
+//
+// RF_CSV and RF_JSONL use the same field names as the importer, so an
+// export can be imported again (for CSV, as long as no field holds a line
+// break; the importer reads CSV a line at a time).
+enum reportformat{
+    RF_TEXT = 0, // the layout PrintAll has always used
+    RF_CSV,
+    RF_JSONL,
+    RF_COUNT,
+    RF_UNKNOWN = -1
+};
+
+int ParseReportFormat(string_view s); // RF_UNKNOWN if unknown
+const char* ReportFormatName(int format);
+
+class reportwriter{
+    private:
+    static const size_t BufferSize = 1 << 20;
+
+    FILE* Out;
+    // set instead of Out when writing into a string
+    string* Sink;
+    bool Owned;
+    bool Failed;
+    vector<char> Buffer;
+    size_t Used;
+
+    reportwriter(const reportwriter&);
+    reportwriter& operator=(const reportwriter&);
+    void Reserve(size_t n);
+
+    public:
+    // writes to out, which stays open
+    explicit reportwriter(FILE* out);
+    // writes to the file at path; check IsOpen()
+    explicit reportwriter(const string& path);
+    // appends to sink on every Flush(), e.g. a connection's output buffer
+    explicit reportwriter(string* sink);
+    ~reportwriter();
+    // flushes, then sends further output to another string so one writer
+    // can serve many connections
+    void Redirect(string* sink);
+    bool IsOpen() const;
+    void Put(string_view s);
+    void PutChar(char c);
+    void PutInt(int64_t v);
+    void PutFloat(float v);
+    void PutDouble(double v);
+    // s as a CSV field, quoted only when it needs to be
+    void PutCsv(string_view s);
+    // s as a JSON string, quotes included
+    void PutJson(string_view s);
+    // false if any write so far failed
+    bool Flush();
+};
+
+// both return the number of records written
+size_t ExportDrivers(const drivers& list, reportwriter& out, reportformat format);
+size_t ExportPassengers(const passengers& list, reportwriter& out, reportformat format);
+// the same from a published version, safe while the writer keeps going
+size_t ExportDrivers(const driverversion& list, reportwriter& out, reportformat format);
+size_t ExportPassengers(const passengerversion& list, reportwriter& out, reportformat format);
+// a single record, without any header
+void WriteDriver(reportwriter& out, const driverview& d, reportformat format);
+void WritePassenger(reportwriter& out, const passengerview& p, reportformat format);
+#endif
@@ -0,0 +1,513 @@
+#include "ridearchive.h"
+#include "snapshot.h"
+#include "mappedfile.h"
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+// File layout (all little-endian, unaligned):
+//   "RIDEARC1", uint32 version, uint32 labels, uint64 segments
+//   labels: uint32 length, bytes
+//   segments: uint64 rows, int32 min/max passenger, min/max driver,
+//             7 packed columns (int64 base, uint8 width, uint64 words,
+//             words), 3 streams (uint64 bytes, bytes)
+static const char ArchiveMagic[8] = {'R', 'I', 'D', 'E', 'A', 'R', 'C', '1'};
+static const uint32_t ArchiveVersion = 1;
+static const double CoordScale = 1e6;
+
+static uint64_t ZigZag(int64_t v){
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+static int64_t UnZigZag(uint64_t v){
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+static void PutVarint(vector<uint8_t>& out, uint64_t v){
+    while(v >= 0x80){
+        out.push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+static uint64_t GetVarint(const uint8_t*& p){
+    uint64_t v = 0;
+    int shift = 0;
+    while(*p & 0x80){
+        v |= static_cast<uint64_t>(*p++ & 0x7F) << shift;
+        shift += 7;
+    }
+    v |= static_cast<uint64_t>(*p++) << shift;
+    return v;
+}
+
+// values in a stream, or SIZE_MAX if it ends in the middle of one
+static size_t VarintCount(const vector<uint8_t>& s){
+    if(!s.empty() && s.back() >= 0x80){
+        return SIZE_MAX;
+    }
+    size_t n = 0;
+    for(size_t i = 0; i < s.size(); i++){
+        n += s[i] < 0x80;
+    }
+    return n;
+}
+
+static int64_t Micro(double degrees){
+    return llround(degrees * CoordScale);
+}
+
+void ridearchive::Encode(const vector<ride>& rows, segment& seg, vector<string>& newNames){
+    size_t n = rows.size();
+    seg.rows = n;
+    seg.minPassenger = seg.maxPassenger = rows[0].getPassenger();
+    seg.minDriver = seg.maxDriver = rows[0].getDriver();
+    vector<int64_t> columns[7];
+    for(size_t c = 0; c < 7; c++){
+        columns[c].resize(n);
+    }
+    int64_t prevId = 0;
+    int64_t prevTime = 0;
+    int64_t prevCoord[4] = {};
+    for(size_t i = 0; i < n; i++){
+        const ride& r = rows[i];
+        seg.minPassenger = r.getPassenger() < seg.minPassenger ? r.getPassenger() : seg.minPassenger;
+        seg.maxPassenger = r.getPassenger() > seg.maxPassenger ? r.getPassenger() : seg.maxPassenger;
+        seg.minDriver = r.getDriver() < seg.minDriver ? r.getDriver() : seg.minDriver;
+        seg.maxDriver = r.getDriver() > seg.maxDriver ? r.getDriver() : seg.maxDriver;
+        columns[0][i] = r.getPassenger();
+        columns[1][i] = r.getDriver();
+        columns[2][i] = Code(r.getPickUp(), newNames);
+        columns[3][i] = Code(r.getDropoff(), newNames);
+        columns[4][i] = r.getPartySize();
+        columns[5][i] = r.getPets();
+        columns[6][i] = r.getStatus();
+        PutVarint(seg.ids, ZigZag(r.getID() - prevId));
+        prevId = r.getID();
+        PutVarint(seg.times, ZigZag(r.getRequestTime() - prevTime));
+        prevTime = r.getRequestTime();
+        int64_t coord[4] = {
+            Micro(r.getPickUpLat()), Micro(r.getPickUpLon()), Micro(r.getDropoffLat()), Micro(r.getDropoffLon())
+        };
+        for(int k = 0; k < 4; k++){
+            PutVarint(seg.coords, ZigZag(coord[k] - prevCoord[k]));
+            prevCoord[k] = coord[k];
+        }
+    }
+    packedcolumn* packed[7] = {
+        &seg.passenger, &seg.driver, &seg.pickup, &seg.dropoff, &seg.party, &seg.pets, &seg.status
+    };
+    for(size_t c = 0; c < 7; c++){
+        const vector<int64_t>& v = columns[c];
+        int64_t lo = v[0];
+        int64_t hi = v[0];
+        for(size_t i = 1; i < n; i++){
+            lo = v[i] < lo ? v[i] : lo;
+            hi = v[i] > hi ? v[i] : hi;
+        }
+        packedcolumn& p = *packed[c];
+        p.base = lo;
+        uint64_t range = static_cast<uint64_t>(hi - lo);
+        p.width = 0;
+        while(p.width < 64 && (range >> p.width) != 0){
+            p.width++;
+        }
+        p.words.assign((n * p.width + 63) / 64, 0);
+        for(size_t i = 0; p.width > 0 && i < n; i++){
+            uint64_t x = static_cast<uint64_t>(v[i] - lo);
+            size_t bit = i * p.width;
+            size_t w = bit >> 6;
+            size_t off = bit & 63;
+            p.words[w] |= x << off;
+            if(off + p.width > 64){
+                p.words[w + 1] |= x >> (64 - off);
+            }
+        }
+    }
+    seg.ids.shrink_to_fit();
+    seg.times.shrink_to_fit();
+    seg.coords.shrink_to_fit();
+}
+
+// row i of a packed column
+static inline int64_t PackedAt(int64_t base, uint8_t width, const uint64_t* words, size_t i){
+    if(width == 0){
+        return base;
+    }
+    size_t bit = i * width;
+    size_t w = bit >> 6;
+    size_t off = bit & 63;
+    uint64_t x = words[w] >> off;
+    if(off + width > 64){
+        x |= words[w + 1] << (64 - off);
+    }
+    if(width < 64){
+        x &= (uint64_t(1) << width) - 1;
+    }
+    return base + static_cast<int64_t>(x);
+}
+
+uint32_t ridearchive::Code(const char* label, vector<string>& newNames){
+    string key(label);
+    unordered_map<string, uint32_t>::iterator i = Codes.find(key);
+    if(i != Codes.end()){
+        return i->second;
+    }
+    // only the sealer adds to Names, so its size is stable here
+    uint32_t code = static_cast<uint32_t>(Names.size() + newNames.size());
+    Codes.emplace(key, code);
+    newNames.push_back(key);
+    return code;
+}
+
+ridearchive::ridearchive(){
+    Names.push_back(string());
+    Codes.emplace(string(), 0);
+    Requested = 0;
+    SealedCount = 0;
+    ArchivedCount = 0;
+    Stop = false;
+    Sealer = thread(&ridearchive::SealLoop, this);
+}
+
+ridearchive::~ridearchive(){
+    {
+        lock_guard<mutex> lk(Lock);
+        Stop = true;
+    }
+    Wake.notify_all();
+    Sealer.join();
+}
+
+void ridearchive::Archive(const ride& r){
+    bool full;
+    {
+        lock_guard<mutex> lk(Lock);
+        Pending.push_back(r);
+        ArchivedCount++;
+        full = Pending.size() == SegmentRows;
+    }
+    if(full){
+        Wake.notify_one();
+    }
+}
+
+void ridearchive::Flush(){
+    unique_lock<mutex> lk(Lock);
+    size_t target = ArchivedCount;
+    if(Requested < target){
+        Requested = target;
+    }
+    Wake.notify_one();
+    Sealed.wait(lk, [this, target]{ return SealedCount >= target; });
+}
+
+void ridearchive::SealLoop(){
+    vector<string> newNames;
+    while(true){
+        {
+            unique_lock<mutex> lk(Lock);
+            Wake.wait(lk, [this]{
+                return Stop || Pending.size() >= SegmentRows || (Requested > SealedCount && !Pending.empty());
+            });
+            if(Pending.empty()){
+                return;
+            }
+            if(Pending.size() <= SegmentRows){
+                Sealing.swap(Pending);
+            }
+            else{
+                Sealing.assign(Pending.begin(), Pending.begin() + SegmentRows);
+                Pending.erase(Pending.begin(), Pending.begin() + SegmentRows);
+            }
+        }
+        // readers may scan Sealing meanwhile; nobody writes it but us
+        segment seg;
+        newNames.clear();
+        Encode(Sealing, seg, newNames);
+        {
+            unique_lock<shared_mutex> sl(SegmentLock);
+            Segments.push_back(move(seg));
+            for(size_t i = 0; i < newNames.size(); i++){
+                Names.push_back(move(newNames[i]));
+            }
+            lock_guard<mutex> lk(Lock);
+            SealedCount += Sealing.size();
+            Sealing.clear();
+        }
+        Sealed.notify_all();
+    }
+}
+
+void ridearchive::Scan(const segment& seg, bool byDriver, int id, vector<ride>& out) const{
+    const packedcolumn& key = byDriver ? seg.driver : seg.passenger;
+    // rows are found on the packed ids alone; the streams are only decoded
+    // if something matched
+    size_t first = out.size();
+    vector<size_t> rows;
+    for(size_t i = 0; i < seg.rows; i++){
+        if(PackedAt(key.base, key.width, key.words.data(), i) == id){
+            rows.push_back(i);
+        }
+    }
+    if(rows.empty()){
+        return;
+    }
+    out.resize(first + rows.size());
+    const uint8_t* ids = seg.ids.data();
+    const uint8_t* times = seg.times.data();
+    const uint8_t* coords = seg.coords.data();
+    int64_t rideId = 0;
+    int64_t time = 0;
+    int64_t coord[4] = {};
+    size_t next = 0;
+    for(size_t i = 0; next < rows.size(); i++){
+        rideId += UnZigZag(GetVarint(ids));
+        time += UnZigZag(GetVarint(times));
+        for(int k = 0; k < 4; k++){
+            coord[k] += UnZigZag(GetVarint(coords));
+        }
+        if(i != rows[next]){
+            continue;
+        }
+        ride& r = out[first + next++];
+        r.setID(static_cast<int>(rideId));
+        r.setRequestTime(time);
+        r.setPickUpCoords(coord[0] / CoordScale, coord[1] / CoordScale);
+        r.setDropoffCoords(coord[2] / CoordScale, coord[3] / CoordScale);
+        r.setPassenger(static_cast<int>(PackedAt(seg.passenger.base, seg.passenger.width, seg.passenger.words.data(), i)));
+        r.setDriver(static_cast<int>(PackedAt(seg.driver.base, seg.driver.width, seg.driver.words.data(), i)));
+        r.setPickUp(Names[PackedAt(seg.pickup.base, seg.pickup.width, seg.pickup.words.data(), i)]);
+        r.setDropoff(Names[PackedAt(seg.dropoff.base, seg.dropoff.width, seg.dropoff.words.data(), i)]);
+        r.setPartySize(static_cast<int>(PackedAt(seg.party.base, seg.party.width, seg.party.words.data(), i)));
+        r.setPets(PackedAt(seg.pets.base, seg.pets.width, seg.pets.words.data(), i) != 0);
+        r.setStatus(static_cast<ridestatus>(PackedAt(seg.status.base, seg.status.width, seg.status.words.data(), i)));
+    }
+}
+
+void ridearchive::History(bool byDriver, int id, vector<ride>& out) const{
+    out.clear();
+    shared_lock<shared_mutex> sl(SegmentLock);
+    for(size_t s = 0; s < Segments.size(); s++){
+        const segment& seg = Segments[s];
+        int lo = byDriver ? seg.minDriver : seg.minPassenger;
+        int hi = byDriver ? seg.maxDriver : seg.maxPassenger;
+        if(id >= lo && id <= hi){
+            Scan(seg, byDriver, id, out);
+        }
+    }
+    // not sealed yet; Sealing is the older of the two
+    lock_guard<mutex> lk(Lock);
+    const vector<ride>* open[2] = { &Sealing, &Pending };
+    for(int k = 0; k < 2; k++){
+        for(size_t i = 0; i < open[k]->size(); i++){
+            const ride& r = (*open[k])[i];
+            if((byDriver ? r.getDriver() : r.getPassenger()) == id){
+                out.push_back(r);
+            }
+        }
+    }
+}
+
+void ridearchive::PassengerHistory(int passengerId, vector<ride>& out) const{
+    History(false, passengerId, out);
+}
+
+void ridearchive::DriverHistory(int driverId, vector<ride>& out) const{
+    History(true, driverId, out);
+}
+
+archivestats ridearchive::Stats() const{
+    archivestats s;
+    shared_lock<shared_mutex> sl(SegmentLock);
+    s.segments = Segments.size();
+    s.locations = Names.size();
+    s.bytes = 0;
+    size_t sealed = 0;
+    for(size_t i = 0; i < Segments.size(); i++){
+        const segment& seg = Segments[i];
+        const packedcolumn* packed[7] = {
+            &seg.passenger, &seg.driver, &seg.pickup, &seg.dropoff, &seg.party, &seg.pets, &seg.status
+        };
+        s.bytes += sizeof(segment) + seg.ids.size() + seg.times.size() + seg.coords.size();
+        for(int c = 0; c < 7; c++){
+            s.bytes += packed[c]->words.size() * sizeof(uint64_t);
+        }
+        sealed += seg.rows;
+    }
+    for(size_t i = 0; i < Names.size(); i++){
+        s.bytes += sizeof(string) + Names[i].size();
+    }
+    s.rawBytes = sealed * sizeof(ride);
+    lock_guard<mutex> lk(Lock);
+    s.rides = ArchivedCount;
+    return s;
+}
+
+template <class T>
+static void Append(vector<char>& out, const T& v){
+    const char* p = reinterpret_cast<const char*>(&v);
+    out.insert(out.end(), p, p + sizeof(T));
+}
+
+static void AppendBytes(vector<char>& out, const void* data, size_t n){
+    uint64_t size = n;
+    Append(out, size);
+    const char* p = static_cast<const char*>(data);
+    out.insert(out.end(), p, p + n);
+}
+
+bool ridearchive::Save(const string& path){
+    Flush();
+    vector<char> bytes;
+    shared_lock<shared_mutex> sl(SegmentLock);
+    bytes.insert(bytes.end(), ArchiveMagic, ArchiveMagic + 8);
+    Append(bytes, ArchiveVersion);
+    Append(bytes, static_cast<uint32_t>(Names.size()));
+    Append(bytes, static_cast<uint64_t>(Segments.size()));
+    for(size_t i = 0; i < Names.size(); i++){
+        Append(bytes, static_cast<uint32_t>(Names[i].size()));
+        bytes.insert(bytes.end(), Names[i].begin(), Names[i].end());
+    }
+    for(size_t i = 0; i < Segments.size(); i++){
+        const segment& seg = Segments[i];
+        Append(bytes, static_cast<uint64_t>(seg.rows));
+        Append(bytes, static_cast<int32_t>(seg.minPassenger));
+        Append(bytes, static_cast<int32_t>(seg.maxPassenger));
+        Append(bytes, static_cast<int32_t>(seg.minDriver));
+        Append(bytes, static_cast<int32_t>(seg.maxDriver));
+        const packedcolumn* packed[7] = {
+            &seg.passenger, &seg.driver, &seg.pickup, &seg.dropoff, &seg.party, &seg.pets, &seg.status
+        };
+        for(int c = 0; c < 7; c++){
+            Append(bytes, packed[c]->base);
+            Append(bytes, packed[c]->width);
+            AppendBytes(bytes, packed[c]->words.data(), packed[c]->words.size() * sizeof(uint64_t));
+        }
+        AppendBytes(bytes, seg.ids.data(), seg.ids.size());
+        AppendBytes(bytes, seg.times.data(), seg.times.size());
+        AppendBytes(bytes, seg.coords.data(), seg.coords.size());
+    }
+    sl.unlock();
+    return WriteSnapshotFile(path, bytes);
+}
+
+// bounds-checked reads from the mapped file
+class archivereader{
+    private:
+    const char* P;
+    const char* End;
+
+    public:
+    archivereader(const char* data, size_t size) : P(data), End(data + size){
+    }
+    bool Take(void* out, size_t n){
+        if(static_cast<size_t>(End - P) < n){
+            return false;
+        }
+        memcpy(out, P, n);
+        P += n;
+        return true;
+    }
+    template <class T>
+    bool Get(T& v){
+        return Take(&v, sizeof(T));
+    }
+    template <class T>
+    bool GetVector(vector<T>& v){
+        uint64_t n;
+        if(!Get(n) || n % sizeof(T) != 0 || static_cast<uint64_t>(End - P) < n){
+            return false;
+        }
+        v.resize(n / sizeof(T));
+        return Take(v.data(), n);
+    }
+};
+
+bool ridearchive::Load(const string& path){
+    mappedfile file;
+    if(!file.Open(path)){
+        return false;
+    }
+    archivereader in(file.GetData(), file.GetLength());
+    char magic[8];
+    uint32_t version;
+    uint32_t labels;
+    uint64_t count;
+    if(!in.Take(magic, 8) || memcmp(magic, ArchiveMagic, 8) != 0 || !in.Get(version) || version != ArchiveVersion
+       || !in.Get(labels) || !in.Get(count)){
+        return false;
+    }
+    deque<string> names;
+    for(uint32_t i = 0; i < labels; i++){
+        uint32_t n;
+        string s;
+        if(!in.Get(n) || n > file.GetLength()){
+            return false;
+        }
+        s.resize(n);
+        if(!in.Take(&s[0], n)){
+            return false;
+        }
+        names.push_back(s);
+    }
+    if(names.empty() || !names[0].empty()){
+        return false;
+    }
+    vector<segment> segments;
+    size_t rows = 0;
+    for(uint64_t i = 0; i < count; i++){
+        segment seg;
+        uint64_t n;
+        int32_t bounds[4];
+        if(!in.Get(n) || n == 0 || n > SegmentRows || !in.Take(bounds, sizeof(bounds))){
+            return false;
+        }
+        seg.rows = n;
+        seg.minPassenger = bounds[0];
+        seg.maxPassenger = bounds[1];
+        seg.minDriver = bounds[2];
+        seg.maxDriver = bounds[3];
+        packedcolumn* packed[7] = {
+            &seg.passenger, &seg.driver, &seg.pickup, &seg.dropoff, &seg.party, &seg.pets, &seg.status
+        };
+        for(int c = 0; c < 7; c++){
+            if(!in.Get(packed[c]->base) || !in.Get(packed[c]->width) || packed[c]->width > 64
+               || !in.GetVector(packed[c]->words) || packed[c]->words.size() != (n * packed[c]->width + 63) / 64){
+                return false;
+            }
+        }
+        if(!in.GetVector(seg.ids) || !in.GetVector(seg.times) || !in.GetVector(seg.coords)){
+            return false;
+        }
+        if(VarintCount(seg.ids) != n || VarintCount(seg.times) != n || VarintCount(seg.coords) != 4 * n){
+            return false;
+        }
+        // label codes must resolve
+        for(size_t r = 0; r < n; r++){
+            int64_t a = PackedAt(seg.pickup.base, seg.pickup.width, seg.pickup.words.data(), r);
+            int64_t b = PackedAt(seg.dropoff.base, seg.dropoff.width, seg.dropoff.words.data(), r);
+            if(a < 0 || b < 0 || static_cast<size_t>(a) >= names.size() || static_cast<size_t>(b) >= names.size()){
+                return false;
+            }
+        }
+        rows += n;
+        segments.push_back(move(seg));
+    }
+    Flush();
+    unique_lock<shared_mutex> sl(SegmentLock);
+    Segments.swap(segments);
+    Names.swap(names);
+    Codes.clear();
+    for(size_t i = 0; i < Names.size(); i++){
+        Codes.emplace(Names[i], static_cast<uint32_t>(i));
+    }
+    lock_guard<mutex> lk(Lock);
+    // whatever was archived before is replaced, pending rides included
+    Pending.clear();
+    ArchivedCount = rows;
+    SealedCount = rows;
+    Requested = rows;
+    return true;
+}
@@ -0,0 +1,122 @@
+#ifndef RIDEARCHIVE_H
+#define RIDEARCHIVE_H
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+#include "Ride.h"
+
+struct archivestats{
+    size_t rides;       // archived, sealed or not
+    size_t segments;
+    size_t locations;   // distinct pickup/dropoff labels
+    size_t bytes;       // held by the sealed segments and the dictionary
+    size_t rawBytes;    // what the sealed rides took as ride objects
+};
+
+// Cold storage for finished rides. Archive() only copies the ride into a
+// pending buffer, so the dispatch path pays for a memcpy; a sealer thread
+// turns every SegmentRows pending rides into one immutable columnar
+// segment:
+//
+//   - ride ids and request times: zigzag varint deltas from the row before
+//   - coordinates: microdegrees, zigzag varint deltas per column
+//   - passenger and driver ids, party size, pets, status: bit-packed at the
+//     width the segment's min..max range needs (frame of reference)
+//   - pickup and dropoff labels: bit-packed codes into one dictionary
+//
+// A segment also keeps the min and max passenger and driver id, so a
+// history scan skips segments that can't hold the id and, in the rest,
+// reads the packed id column a row at a time; only matching rows are
+// decoded back into rides.
+//
+// History reads may run on any thread while the sealer works. Rides that
+// are still pending (or being sealed) are scanned as plain records, so a
+// ride is visible from the moment it was archived.
+class ridearchive{
+    public:
+    static const size_t SegmentRows = 4096;
+
+    private:
+    // values stored as value - base in width bits each
+    struct packedcolumn{
+        int64_t base;
+        uint8_t width;
+        vector<uint64_t> words;
+    };
+
+    struct segment{
+        size_t rows;
+        int minPassenger, maxPassenger;
+        int minDriver, maxDriver;
+        packedcolumn passenger;
+        packedcolumn driver;
+        packedcolumn pickup;
+        packedcolumn dropoff;
+        packedcolumn party;
+        packedcolumn pets;
+        packedcolumn status;
+        // varint streams, decoded front to back
+        vector<uint8_t> ids;
+        vector<uint8_t> times;
+        vector<uint8_t> coords; // pickup lat, lon, dropoff lat, lon per row
+    };
+
+    // SegmentLock guards Segments and Names; Lock guards Pending, Sealing
+    // and the flags. Always take SegmentLock first.
+    mutable shared_mutex SegmentLock;
+    vector<segment> Segments;
+    // dictionary: code -> label; Codes is only touched by the sealer
+    deque<string> Names;
+    unordered_map<string, uint32_t> Codes;
+    mutable mutex Lock;
+    condition_variable Wake;
+    condition_variable Sealed;
+    vector<ride> Pending;
+    // the batch the sealer is encoding, still readable until it's published
+    vector<ride> Sealing;
+    size_t Requested;  // seal even a partial batch, for Flush
+    size_t SealedCount;
+    size_t ArchivedCount;
+    bool Stop;
+    thread Sealer;
+
+    void SealLoop();
+    // encodes rows into seg; new labels go to newNames, not Names yet
+    void Encode(const vector<ride>& rows, segment& seg, vector<string>& newNames);
+    uint32_t Code(const char* label, vector<string>& newNames);
+    // appends the rides of seg whose passenger (byDriver false) or driver
+    // is id
+    void Scan(const segment& seg, bool byDriver, int id, vector<ride>& out) const;
+    void History(bool byDriver, int id, vector<ride>& out) const;
+
+    ridearchive(const ridearchive&);
+    ridearchive& operator=(const ridearchive&);
+
+    public:
+    ridearchive();
+    // seals what is pending and stops the sealer
+    ~ridearchive();
+    // r should be completed or cancelled; safe from any thread
+    void Archive(const ride& r);
+    // returns once every ride archived so far sits in a sealed segment
+    void Flush();
+    // oldest first
+    void PassengerHistory(int passengerId, vector<ride>& out) const;
+    void DriverHistory(int driverId, vector<ride>& out) const;
+    archivestats Stats() const;
+    // the sealed segments, after a Flush; see ridearchive.cpp for the
+    // layout. Load replaces whatever the archive held.
+    bool Save(const string& path);
+    bool Load(const string& path);
+};
+#endif
@@ -0,0 +1,348 @@
+#include "rides.h"
+#include "snapshot.h"
+#include <chrono>
+#include <cstring>
+#include <type_traits>
+
+static_assert(is_trivially_copyable<ride>::value, "rides are copied as raw bytes");
+
+static const int SlotBits = 24;
+static const uint32_t SlotMask = (1u << SlotBits) - 1;
+
+rides::rides(){
+    Capacity = 0;
+    Clear();
+}
+
+rides::rides(string name){
+    Capacity = 0;
+    Clear();
+    ListName = name;
+}
+
+rides::slot& rides::SlotAt(uint32_t i){
+    return Slabs[i / SlabSize][i % SlabSize];
+}
+
+const rides::slot& rides::SlotAt(uint32_t i) const{
+    return Slabs[i / SlabSize][i % SlabSize];
+}
+
+uint32_t rides::Resolve(int id) const{
+    if(id <= 0){
+        return NoSlot;
+    }
+    uint32_t i = static_cast<uint32_t>(id) & SlotMask;
+    uint32_t gen = static_cast<uint32_t>(id) >> SlotBits;
+    if(i >= Capacity){
+        return NoSlot;
+    }
+    const slot& s = SlotAt(i);
+    if(!s.live || s.generation != gen){
+        return NoSlot;
+    }
+    return i;
+}
+
+void rides::Link(uint32_t i, ridestatus st){
+    // append at the tail so each list stays in transition order
+    slot& s = SlotAt(i);
+    s.r.setStatus(st);
+    s.next = NoSlot;
+    uint32_t head = Heads[st];
+    if(head == NoSlot){
+        s.prev = i;
+        Heads[st] = i;
+    }
+    else{
+        // head.prev holds the tail
+        uint32_t tail = SlotAt(head).prev;
+        s.prev = tail;
+        SlotAt(tail).next = i;
+        SlotAt(head).prev = i;
+    }
+    Counts[st]++;
+}
+
+void rides::Unlink(uint32_t i){
+    slot& s = SlotAt(i);
+    ridestatus st = s.r.getStatus();
+    uint32_t head = Heads[st];
+    if(i == head){
+        Heads[st] = s.next;
+        if(s.next != NoSlot){
+            SlotAt(s.next).prev = s.prev;
+        }
+    }
+    else{
+        SlotAt(s.prev).next = s.next;
+        if(s.next != NoSlot){
+            SlotAt(s.next).prev = s.prev;
+        }
+        else{
+            SlotAt(head).prev = s.prev;
+        }
+    }
+    Counts[st]--;
+}
+
+void rides::Grow(){
+    if(Capacity + SlabSize > (static_cast<size_t>(SlotMask) + 1)){
+        return;
+    }
+    Slabs.push_back(unique_ptr<slot[]>(new slot[SlabSize]));
+    // thread the new slots onto the free list, lowest index first
+    for(size_t k = SlabSize; k > 0; k--){
+        uint32_t i = static_cast<uint32_t>(Capacity + k - 1);
+        slot& s = SlotAt(i);
+        s.generation = 1;
+        s.live = false;
+        s.prev = NoSlot;
+        s.next = FreeHead;
+        FreeHead = i;
+    }
+    Capacity += SlabSize;
+}
+
+int rides::Create(ride r){
+    if(FreeHead == NoSlot){
+        Grow();
+        if(FreeHead == NoSlot){
+            return -1;
+        }
+    }
+    uint32_t i = FreeHead;
+    slot& s = SlotAt(i);
+    FreeHead = s.next;
+    int id = static_cast<int>((static_cast<uint32_t>(s.generation) << SlotBits) | i);
+    if(r.getRequestTime() == 0){
+        r.setRequestTime(chrono::duration_cast<chrono::milliseconds>(
+            chrono::system_clock::now().time_since_epoch()).count());
+    }
+    r.setID(id);
+    r.setDriver(-1);
+    s.r = r;
+    s.live = true;
+    Link(i, RS_REQUESTED);
+    LiveCount++;
+    return id;
+}
+
+const ride* rides::Find(int id) const{
+    uint32_t i = Resolve(id);
+    if(i == NoSlot){
+        return 0;
+    }
+    return &SlotAt(i).r;
+}
+
+bool rides::SetStatus(int id, ridestatus st){
+    uint32_t i = Resolve(id);
+    if(i == NoSlot || !CanTransition(SlotAt(i).r.getStatus(), st)){
+        return false;
+    }
+    Unlink(i);
+    if(st == RS_REQUESTED){
+        // the driver dropped it
+        SlotAt(i).r.setDriver(-1);
+    }
+    Link(i, st);
+    return true;
+}
+
+bool rides::AssignDriver(int id, int driverId){
+    uint32_t i = Resolve(id);
+    if(i == NoSlot || SlotAt(i).r.getStatus() != RS_REQUESTED){
+        return false;
+    }
+    Unlink(i);
+    SlotAt(i).r.setDriver(driverId);
+    Link(i, RS_ASSIGNED);
+    return true;
+}
+
+bool rides::Requeue(int id){
+    uint32_t i = Resolve(id);
+    if(i == NoSlot){
+        return false;
+    }
+    ridestatus st = SlotAt(i).r.getStatus();
+    Unlink(i);
+    Link(i, st);
+    return true;
+}
+
+bool rides::Retire(int id){
+    uint32_t i = Resolve(id);
+    if(i == NoSlot){
+        return false;
+    }
+    slot& s = SlotAt(i);
+    if(s.r.getStatus() != RS_COMPLETED && s.r.getStatus() != RS_CANCELLED){
+        return false;
+    }
+    Unlink(i);
+    s.live = false;
+    s.generation = s.generation == 127 ? 1 : s.generation + 1;
+    s.next = FreeHead;
+    FreeHead = i;
+    LiveCount--;
+    return true;
+}
+
+size_t rides::Size() const{
+    return LiveCount;
+}
+
+size_t rides::CountByStatus(ridestatus st) const{
+    return Counts[st];
+}
+
+void rides::ByStatus(ridestatus st, vector<int>& out) const{
+    out.clear();
+    for(uint32_t i = Heads[st]; i != NoSlot; i = SlotAt(i).next){
+        out.push_back(SlotAt(i).r.getID());
+    }
+}
+
+void rides::Reserve(size_t n){
+    while(Capacity < n){
+        size_t before = Capacity;
+        Grow();
+        if(Capacity == before){
+            return;
+        }
+    }
+}
+
+void rides::Clear(){
+    Slabs.clear();
+    Capacity = 0;
+    LiveCount = 0;
+    FreeHead = NoSlot;
+    for(int s = 0; s < RS_COUNT; s++){
+        Heads[s] = NoSlot;
+        Counts[s] = 0;
+    }
+}
+
+static const char RidesMagic[8] = {'R', 'D', 'E', 'S', 'N', 'A', 'P', '2'};
+
+// columns: the generation of every slot, then the live rides status list by
+// status list, each in list order: their slots, then the raw records. Loading
+// links them back in that order, so each list keeps its order (the requested
+// list is the FIFO the dispatcher takes rides from).
+bool rides::SaveSnapshot(const string& path) const{
+    vector<uint8_t> generations(Capacity);
+    vector<uint32_t> slots;
+    vector<ride> records;
+    slots.reserve(LiveCount);
+    records.reserve(LiveCount);
+    for(uint32_t i = 0; i < Capacity; i++){
+        generations[i] = SlotAt(i).generation;
+    }
+    for(int st = 0; st < RS_COUNT; st++){
+        for(uint32_t i = Heads[st]; i != NoSlot; i = SlotAt(i).next){
+            slots.push_back(i);
+            records.push_back(SlotAt(i).r);
+        }
+    }
+    uint64_t count = records.size();
+    snapshotwriter w;
+    w.Begin(RidesMagic, Capacity, 0, 0, 0);
+    w.WriteColumn(generations.data(), Capacity);
+    w.WriteColumn(&count, sizeof(count));
+    w.WriteColumn(slots.data(), slots.size() * sizeof(uint32_t));
+    w.WriteColumn(records.data(), records.size() * sizeof(ride));
+    return w.Finish(path);
+}
+
+bool rides::LoadSnapshot(const string& path){
+    snapshotreader r;
+    if(!r.Open(path, RidesMagic)){
+        return false;
+    }
+    uint64_t cap = r.GetHeader().count;
+    if(cap % SlabSize != 0 || cap > static_cast<uint64_t>(SlotMask) + 1){
+        return false;
+    }
+    // every column is checked against the file before anything is changed,
+    // so a short or damaged snapshot leaves the collection as it was
+    const uint8_t* generations = static_cast<const uint8_t*>(r.NextColumn(cap));
+    const uint64_t* count = static_cast<const uint64_t*>(r.NextColumn(sizeof(uint64_t)));
+    if(generations == 0 || count == 0 || *count > cap){
+        return false;
+    }
+    const uint32_t* slots = static_cast<const uint32_t*>(r.NextColumn(*count * sizeof(uint32_t)));
+    const ride* records = static_cast<const ride*>(r.NextColumn(*count * sizeof(ride)));
+    if(slots == 0 || records == 0){
+        return false;
+    }
+    for(uint64_t i = 0; i < cap; i++){
+        if(generations[i] == 0 || generations[i] > 127){
+            return false;
+        }
+    }
+    vector<uint8_t> live(cap, 0);
+    for(uint64_t k = 0; k < *count; k++){
+        uint32_t i = slots[k];
+        if(i >= cap || live[i] || !records[k].Valid()
+           || records[k].getID() != static_cast<int>((static_cast<uint32_t>(generations[i]) << SlotBits) | i)){
+            return false;
+        }
+        live[i] = 1;
+    }
+
+    Clear();
+    Reserve(cap);
+    for(uint32_t i = 0; i < cap; i++){
+        SlotAt(i).generation = generations[i];
+        SlotAt(i).live = live[i];
+    }
+    for(uint64_t k = 0; k < *count; k++){
+        slot& s = SlotAt(slots[k]);
+        s.r = records[k];
+        Link(slots[k], s.r.getStatus());
+        LiveCount++;
+    }
+    // rebuild the free list from scratch, lowest index first
+    FreeHead = NoSlot;
+    for(uint32_t i = static_cast<uint32_t>(cap); i > 0; i--){
+        slot& s = SlotAt(i - 1);
+        if(!s.live){
+            s.next = FreeHead;
+            FreeHead = i - 1;
+        }
+    }
+    return true;
+}
+
+void rides::PrintSize(){
+    if(LiveCount != 0){
+        cout << "There are " << LiveCount << " rides:";
+        for(int s = 0; s < RS_COUNT; s++){
+            cout << " " << Counts[s] << " " << RideStatusName(s);
+        }
+        cout << "\n";
+    }
+    else
+    cout << "No rides.\n";
+}
+
+void rides::PrintAll(){
+    for(int st = 0; st < RS_COUNT; st++){
+        for(uint32_t i = Heads[st]; i != NoSlot; i = SlotAt(i).next){
+            const ride& r = SlotAt(i).r;
+            cout << "Ride ID: " << r.getID() << "\n";
+            cout << "Passenger: " << r.getPassenger() << "\n";
+            if(r.getDriver() >= 0){
+                cout << "Driver: " << r.getDriver() << "\n";
+            }
+            cout << "Pickup: " << r.getPickUp() << " (" << r.getPickUpLat() << ", " << r.getPickUpLon() << ")\n";
+            cout << "Dropoff: " << r.getDropoff() << " (" << r.getDropoffLat() << ", " << r.getDropoffLon() << ")\n";
+            cout << "Party Size: " << r.getPartySize() << "\n";
+            cout << "Pets: " << (r.getPets() ? "yes" : "no") << "\n";
+            cout << "Status: " << RideStatusName(r.getStatus()) << "\n\n";
+        }
+    }
+}
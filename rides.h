@@ -0,0 +1,79 @@
+#ifndef RIDES_H
+#define RIDES_H
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+#include "Ride.h"
+
+// Rides live in fixed-size slabs that are never moved or freed while the
+// collection exists, so creating a ride reuses a slot from the free list and
+// only allocates when a whole slab runs out. Every slot is also linked into
+// the list of its current status, which makes "all requested rides" a walk
+// over just those rides.
+//
+// A ride id packs the slot index (low 24 bits) with a 7-bit generation that
+// changes each time the slot is reused, so ids of retired rides stop
+// resolving.
+class rides{
+    private:
+    static const size_t SlabSize = 1024;
+    static const uint32_t NoSlot = 0xFFFFFFFFu;
+
+    struct slot{
+        ride r;
+        uint32_t prev;
+        uint32_t next; // status list, or free list when not live
+        uint8_t generation;
+        bool live;
+    };
+
+    vector<unique_ptr<slot[]> > Slabs;
+    size_t Capacity;
+    size_t LiveCount;
+    uint32_t FreeHead;
+    uint32_t Heads[RS_COUNT];
+    size_t Counts[RS_COUNT];
+    string ListName;
+
+    slot& SlotAt(uint32_t i);
+    const slot& SlotAt(uint32_t i) const;
+    // slot index for a live ride id, or NoSlot
+    uint32_t Resolve(int id) const;
+    void Link(uint32_t i, ridestatus s);
+    void Unlink(uint32_t i);
+    void Grow();
+
+    public:
+    rides();
+    rides(string);
+    // stores r as a new requested ride and returns its id
+    int Create(ride r);
+    // 0 if there is no live ride with this id
+    const ride* Find(int id) const;
+    // only transitions allowed by CanTransition() succeed
+    bool SetStatus(int id, ridestatus s);
+    // requested -> assigned with the given driver
+    bool AssignDriver(int id, int driverId);
+    // moves a ride to the back of its status list
+    bool Requeue(int id);
+    // frees the slot of a completed or cancelled ride
+    bool Retire(int id);
+    size_t Size() const;
+    size_t CountByStatus(ridestatus s) const;
+    // ids of every ride in status s, oldest transition first
+    void ByStatus(ridestatus s, vector<int>& out) const;
+    void Reserve(size_t n);
+    void Clear();
+    // binary snapshot, see snapshot.h. Every status list keeps its order
+    // across a save and load. Load refuses a short or inconsistent file
+    // and leaves the collection unchanged.
+    bool SaveSnapshot(const string& path) const;
+    bool LoadSnapshot(const string& path);
+    void PrintSize();
+    void PrintAll();
+};
+#endif
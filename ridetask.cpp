@@ -0,0 +1,293 @@
+#include "ridetask.h"
+#if defined(__cpp_impl_coroutine)
+
+namespace{
+
+// kept out of the coroutine so the ride isn't part of its frame
+ride MakeRide(const riderequest& r){
+    ride x;
+    x.setPassenger(r.passengerId);
+    x.setPickUpCoords(r.pickupLat, r.pickupLon);
+    x.setDropoffCoords(r.dropoffLat, r.dropoffLon);
+    x.setPartySize(r.partySize);
+    x.setPets(r.pets);
+    return x;
+}
+
+}
+
+atomic<size_t> ridetask::FrameCount(0);
+atomic<size_t> ridetask::FrameBytes(0);
+
+// out of line: once inlined into a coroutine, gcc pairs the ::operator new
+// here with the frame's delete and warns about a mismatch that isn't one
+__attribute__((noinline)) void* ridetask::promise_type::operator new(size_t size){
+    FrameCount.fetch_add(1, memory_order_relaxed);
+    FrameBytes.fetch_add(size, memory_order_relaxed);
+    return ::operator new(size);
+}
+
+void ridetask::promise_type::operator delete(void* p, size_t size){
+    FrameCount.fetch_sub(1, memory_order_relaxed);
+    FrameBytes.fetch_sub(size, memory_order_relaxed);
+    ::operator delete(p, size);
+}
+
+size_t ridetask::LiveFrames(){
+    return FrameCount.load(memory_order_relaxed);
+}
+
+size_t ridetask::LiveFrameBytes(){
+    return FrameBytes.load(memory_order_relaxed);
+}
+
+coroscheduler::coroscheduler(size_t threads){
+    SerialBusy = false;
+    Stopping = false;
+    if(threads == 0){
+        threads = 1;
+    }
+    for(size_t i = 0; i < threads; i++){
+        Workers.push_back(thread(&coroscheduler::WorkerLoop, this));
+    }
+}
+
+coroscheduler::~coroscheduler(){
+    {
+        lock_guard<mutex> lk(Lock);
+        Stopping = true;
+    }
+    Wake.notify_all();
+    for(size_t i = 0; i < Workers.size(); i++){
+        Workers[i].join();
+    }
+}
+
+size_t coroscheduler::Size() const{
+    return Workers.size();
+}
+
+void coroscheduler::WorkerLoop(){
+    unique_lock<mutex> lk(Lock);
+    while(!Stopping){
+        clock::time_point now = clock::now();
+        while(!Timers.empty() && Timers.top().due <= now){
+            Ready.push_back(Timers.top().h);
+            Timers.pop();
+        }
+        // resume() returns at the coroutine's next suspension, which is
+        // where it gives up the strand
+        if(!SerialBusy && !SerialQueue.empty()){
+            coroutine_handle<> h = SerialQueue.front();
+            SerialQueue.pop_front();
+            SerialBusy = true;
+            lk.unlock();
+            h.resume();
+            lk.lock();
+            SerialBusy = false;
+            if(!SerialQueue.empty()){
+                Wake.notify_one();
+            }
+            continue;
+        }
+        if(!Ready.empty()){
+            coroutine_handle<> h = Ready.front();
+            Ready.pop_front();
+            lk.unlock();
+            h.resume();
+            lk.lock();
+            continue;
+        }
+        if(Timers.empty()){
+            Wake.wait(lk);
+        }
+        else{
+            Wake.wait_until(lk, Timers.top().due);
+        }
+    }
+}
+
+void coroscheduler::Post(coroutine_handle<> h){
+    {
+        lock_guard<mutex> lk(Lock);
+        Ready.push_back(h);
+    }
+    Wake.notify_one();
+}
+
+void coroscheduler::PostSerial(coroutine_handle<> h){
+    {
+        lock_guard<mutex> lk(Lock);
+        SerialQueue.push_back(h);
+    }
+    Wake.notify_one();
+}
+
+void coroscheduler::PostAfter(chrono::milliseconds delay, coroutine_handle<> h){
+    timer t;
+    t.due = clock::now() + delay;
+    t.h = h;
+    {
+        lock_guard<mutex> lk(Lock);
+        Timers.push(t);
+    }
+    // a sleeping worker may need an earlier deadline
+    Wake.notify_one();
+}
+
+coroscheduler::scheduleawaiter coroscheduler::Schedule(){
+    scheduleawaiter a;
+    a.s = this;
+    a.serial = false;
+    return a;
+}
+
+coroscheduler::scheduleawaiter coroscheduler::Serial(){
+    scheduleawaiter a;
+    a.s = this;
+    a.serial = true;
+    return a;
+}
+
+coroscheduler::sleepawaiter coroscheduler::Sleep(chrono::milliseconds delay){
+    sleepawaiter a;
+    a.s = this;
+    a.delay = delay;
+    return a;
+}
+
+dispatchwindow::dispatchwindow(coroscheduler& s, dispatcher& d, rides& r, unsigned windowMs, unsigned maxTicks)
+    : Scheduler(s), Dispatch(d), Rides(r), Window(windowMs), MaxTicks(maxTicks){
+    Stopping.store(false);
+    Running = true;
+    Loop();
+}
+
+dispatchwindow::~dispatchwindow(){
+    Stop();
+}
+
+void dispatchwindow::Stop(){
+    Stopping.store(true);
+    unique_lock<mutex> lk(LoopLock);
+    LoopDone.wait(lk, [this]{ return !Running; });
+}
+
+ridetask dispatchwindow::Loop(){
+    while(!Stopping.load()){
+        co_await Scheduler.Sleep(Window);
+        co_await Scheduler.Serial();
+        Tick();
+    }
+    // notify under the lock: Stop() may destroy us as soon as it wakes
+    lock_guard<mutex> lk(LoopLock);
+    Running = false;
+    LoopDone.notify_all();
+}
+
+dispatchwindow::assignmentawaiter dispatchwindow::Assignment(int rideId){
+    assignmentawaiter a;
+    a.w = this;
+    a.rideId = rideId;
+    a.driver = -1;
+    return a;
+}
+
+void dispatchwindow::Wait(int rideId, coroutine_handle<> h, int* driver){
+    waiter w;
+    w.rideId = rideId;
+    w.ticks = 0;
+    w.h = h;
+    w.driver = driver;
+    Waiting.push_back(w);
+}
+
+void dispatchwindow::Tick(){
+    if(Waiting.empty()){
+        return;
+    }
+    Dispatch.Tick();
+    size_t kept = 0;
+    for(size_t i = 0; i < Waiting.size(); i++){
+        waiter& w = Waiting[i];
+        const ride* r = Rides.Find(w.rideId);
+        bool settled = true;
+        if(r != 0 && r->getStatus() == RS_ASSIGNED){
+            *w.driver = r->getDriver();
+        }
+        else if(r != 0 && r->getStatus() == RS_REQUESTED && (MaxTicks == 0 || ++w.ticks < MaxTicks)){
+            settled = false;
+        }
+        else{
+            // timed out, or moved on without us; either way no driver
+            Dispatch.CancelRide(w.rideId);
+            *w.driver = -1;
+        }
+        if(settled){
+            Scheduler.Post(w.h);
+        }
+        else{
+            Waiting[kept++] = w;
+        }
+    }
+    Waiting.resize(kept);
+}
+
+size_t dispatchwindow::WaitingCount() const{
+    return Waiting.size();
+}
+
+const char* RideResultName(int result){
+    switch(result){
+        case RR_MATCHED:
+            return "matched";
+        case RR_NO_PASSENGER:
+            return "no passenger";
+        case RR_UNMATCHED:
+            return "unmatched";
+        case RR_NOT_LOGGED:
+            return "not logged";
+    }
+    return "unknown";
+}
+
+ridetasks::ridetasks(coroscheduler& s, dispatchwindow& w, passengers& p, rides& r, writeaheadlog* log, notifyfn notify)
+    : Scheduler(s), Window(w), Passengers(p), Rides(r), Log(log), Notify(notify){
+    InFlight.store(0);
+}
+
+void ridetasks::Submit(const riderequest& r){
+    InFlight.fetch_add(1);
+    Lifecycle(r);
+}
+
+size_t ridetasks::InFlightCount() const{
+    return InFlight.load();
+}
+
+ridetask ridetasks::Lifecycle(riderequest r){
+    co_await Scheduler.Serial();
+    rideoutcome o;
+    o.rideId = -1;
+    o.driverId = -1;
+    o.result = RR_UNMATCHED;
+    if(Passengers.Lookup(r.passengerId) == passengers::npos){
+        o.result = RR_NO_PASSENGER;
+    }
+    else{
+        o.rideId = Rides.Create(MakeRide(r));
+        o.driverId = co_await Window.Assignment(o.rideId);
+        if(o.driverId >= 0){
+            // the claim was logged during the tick, so it is at or before
+            // the last lsn by now
+            durableawaiter d;
+            d.s = &Scheduler;
+            d.log = Log;
+            d.lsn = Log != 0 ? Log->LastLsn() : 0;
+            o.result = co_await d ? RR_MATCHED : RR_NOT_LOGGED;
+        }
+    }
+    Notify(r, o);
+    InFlight.fetch_sub(1);
+}
+#endif
@@ -0,0 +1,275 @@
+#ifndef RIDETASK_H
+#define RIDETASK_H
+// C++20 only; with an older standard this header declares nothing
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+#include "passengers.h"
+#include "rides.h"
+#include "dispatcher.h"
+#include "wal.h"
+
+// Coroutine ride requests. Each request is one coroutine whose frame is all
+// the state it keeps while it waits, so holding 100k requests in flight
+// costs 100k small frames rather than 100k threads or stacks:
+//
+//   coroscheduler sched(2);
+//   dispatchwindow window(sched, dispatch, rides, 5);
+//   ridetasks tasks(sched, window, passengers, rides, &log, notify);
+//   tasks.Submit(request);   // from any thread
+//
+// The registries stay single-writer. Every step that touches them runs on
+// the scheduler's serial strand; a coroutine enters it with
+// co_await sched.Serial() and keeps it until its next co_await.
+
+// A detached coroutine: it starts right away, nobody awaits it, and the
+// frame frees itself when the body returns.
+class ridetask{
+    private:
+    static atomic<size_t> FrameCount;
+    static atomic<size_t> FrameBytes;
+
+    public:
+    struct promise_type{
+        ridetask get_return_object(){
+            return ridetask();
+        }
+        suspend_never initial_suspend() noexcept{
+            return suspend_never();
+        }
+        suspend_never final_suspend() noexcept{
+            return suspend_never();
+        }
+        void return_void(){
+        }
+        void unhandled_exception(){
+            terminate();
+        }
+        // counted, so LiveFrameBytes() shows what requests cost
+        static void* operator new(size_t size);
+        static void operator delete(void* p, size_t size);
+    };
+
+    // frames alive right now and the bytes they hold
+    static size_t LiveFrames();
+    static size_t LiveFrameBytes();
+};
+
+// A small fixed pool of threads that resume coroutines. Ordinary work runs
+// on any thread; Serial() work runs on one thread at a time, in order.
+class coroscheduler{
+    private:
+    typedef chrono::steady_clock clock;
+    struct timer{
+        clock::time_point due;
+        coroutine_handle<> h;
+        bool operator>(const timer& o) const{
+            return due > o.due;
+        }
+    };
+
+    mutex Lock;
+    condition_variable Wake;
+    deque<coroutine_handle<> > Ready;
+    deque<coroutine_handle<> > SerialQueue;
+    bool SerialBusy;
+    priority_queue<timer, vector<timer>, greater<timer> > Timers;
+    bool Stopping;
+    vector<thread> Workers;
+
+    coroscheduler(const coroscheduler&);
+    coroscheduler& operator=(const coroscheduler&);
+    void WorkerLoop();
+
+    public:
+    struct scheduleawaiter{
+        coroscheduler* s;
+        bool serial;
+        bool await_ready() const noexcept{
+            return false;
+        }
+        void await_suspend(coroutine_handle<> h){
+            if(serial){
+                s->PostSerial(h);
+            }
+            else{
+                s->Post(h);
+            }
+        }
+        void await_resume() const noexcept{
+        }
+    };
+    struct sleepawaiter{
+        coroscheduler* s;
+        chrono::milliseconds delay;
+        bool await_ready() const noexcept{
+            return false;
+        }
+        void await_suspend(coroutine_handle<> h){
+            s->PostAfter(delay, h);
+        }
+        void await_resume() const noexcept{
+        }
+    };
+
+    explicit coroscheduler(size_t threads = 2);
+    // stops the threads; coroutines still suspended are not resumed, so
+    // wait for them to finish first
+    ~coroscheduler();
+    size_t Size() const;
+    // any thread may post
+    void Post(coroutine_handle<> h);
+    void PostSerial(coroutine_handle<> h);
+    void PostAfter(chrono::milliseconds delay, coroutine_handle<> h);
+    // co_await Schedule() moves to a pool thread, Serial() onto the strand
+    scheduleawaiter Schedule();
+    scheduleawaiter Serial();
+    sleepawaiter Sleep(chrono::milliseconds delay);
+};
+
+// The dispatcher's batch window as an awaitable. A request co_awaits
+// Assignment(rideId) on the strand; every windowMs the window runs one
+// dispatcher Tick and resumes, on the pool, each waiting ride that got a
+// driver. A ride still unmatched after maxTicks ticks is cancelled and its
+// waiter resumed with -1; maxTicks 0 waits forever.
+class dispatchwindow{
+    private:
+    struct waiter{
+        int rideId;
+        unsigned ticks;
+        coroutine_handle<> h;
+        int* driver;
+    };
+
+    coroscheduler& Scheduler;
+    dispatcher& Dispatch;
+    rides& Rides;
+    chrono::milliseconds Window;
+    unsigned MaxTicks;
+    vector<waiter> Waiting;
+    // the loop's own state, shared with Stop()
+    mutex LoopLock;
+    condition_variable LoopDone;
+    atomic<bool> Stopping;
+    bool Running;
+
+    dispatchwindow(const dispatchwindow&);
+    dispatchwindow& operator=(const dispatchwindow&);
+    ridetask Loop();
+
+    public:
+    struct assignmentawaiter{
+        dispatchwindow* w;
+        int rideId;
+        int driver;
+        bool await_ready() const noexcept{
+            return false;
+        }
+        void await_suspend(coroutine_handle<> h){
+            w->Wait(rideId, h, &driver);
+        }
+        int await_resume() const noexcept{
+            return driver;
+        }
+    };
+
+    dispatchwindow(coroscheduler& s, dispatcher& d, rides& r, unsigned windowMs, unsigned maxTicks = 0);
+    // stops the loop and waits for it to exit
+    ~dispatchwindow();
+    void Stop();
+    // strand only
+    assignmentawaiter Assignment(int rideId);
+    void Wait(int rideId, coroutine_handle<> h, int* driver);
+    // one window: ticks the dispatcher and resumes the settled waiters
+    void Tick();
+    size_t WaitingCount() const;
+};
+
+// resumes on the pool once lsn is durable, or the log failed first, and
+// yields which; right away (true) without a log
+struct durableawaiter{
+    coroscheduler* s;
+    writeaheadlog* log;
+    uint64_t lsn;
+    bool durable;
+    bool await_ready() noexcept{
+        durable = true;
+        return log == 0;
+    }
+    void await_suspend(coroutine_handle<> h){
+        coroscheduler* sched = s;
+        bool* out = &durable;
+        log->OnDurable(lsn, [sched, h, out](bool ok){
+            *out = ok;
+            sched->Post(h);
+        });
+    }
+    bool await_resume() const noexcept{
+        return durable;
+    }
+};
+
+struct riderequest{
+    int passengerId;
+    double pickupLat, pickupLon;
+    double dropoffLat, dropoffLon;
+    int partySize;
+    bool pets;
+};
+
+enum rideresult : uint8_t{
+    RR_MATCHED = 0,
+    RR_NO_PASSENGER,
+    RR_UNMATCHED,
+    RR_NOT_LOGGED  // matched, but the log failed before the claim was durable
+};
+
+const char* RideResultName(int result);
+
+struct rideoutcome{
+    int rideId;   // -1 if no ride was created
+    int driverId; // -1 unless matched
+    rideresult result;
+};
+
+// The request lifecycle: look the passenger up, create the ride, wait for
+// the batch window to assign a driver, wait until the driver's claim is in
+// the log, then notify. notify runs on a pool thread.
+class ridetasks{
+    public:
+    typedef function<void(const riderequest&, const rideoutcome&)> notifyfn;
+
+    private:
+    coroscheduler& Scheduler;
+    dispatchwindow& Window;
+    passengers& Passengers;
+    rides& Rides;
+    writeaheadlog* Log;
+    notifyfn Notify;
+    atomic<size_t> InFlight;
+
+    ridetasks(const ridetasks&);
+    ridetasks& operator=(const ridetasks&);
+    ridetask Lifecycle(riderequest r);
+
+    public:
+    // log may be 0
+    ridetasks(coroscheduler& s, dispatchwindow& w, passengers& p, rides& r, writeaheadlog* log, notifyfn notify);
+    // starts a request; any thread
+    void Submit(const riderequest& r);
+    size_t InFlightCount() const;
+};
+#endif
+#endif
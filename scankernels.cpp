@@ -0,0 +1,199 @@
+#include "scankernels.h"
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SCAN_NEON 1
+#endif
+
+// one slot; also finishes the tail the vector loops leave behind
+static inline uint64_t ScanOne(const uint32_t* masks, const float* ratings, const int* capacities,
+                               size_t i, const scanpredicate& p){
+    bool ok = (masks[i] & p.required) == p.required &&
+              (ratings == 0 || (ratings[i] >= p.minRating && ratings[i] <= p.maxRating)) &&
+              (capacities == 0 || capacities[i] >= p.minCapacity);
+    return ok;
+}
+
+static uint64_t ScanWordScalar(const uint32_t* masks, const float* ratings, const int* capacities,
+                               size_t base, size_t count, const scanpredicate& p){
+    uint64_t w = 0;
+    for(size_t i = 0; i < count; i++){
+        w |= ScanOne(masks, ratings, capacities, base + i, p) << i;
+    }
+    return w;
+}
+
+#if !defined(SCAN_X86) && !defined(SCAN_NEON)
+static void ScanScalar(const uint32_t* masks, const float* ratings, const int* capacities,
+                       size_t n, const scanpredicate& p, uint64_t* bits){
+    for(size_t base = 0; base < n; base += 64){
+        size_t count = n - base < 64 ? n - base : 64;
+        bits[base / 64] = ScanWordScalar(masks, ratings, capacities, base, count, p);
+    }
+}
+#endif
+
+#ifdef SCAN_X86
+// SSE2 is part of x86-64, so this needs no runtime check
+static void ScanSse2(const uint32_t* masks, const float* ratings, const int* capacities,
+                     size_t n, const scanpredicate& p, uint64_t* bits){
+    const __m128i req = _mm_set1_epi32(static_cast<int>(p.required));
+    const __m128 lo = _mm_set1_ps(p.minRating);
+    const __m128 hi = _mm_set1_ps(p.maxRating);
+    // capacity >= min as capacity > min - 1
+    const __m128i cap = _mm_set1_epi32(p.minCapacity == INT32_MIN ? INT32_MIN : p.minCapacity - 1);
+    size_t full = n / 64 * 64;
+    for(size_t base = 0; base < full; base += 64){
+        uint64_t w = 0;
+        for(size_t j = 0; j < 64; j += 4){
+            size_t i = base + j;
+            __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(masks + i));
+            __m128i ok = _mm_cmpeq_epi32(_mm_and_si128(m, req), req);
+            if(ratings != 0){
+                __m128 r = _mm_loadu_ps(ratings + i);
+                __m128 okr = _mm_and_ps(_mm_cmpge_ps(r, lo), _mm_cmple_ps(r, hi));
+                ok = _mm_and_si128(ok, _mm_castps_si128(okr));
+            }
+            if(capacities != 0){
+                __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(capacities + i));
+                ok = _mm_and_si128(ok, _mm_cmpgt_epi32(c, cap));
+            }
+            w |= static_cast<uint64_t>(_mm_movemask_ps(_mm_castsi128_ps(ok))) << j;
+        }
+        bits[base / 64] = w;
+    }
+    if(full < n){
+        bits[full / 64] = ScanWordScalar(masks, ratings, capacities, full, n - full, p);
+    }
+}
+
+__attribute__((target("avx2")))
+static void ScanAvx2(const uint32_t* masks, const float* ratings, const int* capacities,
+                     size_t n, const scanpredicate& p, uint64_t* bits){
+    const __m256i req = _mm256_set1_epi32(static_cast<int>(p.required));
+    const __m256 lo = _mm256_set1_ps(p.minRating);
+    const __m256 hi = _mm256_set1_ps(p.maxRating);
+    const __m256i cap = _mm256_set1_epi32(p.minCapacity == INT32_MIN ? INT32_MIN : p.minCapacity - 1);
+    size_t full = n / 64 * 64;
+    for(size_t base = 0; base < full; base += 64){
+        uint64_t w = 0;
+        for(size_t j = 0; j < 64; j += 8){
+            size_t i = base + j;
+            __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(masks + i));
+            __m256i ok = _mm256_cmpeq_epi32(_mm256_and_si256(m, req), req);
+            if(ratings != 0){
+                __m256 r = _mm256_loadu_ps(ratings + i);
+                __m256 okr = _mm256_and_ps(_mm256_cmp_ps(r, lo, _CMP_GE_OQ), _mm256_cmp_ps(r, hi, _CMP_LE_OQ));
+                ok = _mm256_and_si256(ok, _mm256_castps_si256(okr));
+            }
+            if(capacities != 0){
+                __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(capacities + i));
+                ok = _mm256_and_si256(ok, _mm256_cmpgt_epi32(c, cap));
+            }
+            w |= static_cast<uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(ok))) << j;
+        }
+        bits[base / 64] = w;
+    }
+    if(full < n){
+        bits[full / 64] = ScanWordScalar(masks, ratings, capacities, full, n - full, p);
+    }
+}
+#endif
+
+#ifdef SCAN_NEON
+static void ScanNeon(const uint32_t* masks, const float* ratings, const int* capacities,
+                     size_t n, const scanpredicate& p, uint64_t* bits){
+    const uint32x4_t req = vdupq_n_u32(p.required);
+    const float32x4_t lo = vdupq_n_f32(p.minRating);
+    const float32x4_t hi = vdupq_n_f32(p.maxRating);
+    const int32x4_t cap = vdupq_n_s32(p.minCapacity);
+    // lane weights for turning a compare result into 4 bits
+    const uint32_t weights[4] = {1, 2, 4, 8};
+    const uint32x4_t lane = vld1q_u32(weights);
+    size_t full = n / 64 * 64;
+    for(size_t base = 0; base < full; base += 64){
+        uint64_t w = 0;
+        for(size_t j = 0; j < 64; j += 4){
+            size_t i = base + j;
+            uint32x4_t m = vld1q_u32(masks + i);
+            uint32x4_t ok = vceqq_u32(vandq_u32(m, req), req);
+            if(ratings != 0){
+                float32x4_t r = vld1q_f32(ratings + i);
+                ok = vandq_u32(ok, vandq_u32(vcgeq_f32(r, lo), vcleq_f32(r, hi)));
+            }
+            if(capacities != 0){
+                ok = vandq_u32(ok, vcgeq_s32(vld1q_s32(capacities + i), cap));
+            }
+            w |= static_cast<uint64_t>(vaddvq_u32(vandq_u32(ok, lane))) << j;
+        }
+        bits[base / 64] = w;
+    }
+    if(full < n){
+        bits[full / 64] = ScanWordScalar(masks, ratings, capacities, full, n - full, p);
+    }
+}
+#endif
+
+typedef void (*scanfunction)(const uint32_t*, const float*, const int*, size_t, const scanpredicate&, uint64_t*);
+
+struct scankernel{
+    scanfunction scan;
+    const char* name;
+};
+
+static scankernel PickKernel(){
+    scankernel k;
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+        k.scan = ScanAvx2;
+        k.name = "avx2";
+        return k;
+    }
+    k.scan = ScanSse2;
+    k.name = "sse2";
+#elif defined(SCAN_NEON)
+    k.scan = ScanNeon;
+    k.name = "neon";
+#else
+    k.scan = ScanScalar;
+    k.name = "scalar";
+#endif
+    return k;
+}
+
+static const scankernel& Kernel(){
+    static const scankernel k = PickKernel();
+    return k;
+}
+
+void ScanColumns(const uint32_t* masks, const float* ratings, const int* capacities,
+                 size_t n, const scanpredicate& p, uint64_t* bits){
+    Kernel().scan(masks, ratings, capacities, n, p, bits);
+}
+
+size_t CompactBits(const uint64_t* bits, size_t words, size_t* out){
+    size_t m = 0;
+    for(size_t w = 0; w < words; w++){
+        uint64_t b = bits[w];
+        while(b != 0){
+            out[m++] = w * 64 + __builtin_ctzll(b);
+            b &= b - 1;
+        }
+    }
+    return m;
+}
+
+size_t CountBits(const uint64_t* bits, size_t words){
+    size_t m = 0;
+    for(size_t w = 0; w < words; w++){
+        m += __builtin_popcountll(bits[w]);
+    }
+    return m;
+}
+
+const char* ScanKernelName(){
+    return Kernel().name;
+}
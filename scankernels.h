@@ -0,0 +1,28 @@
+#ifndef SCANKERNELS_H
+#define SCANKERNELS_H
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+// Brute-force filters over the driver columns, a 64-slot word of results at
+// a time. The implementation (AVX2, SSE2, NEON or plain C++) is picked once
+// at startup from what the CPU supports; all of them give identical bits.
+struct scanpredicate{
+    uint32_t required; // every bit must be set in the slot's capability mask
+    float minRating;   // inclusive
+    float maxRating;   // inclusive
+    int minCapacity;   // only checked when the capacities column is given
+};
+
+// Sets bit i of bits[i / 64] for every slot i in [0, n) that satisfies p and
+// clears the rest, including the unused tail of the last word. ratings may
+// be 0 to skip the rating check, capacities may be 0 when the capacity check
+// is folded into p.required.
+void ScanColumns(const uint32_t* masks, const float* ratings, const int* capacities,
+                 size_t n, const scanpredicate& p, uint64_t* bits);
+// writes the index of every set bit to out, returns how many were written
+size_t CompactBits(const uint64_t* bits, size_t words, size_t* out);
+size_t CountBits(const uint64_t* bits, size_t words);
+// "avx2", "sse2", "neon" or "scalar"
+const char* ScanKernelName();
+#endif
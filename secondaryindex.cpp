@@ -0,0 +1,99 @@
+#include "secondaryindex.h"
+
+void bucketindex::Insert(size_t key, size_t slot){
+    if(key >= Buckets.size()){
+        Buckets.resize(key + 1);
+    }
+    if(slot >= Pos.size()){
+        Pos.resize(slot + 1);
+    }
+    Pos[slot] = static_cast<uint32_t>(Buckets[key].size());
+    Buckets[key].push_back(static_cast<uint32_t>(slot));
+}
+
+void bucketindex::Remove(size_t key, size_t slot){
+    vector<uint32_t>& b = Buckets[key];
+    uint32_t at = Pos[slot];
+    b[at] = b.back();
+    Pos[b[at]] = at;
+    b.pop_back();
+}
+
+void bucketindex::Renumber(size_t key, size_t from, size_t to){
+    if(to >= Pos.size()){
+        Pos.resize(to + 1);
+    }
+    uint32_t at = Pos[from];
+    Buckets[key][at] = static_cast<uint32_t>(to);
+    Pos[to] = at;
+}
+
+const vector<uint32_t>& bucketindex::Bucket(size_t key) const{
+    static const vector<uint32_t> Empty;
+    if(key >= Buckets.size()){
+        return Empty;
+    }
+    return Buckets[key];
+}
+
+size_t bucketindex::BucketCount() const{
+    return Buckets.size();
+}
+
+void bucketindex::Reserve(size_t slots){
+    Pos.reserve(slots);
+}
+
+void bucketindex::Clear(){
+    Buckets.clear();
+    Pos.clear();
+}
+
+size_t ratingindex::Key(float rating){
+    // !(>=) so NaN lands in the first bucket too
+    if(!(rating >= 0.0f)){
+        return 0;
+    }
+    int k = static_cast<int>(rating * 10.0f);
+    return k >= Buckets ? Buckets - 1 : k;
+}
+
+void ratingindex::Insert(float rating, size_t slot){
+    Index.Insert(Key(rating), slot);
+}
+
+void ratingindex::Remove(float rating, size_t slot){
+    Index.Remove(Key(rating), slot);
+}
+
+void ratingindex::Renumber(float rating, size_t from, size_t to){
+    Index.Renumber(Key(rating), from, to);
+}
+
+size_t ratingindex::CountRange(float lo, float hi) const{
+    if(lo > hi){
+        return 0;
+    }
+    size_t n = 0;
+    for(size_t k = Key(lo); k <= Key(hi); k++){
+        n += Index.Bucket(k).size();
+    }
+    return n;
+}
+
+void ratingindex::Range(float lo, float hi, const float* ratings, vector<size_t>& out) const{
+    if(lo > hi){
+        return;
+    }
+    ForRange(lo, hi, ratings, [&](size_t slot){
+        out.push_back(slot);
+    });
+}
+
+void ratingindex::Reserve(size_t slots){
+    Index.Reserve(slots);
+}
+
+void ratingindex::Clear(){
+    Index.Clear();
+}
@@ -0,0 +1,65 @@
+#ifndef SECONDARYINDEX_H
+#define SECONDARYINDEX_H
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+// Slot lists per key for low-cardinality fields (vehicle type, capacity,
+// payment method). Every slot is in exactly one bucket; Pos remembers
+// where, so Remove is a swap with the bucket's last entry.
+class bucketindex{
+    private:
+    vector<vector<uint32_t> > Buckets;
+    // slot -> position inside its bucket
+    vector<uint32_t> Pos;
+
+    public:
+    void Insert(size_t key, size_t slot);
+    void Remove(size_t key, size_t slot);
+    // the record in from moved to slot to (which isn't indexed); O(1)
+    void Renumber(size_t key, size_t from, size_t to);
+    // empty for keys nothing was inserted under
+    const vector<uint32_t>& Bucket(size_t key) const;
+    size_t BucketCount() const;
+    void Reserve(size_t slots);
+    void Clear();
+};
+
+// Ratings bucketed by tenths, kept in rating order. Buckets strictly inside
+// a range match without looking at the rating; only the two end buckets
+// are checked against the column.
+class ratingindex{
+    private:
+    static const int Buckets = 51; // 0.0 .. 5.0, out of range values clamp
+    bucketindex Index;
+
+    public:
+    static size_t Key(float rating);
+    void Insert(float rating, size_t slot);
+    void Remove(float rating, size_t slot);
+    void Renumber(float rating, size_t from, size_t to);
+    // upper bound on the matches in [lo, hi] without touching any slots
+    size_t CountRange(float lo, float hi) const;
+    // appends the slots whose rating (from ratings, indexed by slot) is in
+    // [lo, hi], in ascending rating bucket order
+    void Range(float lo, float hi, const float* ratings, vector<size_t>& out) const;
+    // same, but hands each slot to the callback instead of collecting them
+    template<typename F>
+    void ForRange(float lo, float hi, const float* ratings, F f) const{
+        size_t first = Key(lo);
+        size_t last = Key(hi);
+        for(size_t k = first; k <= last; k++){
+            const vector<uint32_t>& b = Index.Bucket(k);
+            bool edge = k == first || k == last;
+            for(size_t i = 0; i < b.size(); i++){
+                if(!edge || (ratings[b[i]] >= lo && ratings[b[i]] <= hi)){
+                    f(b[i]);
+                }
+            }
+        }
+    }
+    void Reserve(size_t slots);
+    void Clear();
+};
+#endif
@@ -0,0 +1,551 @@
+// End-to-end checks for paths that span several modules, run by make check.
+// Each check prints its name and ok or what went wrong; the exit status is
+// the number of failures.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <thread>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+using namespace std;
+
+#include "drivers.h"
+#include "passengers.h"
+#include "rides.h"
+#include "dispatcher.h"
+#include "ridearchive.h"
+#include "wal.h"
+#include "snapshot.h"
+#include "batch.h"
+#include "server.h"
+
+static int Failures = 0;
+
+static bool Expect(bool cond, const char* check, const char* what){
+    if(!cond){
+        cout << check << ": FAIL " << what << "\n";
+        Failures++;
+    }
+    return cond;
+}
+
+static int RequestRide(rides& r_list, int passengerId){
+    ride r;
+    r.setPassenger(passengerId);
+    r.setPickUpCoords(40.75, -73.99);
+    r.setDropoffCoords(40.70, -74.01);
+    r.setPartySize(1);
+    r.setPets(false);
+    return r_list.Create(r);
+}
+
+// request -> tick -> (pickup) -> complete, with the driver back in the pool
+// and the ride in the archive afterwards
+static void CheckRideLifecycle(){
+    const char* name = "ride lifecycle";
+    int before = Failures;
+    drivers d_list("Drivers");
+    passengers p_list("Passengers");
+    rides r_list("Rides");
+    dispatcher dispatch(d_list, p_list, r_list);
+    ridearchive archive;
+    dispatch.AttachArchive(&archive);
+    d_list.Emplace(1, "Ann", 4, false, "sedan", 4.5f, true, false, "", 40.751, -73.991);
+    p_list.Emplace("Bo", 7, "cash", false, 4.0f, false);
+
+    for(int pickup = 0; pickup < 2; pickup++){
+        int rideId = RequestRide(r_list, 7);
+        batchreport b = dispatch.Tick();
+        if(!Expect(b.matched == 1, name, "tick did not match the ride")){
+            return;
+        }
+        Expect(!d_list.AvailableAt(d_list.Lookup(1)), name, "matched driver still available");
+        if(pickup){
+            Expect(dispatch.PickUp(rideId), name, "pickup refused");
+            Expect(r_list.Find(rideId)->getStatus() == RS_ENROUTE, name, "ride not en-route after pickup");
+        }
+        if(!Expect(dispatch.CompleteRide(rideId), name, "complete refused")){
+            return;
+        }
+        Expect(d_list.AvailableAt(d_list.Lookup(1)), name, "driver not released");
+        Expect(r_list.Find(rideId) == 0, name, "completed ride still in the active list");
+    }
+    archive.Flush();
+    Expect(archive.Stats().rides == 2, name, "completed rides not archived");
+    Expect(!dispatch.CompleteRide(RequestRide(r_list, 7)), name, "completed a ride nobody was assigned");
+    if(Failures == before){
+        cout << name << ": ok\n";
+    }
+}
+
+// a ride whose passenger was deleted before the tick is cancelled, archived
+// and retired rather than left in the active list
+static void CheckOrphanedRide(){
+    const char* name = "orphaned ride";
+    int before = Failures;
+    drivers d_list("Drivers");
+    passengers p_list("Passengers");
+    rides r_list("Rides");
+    dispatcher dispatch(d_list, p_list, r_list);
+    ridearchive archive;
+    dispatch.AttachArchive(&archive);
+    d_list.Emplace(1, "Ann", 4, false, "sedan", 4.5f, true, false, "", 40.751, -73.991);
+    p_list.Emplace("Bo", 7, "cash", false, 4.0f, false);
+    int rideId = RequestRide(r_list, 7);
+    p_list.Delete(7);
+    batchreport b = dispatch.Tick();
+    Expect(b.matched == 0, name, "matched a ride with no passenger");
+    Expect(r_list.Find(rideId) == 0, name, "orphaned ride still in the active list");
+    Expect(d_list.AvailableAt(d_list.Lookup(1)), name, "driver taken by an orphaned ride");
+    archive.Flush();
+    Expect(archive.Stats().rides == 1, name, "orphaned ride not archived");
+    if(Failures == before){
+        cout << name << ": ok\n";
+    }
+}
+
+// the same slots, in any order
+static bool SameSlots(vector<size_t> a, vector<size_t> b){
+    sort(a.begin(), a.end());
+    sort(b.begin(), b.end());
+    return a == b;
+}
+
+static bool Contains(const vector<size_t>& slots, size_t slot){
+    return find(slots.begin(), slots.end(), slot) != slots.end();
+}
+
+// handles follow a record moved by a delete, never resolve once it's gone,
+// and an in-place edit keeps the secondary indexes in step
+static void CheckDriverHandles(){
+    const char* name = "driver handles";
+    int before = Failures;
+    drivers d_list("Drivers");
+    const char* types[] = {"sedan", "sedan", "SUV", "compact", "sedan"};
+    for(int id = 1; id <= 5; id++){
+        d_list.Emplace(id, "D", 4, false, types[id - 1], 3.0f + 0.25f * id, true, false, "", 40.75, -73.99);
+    }
+    recordhandle first = d_list.Handle(1);
+    recordhandle last = d_list.Handle(5);
+    recordhandle edited = d_list.Handle(2);
+    // 5 is moved into the hole 1 leaves
+    Expect(d_list.Delete(first), name, "delete by handle refused");
+    size_t slot = d_list.Resolve(last);
+    Expect(slot != drivers::npos && d_list.IdAt(slot) == 5 && slot == d_list.Lookup(5), name,
+           "handle lost its record after a swap-and-pop delete");
+    Expect(d_list.Resolve(first) == drivers::npos, name, "deleted record's handle still resolves");
+    // the freed handle slot is reused for the next records
+    for(int id = 6; id <= 8; id++){
+        d_list.Emplace(id, "D", 4, false, "van", 4.0f, true, false, "", 40.75, -73.99);
+    }
+    Expect(d_list.Resolve(first) == drivers::npos, name, "deleted record's handle resolves after reuse");
+    Expect(!d_list.Edit(first, d_list.At(d_list.Lookup(6))), name, "edit through a stale handle");
+
+    driver d = d_list.At(d_list.Resolve(edited));
+    d.setType("van");
+    d.setRating(1.5f);
+    Expect(d_list.Edit(edited, d), name, "edit by handle refused");
+    slot = d_list.Resolve(edited);
+    driverquery q = AnyDriver();
+    for(int type = VT_ANY; type < VT_COUNT; type++){
+        q.type = type;
+        Expect(SameSlots(d_list.Query(q), d_list.Scan(q)), name, "type index out of step after an edit");
+    }
+    q = AnyDriver();
+    q.maxRating = 2.0f;
+    Expect(d_list.Query(q) == vector<size_t>(1, slot), name, "rating index out of step after an edit");
+    q.minRating = 3.0f;
+    q.maxRating = 5.0f;
+    Expect(SameSlots(d_list.Query(q), d_list.Scan(q)), name, "rating index out of step after an edit");
+    vector<size_t> vans = d_list.TopRated(40.75, -73.99, 10, VT_VAN);
+    Expect(vans.size() == 4 && vans.back() == slot, name, "edited driver not ranked with its new type");
+    Expect(!Contains(d_list.TopRated(40.75, -73.99, 10, VT_SEDAN), slot), name, "edited driver still ranked with its old type");
+    if(Failures == before){
+        cout << name << ": ok\n";
+    }
+}
+
+// Query (secondary indexes) and Scan (column scan) agree on random
+// filters while drivers are added, edited, deleted, claimed and released
+static void CheckQueryMatchesScan(){
+    const char* name = "query matches scan";
+    int before = Failures;
+    drivers d_list("Drivers");
+    const char* types[] = {"compact", "2dr", "sedan", "4dr", "SUV", "van", "other", "limo"};
+    mt19937 rng(12345);
+    int nextId = 1;
+    for(int round = 0; round < 200 && Failures == before; round++){
+        for(int op = 0; op < 20; op++){
+            int id = static_cast<int>(rng() % nextId) + 1;
+            size_t slot = d_list.Lookup(id);
+            switch(rng() % 5){
+            case 0:
+                d_list.Emplace(nextId++, "D", 1 + rng() % 8, rng() % 2, types[rng() % 8], 1.0f + (rng() % 41) * 0.1f,
+                               rng() % 2, rng() % 2, "", 40.7 + (rng() % 100) * 0.001, -74.0 + (rng() % 100) * 0.001);
+                break;
+            case 1:
+                if(slot != drivers::npos){
+                    driver d = d_list.At(slot);
+                    d.setType(types[rng() % 8]);
+                    d.setRating(1.0f + (rng() % 41) * 0.1f);
+                    d.setCapacity(1 + rng() % 8);
+                    d_list.Edit(id, d);
+                }
+                break;
+            case 2:
+                d_list.Delete(id);
+                break;
+            case 3:
+                d_list.Claim(id);
+                break;
+            default:
+                d_list.Release(id);
+                break;
+            }
+        }
+        for(int i = 0; i < 10; i++){
+            driverquery q = AnyDriver();
+            q.type = static_cast<int>(rng() % (VT_COUNT + 1)) - 1;
+            q.minCapacity = rng() % 9;
+            q.minRating = 1.0f + (rng() % 41) * 0.1f;
+            q.maxRating = q.minRating + (rng() % 41) * 0.1f;
+            q.availableOnly = rng() % 2;
+            q.handicap = rng() % 4 == 0;
+            q.pets = rng() % 4 == 0;
+            Expect(SameSlots(d_list.Query(q), d_list.Scan(q)), name, "query and scan disagree");
+        }
+    }
+    if(Failures == before){
+        cout << name << ": ok\n";
+    }
+}
+
+// parties bigger than the capacity bits in the masks still find a driver
+// with enough seats, and only one
+static void CheckLargeParty(){
+    const char* name = "large party";
+    int before = Failures;
+    drivers d_list("Drivers");
+    passengers p_list("Passengers");
+    rides r_list("Rides");
+    dispatcher dispatch(d_list, p_list, r_list);
+    // the van is closer but too small
+    d_list.Emplace(1, "Van", CapacityBits, false, "van", 4.5f, true, false, "", 40.7501, -73.9901);
+    d_list.Emplace(2, "Bus", 40, false, "other", 4.5f, true, false, "", 40.752, -73.992);
+    p_list.Emplace("Bo", 7, "cash", false, 4.0f, false);
+    ride r;
+    r.setPassenger(7);
+    r.setPickUpCoords(40.75, -73.99);
+    r.setDropoffCoords(40.70, -74.01);
+    r.setPartySize(30);
+    r.setPets(false);
+    int rideId = r_list.Create(r);
+    Expect(dispatch.Tick().matched == 1, name, "no driver for a party over CapacityBits");
+    Expect(r_list.Find(rideId)->getDriver() == 2, name, "party given a driver without enough seats");
+    r.setPartySize(50);
+    rideId = r_list.Create(r);
+    Expect(dispatch.Tick().matched == 0, name, "party given a driver without enough seats");
+    if(Failures == before){
+        cout << name << ": ok\n";
+    }
+}
+
+static string TempDir(){
+    char dir[] = "/tmp/selfcheck-XXXXXX";
+    return mkdtemp(dir) != 0 ? string(dir) : string();
+}
+
+static void RemoveDir(const string& dir){
+    string cmd = "rm -rf '" + dir + "'";
+    if(system(cmd.c_str()) != 0){
+        cout << "could not remove " << dir << "\n";
+    }
+}
+
+static void AppendRecords(const string& dir, uint64_t first, int n, bool rotate){
+    writeaheadlog log;
+    log.Open(dir, first);
+    for(int i = 0; i < n; i++){
+        char payload = static_cast<char>(i);
+        log.Append(LR_DRIVER_AVAILABLE, &payload, 1);
+        uint64_t cut;
+        if(rotate && i == n / 2){
+            log.Rotate(cut);
+        }
+    }
+    log.Close();
+}
+
+static vector<uint64_t> ReplayLsns(const string& dir, bool repair, uint64_t first = 0){
+    vector<uint64_t> lsns;
+    writeaheadlog::Replay(dir, [&](uint64_t lsn, uint8_t, const char*, size_t){
+        lsns.push_back(lsn);
+    }, repair, first);
+    return lsns;
+}
+
+// a corrupt record ends the replay for good, and repair lets the log carry
+// on from the good prefix
+static void CheckReplayStopsAtHole(){
+    const char* name = "log replay stops at a hole";
+    int before = Failures;
+    string dir = TempDir();
+    // lsns 1..3 in the first segment, 4..6 in the second
+    AppendRecords(dir, 1, 6, true);
+    vector<string> segments = writeaheadlog::Segments(dir);
+    if(!Expect(segments.size() == 2, name, "expected two segments")){
+        RemoveDir(dir);
+        return;
+    }
+    // flip a payload byte of lsn 2
+    string path = dir + "/" + segments[0];
+    FILE* f = fopen(path.c_str(), "r+b");
+    fseek(f, 18 + 17, SEEK_SET);
+    fputc(0x55, f);
+    fclose(f);
+    Expect(ReplayLsns(dir, false) == vector<uint64_t>(1, 1), name, "replayed past the corrupt record");
+    Expect(ReplayLsns(dir, true) == vector<uint64_t>(1, 1), name, "repair replayed past the corrupt record");
+    AppendRecords(dir, 2, 2, false);
+    vector<uint64_t> want;
+    want.push_back(1);
+    want.push_back(2);
+    want.push_back(3);
+    Expect(ReplayLsns(dir, false) == want, name, "records after the repair are not replayed");
+    RemoveDir(dir);
+
+    // a log that starts past the expected lsn lost its head
+    dir = TempDir();
+    AppendRecords(dir, 5, 2, false);
+    want.assign(1, 5);
+    want.push_back(6);
+    Expect(ReplayLsns(dir, false, 5) == want, name, "log starting at the expected lsn not replayed");
+    Expect(ReplayLsns(dir, false, 6) == want, name, "records older than the expected lsn not replayed");
+    Expect(ReplayLsns(dir, false, 3).empty(), name, "replayed a log missing its first records");
+    RemoveDir(dir);
+    if(Failures == before){
+        cout << name << ": ok\n";
+    }
+}
+
+// a failed write is never reported durable, and stays failed
+static void CheckLogWriteFailure(){
+    const char* name = "log write failure";
+    int before = Failures;
+    string dir = TempDir();
+    // every write to the first segment fails with ENOSPC
+    if(symlink("/dev/full", (dir + "/wal-0000000000000001.log").c_str()) != 0){
+        cout << name << ": skipped, no /dev/full\n";
+        RemoveDir(dir);
+        return;
+    }
+    writeaheadlog log;
+    if(!Expect(log.Open(dir, 1), name, "could not open the log")){
+        RemoveDir(dir);
+        return;
+    }
+    char payload = 1;
+    uint64_t lsn = log.Append(LR_DRIVER_AVAILABLE, &payload, 1);
+    Expect(!log.WaitDurable(lsn), name, "failed write reported durable");
+    Expect(log.HasFailed(), name, "failure not sticky");
+    atomic<int> told(0);
+    log.OnDurable(log.Append(LR_DRIVER_AVAILABLE, &payload, 1), [&](bool ok){ told = ok ? 1 : 2; });
+    Expect(told == 2, name, "waiter not told about the failure");
+    Expect(!log.Sync(), name, "sync succeeded after a failure");
+    uint64_t cut = 0;
+    Expect(!log.Rotate(cut), name, "rotate succeeded after a failure");
+    log.Close();
+    RemoveDir(dir);
+    if(Failures == before){
+        cout << name << ": ok\n";
+    }
+}
+
+// overwrites one byte, at offset into the first occurrence of find
+static bool PatchFile(const string& path, const string& find, size_t offset, char value){
+    FILE* f = fopen(path.c_str(), "r+b");
+    if(f == 0){
+        return false;
+    }
+    string contents;
+    char buf[4096];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0){
+        contents.append(buf, n);
+    }
+    size_t at = contents.find(find);
+    bool ok = at != string::npos && fseek(f, static_cast<long>(at + offset), SEEK_SET) == 0 && fputc(value, f) != EOF;
+    fclose(f);
+    return ok;
+}
+
+// snapshots SaveSnapshot can't have written (duplicate ids, flag bytes
+// other than 0/1) are refused without touching the collection
+static void CheckDamagedSnapshots(){
+    const char* name = "damaged snapshots";
+    int before = Failures;
+    string dir = TempDir();
+    drivers d_list("Drivers");
+    d_list.Emplace(1001, "Ann", 4, false, "sedan", 4.5f, true, false, "", 40.75, -73.99);
+    d_list.Emplace(1002, "Cy", 4, false, "sedan", 4.5f, true, false, "", 40.75, -73.99);
+    d_list.SaveSnapshot(dir + "/drivers.snap");
+    // ids are one int column: make the second id the same as the first
+    int ids[2] = {1001, 1002};
+    Expect(PatchFile(dir + "/drivers.snap", string(reinterpret_cast<const char*>(ids), sizeof(ids)), 4, static_cast<char>(1001 & 0xff)),
+           name, "driver ids not found in the snapshot");
+    drivers loaded("Drivers");
+    loaded.Emplace(7, "Bo", 4, false, "sedan", 4.5f, true, false, "", 40.75, -73.99);
+    Expect(!loaded.LoadSnapshot(dir + "/drivers.snap"), name, "loaded a drivers snapshot with a duplicate id");
+    Expect(loaded.Size() == 1 && loaded.Lookup(7) == 0, name, "failed load changed the drivers");
+
+    passengers p_list("Passengers");
+    p_list.Emplace("Bo", 1001, "cash", false, 4.0f, false);
+    p_list.Emplace("Di", 1002, "cash", false, 4.0f, false);
+    p_list.SaveSnapshot(dir + "/passengers.snap");
+    Expect(PatchFile(dir + "/passengers.snap", string(reinterpret_cast<const char*>(ids), sizeof(ids)), 4, static_cast<char>(1001 & 0xff)),
+           name, "passenger ids not found in the snapshot");
+    passengers pLoaded("Passengers");
+    Expect(!pLoaded.LoadSnapshot(dir + "/passengers.snap"), name, "loaded a passengers snapshot with a duplicate id");
+
+    // the pets flag is the one byte that differs between these two rides
+    rides r_list("Rides");
+    const ride* with = r_list.Find(RequestRide(r_list, 1));
+    ride without = *with;
+    without.setPets(true);
+    size_t petsAt = 0;
+    while(petsAt < sizeof(ride) && reinterpret_cast<const char*>(with)[petsAt] == reinterpret_cast<const char*>(&without)[petsAt]){
+        petsAt++;
+    }
+    r_list.SaveSnapshot(dir + "/rides.snap");
+    Expect(PatchFile(dir + "/rides.snap", string(reinterpret_cast<const char*>(with), sizeof(ride)), petsAt, 2),
+           name, "ride not found in the snapshot");
+    rides rLoaded("Rides");
+    Expect(!rLoaded.LoadSnapshot(dir + "/rides.snap"), name, "loaded a ride with a pets byte of 2");
+    RemoveDir(dir);
+    if(Failures == before){
+        cout << name << ": ok\n";
+    }
+}
+
+// requested rides come back in FIFO order, and a truncated file is
+// refused without touching the collection
+static void CheckRidesSnapshot(){
+    const char* name = "rides snapshot";
+    int before = Failures;
+    string dir = TempDir();
+    rides r_list("Rides");
+    vector<int> ids;
+    for(int i = 0; i < 5; i++){
+        ids.push_back(RequestRide(r_list, i));
+    }
+    // move the oldest two behind the rest, so list order != slot order
+    r_list.Requeue(ids[0]);
+    r_list.Requeue(ids[1]);
+    r_list.AssignDriver(ids[2], 9);
+    vector<int> requested, assigned;
+    r_list.ByStatus(RS_REQUESTED, requested);
+    r_list.ByStatus(RS_ASSIGNED, assigned);
+    Expect(r_list.SaveSnapshot(dir + "/rides.snap"), name, "save failed");
+    rides loaded("Rides");
+    Expect(loaded.LoadSnapshot(dir + "/rides.snap"), name, "load failed");
+    vector<int> got;
+    loaded.ByStatus(RS_REQUESTED, got);
+    Expect(got == requested, name, "requested order lost");
+    loaded.ByStatus(RS_ASSIGNED, got);
+    Expect(got == assigned, name, "assigned list lost");
+    Expect(loaded.Size() == 5 && loaded.Find(ids[2])->getDriver() == 9, name, "rides lost");
+
+    // a valid header promising 1024 slots, then 8 zero bytes
+    const char magic[8] = {'R', 'D', 'E', 'S', 'N', 'A', 'P', '2'};
+    uint64_t zero = 0;
+    snapshotwriter w;
+    w.Begin(magic, 1024, 0, 0, 0);
+    w.WriteColumn(&zero, sizeof(zero));
+    w.Finish(dir + "/short.snap");
+    Expect(!loaded.LoadSnapshot(dir + "/short.snap"), name, "loaded a truncated snapshot");
+    Expect(loaded.Size() == 5, name, "failed load changed the collection");
+    RemoveDir(dir);
+    if(Failures == before){
+        cout << name << ": ok\n";
+    }
+}
+
+// sends lines over one connection and reads until as many reply lines
+// came back
+static string Converse(int port, const string& lines, int replies){
+    string got;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+       || write(fd, lines.data(), lines.size()) != static_cast<ssize_t>(lines.size())){
+        if(fd >= 0){
+            close(fd);
+        }
+        return got;
+    }
+    char buf[4096];
+    ssize_t n;
+    while(count(got.begin(), got.end(), '\n') < replies && (n = read(fd, buf, sizeof(buf))) > 0){
+        got.append(buf, n);
+    }
+    close(fd);
+    return got;
+}
+
+// positions that aren't on the globe are refused over the wire too
+static void CheckServerRejectsBadCoordinates(){
+    const char* name = "server rejects bad coordinates";
+    int before = Failures;
+    drivers d_list("Drivers");
+    passengers p_list("Passengers");
+    rides r_list("Rides");
+    dispatcher dispatch(d_list, p_list, r_list);
+    batchexecutor exec(d_list, p_list, r_list, dispatch);
+    requestserver server(exec);
+    if(!Expect(server.Listen("127.0.0.1", 0), name, "could not listen")){
+        return;
+    }
+    thread serving([&]{ server.Run(); });
+    string got = Converse(server.Port(),
+                          "add driver 1|Ann|4|no|sedan|4.5|yes|no||40.75|-73.99\n"
+                          "location 1 nan 0\n"
+                          "top 1e308 0 3\n"
+                          "add driver 2|Cy|4|no|sedan|4.5|yes|no||-91|0\n"
+                          "request 7 40.75 -73.99 40.70 inf 1 no\n", 5);
+    server.Stop();
+    serving.join();
+    Expect(got == "ok\n"
+                  "error bad coordinates\n"
+                  "error bad coordinates\n"
+                  "error bad coordinates\n"
+                  "error bad coordinates\n", name, "bad coordinates not refused");
+    Expect(d_list.Size() == 1 && d_list.LatAt(d_list.Lookup(1)) == 40.75, name, "refused command changed the registry");
+    if(Failures == before){
+        cout << name << ": ok\n";
+    }
+}
+
+int main(){
+    CheckRideLifecycle();
+    CheckOrphanedRide();
+    CheckDriverHandles();
+    CheckQueryMatchesScan();
+    CheckLargeParty();
+    CheckReplayStopsAtHole();
+    CheckLogWriteFailure();
+    CheckRidesSnapshot();
+    CheckDamagedSnapshots();
+    CheckServerRejectsBadCoordinates();
+    return Failures;
+}
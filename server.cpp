@@ -0,0 +1,304 @@
+#include "server.h"
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+
+requestserver::requestserver(batchexecutor& exec)
+    : requestserver([&exec](string_view line, reportwriter& out){ return exec.Execute(line, out); }){
+}
+
+requestserver::requestserver(commandhandler handler)
+    : Handler(handler), Out(static_cast<string*>(0)){
+    Listener = -1;
+    Epoll = epoll_create1(EPOLL_CLOEXEC);
+    Wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    Requests = 0;
+    if(Epoll >= 0 && Wake >= 0){
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = Wake;
+        epoll_ctl(Epoll, EPOLL_CTL_ADD, Wake, &ev);
+    }
+}
+
+requestserver::~requestserver(){
+    Out.Redirect(0);
+    while(!Connections.empty()){
+        Close(*Connections.begin()->second);
+    }
+    if(Listener >= 0){
+        close(Listener);
+    }
+    if(Wake >= 0){
+        close(Wake);
+    }
+    if(Epoll >= 0){
+        close(Epoll);
+    }
+}
+
+bool requestserver::Listen(const string& host, int port){
+    if(Epoll < 0 || Wake < 0 || Listener >= 0){
+        return false;
+    }
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if(host.empty()){
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    }
+    else if(inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1){
+        return false;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0){
+        return false;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0){
+        close(fd);
+        return false;
+    }
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if(epoll_ctl(Epoll, EPOLL_CTL_ADD, fd, &ev) != 0){
+        close(fd);
+        return false;
+    }
+    Listener = fd;
+    return true;
+}
+
+int requestserver::Port() const{
+    sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if(Listener < 0 || getsockname(Listener, reinterpret_cast<sockaddr*>(&addr), &len) != 0){
+        return -1;
+    }
+    return ntohs(addr.sin_port);
+}
+
+void requestserver::Accept(){
+    for(;;){
+        int fd = accept4(Listener, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0){
+            // EAGAIN once the backlog is empty; anything else (EMFILE, a
+            // client that gave up) just ends this round
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        unique_ptr<connection> c(new connection());
+        c->fd = fd;
+        c->sent = 0;
+        c->reading = true;
+        c->writing = false;
+        c->closing = false;
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if(epoll_ctl(Epoll, EPOLL_CTL_ADD, fd, &ev) != 0){
+            close(fd);
+            continue;
+        }
+        Connections[fd] = move(c);
+    }
+}
+
+void requestserver::Read(connection& c){
+    char buf[ReadSize];
+    for(;;){
+        ssize_t got = read(c.fd, buf, sizeof(buf));
+        if(got > 0){
+            c.in.append(buf, got);
+            if(static_cast<size_t>(got) < sizeof(buf)){
+                break;
+            }
+            continue;
+        }
+        if(got < 0 && errno == EINTR){
+            continue;
+        }
+        if(got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            break;
+        }
+        // end of input or a dead socket: answer what is already complete,
+        // then the trailing line, then hang up
+        c.closing = true;
+        break;
+    }
+    Execute(c);
+}
+
+void requestserver::Execute(connection& c){
+    Out.Redirect(&c.out);
+    size_t start = 0;
+    for(;;){
+        size_t nl = c.in.find('\n', start);
+        if(nl == string::npos){
+            break;
+        }
+        Handler(string_view(c.in.data() + start, nl - start), Out);
+        Requests++;
+        start = nl + 1;
+    }
+    c.in.erase(0, start);
+    if(c.closing && !c.in.empty()){
+        Handler(c.in, Out);
+        Requests++;
+        c.in.clear();
+    }
+    else if(c.in.size() > MaxLine){
+        Out.Put("error line too long\n");
+        c.in.clear();
+        c.closing = true;
+    }
+    Out.Redirect(0);
+    Write(c);
+}
+
+void requestserver::Write(connection& c){
+    while(c.sent < c.out.size()){
+        ssize_t put = send(c.fd, c.out.data() + c.sent, c.out.size() - c.sent, MSG_NOSIGNAL);
+        if(put > 0){
+            c.sent += put;
+            continue;
+        }
+        if(put < 0 && errno == EINTR){
+            continue;
+        }
+        if(put < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            break;
+        }
+        // the peer is gone; nothing more can be delivered
+        Close(c);
+        return;
+    }
+    if(c.sent == c.out.size()){
+        c.out.clear();
+        c.sent = 0;
+        if(c.closing){
+            Close(c);
+            return;
+        }
+    }
+    else if(c.sent > MaxPending){
+        c.out.erase(0, c.sent);
+        c.sent = 0;
+    }
+    Watch(c);
+}
+
+// arms EPOLLIN unless the connection is closing or backed up, and EPOLLOUT
+// while output is pending
+void requestserver::Watch(connection& c){
+    bool pending = c.sent < c.out.size();
+    bool reading = !c.closing && c.out.size() - c.sent < MaxPending;
+    if(reading == c.reading && pending == c.writing){
+        return;
+    }
+    epoll_event ev;
+    ev.events = 0;
+    if(reading){
+        ev.events |= EPOLLIN;
+    }
+    if(pending){
+        ev.events |= EPOLLOUT;
+    }
+    ev.data.fd = c.fd;
+    epoll_ctl(Epoll, EPOLL_CTL_MOD, c.fd, &ev);
+    c.reading = reading;
+    c.writing = pending;
+}
+
+void requestserver::Close(connection& c){
+    int fd = c.fd;
+    epoll_ctl(Epoll, EPOLL_CTL_DEL, fd, 0);
+    close(fd);
+    // c is owned by the map; don't touch it after this
+    Connections.erase(fd);
+}
+
+void requestserver::Run(const function<void()>& idle){
+    if(Epoll < 0 || Listener < 0){
+        return;
+    }
+    epoll_event events[256];
+    for(;;){
+        int n = epoll_wait(Epoll, events, 256, -1);
+        if(n < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            return;
+        }
+        bool stop = false;
+        for(int i = 0; i < n; i++){
+            int fd = events[i].data.fd;
+            if(fd == Wake){
+                stop = true;
+                continue;
+            }
+            if(fd == Listener){
+                Accept();
+                continue;
+            }
+            unordered_map<int, unique_ptr<connection> >::iterator it = Connections.find(fd);
+            if(it == Connections.end()){
+                // closed earlier in this batch
+                continue;
+            }
+            connection& c = *it->second;
+            if(events[i].events & (EPOLLERR | EPOLLHUP)){
+                if(!(events[i].events & EPOLLIN)){
+                    Close(c);
+                    continue;
+                }
+            }
+            if(events[i].events & EPOLLOUT){
+                Write(c);
+                if(Connections.find(fd) == Connections.end()){
+                    continue;
+                }
+            }
+            if(events[i].events & EPOLLIN){
+                Read(c);
+            }
+        }
+        if(idle){
+            idle();
+        }
+        if(stop){
+            uint64_t count;
+            while(read(Wake, &count, sizeof(count)) > 0){
+            }
+            return;
+        }
+    }
+}
+
+void requestserver::Stop(){
+    uint64_t one = 1;
+    // write(2) is async-signal-safe, so this works from a signal handler
+    ssize_t ignored = write(Wake, &one, sizeof(one));
+    (void)ignored;
+}
+
+size_t requestserver::ConnectionCount() const{
+    return Connections.size();
+}
+
+size_t requestserver::RequestCount() const{
+    return Requests;
+}
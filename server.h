@@ -0,0 +1,79 @@
+#ifndef SERVER_H
+#define SERVER_H
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+#include <cstddef>
+using namespace std;
+
+#include "batch.h"
+#include "report.h"
+
+// Long-running TCP front end for batchexecutor. Clients speak the batch
+// line protocol (see batch.h) and may pipeline: every complete line that
+// arrives is executed in order and the responses go back in one write, so
+// a client can keep many requests in flight on one connection.
+//
+// Single threaded on one epoll loop; the registries are only ever touched
+// from Run(), so many clients share one in-memory state without locking.
+// A connection whose unsent output passes MaxPending stops being read until
+// it drains, so a client that never reads cannot grow the server's memory.
+class requestserver{
+    public:
+    // runs one command line and appends its response, like
+    // batchexecutor::Execute
+    typedef function<bool(string_view line, reportwriter& out)> commandhandler;
+
+    private:
+    static const size_t ReadSize = 64 * 1024;
+    static const size_t MaxLine = 1 << 20;
+    static const size_t MaxPending = 4 << 20;
+
+    struct connection{
+        int fd;
+        string in;
+        string out;
+        size_t sent;
+        bool reading;   // EPOLLIN armed
+        bool writing;   // EPOLLOUT armed
+        bool closing;   // close once out is sent
+    };
+
+    commandhandler Handler;
+    int Listener;
+    int Epoll;
+    int Wake;  // eventfd written by Stop()
+    reportwriter Out;
+    unordered_map<int, unique_ptr<connection> > Connections;
+    size_t Requests;
+
+    requestserver(const requestserver&);
+    requestserver& operator=(const requestserver&);
+    void Accept();
+    void Read(connection& c);
+    void Execute(connection& c);
+    void Write(connection& c);
+    void Watch(connection& c);
+    void Close(connection& c);
+
+    public:
+    explicit requestserver(batchexecutor& exec);
+    // serves another implementation of the protocol, e.g. a shardrouter
+    explicit requestserver(commandhandler handler);
+    ~requestserver();
+    // binds host:port (host "" or "0.0.0.0" for any); false on failure
+    bool Listen(const string& host, int port);
+    // the bound port, useful after Listen(host, 0)
+    int Port() const;
+    // serves until Stop(); idle (if set) runs after each batch of events,
+    // e.g. to let the registry compact its log
+    void Run(const function<void()>& idle = function<void()>());
+    // safe to call from another thread or a signal handler
+    void Stop();
+    size_t ConnectionCount() const;
+    size_t RequestCount() const;
+};
+#endif
@@ -0,0 +1,133 @@
+#include "shardclient.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+
+shardclient::shardclient(){
+    Fd = -1;
+    InStart = 0;
+}
+
+shardclient::~shardclient(){
+    Close();
+}
+
+bool shardclient::Connect(const string& host, int port){
+    Close();
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if(inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1){
+        return false;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0){
+        return false;
+    }
+    if(connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0){
+        close(fd);
+        return false;
+    }
+    // one small command per round trip; don't let Nagle hold it back
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    Fd = fd;
+    return true;
+}
+
+void shardclient::Close(){
+    if(Fd >= 0){
+        close(Fd);
+        Fd = -1;
+    }
+    Out.clear();
+    In.clear();
+    InStart = 0;
+}
+
+bool shardclient::IsOpen() const{
+    return Fd >= 0;
+}
+
+void shardclient::Send(string_view line){
+    Out.append(line.data(), line.size());
+    Out.push_back('\n');
+}
+
+bool shardclient::Flush(){
+    size_t done = 0;
+    while(done < Out.size() && Fd >= 0){
+        ssize_t n = send(Fd, Out.data() + done, Out.size() - done, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n <= 0){
+            Close();
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    Out.clear();
+    return Fd >= 0;
+}
+
+bool shardclient::Receive(string& response){
+    response.clear();
+    size_t scan = InStart;
+    for(;;){
+        size_t nl;
+        while((nl = In.find('\n', scan)) != string::npos){
+            string_view line(In.data() + scan, nl - scan);
+            scan = nl + 1;
+            if(line.compare(0, 2, "ok") == 0 || line.compare(0, 5, "error") == 0){
+                response.assign(In, InStart, scan - InStart);
+                InStart = scan;
+                if(InStart == In.size()){
+                    In.clear();
+                    InStart = 0;
+                }
+                return true;
+            }
+        }
+        if(Fd < 0){
+            return false;
+        }
+        // keep the partial response, drop what was handed out already
+        In.erase(0, InStart);
+        scan -= InStart;
+        InStart = 0;
+        char buf[64 * 1024];
+        ssize_t n = recv(Fd, buf, sizeof(buf), 0);
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n <= 0){
+            Close();
+            return false;
+        }
+        In.append(buf, static_cast<size_t>(n));
+    }
+}
+
+bool shardclient::Call(string_view line, string& response){
+    Send(line);
+    return Flush() && Receive(response);
+}
+
+string_view ResponseStatus(string_view response){
+    if(!response.empty() && response.back() == '\n'){
+        response.remove_suffix(1);
+    }
+    size_t nl = response.rfind('\n');
+    return nl == string_view::npos ? response : response.substr(nl + 1);
+}
+
+bool ResponseOk(string_view response){
+    return ResponseStatus(response).compare(0, 2, "ok") == 0;
+}
@@ -0,0 +1,41 @@
+#ifndef SHARDCLIENT_H
+#define SHARDCLIENT_H
+#include <string>
+#include <string_view>
+#include <cstddef>
+using namespace std;
+
+// Blocking client for one requestserver, speaking the batch line protocol.
+// Send() only queues; Flush() writes everything queued in one go, so a
+// caller can put a command on several shards before waiting on any of them
+// and the shards work on it at the same time.
+class shardclient{
+    private:
+    int Fd;
+    string Out;
+    string In;
+    size_t InStart; // first byte of In not handed out yet
+
+    shardclient(const shardclient&);
+    shardclient& operator=(const shardclient&);
+
+    public:
+    shardclient();
+    ~shardclient();
+    bool Connect(const string& host, int port);
+    void Close();
+    bool IsOpen() const;
+    // queues one command; a newline is added
+    void Send(string_view line);
+    bool Flush();
+    // the next response: every line up to and including the one starting
+    // with "ok" or "error", newlines kept. False if the shard went away.
+    bool Receive(string& response);
+    // Send, Flush and Receive
+    bool Call(string_view line, string& response);
+};
+
+// the last line of a response, without its newline
+string_view ResponseStatus(string_view response);
+bool ResponseOk(string_view response);
+#endif
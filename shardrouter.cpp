@@ -0,0 +1,772 @@
+#include "shardrouter.h"
+#include "geohash.h"
+#include "spatialgrid.h"
+#include "fieldparse.h"
+#include "metrics.h"
+#include <cstdio>
+#include <cmath>
+
+shardmap::shardmap(){
+    Longest = 0;
+    Fallback = 0;
+}
+
+bool shardmap::Assign(string_view prefix, size_t shard){
+    geobox box;
+    if(prefix.empty() || prefix.size() > MaxGeohashLength || !GeohashDecode(prefix, box)){
+        return false;
+    }
+    Regions[string(prefix)] = shard;
+    if(prefix.size() > Longest){
+        Longest = prefix.size();
+    }
+    return true;
+}
+
+void shardmap::SetFallback(size_t shard){
+    Fallback = shard;
+}
+
+size_t shardmap::Owner(double lat, double lon) const{
+    string hash = GeohashEncode(lat, lon, Longest);
+    while(!hash.empty()){
+        unordered_map<string, size_t>::const_iterator i = Regions.find(hash);
+        if(i != Regions.end()){
+            return i->second;
+        }
+        hash.pop_back();
+    }
+    return Fallback;
+}
+
+size_t shardmap::Precision() const{
+    return Longest;
+}
+
+size_t shardmap::RegionCount() const{
+    return Regions.size();
+}
+
+bool LoadDeployment(const string& path, sharddeployment& d){
+    FILE* f = fopen(path.c_str(), "r");
+    if(f == 0){
+        return false;
+    }
+    d.map = shardmap();
+    d.shards.clear();
+    d.reachKm = 10.0;
+    vector<pair<string, int> > regions;
+    int fallback = 0;
+    bool ok = true;
+    char buf[512];
+    while(ok && fgets(buf, sizeof(buf), f) != 0){
+        string_view rest = Trim(buf);
+        if(!rest.empty() && rest.back() == '\n'){
+            rest = Trim(rest.substr(0, rest.size() - 1));
+        }
+        if(rest.empty() || rest[0] == '#'){
+            continue;
+        }
+        string_view key = NextWord(rest);
+        string_view a = NextWord(rest);
+        string_view b = NextWord(rest);
+        int n;
+        if(key == "shard" && ParseInt(b, n) && n > 0 && n < 65536){
+            shardaddress s;
+            s.host = string(a);
+            s.port = n;
+            d.shards.push_back(s);
+        }
+        else if(key == "region" && ParseInt(b, n) && n >= 0){
+            regions.push_back(make_pair(string(a), n));
+        }
+        else if(key == "fallback" && ParseInt(a, n) && n >= 0){
+            fallback = n;
+        }
+        else if(key == "reach" && ParseDouble(a, d.reachKm) && d.reachKm >= 0){
+        }
+        else{
+            ok = false;
+        }
+    }
+    fclose(f);
+    // regions may come before the shards they name
+    ok = ok && !d.shards.empty() && static_cast<size_t>(fallback) < d.shards.size();
+    for(size_t i = 0; ok && i < regions.size(); i++){
+        ok = static_cast<size_t>(regions[i].second) < d.shards.size()
+             && d.map.Assign(regions[i].first, regions[i].second);
+    }
+    d.map.SetFallback(fallback);
+    return ok;
+}
+
+// "<shard>:<id>" as the router hands out ride ids
+static bool ParseRideId(string_view s, size_t shards, size_t& shard, string_view& id){
+    size_t colon = s.find(':');
+    int n;
+    int local;
+    if(colon == string_view::npos || !ParseInt(s.substr(0, colon), n) || n < 0 || static_cast<size_t>(n) >= shards
+       || !ParseInt(s.substr(colon + 1), local)){
+        return false;
+    }
+    shard = n;
+    id = s.substr(colon + 1);
+    return true;
+}
+
+// the number after key= in a status line
+static bool StatusValue(string_view status, string_view key, double& v){
+    size_t at = 0;
+    while((at = status.find(key, at)) != string_view::npos){
+        if((at == 0 || status[at - 1] == ' ') && at + key.size() < status.size() && status[at + key.size()] == '='){
+            string_view rest = status.substr(at + key.size() + 1);
+            return ParseDouble(NextWord(rest), v);
+        }
+        at += key.size();
+    }
+    return false;
+}
+
+shardrouter::shardrouter(const sharddeployment& d)
+    : Deployment(d), Links(new shardclient[d.shards.size()]){
+    Commands = 0;
+    Failures = 0;
+    Replies.resize(d.shards.size());
+    for(size_t i = 0; i < d.shards.size(); i++){
+        Everyone.push_back(i);
+    }
+}
+
+bool shardrouter::Connect(){
+    for(size_t i = 0; i < Deployment.shards.size(); i++){
+        if(!Links[i].Connect(Deployment.shards[i].host, Deployment.shards[i].port)){
+            return false;
+        }
+    }
+    // learn where the drivers the shards already hold live
+    DriverHome.clear();
+    if(!Gather(Everyone, "print drivers csv")){
+        return false;
+    }
+    for(size_t s = 0; s < Replies.size(); s++){
+        string_view body = Replies[s];
+        // skip the header
+        size_t at = body.find('\n');
+        while(at != string_view::npos && at + 1 < body.size()){
+            size_t end = body.find('\n', at + 1);
+            string_view row = body.substr(at + 1, end == string_view::npos ? string_view::npos : end - at - 1);
+            int id;
+            if(ParseInt(row.substr(0, row.find(',')), id)){
+                DriverHome[id] = s;
+            }
+            at = end;
+        }
+    }
+    return true;
+}
+
+bool shardrouter::Fail(reportwriter& out, string_view message, string_view detail){
+    Failures++;
+    out.Put("error ");
+    out.Put(message);
+    if(!detail.empty()){
+        out.PutChar(' ');
+        out.Put(detail);
+    }
+    out.PutChar('\n');
+    return false;
+}
+
+bool shardrouter::Gather(const vector<size_t>& shards, string_view line){
+    // everyone gets the command before anyone is waited on
+    for(size_t i = 0; i < shards.size(); i++){
+        Links[shards[i]].Send(line);
+    }
+    bool ok = true;
+    for(size_t i = 0; i < shards.size(); i++){
+        ok = Links[shards[i]].Flush() && ok;
+    }
+    for(size_t i = 0; i < shards.size(); i++){
+        if(!Links[shards[i]].Receive(Replies[shards[i]])){
+            Replies[shards[i]] = "error shard unreachable\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool shardrouter::Forward(size_t shard, string_view line, reportwriter& out){
+    if(!Links[shard].Call(line, Replies[shard])){
+        return Fail(out, "unreachable shard", to_string(shard));
+    }
+    out.Put(Replies[shard]);
+    if(!ResponseOk(Replies[shard])){
+        Failures++;
+        return false;
+    }
+    return true;
+}
+
+void shardrouter::ShardsInReach(double lat, double lon, vector<size_t>& out) const{
+    out.clear();
+    out.push_back(Deployment.map.Owner(lat, lon));
+    size_t precision = Deployment.map.Precision();
+    double reach = Deployment.reachKm;
+    geobox home;
+    if(precision == 0 || reach <= 0 || !GeohashDecode(GeohashEncode(lat, lon, precision), home)){
+        return;
+    }
+    // every cell of the finest region size that comes within reach
+    double h = home.maxLat - home.minLat;
+    double w = home.maxLon - home.minLon;
+    double hKm = spatialgrid::DistanceKm(home.minLat, lon, home.maxLat, lon);
+    double wKm = spatialgrid::DistanceKm(lat, home.minLon, lat, home.maxLon);
+    int rows = hKm > 0 ? static_cast<int>(ceil(reach / hKm)) : 0;
+    int cols = wKm > 0 ? static_cast<int>(ceil(reach / wKm)) : 0;
+    // a reach far beyond the region size is a config mistake; don't scan
+    // the whole map for it
+    rows = rows > 8 ? 8 : rows;
+    cols = cols > 8 ? 8 : cols;
+    for(int dy = -rows; dy <= rows; dy++){
+        for(int dx = -cols; dx <= cols; dx++){
+            geobox cell = home;
+            cell.minLat += dy * h;
+            cell.maxLat += dy * h;
+            cell.minLon += dx * w;
+            cell.maxLon += dx * w;
+            if(cell.minLat >= 90 || cell.maxLat <= -90 || GeoboxDistanceKm(cell, lat, lon) > reach){
+                continue;
+            }
+            double cLon = (cell.minLon + cell.maxLon) / 2;
+            cLon = cLon >= 180 ? cLon - 360 : (cLon < -180 ? cLon + 360 : cLon);
+            size_t s = Deployment.map.Owner((cell.minLat + cell.maxLat) / 2, cLon);
+            size_t i = 0;
+            while(i < out.size() && out[i] != s){
+                i++;
+            }
+            if(i == out.size()){
+                out.push_back(s);
+            }
+        }
+    }
+}
+
+bool shardrouter::Execute(string_view line, reportwriter& out){
+    METRIC_TIMER(M_COMMAND);
+    Commands++;
+    line = Trim(line);
+    if(line.empty() || line[0] == '#'){
+        return true;
+    }
+    string_view rest = line;
+    string_view cmd = NextWord(rest);
+    string_view what = NextWord(rest);
+    bool isDriver = what == "driver" || what == "drivers";
+    bool isPassenger = what == "passenger" || what == "passengers";
+    int id;
+
+    if(isPassenger && (cmd == "add" || cmd == "edit" || cmd == "delete")){
+        return ReplicatePassenger(cmd, rest, line, out);
+    }
+    if(cmd == "history"){
+        return History(line, out);
+    }
+    if(isPassenger){
+        return Forward(0, line, out);
+    }
+    if(cmd == "add" && isDriver){
+        return AddDriver(rest, out);
+    }
+    if(cmd == "edit" && isDriver){
+        return EditDriver(rest, line, out);
+    }
+    if((cmd == "find" || cmd == "delete") && isDriver){
+        string_view word = NextWord(rest);
+        unordered_map<int, size_t>::iterator home;
+        if(!ParseInt(word, id) || (home = DriverHome.find(id)) == DriverHome.end()){
+            return Fail(out, "no driver", word);
+        }
+        bool done = Forward(home->second, line, out);
+        if(done && cmd == "delete"){
+            DriverHome.erase(home);
+        }
+        return done;
+    }
+    if(cmd == "top"){
+        // one shard holds the whole rating region, see shardrouter.h
+        double lat;
+        double lon;
+        string_view lonText = NextWord(rest);
+        if(lonText.empty()){
+            return Fail(out, "usage: top <lat> <lon> <k> [<vehicle type>]");
+        }
+        if(!ParseCoordinates(what, lonText, lat, lon)){
+            return Fail(out, "bad coordinates");
+        }
+        return Forward(Deployment.map.Owner(lat, lon), line, out);
+    }
+    if(cmd == "available" || cmd == "rating"){
+        unordered_map<int, size_t>::iterator home;
+        if(!ParseInt(what, id) || (home = DriverHome.find(id)) == DriverHome.end()){
+            return Fail(out, "no driver", what);
+        }
+        return Forward(home->second, line, out);
+    }
+    if(cmd == "location" || cmd == "ping"){
+        return LocateDriver(what, rest, line, out);
+    }
+    if(cmd == "print" && isDriver){
+        return PrintDrivers(NextWord(rest), out);
+    }
+    if(cmd == "stats" && isDriver){
+        return DriverStats(out);
+    }
+    if(cmd == "stats" && what == "archive"){
+        return ArchiveStats(out);
+    }
+    if(cmd == "tick"){
+        return Tick(out);
+    }
+    if(cmd == "request"){
+        return RequestRide(Trim(line.substr(cmd.size())), line, out);
+    }
+    if(cmd == "ride" || cmd == "pickup" || cmd == "complete" || cmd == "cancel"){
+        size_t shard;
+        string_view local;
+        if(!ParseRideId(what, Deployment.shards.size(), shard, local)){
+            return Fail(out, "bad ride id", what);
+        }
+        string forwarded = string(cmd) + " " + string(local);
+        return Forward(shard, forwarded, out);
+    }
+    if(cmd == "metrics"){
+        // the router's own; each shard serves its own metrics
+        WriteMetrics(out);
+        out.Put("ok\n");
+        return true;
+    }
+    return Fail(out, "unknown command", cmd);
+}
+
+bool shardrouter::AddDriver(string_view fields, reportwriter& out){
+    string_view f[11];
+    size_t n = SplitFields(fields, f, 11);
+    int id;
+    double lat = 0;
+    double lon = 0;
+    if((n != 9 && n != 11) || !ParseInt(f[0], id) || (n == 11 && !ParseCoordinates(f[9], f[10], lat, lon))){
+        // not routable; let a shard explain what's wrong with it
+        return Forward(Deployment.map.Owner(0, 0), string("add driver ") + string(fields), out);
+    }
+    if(DriverHome.count(id) != 0){
+        return Fail(out, "duplicate driver id", f[0]);
+    }
+    size_t shard = Deployment.map.Owner(lat, lon);
+    if(!Forward(shard, string("add driver ") + string(fields), out)){
+        return false;
+    }
+    DriverHome[id] = shard;
+    return true;
+}
+
+bool shardrouter::ReplicatePassenger(string_view cmd, string_view rest, string_view line, reportwriter& out){
+    // the command that puts a shard which applied line back as it was
+    string undo;
+    string_view f[6];
+    int id;
+    if(cmd == "add"){
+        if(SplitFields(rest, f, 6) != 6 || !ParseInt(f[1], id)){
+            return Fail(out, "usage: add passenger name|id|payment|handicap|rating|pets");
+        }
+        undo = "delete passenger " + to_string(id);
+    }
+    else{
+        string_view word = NextWord(rest);
+        if(!ParseInt(word, id)){
+            return Fail(out, "bad id", word);
+        }
+        // the record as it stands, from the shard passenger reads go to
+        if(!Links[0].Call("find passenger " + string(word) + " fields", Replies[0])){
+            return Fail(out, "unreachable shard", "0");
+        }
+        if(!ResponseOk(Replies[0])){
+            out.Put(Replies[0]);
+            Failures++;
+            return false;
+        }
+        string_view old = Trim(string_view(Replies[0]).substr(2));
+        int newId;
+        if(cmd == "delete"){
+            undo = "add passenger " + string(old);
+        }
+        else if(SplitFields(rest, f, 6) == 6 && ParseInt(f[1], newId)){
+            undo = "edit passenger " + to_string(newId) + " " + string(old);
+        }
+        else{
+            return Fail(out, "usage: edit passenger <id> name|id|payment|handicap|rating|pets");
+        }
+    }
+    Gather(Everyone, line);
+    vector<size_t> applied;
+    size_t refused = Replies.size();
+    for(size_t s = 0; s < Replies.size(); s++){
+        if(ResponseOk(Replies[s])){
+            applied.push_back(s);
+        }
+        else if(refused == Replies.size()){
+            refused = s;
+        }
+    }
+    if(refused == Replies.size()){
+        out.Put("ok\n");
+        return true;
+    }
+    // undo it where it went through, so every shard keeps the same riders
+    string_view why = Replies[refused];
+    while(!why.empty() && (why.back() == '\n' || why.back() == '\r')){
+        why.remove_suffix(1);
+    }
+    why = why.substr(why.rfind('\n') + 1);
+    if(why.substr(0, 6) == "error "){
+        why.remove_prefix(6);
+    }
+    string detail = "on shard " + to_string(refused) + " (" + string(why) + "), ";
+    string stuck;
+    if(!applied.empty()){
+        Gather(applied, undo);
+        for(size_t i = 0; i < applied.size(); i++){
+            if(!ResponseOk(Replies[applied[i]])){
+                stuck += (stuck.empty() ? "" : ",") + to_string(applied[i]);
+            }
+        }
+    }
+    if(stuck.empty()){
+        detail += applied.empty() ? "no shard applied it" : "undone on the others";
+    }
+    else{
+        detail += "could not be undone on shards " + stuck;
+    }
+    return Fail(out, "passenger " + string(cmd) + " failed", detail);
+}
+
+bool shardrouter::EditDriver(string_view rest, string_view line, reportwriter& out){
+    string_view word = NextWord(rest);
+    int id;
+    unordered_map<int, size_t>::iterator home;
+    if(!ParseInt(word, id) || (home = DriverHome.find(id)) == DriverHome.end()){
+        return Fail(out, "no such driver, or the new id is taken");
+    }
+    size_t from = home->second;
+    string_view f[11];
+    size_t n = SplitFields(rest, f, 11);
+    int newId;
+    double lat;
+    double lon;
+    if(n == 11 && ParseInt(f[0], newId) && ParseCoordinates(f[9], f[10], lat, lon)){
+        if(newId != id && DriverHome.count(newId) != 0){
+            return Fail(out, "no such driver, or the new id is taken");
+        }
+        size_t to = Deployment.map.Owner(lat, lon);
+        if(to != from){
+            return MoveDriver(id, newId, from, to, Trim(rest), out);
+        }
+    }
+    else if(n < 1 || !ParseInt(f[0], newId)){
+        newId = id;
+    }
+    if(!Forward(from, line, out)){
+        return false;
+    }
+    if(newId != id){
+        DriverHome.erase(id);
+        DriverHome[newId] = from;
+    }
+    return true;
+}
+
+bool shardrouter::LocateDriver(string_view what, string_view rest, string_view line, reportwriter& out){
+    int id;
+    double lat;
+    double lon;
+    string_view latText = NextWord(rest);
+    string_view lonText = NextWord(rest);
+    if(!ParseInt(what, id) || lonText.empty()){
+        return Fail(out, "usage: location|ping <driver id> <lat> <lon>");
+    }
+    if(!ParseCoordinates(latText, lonText, lat, lon)){
+        return Fail(out, "bad coordinates");
+    }
+    unordered_map<int, size_t>::iterator home = DriverHome.find(id);
+    if(home == DriverHome.end()){
+        return Fail(out, "no driver", what);
+    }
+    size_t from = home->second;
+    size_t to = Deployment.map.Owner(lat, lon);
+    if(to == from){
+        return Forward(from, line, out);
+    }
+    string find = "find driver " + string(what) + " fields";
+    if(!Links[from].Call(find, Replies[from]) || !ResponseOk(Replies[from])){
+        return Fail(out, "no driver", what);
+    }
+    string_view record = Trim(ResponseStatus(Replies[from]).substr(2));
+    string_view f[11];
+    if(SplitFields(record, f, 11) != 11){
+        return Fail(out, "unexpected driver record from shard");
+    }
+    if(ParseBool(f[6]) != 1){
+        // on a ride; its shard has to see it through, so it stays put
+        return Forward(from, line, out);
+    }
+    string fields;
+    for(size_t i = 0; i < 9; i++){
+        fields.append(f[i].data(), f[i].size());
+        fields.push_back('|');
+    }
+    fields.append(latText.data(), latText.size());
+    fields.push_back('|');
+    fields.append(lonText.data(), lonText.size());
+    return MoveDriver(id, id, from, to, fields, out);
+}
+
+bool shardrouter::MoveDriver(int id, int newId, size_t from, size_t to, string_view fields, reportwriter& out){
+    // add first: if the new shard refuses, the driver is still where it was
+    if(!Links[to].Call(string("add driver ") + string(fields), Replies[to]) || !ResponseOk(Replies[to])){
+        out.Put(Replies[to]);
+        Failures++;
+        return false;
+    }
+    string del = "delete driver " + to_string(id);
+    if(!Links[from].Call(del, Replies[from])){
+        return Fail(out, "driver copied but old shard unreachable");
+    }
+    DriverHome.erase(id);
+    DriverHome[newId] = to;
+    out.Put("ok\n");
+    return true;
+}
+
+bool shardrouter::PrintDrivers(string_view format, reportwriter& out){
+    int f = format.empty() ? RF_TEXT : ParseReportFormat(format);
+    if(f == RF_UNKNOWN){
+        return Fail(out, "format must be text, csv or jsonl; got", format);
+    }
+    string line = "print drivers " + string(ReportFormatName(f));
+    bool reached = Gather(Everyone, line);
+    int64_t total = 0;
+    for(size_t s = 0; s < Replies.size(); s++){
+        string_view body = Replies[s];
+        string_view status = ResponseStatus(body);
+        int n;
+        if(!ResponseOk(status) || !ParseInt(Trim(status.substr(2)), n)){
+            out.Put(body);
+            Failures++;
+            return false;
+        }
+        total += n;
+        body = body.substr(0, body.size() - status.size() - 1);
+        if(f == RF_CSV && s > 0){
+            // one header is enough
+            size_t nl = body.find('\n');
+            body = nl == string_view::npos ? string_view() : body.substr(nl + 1);
+        }
+        out.Put(body);
+    }
+    out.Put("ok ");
+    out.PutInt(total);
+    out.PutChar('\n');
+    return reached;
+}
+
+bool shardrouter::DriverStats(reportwriter& out){
+    static const char* const Summed[] = { "count", "available", "seats", "handicap", "pets" };
+    double sums[5] = {};
+    double ratingSum = 0;
+    bool reached = Gather(Everyone, "stats drivers");
+    for(size_t s = 0; s < Replies.size(); s++){
+        string_view status = ResponseStatus(Replies[s]);
+        double v[5];
+        double rating;
+        bool ok = ResponseOk(status) && StatusValue(status, "rating", rating);
+        for(size_t k = 0; ok && k < 5; k++){
+            ok = StatusValue(status, Summed[k], v[k]);
+        }
+        if(!ok){
+            out.Put(Replies[s]);
+            Failures++;
+            return false;
+        }
+        for(size_t k = 0; k < 5; k++){
+            sums[k] += v[k];
+        }
+        ratingSum += rating * v[0];
+    }
+    out.Put("ok count=");
+    out.PutInt(static_cast<int64_t>(sums[0]));
+    out.Put(" available=");
+    out.PutInt(static_cast<int64_t>(sums[1]));
+    out.Put(" seats=");
+    out.PutInt(static_cast<int64_t>(sums[2]));
+    out.Put(" rating=");
+    out.PutDouble(sums[0] > 0 ? ratingSum / sums[0] : 0.0);
+    out.Put(" handicap=");
+    out.PutInt(static_cast<int64_t>(sums[3]));
+    out.Put(" pets=");
+    out.PutInt(static_cast<int64_t>(sums[4]));
+    out.PutChar('\n');
+    return reached;
+}
+
+bool shardrouter::ArchiveStats(reportwriter& out){
+    static const char* const Summed[] = { "rides", "segments", "bytes", "raw_bytes" };
+    double sums[4] = {};
+    bool reached = Gather(Everyone, "stats archive");
+    for(size_t s = 0; s < Replies.size(); s++){
+        string_view status = ResponseStatus(Replies[s]);
+        double v;
+        bool ok = ResponseOk(status);
+        for(size_t k = 0; ok && k < 4; k++){
+            ok = StatusValue(status, Summed[k], v);
+            sums[k] += v;
+        }
+        if(!ok){
+            out.Put(Replies[s]);
+            Failures++;
+            return false;
+        }
+    }
+    // each shard keeps its own label dictionary, so locations don't add up
+    for(size_t k = 0; k < 4; k++){
+        out.Put(k == 0 ? "ok " : " ");
+        out.Put(Summed[k]);
+        out.PutChar('=');
+        out.PutInt(static_cast<int64_t>(sums[k]));
+    }
+    out.PutChar('\n');
+    return reached;
+}
+
+bool shardrouter::History(string_view line, reportwriter& out){
+    bool reached = Gather(Everyone, line);
+    int64_t total = 0;
+    for(size_t s = 0; s < Replies.size(); s++){
+        string_view body = Replies[s];
+        string_view status = ResponseStatus(body);
+        int n;
+        if(!ResponseOk(status) || !ParseInt(Trim(status.substr(2)), n)){
+            out.Put(body);
+            Failures++;
+            return false;
+        }
+        total += n;
+        // ride ids in the records are the shard's own
+        out.Put(body.substr(0, body.size() - status.size() - 1));
+    }
+    out.Put("ok ");
+    out.PutInt(total);
+    out.PutChar('\n');
+    return reached;
+}
+
+bool shardrouter::Tick(reportwriter& out){
+    static const char* const Summed[] = { "pending", "batched", "matched" };
+    double sums[3] = {};
+    double latency = 0;
+    bool reached = Gather(Everyone, "tick");
+    for(size_t s = 0; s < Replies.size(); s++){
+        string_view status = ResponseStatus(Replies[s]);
+        double v;
+        bool ok = ResponseOk(status);
+        for(size_t k = 0; ok && k < 3; k++){
+            ok = StatusValue(status, Summed[k], v);
+            sums[k] += v;
+        }
+        if(!ok){
+            out.Put(Replies[s]);
+            Failures++;
+            return false;
+        }
+        // the shards tick side by side, so the slowest one is the latency
+        if(StatusValue(status, "latency_us", v) && v > latency){
+            latency = v;
+        }
+    }
+    out.Put("ok pending=");
+    out.PutInt(static_cast<int64_t>(sums[0]));
+    out.Put(" batched=");
+    out.PutInt(static_cast<int64_t>(sums[1]));
+    out.Put(" matched=");
+    out.PutInt(static_cast<int64_t>(sums[2]));
+    out.Put(" latency_us=");
+    out.PutDouble(latency);
+    out.PutChar('\n');
+    return reached;
+}
+
+bool shardrouter::RequestRide(string_view rest, string_view line, reportwriter& out){
+    string_view passenger = NextWord(rest);
+    string_view latText = NextWord(rest);
+    string_view lonText = NextWord(rest);
+    NextWord(rest);
+    NextWord(rest);
+    string_view party = NextWord(rest);
+    string_view pets = NextWord(rest);
+    double lat;
+    double lon;
+    if(lonText.empty()){
+        return Fail(out, "usage: request <passenger id> <lat> <lon> <lat> <lon> <party size> <pets yes|no>");
+    }
+    if(!ParseCoordinates(latText, lonText, lat, lon)){
+        return Fail(out, "bad coordinates");
+    }
+    vector<size_t> near;
+    ShardsInReach(lat, lon, near);
+    size_t target = near[0];
+    if(near.size() > 1){
+        // near a border: the ride goes where its nearest driver is
+        string ask = "candidates " + string(passenger) + " " + string(latText) + " " + string(lonText) + " "
+                     + string(party) + " " + string(pets);
+        Gather(near, ask);
+        double best = -1;
+        for(size_t i = 0; i < near.size(); i++){
+            string_view status = ResponseStatus(Replies[near[i]]);
+            if(!ResponseOk(status)){
+                continue;
+            }
+            string_view words = status.substr(2);
+            int count;
+            double km;
+            if(ParseInt(NextWord(words), count) && count > 0 && ParseDouble(NextWord(words), km) && (best < 0 || km < best)){
+                best = km;
+                target = near[i];
+            }
+        }
+    }
+    if(!Links[target].Call(line, Replies[target])){
+        return Fail(out, "unreachable shard", to_string(target));
+    }
+    string_view status = ResponseStatus(Replies[target]);
+    if(!ResponseOk(status)){
+        out.Put(Replies[target]);
+        Failures++;
+        return false;
+    }
+    out.Put("ok ");
+    out.PutInt(target);
+    out.PutChar(':');
+    out.Put(Trim(status.substr(2)));
+    out.PutChar('\n');
+    return true;
+}
+
+size_t shardrouter::ShardCount() const{
+    return Deployment.shards.size();
+}
+
+size_t shardrouter::CommandCount() const{
+    return Commands;
+}
+
+size_t shardrouter::FailureCount() const{
+    return Failures;
+}
@@ -0,0 +1,135 @@
+#ifndef SHARDROUTER_H
+#define SHARDROUTER_H
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <cstddef>
+using namespace std;
+
+#include "shardclient.h"
+#include "report.h"
+
+// Which shard owns a point: the one assigned the longest geohash prefix of
+// it, or the fallback shard when no prefix matches.
+class shardmap{
+    private:
+    unordered_map<string, size_t> Regions;
+    size_t Longest;
+    size_t Fallback;
+
+    public:
+    shardmap();
+    // false if prefix isn't a geohash of at most MaxGeohashLength
+    bool Assign(string_view prefix, size_t shard);
+    void SetFallback(size_t shard);
+    size_t Owner(double lat, double lon) const;
+    // length of the longest assigned prefix
+    size_t Precision() const;
+    size_t RegionCount() const;
+};
+
+struct shardaddress{
+    string host;
+    int port;
+};
+
+// A partitioned deployment, read from a file such as
+//
+//   # shard <host> <port>, numbered from 0 in order
+//   shard 10.0.0.1 7878
+//   shard 10.0.0.2 7878
+//   # region <geohash prefix> <shard>
+//   region dr5r 0
+//   region dr72 1
+//   # where points outside every region go (default 0)
+//   fallback 0
+//   # how far a pickup may be from its driver, the dispatchers'
+//   # maxPickupKm (default 10)
+//   reach 10
+struct sharddeployment{
+    shardmap map;
+    vector<shardaddress> shards;
+    double reachKm;
+};
+
+// false on a malformed line or a region naming a shard that isn't listed
+bool LoadDeployment(const string& path, sharddeployment& d);
+
+// Front end of a partitioned registry. Each shard is an ordinary
+// `main --serve` node holding the drivers, rides and dispatcher of its
+// regions; the router speaks the same batch protocol (batch.h) and sends
+// every command to the shard that owns it:
+//
+//   - drivers live on the shard that owns their position. A location update
+//     that crosses into another region moves the driver over, unless it is
+//     on a ride; a busy driver moves with its first update once it's free.
+//   - a ride request goes to the shard owning the pickup. When the pickup is
+//     within reach of other regions, those shards are asked for candidates
+//     in parallel and the ride goes wherever the nearest eligible driver is.
+//     Ride ids come back as <shard>:<id>.
+//   - top goes to the shard owning the point. Its region is a 20 bit (4
+//     character) geohash cell, which one shard holds whole as long as no
+//     region prefix is longer than that.
+//   - passengers have no position, and every shard's dispatcher needs the
+//     rider's record, so passenger changes go to all shards. If any shard
+//     refuses one, the shards that took it are put back (a delete after a
+//     failed add, the old record after a failed edit or delete) and the
+//     error names any shard that couldn't be.
+//   - tick, print drivers, stats drivers|archive and history fan out and
+//     add the shards' answers up; a rider's history is spread over every
+//     shard that ever dispatched them.
+//
+// Commands are sent to all the shards involved before waiting for any of
+// them, so a fan-out costs about one round trip, not one per shard. The
+// router blocks on the shards while it does; run several routers for more
+// front-end throughput, each behind its own port.
+class shardrouter{
+    private:
+    sharddeployment Deployment;
+    unique_ptr<shardclient[]> Links;
+    // the shard each driver lives on
+    unordered_map<int, size_t> DriverHome;
+    size_t Commands;
+    size_t Failures;
+    // one reply per shard, reused
+    vector<string> Replies;
+    vector<size_t> Everyone;
+
+    shardrouter(const shardrouter&);
+    shardrouter& operator=(const shardrouter&);
+    bool Fail(reportwriter& out, string_view message, string_view detail = string_view());
+    // sends line to every shard in shards, then collects Replies[shard];
+    // false if one of them could not be reached
+    bool Gather(const vector<size_t>& shards, string_view line);
+    // one shard's reply passed through to out
+    bool Forward(size_t shard, string_view line, reportwriter& out);
+    // the shards with ground within reach of (lat, lon), its owner first
+    void ShardsInReach(double lat, double lon, vector<size_t>& out) const;
+    // add/edit/delete passenger on every shard, undone on the shards that
+    // applied it if any shard refuses
+    bool ReplicatePassenger(string_view cmd, string_view rest, string_view line, reportwriter& out);
+    bool AddDriver(string_view fields, reportwriter& out);
+    bool EditDriver(string_view rest, string_view line, reportwriter& out);
+    bool LocateDriver(string_view what, string_view rest, string_view line, reportwriter& out);
+    // re-adds the driver on to with fields, then deletes it from from
+    bool MoveDriver(int id, int newId, size_t from, size_t to, string_view fields, reportwriter& out);
+    bool PrintDrivers(string_view format, reportwriter& out);
+    bool DriverStats(reportwriter& out);
+    bool ArchiveStats(reportwriter& out);
+    bool History(string_view line, reportwriter& out);
+    bool Tick(reportwriter& out);
+    bool RequestRide(string_view rest, string_view line, reportwriter& out);
+
+    public:
+    explicit shardrouter(const sharddeployment& d);
+    // connects to every shard and learns where the drivers they already
+    // hold live; false if a shard can't be reached
+    bool Connect();
+    bool Execute(string_view line, reportwriter& out);
+    size_t ShardCount() const;
+    size_t CommandCount() const;
+    size_t FailureCount() const;
+};
+#endif
@@ -0,0 +1,147 @@
+#include "snapshot.h"
+#include <cstring>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+
+static size_t Padded(size_t bytes){
+    return (bytes + 7) & ~static_cast<size_t>(7);
+}
+
+void snapshotwriter::Begin(const char* magic, uint64_t count, uint32_t fields, uint64_t stringBytes, uint64_t lsn){
+    Bytes.clear();
+    snapshotheader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, magic, sizeof(h.magic));
+    h.version = SnapshotVersion;
+    h.fields = fields;
+    h.count = count;
+    h.stringBytes = stringBytes;
+    h.lsn = lsn;
+    WriteColumn(&h, sizeof(h));
+}
+
+void snapshotwriter::WriteColumn(const void* data, size_t bytes){
+    const char* p = static_cast<const char*>(data);
+    if(bytes != 0){
+        Bytes.insert(Bytes.end(), p, p + bytes);
+    }
+    Bytes.resize(Padded(Bytes.size()), 0);
+}
+
+void snapshotwriter::WriteStrings(const vector<string_view>& strings){
+    vector<uint64_t> offsets(strings.size() + 1);
+    uint64_t at = 0;
+    for(size_t i = 0; i < strings.size(); i++){
+        offsets[i] = at;
+        at += strings[i].size();
+    }
+    offsets[strings.size()] = at;
+    WriteColumn(offsets.data(), offsets.size() * sizeof(uint64_t));
+    Bytes.reserve(Bytes.size() + at + 8);
+    for(size_t i = 0; i < strings.size(); i++){
+        Bytes.insert(Bytes.end(), strings[i].begin(), strings[i].end());
+    }
+    WriteColumn(0, 0);
+}
+
+bool snapshotwriter::Finish(const string& path){
+    return WriteSnapshotFile(path, Bytes);
+}
+
+void snapshotwriter::Take(vector<char>& out){
+    out.swap(Bytes);
+    Bytes.clear();
+}
+
+bool WriteSnapshotFile(const string& path, const vector<char>& bytes){
+    string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        return false;
+    }
+    size_t done = 0;
+    while(done < bytes.size()){
+        ssize_t n = write(fd, bytes.data() + done, bytes.size() - done);
+        if(n <= 0){
+            close(fd);
+            unlink(tmp.c_str());
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    if(fsync(fd) != 0){
+        close(fd);
+        unlink(tmp.c_str());
+        return false;
+    }
+    close(fd);
+    if(rename(tmp.c_str(), path.c_str()) != 0){
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+snapshotreader::snapshotreader(){
+    Offset = 0;
+    memset(&Header, 0, sizeof(Header));
+    StringOffsets = 0;
+    StringData = 0;
+}
+
+bool snapshotreader::Open(const string& path, const char* magic){
+    // version 1 headers stop before lsn
+    const size_t v1Size = offsetof(snapshotheader, lsn);
+    if(!File.Open(path) || File.GetLength() < v1Size){
+        return false;
+    }
+    memset(&Header, 0, sizeof(Header));
+    memcpy(&Header, File.GetData(), v1Size);
+    if(memcmp(Header.magic, magic, sizeof(Header.magic)) != 0){
+        return false;
+    }
+    if(Header.version == 1){
+        Offset = Padded(v1Size);
+        return true;
+    }
+    if(Header.version != SnapshotVersion || File.GetLength() < sizeof(snapshotheader)){
+        return false;
+    }
+    memcpy(&Header, File.GetData(), sizeof(Header));
+    Offset = Padded(sizeof(snapshotheader));
+    return true;
+}
+
+const snapshotheader& snapshotreader::GetHeader() const{
+    return Header;
+}
+
+const void* snapshotreader::NextColumn(size_t bytes){
+    if(Offset + bytes > File.GetLength()){
+        return 0;
+    }
+    const void* p = File.GetData() + Offset;
+    Offset += Padded(bytes);
+    return p;
+}
+
+bool snapshotreader::OpenStrings(){
+    size_t n = Header.count * Header.fields;
+    StringOffsets = static_cast<const uint64_t*>(NextColumn((n + 1) * sizeof(uint64_t)));
+    if(StringOffsets == 0 || StringOffsets[0] != 0 || StringOffsets[n] != Header.stringBytes){
+        return false;
+    }
+    for(size_t i = 0; i < n; i++){
+        if(StringOffsets[i] > StringOffsets[i + 1]){
+            return false;
+        }
+    }
+    StringData = static_cast<const char*>(NextColumn(Header.stringBytes));
+    return StringData != 0 || Header.stringBytes == 0;
+}
+
+const char* snapshotreader::StringAt(size_t i, size_t& length) const{
+    length = StringOffsets[i + 1] - StringOffsets[i];
+    return StringData + StringOffsets[i];
+}
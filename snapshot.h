@@ -0,0 +1,69 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+#include "mappedfile.h"
+
+// Binary snapshot layout shared by the collections:
+//   snapshotheader
+//   one block per column, raw little-endian array, padded to 8 bytes
+//   string table: uint64 offsets [count * fields + 1], then the bytes
+// Loading maps the file and copies each column in one go; nothing is parsed
+// per record.
+struct snapshotheader{
+    char magic[8];
+    uint32_t version;
+    uint32_t fields;  // strings per record
+    uint64_t count;
+    uint64_t stringBytes;
+    // last write-ahead log record the snapshot includes (version 2+)
+    uint64_t lsn;
+};
+
+const uint32_t SnapshotVersion = 2;
+
+// Builds a snapshot in memory. The bytes can be written straight away with
+// Finish() or handed off with Take() and written later (e.g. from a
+// background thread) with WriteSnapshotFile().
+class snapshotwriter{
+    private:
+    vector<char> Bytes;
+
+    public:
+    void Begin(const char* magic, uint64_t count, uint32_t fields, uint64_t stringBytes, uint64_t lsn);
+    void WriteColumn(const void* data, size_t bytes);
+    void WriteStrings(const vector<string_view>& strings);
+    bool Finish(const string& path);
+    void Take(vector<char>& out);
+};
+
+// Writes to path + ".tmp", syncs it and renames over path, so a crash never
+// leaves a half-written snapshot behind.
+bool WriteSnapshotFile(const string& path, const vector<char>& bytes);
+
+// Walks the blocks of a mapped snapshot in the order they were written.
+class snapshotreader{
+    private:
+    mappedfile File;
+    size_t Offset;
+    snapshotheader Header;
+    const uint64_t* StringOffsets;
+    const char* StringData;
+
+    public:
+    snapshotreader();
+    bool Open(const string& path, const char* magic);
+    const snapshotheader& GetHeader() const;
+    // pointer to the next column of bytes length, or 0 if the file is short
+    const void* NextColumn(size_t bytes);
+    bool OpenStrings();
+    // string i of the string table (record * fields + field)
+    const char* StringAt(size_t i, size_t& length) const;
+};
+#endif
@@ -0,0 +1,193 @@
+#include "spatialgrid.h"
+#include <cmath>
+#include <algorithm>
+#include <queue>
+#include <utility>
+
+static const double KmPerDegree = 111.32;
+
+spatialgrid::spatialgrid(){
+    // ~1.1km cells
+    CellSize = 0.01;
+    Count = 0;
+}
+
+spatialgrid::spatialgrid(double cellSizeDegrees){
+    CellSize = cellSizeDegrees;
+    Count = 0;
+}
+
+int64_t spatialgrid::CellKey(int cx, int cy) const{
+    // shifted unsigned: cx is negative west of 0 and << on a negative
+    // value is undefined before C++20. Same bits either way.
+    return static_cast<int64_t>(static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32 | static_cast<uint32_t>(cy));
+}
+
+// callers clamp first, so the casts below stay in range
+int spatialgrid::CellX(double lon) const{
+    return static_cast<int>(floor(lon / CellSize));
+}
+
+int spatialgrid::CellY(double lat) const{
+    return static_cast<int>(floor(lat / CellSize));
+}
+
+bool spatialgrid::ValidPosition(double lat, double lon){
+    return isfinite(lat) && isfinite(lon) && lat >= -90 && lat <= 90 && lon >= -180 && lon <= 180;
+}
+
+void spatialgrid::Clamp(double& lat, double& lon){
+    lat = isfinite(lat) ? min(max(lat, -90.0), 90.0) : 0;
+    lon = isfinite(lon) ? min(max(lon, -180.0), 180.0) : 0;
+}
+
+void spatialgrid::Insert(size_t slot, double lat, double lon){
+    Clamp(lat, lon);
+    entry e;
+    e.slot = slot;
+    e.lat = lat;
+    e.lon = lon;
+    Cells[CellKey(CellX(lon), CellY(lat))].push_back(e);
+    Count++;
+}
+
+bool spatialgrid::Remove(size_t slot, double lat, double lon){
+    Clamp(lat, lon);
+    unordered_map<int64_t, vector<entry> >::iterator it = Cells.find(CellKey(CellX(lon), CellY(lat)));
+    if(it == Cells.end()){
+        return false;
+    }
+    vector<entry>& cell = it->second;
+    for(size_t i = 0; i < cell.size(); i++){
+        if(cell[i].slot == slot){
+            cell[i] = cell.back();
+            cell.pop_back();
+            if(cell.empty()){
+                Cells.erase(it);
+            }
+            Count--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool spatialgrid::Move(size_t slot, double oldLat, double oldLon, double lat, double lon){
+    Clamp(oldLat, oldLon);
+    Clamp(lat, lon);
+    int64_t from = CellKey(CellX(oldLon), CellY(oldLat));
+    if(from != CellKey(CellX(lon), CellY(lat))){
+        if(!Remove(slot, oldLat, oldLon)){
+            return false;
+        }
+        Insert(slot, lat, lon);
+        return true;
+    }
+    unordered_map<int64_t, vector<entry> >::iterator it = Cells.find(from);
+    if(it == Cells.end()){
+        return false;
+    }
+    vector<entry>& cell = it->second;
+    for(size_t i = 0; i < cell.size(); i++){
+        if(cell[i].slot == slot){
+            cell[i].lat = lat;
+            cell[i].lon = lon;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool spatialgrid::Renumber(size_t from, size_t to, double lat, double lon){
+    Clamp(lat, lon);
+    unordered_map<int64_t, vector<entry> >::iterator it = Cells.find(CellKey(CellX(lon), CellY(lat)));
+    if(it == Cells.end()){
+        return false;
+    }
+    vector<entry>& cell = it->second;
+    for(size_t i = 0; i < cell.size(); i++){
+        if(cell[i].slot == from){
+            cell[i].slot = to;
+            return true;
+        }
+    }
+    return false;
+}
+
+void spatialgrid::Clear(){
+    Cells.clear();
+    Count = 0;
+}
+
+size_t spatialgrid::Size() const{
+    return Count;
+}
+
+double spatialgrid::DistanceKm(double lat1, double lon1, double lat2, double lon2){
+    // equirectangular approximation, good enough at city scale
+    double meanLat = (lat1 + lat2) * 0.5 * M_PI / 180.0;
+    double dx = (lon2 - lon1) * cos(meanLat);
+    double dy = lat2 - lat1;
+    return sqrt(dx * dx + dy * dy) * KmPerDegree;
+}
+
+vector<size_t> spatialgrid::KNearest(double lat, double lon, size_t k, double maxKm,
+                                     const function<bool(size_t)>& filter) const{
+    vector<size_t> result;
+    if(k == 0 || Count == 0 || !ValidPosition(lat, lon) || !(maxKm >= 0)){
+        return result;
+    }
+    // max-heap on distance holding the best k seen so far
+    priority_queue<pair<double, size_t> > best;
+    int cx = CellX(lon);
+    int cy = CellY(lat);
+    // a ring of radius r is at least (r - 1) cells away from the query point;
+    // longitude cells shrink with latitude, so use the narrower side
+    double cellKm = CellSize * KmPerDegree * max(cos(lat * M_PI / 180.0), 0.01);
+    // past the rings that cover the whole globe there is nothing left, and
+    // a huge maxKm mustn't overflow the int
+    double globe = ceil(360.0 / CellSize);
+    int maxRing = static_cast<int>(min(ceil(maxKm / cellKm), globe)) + 1;
+    size_t seen = 0;
+
+    for(int r = 0; r <= maxRing && seen < Count; r++){
+        if(best.size() == k && (r - 1) * cellKm > best.top().first){
+            break;
+        }
+        for(int dy = -r; dy <= r; dy++){
+            // interior rows only need the two edge cells of the ring
+            int step = (dy == -r || dy == r) ? 1 : 2 * r;
+            for(int dx = -r; dx <= r; dx += step){
+                unordered_map<int64_t, vector<entry> >::const_iterator it = Cells.find(CellKey(cx + dx, cy + dy));
+                if(it == Cells.end()){
+                    continue;
+                }
+                const vector<entry>& cell = it->second;
+                seen += cell.size();
+                for(size_t i = 0; i < cell.size(); i++){
+                    double d = DistanceKm(lat, lon, cell[i].lat, cell[i].lon);
+                    if(d > maxKm){
+                        continue;
+                    }
+                    if(best.size() == k && d >= best.top().first){
+                        continue;
+                    }
+                    if(filter && !filter(cell[i].slot)){
+                        continue;
+                    }
+                    best.push(make_pair(d, cell[i].slot));
+                    if(best.size() > k){
+                        best.pop();
+                    }
+                }
+            }
+        }
+    }
+
+    result.resize(best.size());
+    for(size_t i = result.size(); i > 0; i--){
+        result[i - 1] = best.top().second;
+        best.pop();
+    }
+    return result;
+}
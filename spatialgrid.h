@@ -0,0 +1,51 @@
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+// Uniform lat/lon grid over slots of a collection. Only the slots that are
+// inserted are searchable, so the owner decides what goes in (e.g. only the
+// available drivers). Positions that aren't ValidPosition() are clamped onto
+// the globe (non-finite parts to 0) rather than trusted, and a query from
+// one finds nothing.
+class spatialgrid{
+    private:
+    struct entry{
+        size_t slot;
+        double lat;
+        double lon;
+    };
+    double CellSize; // degrees
+    size_t Count;
+    unordered_map<int64_t, vector<entry> > Cells;
+
+    int64_t CellKey(int cx, int cy) const;
+    int CellX(double lon) const;
+    int CellY(double lat) const;
+    static void Clamp(double& lat, double& lon);
+
+    public:
+    spatialgrid();
+    spatialgrid(double cellSizeDegrees);
+    void Insert(size_t slot, double lat, double lon);
+    bool Remove(size_t slot, double lat, double lon);
+    // Remove + Insert, but a move within one cell only rewrites the entry
+    bool Move(size_t slot, double oldLat, double oldLon, double lat, double lon);
+    // the entry for slot from now stands for slot to
+    bool Renumber(size_t from, size_t to, double lat, double lon);
+    void Clear();
+    size_t Size() const;
+    // up to k slots nearest to (lat, lon) within maxKm that pass filter,
+    // closest first
+    vector<size_t> KNearest(double lat, double lon, size_t k, double maxKm,
+                            const function<bool(size_t)>& filter) const;
+
+    static double DistanceKm(double lat1, double lon1, double lat2, double lon2);
+    // finite, lat in [-90, 90] and lon in [-180, 180]
+    static bool ValidPosition(double lat, double lon);
+};
+#endif
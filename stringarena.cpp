@@ -0,0 +1,62 @@
+#include "stringarena.h"
+#include <cstring>
+
+stringarena::stringarena(){
+    Cur = 0;
+    Left = 0;
+    Live = 0;
+    Dead = 0;
+}
+
+string_view stringarena::Store(string_view s){
+    if(s.empty()){
+        return string_view();
+    }
+    Live += s.size();
+    // big strings get a block of their own so they don't waste the tail of
+    // the current one
+    if(s.size() > BlockSize / 4){
+        Blocks.push_back(unique_ptr<char[]>(new char[s.size()]));
+        memcpy(Blocks.back().get(), s.data(), s.size());
+        return string_view(Blocks.back().get(), s.size());
+    }
+    if(s.size() > Left){
+        Blocks.push_back(unique_ptr<char[]>(new char[BlockSize]));
+        Cur = Blocks.back().get();
+        Left = BlockSize;
+    }
+    char* p = Cur;
+    memcpy(p, s.data(), s.size());
+    Cur += s.size();
+    Left -= s.size();
+    return string_view(p, s.size());
+}
+
+void stringarena::Forget(string_view s){
+    Live -= s.size();
+    Dead += s.size();
+}
+
+void stringarena::Clear(){
+    Blocks.clear();
+    Cur = 0;
+    Left = 0;
+    Live = 0;
+    Dead = 0;
+}
+
+void stringarena::Swap(stringarena& other){
+    Blocks.swap(other.Blocks);
+    swap(Cur, other.Cur);
+    swap(Left, other.Left);
+    swap(Live, other.Live);
+    swap(Dead, other.Dead);
+}
+
+size_t stringarena::LiveBytes() const{
+    return Live;
+}
+
+size_t stringarena::DeadBytes() const{
+    return Dead;
+}
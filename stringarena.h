@@ -0,0 +1,37 @@
+#ifndef STRINGARENA_H
+#define STRINGARENA_H
+#include <vector>
+#include <memory>
+#include <string_view>
+#include <cstddef>
+using namespace std;
+
+// Bump allocator for the text fields of a collection. Strings are copied in
+// and handed back as string_views that stay valid until Clear() (or until
+// the owner compacts into a new arena). Individual strings are never freed;
+// Forget() only tracks how much of the arena is dead so the owner can decide
+// when to compact.
+class stringarena{
+    private:
+    static const size_t BlockSize = 64 * 1024;
+
+    vector<unique_ptr<char[]> > Blocks;
+    char* Cur;
+    size_t Left;
+    size_t Live;
+    size_t Dead;
+
+    stringarena(const stringarena&);
+    stringarena& operator=(const stringarena&);
+
+    public:
+    stringarena();
+    string_view Store(string_view s);
+    void Forget(string_view s);
+    // drops every string at once
+    void Clear();
+    void Swap(stringarena& other);
+    size_t LiveBytes() const;
+    size_t DeadBytes() const;
+};
+#endif
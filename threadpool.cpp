@@ -0,0 +1,131 @@
+#include "threadpool.h"
+
+// set while a thread is executing pool tasks, to catch nested Run() calls
+static thread_local bool InsidePool = false;
+
+threadpool::threadpool(size_t threads){
+    if(threads == 0){
+        threads = thread::hardware_concurrency();
+        if(threads == 0){
+            threads = 1;
+        }
+    }
+    QueueCount = threads;
+    Queues.reset(new taskqueue[QueueCount]);
+    Job = 0;
+    Generation = 0;
+    Pending = 0;
+    Stop = false;
+    for(size_t i = 1; i < QueueCount; i++){
+        Workers.push_back(thread(&threadpool::WorkerLoop, this, i));
+    }
+}
+
+threadpool::~threadpool(){
+    {
+        lock_guard<mutex> g(Lock);
+        Stop = true;
+    }
+    Wake.notify_all();
+    for(size_t i = 0; i < Workers.size(); i++){
+        Workers[i].join();
+    }
+}
+
+size_t threadpool::Size() const{
+    return QueueCount;
+}
+
+// own queue from the front, then everyone else's from the back
+bool threadpool::RunOne(size_t self){
+    size_t task = 0;
+    bool found = false;
+    {
+        lock_guard<mutex> g(Queues[self].Lock);
+        if(!Queues[self].Tasks.empty()){
+            task = Queues[self].Tasks.front();
+            Queues[self].Tasks.pop_front();
+            found = true;
+        }
+    }
+    for(size_t k = 1; !found && k < QueueCount; k++){
+        taskqueue& victim = Queues[(self + k) % QueueCount];
+        lock_guard<mutex> g(victim.Lock);
+        if(!victim.Tasks.empty()){
+            task = victim.Tasks.back();
+            victim.Tasks.pop_back();
+            found = true;
+        }
+    }
+    if(!found){
+        return false;
+    }
+    // Job was published before any task was queued, and the queue lock
+    // orders that write before this read
+    (*Job)(task);
+    if(Pending.fetch_sub(1) == 1){
+        lock_guard<mutex> g(Lock);
+        Done.notify_all();
+    }
+    return true;
+}
+
+void threadpool::WorkerLoop(size_t self){
+    InsidePool = true;
+    uint64_t seen = 0;
+    for(;;){
+        {
+            unique_lock<mutex> g(Lock);
+            Wake.wait(g, [&]{ return Stop || Generation != seen; });
+            if(Stop){
+                return;
+            }
+            seen = Generation;
+        }
+        while(RunOne(self)){
+        }
+    }
+}
+
+void threadpool::Run(size_t tasks, const function<void(size_t)>& fn){
+    if(tasks == 0){
+        return;
+    }
+    if(InsidePool || QueueCount == 1){
+        for(size_t i = 0; i < tasks; i++){
+            fn(i);
+        }
+        return;
+    }
+    lock_guard<mutex> batch(RunLock);
+    Job = &fn;
+    Pending = tasks;
+    // contiguous blocks keep neighbouring chunks on the same thread until
+    // someone has to steal
+    for(size_t q = 0; q < QueueCount; q++){
+        size_t begin = tasks * q / QueueCount;
+        size_t end = tasks * (q + 1) / QueueCount;
+        lock_guard<mutex> g(Queues[q].Lock);
+        for(size_t i = begin; i < end; i++){
+            Queues[q].Tasks.push_back(i);
+        }
+    }
+    {
+        lock_guard<mutex> g(Lock);
+        Generation++;
+    }
+    Wake.notify_all();
+
+    InsidePool = true;
+    while(RunOne(0)){
+    }
+    InsidePool = false;
+    unique_lock<mutex> g(Lock);
+    Done.wait(g, [&]{ return Pending.load() == 0; });
+    Job = 0;
+}
+
+threadpool& threadpool::Shared(){
+    static threadpool pool;
+    return pool;
+}
@@ -0,0 +1,60 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+// Fixed set of worker threads that run batches of numbered tasks. Run()
+// deals the tasks out in contiguous blocks, one queue per thread; a thread
+// works through its own queue from the front and, once that is empty,
+// steals from the back of the others, so uneven tasks still keep every
+// core busy. The calling thread takes part as well.
+//
+// One batch runs at a time. Run() called from inside a task executes the
+// inner batch inline on that thread instead of deadlocking.
+class threadpool{
+    private:
+    struct alignas(64) taskqueue{
+        mutex Lock;
+        deque<size_t> Tasks;
+    };
+
+    vector<thread> Workers;
+    // queue 0 belongs to the thread calling Run()
+    unique_ptr<taskqueue[]> Queues;
+    size_t QueueCount;
+
+    mutex Lock;
+    condition_variable Wake;
+    condition_variable Done;
+    const function<void(size_t)>* Job;
+    uint64_t Generation;
+    atomic<size_t> Pending;
+    bool Stop;
+    // serializes whole batches
+    mutex RunLock;
+
+    threadpool(const threadpool&);
+    threadpool& operator=(const threadpool&);
+    void WorkerLoop(size_t self);
+    bool RunOne(size_t self);
+
+    public:
+    // threads counts the caller; 0 means one per hardware thread
+    explicit threadpool(size_t threads = 0);
+    ~threadpool();
+    size_t Size() const;
+    // calls fn(i) for every i in [0, tasks) and returns once all are done
+    void Run(size_t tasks, const function<void(size_t)>& fn);
+    // process-wide pool used by the collections' parallel operations
+    static threadpool& Shared();
+};
+#endif
@@ -0,0 +1,131 @@
+#include "toprated.h"
+
+const uint32_t topratedindex::NoPos;
+
+uint64_t topratedindex::Key(uint64_t region, uint16_t type){
+    return region << 16 | type;
+}
+
+void topratedindex::Place(group& g, size_t i, uint32_t slot){
+    g.heap[i] = slot;
+    Pos[slot] = static_cast<uint32_t>(i);
+}
+
+void topratedindex::SiftUp(group& g, size_t i, const float* ratings){
+    uint32_t slot = g.heap[i];
+    while(i > 0 && ratings[g.heap[(i - 1) / 2]] < ratings[slot]){
+        Place(g, i, g.heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    Place(g, i, slot);
+}
+
+void topratedindex::SiftDown(group& g, size_t i, const float* ratings){
+    uint32_t slot = g.heap[i];
+    size_t n = g.heap.size();
+    for(;;){
+        size_t c = 2 * i + 1;
+        if(c >= n){
+            break;
+        }
+        if(c + 1 < n && ratings[g.heap[c]] < ratings[g.heap[c + 1]]){
+            c++;
+        }
+        if(!(ratings[slot] < ratings[g.heap[c]])){
+            break;
+        }
+        Place(g, i, g.heap[c]);
+        i = c;
+    }
+    Place(g, i, slot);
+}
+
+void topratedindex::Insert(uint64_t key, size_t slot, const float* ratings){
+    if(slot >= Pos.size()){
+        Pos.resize(slot + 1, NoPos);
+        GroupOf.resize(slot + 1, NoPos);
+    }
+    unordered_map<uint64_t, uint32_t>::iterator it = GroupIndex.find(key);
+    if(it == GroupIndex.end()){
+        it = GroupIndex.emplace(key, static_cast<uint32_t>(Groups.size())).first;
+        Groups.push_back(group());
+        Groups.back().key = key;
+    }
+    group& g = Groups[it->second];
+    GroupOf[slot] = it->second;
+    g.heap.push_back(static_cast<uint32_t>(slot));
+    SiftUp(g, g.heap.size() - 1, ratings);
+}
+
+void topratedindex::Remove(size_t slot, const float* ratings){
+    if(!Contains(slot)){
+        return;
+    }
+    group& g = Groups[GroupOf[slot]];
+    size_t at = Pos[slot];
+    uint32_t last = g.heap.back();
+    g.heap.pop_back();
+    Pos[slot] = NoPos;
+    GroupOf[slot] = NoPos;
+    if(at < g.heap.size()){
+        // the moved entry may belong above or below the hole
+        Place(g, at, last);
+        SiftUp(g, at, ratings);
+        SiftDown(g, Pos[last], ratings);
+    }
+}
+
+void topratedindex::Update(size_t slot, const float* ratings){
+    if(!Contains(slot)){
+        return;
+    }
+    group& g = Groups[GroupOf[slot]];
+    SiftUp(g, Pos[slot], ratings);
+    SiftDown(g, Pos[slot], ratings);
+}
+
+void topratedindex::Regroup(size_t slot, uint64_t key, const float* ratings){
+    if(!Contains(slot) || Groups[GroupOf[slot]].key == key){
+        return;
+    }
+    Remove(slot, ratings);
+    Insert(key, slot, ratings);
+}
+
+void topratedindex::Renumber(size_t from, size_t to){
+    if(!Contains(from)){
+        return;
+    }
+    if(to >= Pos.size()){
+        Pos.resize(to + 1, NoPos);
+        GroupOf.resize(to + 1, NoPos);
+    }
+    GroupOf[to] = GroupOf[from];
+    Place(Groups[GroupOf[to]], Pos[from], static_cast<uint32_t>(to));
+    Pos[from] = NoPos;
+    GroupOf[from] = NoPos;
+}
+
+bool topratedindex::Contains(size_t slot) const{
+    return slot < Pos.size() && Pos[slot] != NoPos;
+}
+
+size_t topratedindex::Size() const{
+    size_t n = 0;
+    for(size_t i = 0; i < Groups.size(); i++){
+        n += Groups[i].heap.size();
+    }
+    return n;
+}
+
+void topratedindex::Reserve(size_t slots){
+    Pos.reserve(slots);
+    GroupOf.reserve(slots);
+}
+
+void topratedindex::Clear(){
+    Groups.clear();
+    GroupIndex.clear();
+    Pos.clear();
+    GroupOf.clear();
+}
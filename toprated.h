@@ -0,0 +1,122 @@
+#ifndef TOPRATED_H
+#define TOPRATED_H
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+// Available drivers grouped by (region, vehicle type), each group a binary
+// max-heap of slots ordered by rating. Pos remembers where every slot sits
+// in its heap, so a rating change is one sift and leaving the pool (claim,
+// delete, moving to another region) is a swap with the heap's last entry:
+// O(log n) either way, and nobody ever sorts.
+//
+// Top() walks the heaps best-first from their roots with a small frontier
+// heap, so the best k cost O(k log k) however many drivers there are;
+// slots the filter rejects are stepped over, which only costs extra when
+// many of the best drivers don't qualify.
+//
+// Ratings are read from the owner's column (passed in on every call, since
+// the column may move), so the owner changes a rating only while the slot
+// is out of the index or through Update().
+class topratedindex{
+    public:
+    static const uint32_t NoPos = 0xFFFFFFFFu;
+
+    private:
+    struct group{
+        uint64_t key;
+        vector<uint32_t> heap;
+    };
+
+    vector<group> Groups;
+    unordered_map<uint64_t, uint32_t> GroupIndex;
+    // slot -> heap position and group, NoPos if the slot isn't indexed
+    vector<uint32_t> Pos;
+    vector<uint32_t> GroupOf;
+
+    void SiftUp(group& g, size_t i, const float* ratings);
+    void SiftDown(group& g, size_t i, const float* ratings);
+    void Place(group& g, size_t i, uint32_t slot);
+
+    public:
+    static uint64_t Key(uint64_t region, uint16_t type);
+    void Insert(uint64_t key, size_t slot, const float* ratings);
+    // no-op if slot isn't indexed
+    void Remove(size_t slot, const float* ratings);
+    // after ratings[slot] changed
+    void Update(size_t slot, const float* ratings);
+    // moves an indexed slot to another group; no-op if it isn't indexed or
+    // already there
+    void Regroup(size_t slot, uint64_t key, const float* ratings);
+    // the record in from moved to slot to (which isn't indexed); O(1)
+    void Renumber(size_t from, size_t to);
+    bool Contains(size_t slot) const;
+    // appends up to k slots from the groups in keys, best rated first,
+    // skipping those keep(slot) turns down
+    template<typename F>
+    void Top(const uint64_t* keys, size_t keyCount, size_t k, const float* ratings, F keep, vector<size_t>& out) const;
+    size_t Size() const;
+    void Reserve(size_t slots);
+    void Clear();
+};
+
+template<typename F>
+void topratedindex::Top(const uint64_t* keys, size_t keyCount, size_t k, const float* ratings, F keep,
+                        vector<size_t>& out) const{
+    // frontier entries: (group, heap position); a max-heap on rating kept
+    // by hand so it can be a small local vector
+    struct entry{
+        uint32_t group;
+        uint32_t at;
+    };
+    vector<entry> frontier;
+    auto rating = [&](const entry& e){ return ratings[Groups[e.group].heap[e.at]]; };
+    auto push = [&](entry e){
+        frontier.push_back(e);
+        size_t i = frontier.size() - 1;
+        while(i > 0 && rating(frontier[(i - 1) / 2]) < rating(frontier[i])){
+            swap(frontier[i], frontier[(i - 1) / 2]);
+            i = (i - 1) / 2;
+        }
+    };
+    for(size_t i = 0; i < keyCount; i++){
+        unordered_map<uint64_t, uint32_t>::const_iterator g = GroupIndex.find(keys[i]);
+        if(g != GroupIndex.end() && !Groups[g->second].heap.empty()){
+            push(entry{g->second, 0});
+        }
+    }
+    size_t found = 0;
+    while(found < k && !frontier.empty()){
+        entry best = frontier[0];
+        frontier[0] = frontier.back();
+        frontier.pop_back();
+        for(size_t i = 0; ; ){
+            size_t c = 2 * i + 1;
+            if(c >= frontier.size()){
+                break;
+            }
+            if(c + 1 < frontier.size() && rating(frontier[c]) < rating(frontier[c + 1])){
+                c++;
+            }
+            if(!(rating(frontier[i]) < rating(frontier[c]))){
+                break;
+            }
+            swap(frontier[i], frontier[c]);
+            i = c;
+        }
+        const vector<uint32_t>& heap = Groups[best.group].heap;
+        uint32_t slot = heap[best.at];
+        if(keep(slot)){
+            out.push_back(slot);
+            found++;
+        }
+        // children are only reachable through their parent
+        for(uint32_t c = 2 * best.at + 1; c <= 2 * best.at + 2 && c < heap.size(); c++){
+            push(entry{best.group, c});
+        }
+    }
+}
+#endif
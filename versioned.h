@@ -0,0 +1,191 @@
+#ifndef VERSIONED_H
+#define VERSIONED_H
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+#include "epoch.h"
+
+// A growable array of T with multi-version reads. One writer edits a
+// private draft; Publish() freezes the draft as the next version. Readers
+// call Read() and get an immutable version in O(1) no matter how big the
+// table is or what the writer does meanwhile.
+//
+// Rows live in fixed-size pages that versions share. The first write to a
+// page that a published version can see copies it (copy-on-write), so a
+// publish costs one pointer per page plus the pages that actually changed.
+// Superseded versions, and the pages only they still reference, go to the
+// epoch domain and are freed once no reader holds them.
+template<typename T>
+class versionedtable{
+    public:
+    static const size_t PageSize = 256;
+
+    private:
+    struct page{
+        T rows[PageSize];
+        uint64_t owner; // version number of the draft that created it
+    };
+    struct version{
+        vector<page*> pages;
+        size_t size;
+        uint64_t number;
+        // pages this version references that the next one doesn't
+        vector<page*> dropped;
+    };
+
+    epochdomain& Domain;
+    atomic<version*> Published;
+    // writer side
+    vector<page*> Draft;
+    size_t DraftSize;
+    uint64_t DraftNumber;
+    vector<page*> Dropped;
+
+    versionedtable(const versionedtable&);
+    versionedtable& operator=(const versionedtable&);
+
+    // a page the draft may write in place
+    page* Writable(size_t p){
+        page* pg = Draft[p];
+        if(pg->owner != DraftNumber){
+            page* copy = new page(*pg);
+            copy->owner = DraftNumber;
+            Dropped.push_back(pg);
+            Draft[p] = copy;
+            pg = copy;
+        }
+        return pg;
+    }
+
+    void DropPage(page* pg){
+        if(pg->owner == DraftNumber){
+            // never published, nobody else can see it
+            delete pg;
+        }
+        else{
+            Dropped.push_back(pg);
+        }
+    }
+
+    public:
+    // an immutable version; keeps it alive while the view exists
+    class view{
+        private:
+        epochguard Guard;
+        const version* V;
+
+        public:
+        view(epochdomain& d, const atomic<version*>& published)
+            : Guard(d), V(published.load()){
+        }
+        size_t Size() const{
+            return V->size;
+        }
+        uint64_t Number() const{
+            return V->number;
+        }
+        const T& operator[](size_t i) const{
+            return V->pages[i / PageSize]->rows[i % PageSize];
+        }
+        // f(index, row) in order
+        template<typename F>
+        void ForEach(F f) const{
+            for(size_t p = 0; p * PageSize < V->size; p++){
+                const page* pg = V->pages[p];
+                size_t end = V->size - p * PageSize < PageSize ? V->size - p * PageSize : PageSize;
+                for(size_t i = 0; i < end; i++){
+                    f(p * PageSize + i, pg->rows[i]);
+                }
+            }
+        }
+    };
+
+    explicit versionedtable(epochdomain& d = epochdomain::Shared())
+        : Domain(d){
+        version* v = new version();
+        v->size = 0;
+        v->number = 0;
+        Published.store(v);
+        DraftSize = 0;
+        DraftNumber = 1;
+    }
+
+    ~versionedtable(){
+        // whoever still reads must be done by now; free directly
+        version* v = Published.load();
+        for(size_t i = 0; i < Draft.size(); i++){
+            delete Draft[i];
+        }
+        for(size_t i = 0; i < Dropped.size(); i++){
+            delete Dropped[i];
+        }
+        delete v;
+    }
+
+    size_t Size() const{
+        return DraftSize;
+    }
+
+    const T& Get(size_t i) const{
+        return Draft[i / PageSize]->rows[i % PageSize];
+    }
+
+    void Set(size_t i, const T& row){
+        Writable(i / PageSize)->rows[i % PageSize] = row;
+    }
+
+    // shrinks or grows the draft; new rows are T()
+    void Resize(size_t n){
+        size_t pages = (n + PageSize - 1) / PageSize;
+        while(Draft.size() > pages){
+            DropPage(Draft.back());
+            Draft.pop_back();
+        }
+        // rows past the end of a kept partial page keep stale values; reset
+        // them so a later grow starts from T()
+        for(size_t i = n; i < DraftSize && i < pages * PageSize; i++){
+            Writable(i / PageSize)->rows[i % PageSize] = T();
+        }
+        while(Draft.size() < pages){
+            page* pg = new page();
+            pg->owner = DraftNumber;
+            Draft.push_back(pg);
+        }
+        DraftSize = n;
+    }
+
+    void PushBack(const T& row){
+        Resize(DraftSize + 1);
+        Set(DraftSize - 1, row);
+    }
+
+    // makes the draft the version that Read() returns
+    void Publish(){
+        version* v = new version();
+        v->pages = Draft;
+        v->size = DraftSize;
+        v->number = DraftNumber;
+        version* old = Published.exchange(v);
+        old->dropped.swap(Dropped);
+        Domain.Retire([old]{
+            for(size_t i = 0; i < old->dropped.size(); i++){
+                delete old->dropped[i];
+            }
+            delete old;
+        });
+        // every draft page is now shared with v
+        DraftNumber++;
+    }
+
+    view Read() const{
+        return view(Domain, Published);
+    }
+
+    uint64_t PublishedNumber() const{
+        return Published.load()->number;
+    }
+};
+#endif
@@ -0,0 +1,472 @@
+#include "wal.h"
+#include "mappedfile.h"
+#include "metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const size_t RecordHeaderSize = 4 + 4 + 8 + 1;
+// how long the flusher sleeps when there is nothing to write
+static const int IdleFlushMs = 5;
+
+static uint32_t CrcTable[256];
+
+static void BuildCrcTable(){
+    for(uint32_t i = 0; i < 256; i++){
+        uint32_t c = i;
+        for(int k = 0; k < 8; k++){
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        CrcTable[i] = c;
+    }
+}
+
+uint32_t Crc32(const char* data, size_t size, uint32_t crc){
+    static once_flag once;
+    call_once(once, BuildCrcTable);
+    crc = ~crc;
+    for(size_t i = 0; i < size; i++){
+        crc = CrcTable[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void logencoder::Clear(){
+    Bytes.clear();
+}
+
+void logencoder::PutU8(uint8_t v){
+    Bytes.push_back(static_cast<char>(v));
+}
+
+void logencoder::PutInt(int32_t v){
+    const char* p = reinterpret_cast<const char*>(&v);
+    Bytes.insert(Bytes.end(), p, p + sizeof(v));
+}
+
+void logencoder::PutFloat(float v){
+    const char* p = reinterpret_cast<const char*>(&v);
+    Bytes.insert(Bytes.end(), p, p + sizeof(v));
+}
+
+void logencoder::PutDouble(double v){
+    const char* p = reinterpret_cast<const char*>(&v);
+    Bytes.insert(Bytes.end(), p, p + sizeof(v));
+}
+
+void logencoder::PutString(string_view s){
+    PutInt(static_cast<int32_t>(s.size()));
+    Bytes.insert(Bytes.end(), s.begin(), s.end());
+}
+
+const char* logencoder::Data() const{
+    return Bytes.data();
+}
+
+size_t logencoder::Size() const{
+    return Bytes.size();
+}
+
+logdecoder::logdecoder(const char* data, size_t size){
+    P = data;
+    End = data + size;
+    Ok = true;
+}
+
+bool logdecoder::Take(void* out, size_t n){
+    if(!Ok || static_cast<size_t>(End - P) < n){
+        Ok = false;
+        memset(out, 0, n);
+        return false;
+    }
+    memcpy(out, P, n);
+    P += n;
+    return true;
+}
+
+uint8_t logdecoder::GetU8(){
+    uint8_t v;
+    Take(&v, sizeof(v));
+    return v;
+}
+
+int32_t logdecoder::GetInt(){
+    int32_t v;
+    Take(&v, sizeof(v));
+    return v;
+}
+
+float logdecoder::GetFloat(){
+    float v;
+    Take(&v, sizeof(v));
+    return v;
+}
+
+double logdecoder::GetDouble(){
+    double v;
+    Take(&v, sizeof(v));
+    return v;
+}
+
+string logdecoder::GetString(){
+    int32_t n = GetInt();
+    if(!Ok || n < 0 || End - P < n){
+        Ok = false;
+        return string();
+    }
+    string s(P, static_cast<size_t>(n));
+    P += n;
+    return s;
+}
+
+size_t logdecoder::Remaining() const{
+    return End - P;
+}
+
+bool logdecoder::Good() const{
+    return Ok;
+}
+
+writeaheadlog::writeaheadlog(){
+    Fd = -1;
+    SegmentStart = 0;
+    SegmentSize = 0;
+    NextLsn = 1;
+    PendingLast = 0;
+    DurableLsn = 0;
+    Stop = false;
+    Failed = false;
+}
+
+writeaheadlog::~writeaheadlog(){
+    Close();
+}
+
+static string SegmentName(const string& dir, uint64_t startLsn){
+    char name[32];
+    snprintf(name, sizeof(name), "wal-%016llx.log", static_cast<unsigned long long>(startLsn));
+    return dir + "/" + name;
+}
+
+bool writeaheadlog::OpenSegment(uint64_t startLsn){
+    Fd = open(SegmentName(Dir, startLsn).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    SegmentStart = startLsn;
+    SegmentSize = 0;
+    return Fd >= 0;
+}
+
+bool writeaheadlog::Open(const string& dir, uint64_t nextLsn){
+    Close();
+    Dir = dir;
+    mkdir(dir.c_str(), 0755);
+    if(nextLsn == 0){
+        nextLsn = 1;
+    }
+    NextLsn = nextLsn;
+    PendingLast = nextLsn - 1;
+    DurableLsn = nextLsn - 1;
+    Pending.clear();
+    Failed = false;
+    if(!OpenSegment(nextLsn)){
+        return false;
+    }
+    Stop = false;
+    Flusher = thread(&writeaheadlog::FlushLoop, this);
+    return true;
+}
+
+void writeaheadlog::Close(){
+    if(Flusher.joinable()){
+        {
+            lock_guard<mutex> lk(Lock);
+            Stop = true;
+        }
+        Wake.notify_all();
+        Flusher.join();
+    }
+    if(Fd >= 0){
+        close(Fd);
+        Fd = -1;
+    }
+    RunWaiters();
+}
+
+bool writeaheadlog::IsOpen() const{
+    return Fd >= 0;
+}
+
+bool writeaheadlog::WriteAll(const vector<char>& bytes){
+    size_t done = 0;
+    while(done < bytes.size()){
+        ssize_t n = write(Fd, bytes.data() + done, bytes.size() - done);
+        if(n <= 0){
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    return fdatasync(Fd) == 0;
+}
+
+void writeaheadlog::FlushLoop(){
+    while(true){
+        bool idle = false;
+        {
+            unique_lock<mutex> lk(Lock);
+            // also wakes for waiters a Rotate() made durable
+            Wake.wait_for(lk, chrono::milliseconds(IdleFlushMs), [this]{
+                return Stop || !Pending.empty()
+                       || (!Waiters.empty() && (Failed || Waiters.begin()->first <= DurableLsn));
+            });
+            if(Pending.empty()){
+                if(Stop){
+                    return;
+                }
+                idle = true;
+            }
+        }
+        if(idle){
+            RunWaiters();
+            continue;
+        }
+        lock_guard<mutex> io(IoLock);
+        uint64_t last;
+        bool failed;
+        {
+            lock_guard<mutex> lk(Lock);
+            Writing.swap(Pending);
+            last = PendingLast;
+            failed = Failed;
+        }
+        // past a failure the segment may end in a torn record, so nothing
+        // more is written behind it
+        if(!failed && !Writing.empty()){
+            METRIC_TIMER(M_LOG_FLUSH);
+            failed = !WriteAll(Writing);
+        }
+        {
+            lock_guard<mutex> lk(Lock);
+            if(failed){
+                Failed = true;
+            }
+            else{
+                SegmentSize += Writing.size();
+                if(last > DurableLsn){
+                    DurableLsn = last;
+                }
+            }
+        }
+        Writing.clear();
+        DurableChanged.notify_all();
+        RunWaiters();
+    }
+}
+
+uint64_t writeaheadlog::Append(uint8_t type, const char* payload, size_t size){
+    METRIC_TIMER(M_LOG_APPEND);
+    uint32_t length = static_cast<uint32_t>(size);
+    lock_guard<mutex> lk(Lock);
+    uint64_t lsn = NextLsn++;
+    char header[RecordHeaderSize];
+    memcpy(header, &length, 4);
+    memcpy(header + 8, &lsn, 8);
+    header[16] = static_cast<char>(type);
+    uint32_t crc = Crc32(header + 8, RecordHeaderSize - 8);
+    crc = Crc32(payload, size, crc);
+    memcpy(header + 4, &crc, 4);
+    Pending.insert(Pending.end(), header, header + RecordHeaderSize);
+    Pending.insert(Pending.end(), payload, payload + size);
+    PendingLast = lsn;
+    if(Pending.size() == RecordHeaderSize + size){
+        Wake.notify_one();
+    }
+    return lsn;
+}
+
+uint64_t writeaheadlog::Append(uint8_t type, const logencoder& e){
+    return Append(type, e.Data(), e.Size());
+}
+
+bool writeaheadlog::WaitDurable(uint64_t lsn){
+    unique_lock<mutex> lk(Lock);
+    Wake.notify_one();
+    DurableChanged.wait(lk, [this, lsn]{ return DurableLsn >= lsn || Fd < 0 || Failed; });
+    return DurableLsn >= lsn;
+}
+
+void writeaheadlog::OnDurable(uint64_t lsn, function<void(bool)> fn){
+    bool durable;
+    {
+        lock_guard<mutex> lk(Lock);
+        durable = DurableLsn >= lsn;
+        if(!durable && Fd >= 0 && !Failed){
+            Waiters.insert(make_pair(lsn, move(fn)));
+            Wake.notify_one();
+            return;
+        }
+    }
+    fn(durable);
+}
+
+void writeaheadlog::RunWaiters(){
+    vector<pair<function<void(bool)>, bool> > ready;
+    {
+        lock_guard<mutex> lk(Lock);
+        multimap<uint64_t, function<void(bool)> >::iterator end =
+            Fd < 0 || Failed ? Waiters.end() : Waiters.upper_bound(DurableLsn);
+        for(multimap<uint64_t, function<void(bool)> >::iterator i = Waiters.begin(); i != end; ++i){
+            ready.push_back(make_pair(move(i->second), i->first <= DurableLsn));
+        }
+        Waiters.erase(Waiters.begin(), end);
+    }
+    // outside the lock, a callback may append or wait again
+    for(size_t i = 0; i < ready.size(); i++){
+        ready[i].first(ready[i].second);
+    }
+}
+
+bool writeaheadlog::Sync(){
+    return WaitDurable(LastLsn());
+}
+
+bool writeaheadlog::HasFailed() const{
+    lock_guard<mutex> lk(Lock);
+    return Failed;
+}
+
+uint64_t writeaheadlog::LastLsn() const{
+    lock_guard<mutex> lk(Lock);
+    return NextLsn - 1;
+}
+
+size_t writeaheadlog::CurrentSize() const{
+    lock_guard<mutex> lk(Lock);
+    return SegmentSize + Pending.size();
+}
+
+bool writeaheadlog::Rotate(uint64_t& last){
+    lock_guard<mutex> io(IoLock);
+    lock_guard<mutex> lk(Lock);
+    if(Failed || Fd < 0){
+        return false;
+    }
+    if(!Pending.empty()){
+        if(!WriteAll(Pending)){
+            Failed = true;
+            DurableChanged.notify_all();
+            Wake.notify_one();
+            return false;
+        }
+        Pending.clear();
+    }
+    last = NextLsn - 1;
+    DurableLsn = last;
+    close(Fd);
+    if(!OpenSegment(NextLsn)){
+        // the closed segments are complete, but nothing more can be logged
+        Failed = true;
+    }
+    DurableChanged.notify_all();
+    // Rotate made everything durable; the flusher picks the waiters up
+    Wake.notify_one();
+    return true;
+}
+
+vector<string> writeaheadlog::Segments(const string& dir){
+    vector<string> out;
+    DIR* d = opendir(dir.c_str());
+    if(d == 0){
+        return out;
+    }
+    struct dirent* e;
+    while((e = readdir(d)) != 0){
+        string name = e->d_name;
+        if(name.size() == 24 && name.compare(0, 4, "wal-") == 0 && name.compare(20, 4, ".log") == 0){
+            out.push_back(name);
+        }
+    }
+    closedir(d);
+    // fixed-width hex, so name order is lsn order
+    sort(out.begin(), out.end());
+    return out;
+}
+
+// moves a segment out of Segments()' sight without losing it
+static void SetAside(const string& dir, const string& segment){
+    string path = dir + "/" + segment;
+    rename(path.c_str(), (path + ".bad").c_str());
+}
+
+uint64_t writeaheadlog::Replay(const string& dir, const function<void(uint64_t, uint8_t, const char*, size_t)>& apply,
+                               bool repair, uint64_t first){
+    uint64_t last = 0;
+    vector<string> segments = Segments(dir);
+    for(size_t s = 0; s < segments.size(); s++){
+        mappedfile file;
+        bool bad = !file.Open(dir + "/" + segments[s]);
+        size_t at = 0;
+        if(!bad){
+            const char* p = file.GetData();
+            size_t length = file.GetLength();
+            while(at < length){
+                uint32_t size, crc;
+                uint64_t lsn;
+                if(at + RecordHeaderSize > length){
+                    bad = true;
+                    break;
+                }
+                memcpy(&size, p + at, 4);
+                memcpy(&crc, p + at + 4, 4);
+                memcpy(&lsn, p + at + 8, 8);
+                if(at + RecordHeaderSize + size > length){
+                    bad = true;
+                    break;
+                }
+                const char* payload = p + at + RecordHeaderSize;
+                uint32_t check = Crc32(p + at + 8, RecordHeaderSize - 8);
+                check = Crc32(payload, size, check);
+                // the first record may follow a compaction that removed
+                // older segments, but not one past first; after that every
+                // lsn has to be the next one
+                bool hole = last == 0 ? first != 0 && lsn > first : lsn != last + 1;
+                if(check != crc || hole){
+                    bad = true;
+                    break;
+                }
+                apply(lsn, static_cast<uint8_t>(p[at + 16]), payload, size);
+                last = lsn;
+                at += RecordHeaderSize + size;
+            }
+        }
+        if(!bad){
+            continue;
+        }
+        if(repair){
+            // keep the good prefix; everything after the hole is set aside
+            // so the next segment opened can't collide with or follow it
+            file.Close();
+            if(at == 0 || truncate((dir + "/" + segments[s]).c_str(), static_cast<off_t>(at)) != 0){
+                SetAside(dir, segments[s]);
+            }
+            for(size_t t = s + 1; t < segments.size(); t++){
+                SetAside(dir, segments[t]);
+            }
+        }
+        break;
+    }
+    return last;
+}
+
+void writeaheadlog::RemoveSegmentsBefore(const string& dir, uint64_t startLsn){
+    vector<string> segments = Segments(dir);
+    for(size_t s = 0; s < segments.size(); s++){
+        unsigned long long start = strtoull(segments[s].c_str() + 4, 0, 16);
+        if(start < startLsn){
+            unlink((dir + "/" + segments[s]).c_str());
+        }
+    }
+}
@@ -0,0 +1,158 @@
+#ifndef WAL_H
+#define WAL_H
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <map>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+// record types; driver records stay below LR_PASSENGER_FIRST
+enum logrecordtype : uint8_t{
+    LR_DRIVER_ADD = 1,
+    LR_DRIVER_EDIT,
+    LR_DRIVER_DELETE,
+    LR_DRIVER_AVAILABLE,
+    LR_DRIVER_LOCATION,
+    LR_DRIVER_LOCATIONS,  // a batch from drivers::SetLocations
+    LR_DRIVER_RATING,
+    LR_PASSENGER_FIRST = 16,
+    LR_PASSENGER_ADD = LR_PASSENGER_FIRST,
+    LR_PASSENGER_EDIT,
+    LR_PASSENGER_DELETE
+};
+
+// little helpers for building and reading record payloads
+class logencoder{
+    private:
+    vector<char> Bytes;
+
+    public:
+    void Clear();
+    void PutU8(uint8_t v);
+    void PutInt(int32_t v);
+    void PutFloat(float v);
+    void PutDouble(double v);
+    void PutString(string_view s);
+    const char* Data() const;
+    size_t Size() const;
+};
+
+class logdecoder{
+    private:
+    const char* P;
+    const char* End;
+    bool Ok;
+    bool Take(void* out, size_t n);
+
+    public:
+    logdecoder(const char* data, size_t size);
+    uint8_t GetU8();
+    int32_t GetInt();
+    float GetFloat();
+    double GetDouble();
+    string GetString();
+    // false if any read ran past the end
+    bool Good() const;
+    size_t Remaining() const;
+};
+
+// Append-only log of registry mutations, one file per segment
+// (wal-<first lsn>.log) in a directory.
+//
+// Append() only copies the record into an in-memory buffer; a flusher thread
+// writes and fdatasyncs whatever has accumulated, so every append that
+// arrives while a sync is in flight shares the next one (group commit).
+// Callers that need durability wait with WaitDurable()/Sync().
+//
+// A failed write, fdatasync or segment open is sticky: nothing after it is
+// reported durable, later records are dropped rather than written behind a
+// possibly torn one, and every waiter is told it failed. Reopen to recover.
+//
+// Record layout: uint32 payload length, uint32 crc32 of the rest, uint64
+// lsn, uint8 type, payload. Lsns are consecutive across segments; replay
+// stops for good at the first torn or corrupt record, missing lsn or
+// unreadable segment, so it never applies a record past a hole.
+class writeaheadlog{
+    private:
+    string Dir;
+    int Fd;
+    uint64_t SegmentStart;
+    size_t SegmentSize;
+    // IoLock orders writes to the file; Lock guards the buffers and counters.
+    // Always take IoLock first.
+    mutex IoLock;
+    mutable mutex Lock;
+    condition_variable Wake;
+    condition_variable DurableChanged;
+    vector<char> Pending;
+    vector<char> Writing;
+    uint64_t NextLsn;
+    uint64_t PendingLast;
+    uint64_t DurableLsn;
+    bool Stop;
+    bool Failed;
+    thread Flusher;
+    // OnDurable callbacks by the lsn they wait for
+    multimap<uint64_t, function<void(bool)> > Waiters;
+
+    bool OpenSegment(uint64_t startLsn);
+    void FlushLoop();
+    bool WriteAll(const vector<char>& bytes);
+    // runs the callbacks whose lsn is durable, and all of them once the log
+    // failed or closed; call without Lock
+    void RunWaiters();
+
+    writeaheadlog(const writeaheadlog&);
+    writeaheadlog& operator=(const writeaheadlog&);
+
+    public:
+    writeaheadlog();
+    ~writeaheadlog();
+    // starts a new segment whose first record will get nextLsn
+    bool Open(const string& dir, uint64_t nextLsn);
+    // flushes everything and stops the flusher
+    void Close();
+    bool IsOpen() const;
+    // returns the record's lsn
+    uint64_t Append(uint8_t type, const char* payload, size_t size);
+    uint64_t Append(uint8_t type, const logencoder& e);
+    // false if the log failed or closed before lsn was durable
+    bool WaitDurable(uint64_t lsn);
+    // the non-blocking WaitDurable: fn(true) runs on the flusher thread once
+    // lsn is durable, or right away on this thread if it already is;
+    // fn(false) once the log fails. Close() runs whatever is still waiting.
+    void OnDurable(uint64_t lsn, function<void(bool)> fn);
+    bool Sync();
+    // a write, sync or segment open failed since Open()
+    bool HasFailed() const;
+    uint64_t LastLsn() const;
+    // bytes in the current segment
+    size_t CurrentSize() const;
+    // syncs and closes the current segment and opens a new one. last gets
+    // the last lsn in the closed segments, which all older segments are <=.
+    // False (and last untouched) if that lsn couldn't be made durable.
+    bool Rotate(uint64_t& last);
+
+    // applies the intact records in the directory in lsn order up to the
+    // first bad one, returns the last lsn applied (0 if none). With repair,
+    // the bad record and everything after it are cut off (later segments
+    // are renamed to *.bad) so a log opened at the returned lsn + 1 carries
+    // on from the good prefix. first, if not 0, is the lsn the log has to
+    // reach back to (e.g. the one after a snapshot's); a log that starts
+    // past it is missing records, so its first record counts as bad.
+    static uint64_t Replay(const string& dir, const function<void(uint64_t, uint8_t, const char*, size_t)>& apply,
+                           bool repair = false, uint64_t first = 0);
+    // deletes segments that start before startLsn
+    static void RemoveSegmentsBefore(const string& dir, uint64_t startLsn);
+    static vector<string> Segments(const string& dir);
+};
+
+uint32_t Crc32(const char* data, size_t size, uint32_t crc = 0);
+
+#endif